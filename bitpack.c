@@ -0,0 +1,162 @@
+#include "bitpack.h"
+#include <string.h>
+
+/* Eight elements of any width fill a whole number of bytes (one byte per bit of width),
+ *   so groups of eight starting at an element index divisible by eight can be moved
+ *   directly from and to the underlying bytes. */
+#define BITPACK_GROUP 8
+
+#define BITPACK_MASK( width ) (0xFFFFFFFFU >> (32 - (width)))
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define BITPACK_BIGENDIAN( w ) __builtin_bswap64( w )
+#else
+#define BITPACK_BIGENDIAN( w ) (w)
+#endif
+
+/* Load eight bytes as a big-endian word */
+static inline uint64_t BitPack_Load( const byte *in ) {
+	uint64_t w;
+	memcpy( &w, in, sizeof( w ) );
+	return BITPACK_BIGENDIAN( w );
+}
+
+/* Width specific kernels; with the width known at compile time every shift and
+ *   offset in the group is a constant and the loops unroll completely.
+ *   Unpack may read up to seven bytes past the end of the last group. */
+#define BITPACK_KERNEL( K ) \
+void BitPack_Unpack_##K( const byte *in, uint32_t *out, int groups ) { \
+	for( int ig = 0; ig < groups; ig++, in += K, out += BITPACK_GROUP ) \
+		for( int ie = 0; ie < BITPACK_GROUP; ie++ ) \
+			out[ie] = (BitPack_Load( in + ie * K / 8 ) << (ie * K % 8)) >> (64 - K); \
+} \
+void BitPack_Pack_##K( byte *out, const uint32_t *in, int groups ) { \
+	for( int ig = 0; ig < groups; ig++, in += BITPACK_GROUP ) { \
+		uint64_t acc = 0; \
+		int bits = 0; \
+		for( int ie = 0; ie < BITPACK_GROUP; ie++ ) { \
+			acc = (acc << K) | (in[ie] & BITPACK_MASK( K )); \
+			bits += K; \
+			while( bits >= 8 ) { \
+				bits -= 8; \
+				*out++ = acc >> bits; \
+			} \
+		} \
+	} \
+}
+
+BITPACK_KERNEL( 1 )  BITPACK_KERNEL( 2 )  BITPACK_KERNEL( 3 )  BITPACK_KERNEL( 4 )
+BITPACK_KERNEL( 5 )  BITPACK_KERNEL( 6 )  BITPACK_KERNEL( 7 )  BITPACK_KERNEL( 8 )
+BITPACK_KERNEL( 9 )  BITPACK_KERNEL( 10 ) BITPACK_KERNEL( 11 ) BITPACK_KERNEL( 12 )
+BITPACK_KERNEL( 13 ) BITPACK_KERNEL( 14 ) BITPACK_KERNEL( 15 ) BITPACK_KERNEL( 16 )
+BITPACK_KERNEL( 17 ) BITPACK_KERNEL( 18 ) BITPACK_KERNEL( 19 ) BITPACK_KERNEL( 20 )
+BITPACK_KERNEL( 21 ) BITPACK_KERNEL( 22 ) BITPACK_KERNEL( 23 ) BITPACK_KERNEL( 24 )
+BITPACK_KERNEL( 25 ) BITPACK_KERNEL( 26 ) BITPACK_KERNEL( 27 ) BITPACK_KERNEL( 28 )
+BITPACK_KERNEL( 29 ) BITPACK_KERNEL( 30 ) BITPACK_KERNEL( 31 ) BITPACK_KERNEL( 32 )
+
+#define BITPACK_KERNEL_ENTRY( K ) { &BitPack_Unpack_##K, &BitPack_Pack_##K }
+
+const struct {
+	void (*unpack)( const byte *, uint32_t *, int );
+	void (*pack)( byte *, const uint32_t *, int );
+} BitPack_Kernel[33] = {
+	{ NULL, NULL },
+	BITPACK_KERNEL_ENTRY( 1 ),  BITPACK_KERNEL_ENTRY( 2 ),  BITPACK_KERNEL_ENTRY( 3 ),  BITPACK_KERNEL_ENTRY( 4 ),
+	BITPACK_KERNEL_ENTRY( 5 ),  BITPACK_KERNEL_ENTRY( 6 ),  BITPACK_KERNEL_ENTRY( 7 ),  BITPACK_KERNEL_ENTRY( 8 ),
+	BITPACK_KERNEL_ENTRY( 9 ),  BITPACK_KERNEL_ENTRY( 10 ), BITPACK_KERNEL_ENTRY( 11 ), BITPACK_KERNEL_ENTRY( 12 ),
+	BITPACK_KERNEL_ENTRY( 13 ), BITPACK_KERNEL_ENTRY( 14 ), BITPACK_KERNEL_ENTRY( 15 ), BITPACK_KERNEL_ENTRY( 16 ),
+	BITPACK_KERNEL_ENTRY( 17 ), BITPACK_KERNEL_ENTRY( 18 ), BITPACK_KERNEL_ENTRY( 19 ), BITPACK_KERNEL_ENTRY( 20 ),
+	BITPACK_KERNEL_ENTRY( 21 ), BITPACK_KERNEL_ENTRY( 22 ), BITPACK_KERNEL_ENTRY( 23 ), BITPACK_KERNEL_ENTRY( 24 ),
+	BITPACK_KERNEL_ENTRY( 25 ), BITPACK_KERNEL_ENTRY( 26 ), BITPACK_KERNEL_ENTRY( 27 ), BITPACK_KERNEL_ENTRY( 28 ),
+	BITPACK_KERNEL_ENTRY( 29 ), BITPACK_KERNEL_ENTRY( 30 ), BITPACK_KERNEL_ENTRY( 31 ), BITPACK_KERNEL_ENTRY( 32 )
+};
+
+/* Common Assertion that a run of elements lies inside the BitPack */
+#define BitPack_Assert_InRange( mybp, target, span, onfail ) \
+	if( target < 0 || span < 0 || target > mybp->count - span ) { onfail; }
+
+/* Constructor */
+void BitPack_Init( BitPack *bp, int count, int width ) {
+	if( width < 1 ) width = 1;
+	if( width > 32 ) width = 32;
+
+	bp->count = count;
+	bp->width = width;
+	BitString_Init( &bp->bits, count * width );
+}
+
+/* Destructor */
+void BitPack_Free( BitPack *bp ) {
+	BitString_Free( &bp->bits );
+}
+
+/* Count Accessor */
+int BitPack_Count( BitPack *bp ) {
+	return bp->count;
+}
+
+/* Element Access */
+uint32_t BitPack_Get( BitPack *bp, int index ) {
+	BitPack_Assert_InRange( bp, index, 1, return 0 );
+	return BitString_GetBits( &bp->bits, index * bp->width, bp->width );
+}
+
+void BitPack_Set( BitPack *bp, int index, uint32_t value ) {
+	BitPack_Assert_InRange( bp, index, 1, return );
+	BitString_SetBits( &bp->bits, index * bp->width, bp->width, value );
+}
+
+/* Bulk Unpack: unaligned head and tail element by element, aligned groups by kernel */
+void BitPack_Unpack( BitPack *bp, int index, uint32_t *buffer, int count ) {
+	int bytes = (bp->bits.count + 7) / 8;
+	int groups;
+
+	BitPack_Assert_InRange( bp, index, count, return );
+
+	while( count > 0 && index % BITPACK_GROUP ) {
+		*buffer++ = BitPack_Get( bp, index++ );
+		count--;
+	}
+
+	/* The kernel over-reads up to seven bytes; keep those inside the BitString */
+	groups = count / BITPACK_GROUP;
+	while( groups > 0 && (index / BITPACK_GROUP + groups) * bp->width + 7 > bytes )
+		groups--;
+
+	if( groups > 0 ) {
+		BitPack_Kernel[bp->width].unpack( bp->bits.data + index / BITPACK_GROUP * bp->width, buffer, groups );
+		buffer += groups * BITPACK_GROUP;
+		index += groups * BITPACK_GROUP;
+		count -= groups * BITPACK_GROUP;
+	}
+
+	while( count > 0 ) {
+		*buffer++ = BitPack_Get( bp, index++ );
+		count--;
+	}
+}
+
+/* Bulk Pack */
+void BitPack_Pack( BitPack *bp, int index, const uint32_t *buffer, int count ) {
+	int groups;
+
+	BitPack_Assert_InRange( bp, index, count, return );
+
+	while( count > 0 && index % BITPACK_GROUP ) {
+		BitPack_Set( bp, index++, *buffer++ );
+		count--;
+	}
+
+	groups = count / BITPACK_GROUP;
+	if( groups > 0 ) {
+		BitPack_Kernel[bp->width].pack( bp->bits.data + index / BITPACK_GROUP * bp->width, buffer, groups );
+		buffer += groups * BITPACK_GROUP;
+		index += groups * BITPACK_GROUP;
+		count -= groups * BITPACK_GROUP;
+	}
+
+	while( count > 0 ) {
+		BitPack_Set( bp, index++, *buffer++ );
+		count--;
+	}
+}
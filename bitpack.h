@@ -0,0 +1,64 @@
+/// @file
+/*******************************************************************************
+ * >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> BitPack <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<< *
+ *******************************************************************************
+ * Array of small unsigned integers (counters, enumerations and the like)      *
+ *  stored back to back in a BitString, each taking exactly as many bits as    *
+ *  the array was created with.  Bulk packing and unpacking to and from plain  *
+ *  uint32_t buffers runs eight elements (a whole number of bytes) at a time   *
+ *  through kernels unrolled for every width.                                  *
+ ******************************************************************************/
+
+#ifndef INCLUDED_BITPACK_H
+#define INCLUDED_BITPACK_H
+
+#include <stdint.h>
+#include "bitstring.h"
+
+typedef struct {
+	int count;	/* number of elements */
+	int width;	/* bits per element, 1 to 32 */
+	BitString bits;
+} BitPack;
+
+/**
+ * Initialize the BitPack with every element zero
+ *   @param bp		The BitPack to initialize
+ *   @param count	The number of elements (count * width must fit in an int)
+ *   @param width	The number of bits per element (1 to 32)
+ */
+void BitPack_Init( BitPack *bp, int count, int width );
+
+/**
+ * Cleanup the BitPack
+ *   @param bp		The BitPack to be cleaned
+ */
+void BitPack_Free( BitPack *bp );
+
+/**
+ * Retrieve the element count from the BitPack
+ *   @param bp		The BitPack to read
+ */
+int BitPack_Count( BitPack *bp );
+
+/**
+ * Set/Get individual elements
+ *   @param bp		The BitPack to access
+ *   @param index	The index of the element (starts at 0)
+ *   @param value	The value to store, truncated to the width (Set Only)
+ *   @return		The value of the element (Get Only)
+ */
+void BitPack_Set( BitPack *bp, int index, uint32_t value );
+uint32_t BitPack_Get( BitPack *bp, int index );
+
+/**
+ * Bulk transfer between the BitPack and a uint32_t buffer
+ *   @param bp		The BitPack to access
+ *   @param index	The first element to access
+ *   @param buffer	Values to store (Pack) or room for the values read (Unpack)
+ *   @param count	The number of elements to transfer
+ */
+void BitPack_Pack( BitPack *bp, int index, const uint32_t *buffer, int count );
+void BitPack_Unpack( BitPack *bp, int index, uint32_t *buffer, int count );
+
+#endif
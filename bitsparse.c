@@ -0,0 +1,1004 @@
+#include "bitsparse.h"
+#include <stdlib.h>
+#include <string.h>
+#include "util.h"
+
+#define BITSPARSE_CHUNK_BITS 65536
+#define BITSPARSE_WORDS 1024
+#define BITSPARSE_KEY( index ) ((index) >> 16)
+#define BITSPARSE_LOW( index ) ((index) & 0xFFFF)
+#define BITSPARSE_BIT( low ) (0x8000000000000000ULL >> ((low) % 64))
+
+/* Mask of the bits [start, end) of a word, counted from the most significant bit */
+#define BITSPARSE_WORDMASK( start, end ) ((~0ULL >> (start)) & ((end) >= 64 ? ~0ULL : ~(~0ULL >> (end))))
+
+#define BITSPARSE_MIN( a, b ) ((a) < (b) ? (a) : (b))
+
+typedef enum { BITSPARSE_OP_AND, BITSPARSE_OP_OR, BITSPARSE_OP_XOR, BITSPARSE_OP_ANDNOT } BitSparse_Op;
+
+/* Common Assertion that the target bit is in the appropriate range */
+#define BitSparse_Assert_InRange( mybs, target, onfail ) \
+	if( target < 0 || target >= mybs->count ) { onfail; }
+
+/*** Word-level helpers (private) ***/
+
+/* Find the first bit at or after `from' whose value matches; BITSPARSE_CHUNK_BITS when none */
+int BitSparse_Words_Scan( const uint64_t *words, int from, bool value ) {
+	int iw = from / 64;
+	uint64_t w;
+
+	if( iw >= BITSPARSE_WORDS )
+		return BITSPARSE_CHUNK_BITS;
+
+	w = (value ? words[iw] : ~words[iw]) & (~0ULL >> (from % 64));
+	while( w == 0 ) {
+		if( ++iw == BITSPARSE_WORDS )
+			return BITSPARSE_CHUNK_BITS;
+		w = value ? words[iw] : ~words[iw];
+	}
+
+	return iw * 64 + __builtin_clzll( w );
+}
+
+/* Set or clear the bits [start, end) */
+void BitSparse_Words_Fill( uint64_t *words, int start, int end, bool value ) {
+	while( start < end ) {
+		int iw = start / 64;
+		int stop = BITSPARSE_MIN( (iw + 1) * 64, end );
+		uint64_t mask = BITSPARSE_WORDMASK( start % 64, stop - iw * 64 );
+
+		if( value ) {
+			words[iw] |= mask;
+		} else {
+			words[iw] &= ~mask;
+		}
+		start = stop;
+	}
+}
+
+/* OR `count' bits of src starting at sbit into dst starting at dbit */
+void BitSparse_Words_Merge( uint64_t *dst, int dbit, const uint64_t *src, int sbit, int count ) {
+	while( count > 0 ) {
+		int take = BITSPARSE_MIN( count, 64 - dbit % 64 );
+		uint64_t w = src[sbit / 64] << (sbit % 64);
+		if( sbit % 64 && sbit / 64 + 1 < BITSPARSE_WORDS )
+			w |= src[sbit / 64 + 1] >> (64 - sbit % 64);
+
+		dst[dbit / 64] |= (w & BITSPARSE_WORDMASK( 0, take )) >> (dbit % 64);
+		dbit += take;
+		sbit += take;
+		count -= take;
+	}
+}
+
+/*** Container maintenance (private) ***/
+
+/* Binary search for a chunk; returns the slot it occupies or would be inserted at */
+int BitSparse_Container_Find( BitSparse *bs, int key, bool *found ) {
+	int start = 0, end = bs->containers;
+
+	while( start < end ) {
+		int mid = (start + end) / 2;
+		if( bs->container[mid].key < key ) {
+			start = mid + 1;
+		} else {
+			end = mid;
+		}
+	}
+
+	*found = start < bs->containers && bs->container[start].key == key;
+	return start;
+}
+
+/* Open an empty array container for a chunk at the given slot */
+BitSparse_Container *BitSparse_Container_Insert( BitSparse *bs, int slot, int key ) {
+	BitSparse_Container *c;
+
+	if( bs->containers == bs->capacity ) {
+		BitSparse_Container *tmp;
+		bs->capacity = bs->capacity ? bs->capacity * 2 : 4;
+		fmalloc( tmp, sizeof( BitSparse_Container ) * bs->capacity );
+		if( bs->container != NULL ) {
+			memcpy( tmp, bs->container, sizeof( BitSparse_Container ) * bs->containers );
+			free( bs->container );
+		}
+		bs->container = tmp;
+	}
+
+	memmove( &bs->container[slot + 1], &bs->container[slot], sizeof( BitSparse_Container ) * (bs->containers - slot) );
+	bs->containers++;
+
+	c = &bs->container[slot];
+	c->key = key;
+	c->kind = BITSPARSE_ARRAY;
+	c->cardinality = 0;
+	c->size = 0;
+	c->capacity = 0;
+	c->data = NULL;
+
+	return c;
+}
+
+/* Remove a container (and its storage) from the given slot */
+void BitSparse_Container_Drop( BitSparse *bs, int slot ) {
+	if( bs->container[slot].data != NULL )
+		free( bs->container[slot].data );
+
+	memmove( &bs->container[slot], &bs->container[slot + 1], sizeof( BitSparse_Container ) * (bs->containers - slot - 1) );
+	bs->containers--;
+}
+
+/* Make room for `entries' offsets (array) or runs (run) */
+void BitSparse_Container_Reserve( BitSparse_Container *c, uint32_t entries ) {
+	size_t unit = c->kind == BITSPARSE_RUN ? 2 * sizeof( uint16_t ) : sizeof( uint16_t );
+	void *tmp;
+
+	if( entries <= c->capacity )
+		return;
+
+	if( entries < c->capacity * 2 )
+		entries = c->capacity * 2;
+
+	fmalloc( tmp, unit * entries );
+	if( c->data != NULL ) {
+		memcpy( tmp, c->data, unit * c->size );
+		free( c->data );
+	}
+	c->data = tmp;
+	c->capacity = entries;
+}
+
+/* Render any container as a bitmap */
+void BitSparse_Container_Expand( const BitSparse_Container *c, uint64_t *words ) {
+	const uint16_t *v = c->data;
+
+	if( c->kind == BITSPARSE_BITMAP ) {
+		memcpy( words, c->data, sizeof( uint64_t ) * BITSPARSE_WORDS );
+		return;
+	}
+
+	memset( words, 0, sizeof( uint64_t ) * BITSPARSE_WORDS );
+	if( c->kind == BITSPARSE_ARRAY ) {
+		for( uint32_t ix = 0; ix < c->size; ix++ )
+			words[v[ix] / 64] |= BITSPARSE_BIT( v[ix] );
+	} else {
+		for( uint32_t ix = 0; ix < c->size; ix++ )
+			BitSparse_Words_Fill( words, v[2 * ix], v[2 * ix + 1] + 1, true );
+	}
+}
+
+/* Rebuild a container from a bitmap using whichever representation is smallest;
+ *   words may be the container's own bitmap */
+void BitSparse_Container_Pack( BitSparse_Container *c, const uint64_t *words ) {
+	uint32_t card = 0, runs = 0;
+	uint64_t carry = 0;
+	uint8_t kind;
+	void *store;
+
+	for( int iw = 0; iw < BITSPARSE_WORDS; iw++ ) {
+		card += __builtin_popcountll( words[iw] );
+		runs += __builtin_popcountll( words[iw] & ~((words[iw] >> 1) | carry) );
+		carry = words[iw] << 63;
+	}
+
+	if( runs * 4 < BITSPARSE_MIN( card * 2, sizeof( uint64_t ) * BITSPARSE_WORDS ) ) {
+		kind = BITSPARSE_RUN;
+	} else if( card <= BITSPARSE_ARRAY_MAX ) {
+		kind = BITSPARSE_ARRAY;
+	} else {
+		kind = BITSPARSE_BITMAP;
+	}
+
+	/* Nothing to move when a bitmap is repacked as itself */
+	if( kind == BITSPARSE_BITMAP && c->kind == BITSPARSE_BITMAP && words == c->data ) {
+		c->cardinality = card;
+		return;
+	}
+
+	store = NULL;
+	if( kind == BITSPARSE_BITMAP ) {
+		fmalloc( store, sizeof( uint64_t ) * BITSPARSE_WORDS );
+		memcpy( store, words, sizeof( uint64_t ) * BITSPARSE_WORDS );
+		c->size = 0;
+		c->capacity = BITSPARSE_WORDS;
+	} else if( kind == BITSPARSE_RUN ) {
+		uint16_t *r;
+		int pos = 0, ir = 0;
+		if( runs )
+			fmalloc( store, sizeof( uint16_t ) * 2 * runs );
+		r = store;
+		while( (pos = BitSparse_Words_Scan( words, pos, true )) < BITSPARSE_CHUNK_BITS ) {
+			int end = BitSparse_Words_Scan( words, pos, false );
+			r[ir++] = pos;
+			r[ir++] = end - 1;
+			pos = end;
+		}
+		c->size = c->capacity = runs;
+	} else {
+		uint16_t *v;
+		int pos = 0, iv = 0;
+		if( card )
+			fmalloc( store, sizeof( uint16_t ) * card );
+		v = store;
+		while( (pos = BitSparse_Words_Scan( words, pos, true )) < BITSPARSE_CHUNK_BITS )
+			v[iv++] = pos++;
+		c->size = c->capacity = card;
+	}
+
+	if( c->data != NULL )
+		free( c->data );
+	c->data = store;
+	c->kind = kind;
+	c->cardinality = card;
+}
+
+/* Lower bound of an offset in an array container */
+uint32_t BitSparse_Array_Find( const BitSparse_Container *c, uint16_t low ) {
+	const uint16_t *v = c->data;
+	uint32_t start = 0, end = c->size;
+
+	while( start < end ) {
+		uint32_t mid = (start + end) / 2;
+		if( v[mid] < low ) {
+			start = mid + 1;
+		} else {
+			end = mid;
+		}
+	}
+
+	return start;
+}
+
+/* Index of the last run starting at or before an offset, or size if there is none */
+uint32_t BitSparse_Run_Find( const BitSparse_Container *c, uint16_t low ) {
+	const uint16_t *r = c->data;
+	uint32_t start = 0, end = c->size;
+
+	while( start < end ) {
+		uint32_t mid = (start + end) / 2;
+		if( r[2 * mid] <= low ) {
+			start = mid + 1;
+		} else {
+			end = mid;
+		}
+	}
+
+	return start == 0 ? c->size : start - 1;
+}
+
+bool BitSparse_Container_Contains( const BitSparse_Container *c, uint16_t low ) {
+	if( c->kind == BITSPARSE_BITMAP ) {
+		return (((const uint64_t *)c->data)[low / 64] & BITSPARSE_BIT( low )) != 0;
+	} else if( c->kind == BITSPARSE_ARRAY ) {
+		uint32_t ix = BitSparse_Array_Find( c, low );
+		return ix < c->size && ((const uint16_t *)c->data)[ix] == low;
+	} else {
+		uint32_t ir = BitSparse_Run_Find( c, low );
+		return ir < c->size && low <= ((const uint16_t *)c->data)[2 * ir + 1];
+	}
+}
+
+/* Set or clear one offset of a run container in place: extend, trim, merge or split runs.
+ *   Returns false, leaving the container alone, when the result would be better off
+ *   as another kind of container */
+bool BitSparse_Run_Set( BitSparse_Container *c, uint16_t low, bool value ) {
+	uint16_t *r = c->data;
+	uint32_t ir = BitSparse_Run_Find( c, low );
+	uint32_t card = value ? c->cardinality + 1 : c->cardinality - 1;
+	int64_t runs = c->size;
+	bool joinprev = false, joinnext = false;
+	uint32_t next = ir == c->size ? 0 : ir + 1;
+
+	if( value ) {
+		joinprev = ir < c->size && r[2 * ir + 1] + 1 == low;
+		joinnext = next < c->size && r[2 * next] == low + 1;
+		runs += joinprev && joinnext ? -1 : joinprev || joinnext ? 0 : 1;
+	} else if( r[2 * ir] == low && r[2 * ir + 1] == low ) {
+		runs--;
+	} else if( r[2 * ir] != low && r[2 * ir + 1] != low ) {
+		runs++;
+	}
+
+	/* Same test as BitSparse_Container_Pack uses to pick runs */
+	if( !(runs * 4 < (int64_t)BITSPARSE_MIN( card * 2, sizeof( uint64_t ) * BITSPARSE_WORDS )) )
+		return false;
+
+	if( runs > (int64_t)c->size ) {
+		BitSparse_Container_Reserve( c, runs );
+		r = c->data;
+	}
+
+	if( value ) {
+		if( joinprev && joinnext ) {
+			r[2 * ir + 1] = r[2 * next + 1];
+			memmove( &r[2 * next], &r[2 * next + 2], sizeof( uint16_t ) * 2 * (c->size - next - 1) );
+		} else if( joinprev ) {
+			r[2 * ir + 1] = low;
+		} else if( joinnext ) {
+			r[2 * next] = low;
+		} else {
+			/* A new run between ir and next; next is where it goes */
+			memmove( &r[2 * next + 2], &r[2 * next], sizeof( uint16_t ) * 2 * (c->size - next) );
+			r[2 * next] = low;
+			r[2 * next + 1] = low;
+		}
+	} else {
+		if( r[2 * ir] == low && r[2 * ir + 1] == low ) {
+			memmove( &r[2 * ir], &r[2 * ir + 2], sizeof( uint16_t ) * 2 * (c->size - ir - 1) );
+		} else if( r[2 * ir] == low ) {
+			r[2 * ir]++;
+		} else if( r[2 * ir + 1] == low ) {
+			r[2 * ir + 1]--;
+		} else {
+			/* Split the run around low */
+			memmove( &r[2 * ir + 2], &r[2 * ir], sizeof( uint16_t ) * 2 * (c->size - ir) );
+			r[2 * ir + 1] = low - 1;
+			r[2 * ir + 2] = low + 1;
+		}
+	}
+
+	c->size = runs;
+	c->cardinality = card;
+	return true;
+}
+
+/* Duplicate a container's storage into an unused container record */
+void BitSparse_Container_Clone( BitSparse_Container *dest, const BitSparse_Container *orig ) {
+	size_t bytes;
+
+	*dest = *orig;
+	if( orig->kind == BITSPARSE_BITMAP ) {
+		bytes = sizeof( uint64_t ) * BITSPARSE_WORDS;
+	} else if( orig->kind == BITSPARSE_RUN ) {
+		bytes = sizeof( uint16_t ) * 2 * orig->size;
+	} else {
+		bytes = sizeof( uint16_t ) * orig->size;
+	}
+
+	dest->data = NULL;
+	dest->capacity = orig->kind == BITSPARSE_BITMAP ? BITSPARSE_WORDS : orig->size;
+	if( bytes ) {
+		fmalloc( dest->data, bytes );
+		memcpy( dest->data, orig->data, bytes );
+	}
+}
+
+/*** Public routines ***/
+
+/* Constructor */
+void BitSparse_Init( BitSparse *bs, int len ) {
+	bs->count = len;
+	bs->containers = 0;
+	bs->capacity = 0;
+	bs->container = NULL;
+}
+
+/* Destructor */
+void BitSparse_Free( BitSparse *bs ) {
+	for( int ic = 0; ic < bs->containers; ic++ )
+		if( bs->container[ic].data != NULL )
+			free( bs->container[ic].data );
+
+	if( bs->container != NULL )
+		free( bs->container );
+
+	bs->container = NULL;
+	bs->containers = 0;
+	bs->capacity = 0;
+}
+
+/* Count Accessor */
+int BitSparse_Count( BitSparse *bs ) {
+	return bs->count;
+}
+
+/* Get Bit */
+bool BitSparse_Get( BitSparse *bs, int index ) {
+	bool found;
+	int slot;
+
+	BitSparse_Assert_InRange( bs, index, return false );
+
+	slot = BitSparse_Container_Find( bs, BITSPARSE_KEY( index ), &found );
+	return found && BitSparse_Container_Contains( &bs->container[slot], BITSPARSE_LOW( index ) );
+}
+
+/* Set Bit */
+void BitSparse_Set( BitSparse *bs, int index, bool value ) {
+	BitSparse_Container *c;
+	uint16_t low = BITSPARSE_LOW( index );
+	bool found;
+	int slot;
+
+	BitSparse_Assert_InRange( bs, index, return );
+
+	slot = BitSparse_Container_Find( bs, BITSPARSE_KEY( index ), &found );
+	if( !found ) {
+		if( !value )
+			return;
+		c = BitSparse_Container_Insert( bs, slot, BITSPARSE_KEY( index ) );
+	} else {
+		c = &bs->container[slot];
+		if( BitSparse_Container_Contains( c, low ) == value )
+			return;
+	}
+
+	if( c->kind == BITSPARSE_ARRAY && (!value || c->size < BITSPARSE_ARRAY_MAX) ) {
+		uint16_t *v;
+		uint32_t ix = BitSparse_Array_Find( c, low );
+
+		if( value ) {
+			BitSparse_Container_Reserve( c, c->size + 1 );
+			v = c->data;
+			memmove( &v[ix + 1], &v[ix], sizeof( uint16_t ) * (c->size - ix) );
+			v[ix] = low;
+			c->size++;
+			c->cardinality++;
+		} else {
+			v = c->data;
+			memmove( &v[ix], &v[ix + 1], sizeof( uint16_t ) * (c->size - ix - 1) );
+			c->size--;
+			c->cardinality--;
+		}
+	} else if( c->kind == BITSPARSE_BITMAP && (value || c->cardinality > BITSPARSE_ARRAY_MAX + 1) ) {
+		uint64_t *w = c->data;
+
+		if( value ) {
+			w[low / 64] |= BITSPARSE_BIT( low );
+			c->cardinality++;
+		} else {
+			w[low / 64] &= ~BITSPARSE_BIT( low );
+			c->cardinality--;
+		}
+	} else if( c->kind == BITSPARSE_RUN && BitSparse_Run_Set( c, low, value ) ) {
+		/* Edited in place */
+	} else {
+		/* Container changes shape; rebuild it */
+		uint64_t words[BITSPARSE_WORDS];
+		BitSparse_Container_Expand( c, words );
+		BitSparse_Words_Fill( words, low, low + 1, value );
+		BitSparse_Container_Pack( c, words );
+	}
+
+	if( c->cardinality == 0 )
+		BitSparse_Container_Drop( bs, slot );
+}
+
+/* Fill the offsets [lo, hi) of one chunk (private) */
+void BitSparse_Container_Fill( BitSparse *bs, int key, int lo, int hi, bool value ) {
+	BitSparse_Container *c;
+	bool found;
+	int slot;
+
+	slot = BitSparse_Container_Find( bs, key, &found );
+	if( !found && !value )
+		return;
+
+	if( found && !value && lo == 0 && hi == BITSPARSE_CHUNK_BITS ) {
+		BitSparse_Container_Drop( bs, slot );
+		return;
+	}
+
+	if( !found ) {
+		c = BitSparse_Container_Insert( bs, slot, key );
+	} else {
+		c = &bs->container[slot];
+	}
+
+	if( c->cardinality == 0 || (value && lo == 0 && hi == BITSPARSE_CHUNK_BITS) ) {
+		/* Fresh (or fully covered) chunk: a single run or a couple of offsets */
+		uint16_t *v;
+
+		if( c->data != NULL )
+			free( c->data );
+		c->data = NULL;
+		c->size = 0;
+		c->capacity = 0;
+		c->kind = hi - lo > 2 ? BITSPARSE_RUN : BITSPARSE_ARRAY;
+
+		if( c->kind == BITSPARSE_RUN ) {
+			BitSparse_Container_Reserve( c, 1 );
+			v = c->data;
+			v[0] = lo;
+			v[1] = hi - 1;
+			c->size = 1;
+		} else {
+			BitSparse_Container_Reserve( c, hi - lo );
+			v = c->data;
+			for( int ix = lo; ix < hi; ix++ )
+				v[c->size++] = ix;
+		}
+		c->cardinality = hi - lo;
+	} else if( c->kind == BITSPARSE_ARRAY && !value ) {
+		uint16_t *v = c->data;
+		uint32_t first = BitSparse_Array_Find( c, lo );
+		uint32_t last = hi == BITSPARSE_CHUNK_BITS ? c->size : BitSparse_Array_Find( c, hi );
+
+		memmove( &v[first], &v[last], sizeof( uint16_t ) * (c->size - last) );
+		c->size -= last - first;
+		c->cardinality = c->size;
+	} else {
+		uint64_t words[BITSPARSE_WORDS];
+		BitSparse_Container_Expand( c, words );
+		BitSparse_Words_Fill( words, lo, hi, value );
+		BitSparse_Container_Pack( c, words );
+	}
+
+	if( c->cardinality == 0 )
+		BitSparse_Container_Drop( bs, slot );
+}
+
+/* Fill range of bits */
+void BitSparse_Fill( BitSparse *bs, int index, int count, bool value ) {
+	int end;
+
+	if( index < 0 ) {
+		count += index;
+		index = 0;
+	}
+	if( count > bs->count - index )
+		count = bs->count - index;
+
+	end = index + count;
+	while( index < end ) {
+		int key = BITSPARSE_KEY( index );
+		int stop = BITSPARSE_MIN( (key + 1) * BITSPARSE_CHUNK_BITS, end );
+
+		BitSparse_Container_Fill( bs, key, BITSPARSE_LOW( index ), stop - key * BITSPARSE_CHUNK_BITS, value );
+		index = stop;
+	}
+}
+
+/* Copy the origin bits [index, index + count) into a bitmap at offset `at';
+ *   returns false if none of them are set (private) */
+bool BitSparse_Gather( BitSparse *bs, int index, int count, uint64_t *words, int at ) {
+	uint64_t chunk[BITSPARSE_WORDS];
+	bool any = false;
+
+	memset( words, 0, sizeof( uint64_t ) * BITSPARSE_WORDS );
+	while( count > 0 ) {
+		int key = BITSPARSE_KEY( index );
+		int take = BITSPARSE_MIN( count, (key + 1) * BITSPARSE_CHUNK_BITS - index );
+		bool found;
+		int slot;
+
+		slot = BitSparse_Container_Find( bs, key, &found );
+		if( found ) {
+			const uint64_t *src = chunk;
+			if( bs->container[slot].kind == BITSPARSE_BITMAP ) {
+				src = bs->container[slot].data;
+			} else {
+				BitSparse_Container_Expand( &bs->container[slot], chunk );
+			}
+			BitSparse_Words_Merge( words, at, src, BITSPARSE_LOW( index ), take );
+			any = true;
+		}
+
+		index += take;
+		at += take;
+		count -= take;
+	}
+
+	return any;
+}
+
+/* Copy Range of bits */
+void BitSparse_Copy( BitSparse *destBS, int destIndex, BitSparse *origBS, int origIndex, int count ) {
+	uint64_t src[BITSPARSE_WORDS], dst[BITSPARSE_WORDS];
+	int end;
+
+	if( destIndex < 0 || origIndex < 0 )
+		return;
+	if( count > destBS->count - destIndex )
+		count = destBS->count - destIndex;
+	if( count > origBS->count - origIndex )
+		count = origBS->count - origIndex;
+
+	if( destBS == origBS ) {
+		/* Same strategy as the BitString: copy from a duplicate of self */
+		if( destIndex != origIndex && count > 0 ) {
+			BitSparse tmpBS;
+			BitSparse_Init( &tmpBS, origBS->count );
+			BitSparse_Or( &tmpBS, &tmpBS, origBS );
+			BitSparse_Copy( destBS, destIndex, &tmpBS, origIndex, count );
+			BitSparse_Free( &tmpBS );
+		}
+		return;
+	}
+
+	end = destIndex + count;
+	while( destIndex < end ) {
+		int key = BITSPARSE_KEY( destIndex );
+		int lo = BITSPARSE_LOW( destIndex );
+		int hi = BITSPARSE_MIN( (key + 1) * BITSPARSE_CHUNK_BITS, end ) - key * BITSPARSE_CHUNK_BITS;
+
+		if( !BitSparse_Gather( origBS, origIndex, hi - lo, src, lo ) ) {
+			BitSparse_Container_Fill( destBS, key, lo, hi, false );
+		} else {
+			BitSparse_Container *c;
+			bool found;
+			int slot;
+
+			slot = BitSparse_Container_Find( destBS, key, &found );
+			if( found ) {
+				c = &destBS->container[slot];
+				BitSparse_Container_Expand( c, dst );
+				BitSparse_Words_Fill( dst, lo, hi, false );
+			} else {
+				c = BitSparse_Container_Insert( destBS, slot, key );
+				memset( dst, 0, sizeof( dst ) );
+			}
+
+			for( int iw = 0; iw < BITSPARSE_WORDS; iw++ )
+				dst[iw] |= src[iw];
+			BitSparse_Container_Pack( c, dst );
+		}
+
+		origIndex += hi - lo;
+		destIndex += hi - lo;
+	}
+}
+
+/* Cardinality */
+size_t BitSparse_Cardinality( BitSparse *bs ) {
+	size_t result = 0;
+
+	for( int ic = 0; ic < bs->containers; ic++ )
+		result += bs->container[ic].cardinality;
+
+	return result;
+}
+
+/* Intersect a short sorted array with a much longer one by galloping: each search
+ *   doubles its stride from where the last one ended, then bisects (private) */
+uint32_t BitSparse_Array_Gallop( uint16_t *out, const BitSparse_Container *small, const BitSparse_Container *large ) {
+	const uint16_t *vs = small->data, *vl = large->data;
+	uint32_t il = 0, n = 0;
+
+	for( uint32_t is = 0; is < small->size && il < large->size; is++ ) {
+		if( vl[il] < vs[is] ) {
+			uint32_t step = 1, hi;
+
+			/* vl[il] stays below the target; it lies in (il, il + step] */
+			while( il + step < large->size && vl[il + step] < vs[is] ) {
+				il += step;
+				step *= 2;
+			}
+			hi = BITSPARSE_MIN( il + step, large->size );
+			il++;
+			while( il < hi ) {
+				uint32_t mid = (il + hi) / 2;
+				if( vl[mid] < vs[is] ) {
+					il = mid + 1;
+				} else {
+					hi = mid;
+				}
+			}
+		}
+
+		if( il < large->size && vl[il] == vs[is] ) {
+			out[n++] = vs[is];
+			il++;
+		}
+	}
+
+	return n;
+}
+
+/* Merge two sorted offset arrays; result may hold up to a->size + b->size offsets (private) */
+uint32_t BitSparse_Array_Op( uint16_t *out, const BitSparse_Container *a, const BitSparse_Container *b, BitSparse_Op op ) {
+	const uint16_t *va = a->data, *vb = b->data;
+	uint32_t ia = 0, ib = 0, n = 0;
+
+	/* A lopsided intersection skips through the longer array rather than stepping */
+	if( op == BITSPARSE_OP_AND && a->size * 8 < b->size )
+		return BitSparse_Array_Gallop( out, a, b );
+	if( op == BITSPARSE_OP_AND && b->size * 8 < a->size )
+		return BitSparse_Array_Gallop( out, b, a );
+
+	while( ia < a->size && ib < b->size ) {
+		if( va[ia] < vb[ib] ) {
+			if( op != BITSPARSE_OP_AND )
+				out[n++] = va[ia];
+			ia++;
+		} else if( va[ia] > vb[ib] ) {
+			if( op == BITSPARSE_OP_OR || op == BITSPARSE_OP_XOR )
+				out[n++] = vb[ib];
+			ib++;
+		} else {
+			if( op == BITSPARSE_OP_AND || op == BITSPARSE_OP_OR )
+				out[n++] = va[ia];
+			ia++;
+			ib++;
+		}
+	}
+
+	if( op != BITSPARSE_OP_AND )
+		while( ia < a->size )
+			out[n++] = va[ia++];
+
+	if( op == BITSPARSE_OP_OR || op == BITSPARSE_OP_XOR )
+		while( ib < b->size )
+			out[n++] = vb[ib++];
+
+	return n;
+}
+
+/* Combine two containers of the same chunk into an unused container record (private) */
+void BitSparse_Container_Op( BitSparse_Container *out, const BitSparse_Container *a, const BitSparse_Container *b, BitSparse_Op op ) {
+	out->key = a->key;
+	out->kind = BITSPARSE_ARRAY;
+	out->cardinality = out->size = out->capacity = 0;
+	out->data = NULL;
+
+	if( a->kind == BITSPARSE_ARRAY && b->kind == BITSPARSE_ARRAY && a->size + b->size <= BITSPARSE_ARRAY_MAX ) {
+		/* Sorted merge */
+		BitSparse_Container_Reserve( out, a->size + b->size );
+		out->size = out->cardinality = BitSparse_Array_Op( out->data, a, b, op );
+	} else if( op == BITSPARSE_OP_AND && (a->kind == BITSPARSE_ARRAY || b->kind == BITSPARSE_ARRAY) ) {
+		/* Probe the array's offsets in the other container */
+		const BitSparse_Container *arr = a->kind == BITSPARSE_ARRAY ? a : b;
+		const BitSparse_Container *other = arr == a ? b : a;
+		const uint16_t *v = arr->data;
+		uint16_t *o;
+
+		BitSparse_Container_Reserve( out, arr->size );
+		o = out->data;
+		for( uint32_t ix = 0; ix < arr->size; ix++ )
+			if( BitSparse_Container_Contains( other, v[ix] ) )
+				o[out->size++] = v[ix];
+		out->cardinality = out->size;
+	} else {
+		/* Word at a time */
+		uint64_t wa[BITSPARSE_WORDS], wb[BITSPARSE_WORDS];
+
+		BitSparse_Container_Expand( a, wa );
+		BitSparse_Container_Expand( b, wb );
+		switch( op ) {
+			case BITSPARSE_OP_AND:
+				for( int iw = 0; iw < BITSPARSE_WORDS; iw++ ) wa[iw] &= wb[iw];
+				break;
+			case BITSPARSE_OP_OR:
+				for( int iw = 0; iw < BITSPARSE_WORDS; iw++ ) wa[iw] |= wb[iw];
+				break;
+			case BITSPARSE_OP_XOR:
+				for( int iw = 0; iw < BITSPARSE_WORDS; iw++ ) wa[iw] ^= wb[iw];
+				break;
+			case BITSPARSE_OP_ANDNOT:
+				for( int iw = 0; iw < BITSPARSE_WORDS; iw++ ) wa[iw] &= ~wb[iw];
+				break;
+		}
+		BitSparse_Container_Pack( out, wa );
+	}
+}
+
+/* Boolean operation driver: walk both container lists in key order (private) */
+void BitSparse_Operate( BitSparse *dest, BitSparse *a, BitSparse *b, BitSparse_Op op ) {
+	BitSparse result;
+	int ia = 0, ib = 0;
+
+	BitSparse_Init( &result, a->count > b->count ? a->count : b->count );
+
+	while( ia < a->containers || ib < b->containers ) {
+		BitSparse_Container tmp;
+		int ka = ia < a->containers ? a->container[ia].key : BITSPARSE_CHUNK_BITS;
+		int kb = ib < b->containers ? b->container[ib].key : BITSPARSE_CHUNK_BITS;
+
+		if( ka < kb ) {
+			if( op == BITSPARSE_OP_AND ) {
+				ia++;
+				continue;
+			}
+			BitSparse_Container_Clone( &tmp, &a->container[ia++] );
+		} else if( kb < ka ) {
+			if( op == BITSPARSE_OP_AND || op == BITSPARSE_OP_ANDNOT ) {
+				ib++;
+				continue;
+			}
+			BitSparse_Container_Clone( &tmp, &b->container[ib++] );
+		} else {
+			BitSparse_Container_Op( &tmp, &a->container[ia++], &b->container[ib++], op );
+		}
+
+		if( tmp.cardinality == 0 ) {
+			if( tmp.data != NULL )
+				free( tmp.data );
+		} else {
+			*BitSparse_Container_Insert( &result, result.containers, tmp.key ) = tmp;
+		}
+	}
+
+	BitSparse_Free( dest );
+	*dest = result;
+}
+
+void BitSparse_And( BitSparse *dest, BitSparse *a, BitSparse *b ) {
+	BitSparse_Operate( dest, a, b, BITSPARSE_OP_AND );
+}
+
+void BitSparse_Or( BitSparse *dest, BitSparse *a, BitSparse *b ) {
+	BitSparse_Operate( dest, a, b, BITSPARSE_OP_OR );
+}
+
+void BitSparse_Xor( BitSparse *dest, BitSparse *a, BitSparse *b ) {
+	BitSparse_Operate( dest, a, b, BITSPARSE_OP_XOR );
+}
+
+void BitSparse_AndNot( BitSparse *dest, BitSparse *a, BitSparse *b ) {
+	BitSparse_Operate( dest, a, b, BITSPARSE_OP_ANDNOT );
+}
+
+/* Next set bit */
+int BitSparse_Next( BitSparse *bs, int index ) {
+	bool found;
+	int slot;
+
+	if( index < 0 )
+		index = 0;
+	if( index >= bs->count )
+		return -1;
+
+	slot = BitSparse_Container_Find( bs, BITSPARSE_KEY( index ), &found );
+	if( !found )
+		index = 0;
+
+	for( ; slot < bs->containers; slot++, index = 0 ) {
+		BitSparse_Container *c = &bs->container[slot];
+		int low = c->key == BITSPARSE_KEY( index ) ? BITSPARSE_LOW( index ) : 0;
+		int base = c->key * BITSPARSE_CHUNK_BITS;
+
+		if( c->kind == BITSPARSE_BITMAP ) {
+			int pos = BitSparse_Words_Scan( c->data, low, true );
+			if( pos < BITSPARSE_CHUNK_BITS )
+				return base + pos;
+		} else if( c->kind == BITSPARSE_ARRAY ) {
+			uint32_t ix = BitSparse_Array_Find( c, low );
+			if( ix < c->size )
+				return base + ((uint16_t *)c->data)[ix];
+		} else {
+			const uint16_t *r = c->data;
+			uint32_t ir = BitSparse_Run_Find( c, low );
+			if( ir < c->size && low <= r[2 * ir + 1] )
+				return base + low;
+			ir = ir == c->size ? 0 : ir + 1;
+			if( ir < c->size )
+				return base + r[2 * ir];
+		}
+	}
+
+	return -1;
+}
+
+/* Set bit by rank; whole containers are skipped on their cardinalities */
+int BitSparse_Select( BitSparse *bs, size_t rank ) {
+	for( int ic = 0; ic < bs->containers; ic++ ) {
+		BitSparse_Container *c = &bs->container[ic];
+		const uint16_t *v = c->data;
+		int base = c->key * BITSPARSE_CHUNK_BITS;
+
+		if( rank >= c->cardinality ) {
+			rank -= c->cardinality;
+			continue;
+		}
+
+		if( c->kind == BITSPARSE_ARRAY )
+			return base + v[rank];
+
+		if( c->kind == BITSPARSE_BITMAP ) {
+			const uint64_t *w = c->data;
+			for( int iw = 0; iw < BITSPARSE_WORDS; iw++ ) {
+				uint64_t word = w[iw];
+				size_t pop = __builtin_popcountll( word );
+
+				if( rank >= pop ) {
+					rank -= pop;
+					continue;
+				}
+				/* Drop the leading set bits ahead of the one wanted */
+				while( rank-- > 0 )
+					word &= ~(0x8000000000000000ULL >> __builtin_clzll( word ));
+				return base + iw * 64 + __builtin_clzll( word );
+			}
+		}
+
+		for( uint32_t ir = 0; ir < c->size; ir++ ) {
+			size_t run = v[2 * ir + 1] - v[2 * ir] + 1;
+			if( rank < run )
+				return base + v[2 * ir] + (int)rank;
+			rank -= run;
+		}
+	}
+
+	return -1;
+}
+
+/* Foreach set bit */
+void BitSparse_Foreach( BitSparse *bs, void (*callback)(void *, int), void *data ) {
+	for( int ic = 0; ic < bs->containers; ic++ ) {
+		BitSparse_Container *c = &bs->container[ic];
+		const uint16_t *v = c->data;
+		int base = c->key * BITSPARSE_CHUNK_BITS;
+
+		if( c->kind == BITSPARSE_BITMAP ) {
+			int pos = 0;
+			while( (pos = BitSparse_Words_Scan( c->data, pos, true )) < BITSPARSE_CHUNK_BITS )
+				callback( data, base + pos++ );
+		} else if( c->kind == BITSPARSE_ARRAY ) {
+			for( uint32_t ix = 0; ix < c->size; ix++ )
+				callback( data, base + v[ix] );
+		} else {
+			for( uint32_t ir = 0; ir < c->size; ir++ )
+				for( int pos = v[2 * ir]; pos <= v[2 * ir + 1]; pos++ )
+					callback( data, base + pos );
+		}
+	}
+}
+
+/* Re-pack every container */
+void BitSparse_Optimize( BitSparse *bs ) {
+	uint64_t words[BITSPARSE_WORDS];
+
+	for( int ic = 0; ic < bs->containers; ic++ ) {
+		BitSparse_Container_Expand( &bs->container[ic], words );
+		BitSparse_Container_Pack( &bs->container[ic], words );
+	}
+}
+
+/* Dense to compressed */
+void BitSparse_Compress( BitSparse *sparse, BitString *dense ) {
+	int bytes = dense->count / 8 + (dense->count % 8 ? 1 : 0);
+	uint64_t words[BITSPARSE_WORDS];
+
+	BitSparse_Init( sparse, dense->count );
+
+	for( int key = 0; key * (BITSPARSE_CHUNK_BITS / 8) < bytes; key++ ) {
+		int first = key * (BITSPARSE_CHUNK_BITS / 8);
+		int last = BITSPARSE_MIN( first + BITSPARSE_CHUNK_BITS / 8, bytes );
+		bool any = false;
+
+		/* Bytes are already most significant bit first; load them as big-endian words */
+		for( int iw = 0; iw < BITSPARSE_WORDS; iw++ ) {
+			uint64_t w = 0;
+			for( int ib = 0; ib < 8; ib++ ) {
+				int at = first + iw * 8 + ib;
+				w = (w << 8) | (at < last ? dense->data[at] : 0x00);
+			}
+			words[iw] = w;
+			any |= w != 0;
+		}
+
+		if( !any )
+			continue;
+
+		/* Ignore whatever lies past the last bit */
+		if( (key + 1) * BITSPARSE_CHUNK_BITS > dense->count )
+			BitSparse_Words_Fill( words, dense->count - key * BITSPARSE_CHUNK_BITS, BITSPARSE_CHUNK_BITS, false );
+
+		BitSparse_Container_Pack( BitSparse_Container_Insert( sparse, sparse->containers, key ), words );
+		if( sparse->container[sparse->containers - 1].cardinality == 0 )
+			BitSparse_Container_Drop( sparse, sparse->containers - 1 );
+	}
+}
+
+/* Compressed to dense */
+void BitSparse_Decompress( BitString *dense, BitSparse *sparse ) {
+	int bytes = sparse->count / 8 + (sparse->count % 8 ? 1 : 0);
+	uint64_t words[BITSPARSE_WORDS];
+
+	BitString_Init( dense, sparse->count );
+
+	for( int ic = 0; ic < sparse->containers; ic++ ) {
+		int first = sparse->container[ic].key * (BITSPARSE_CHUNK_BITS / 8);
+
+		BitSparse_Container_Expand( &sparse->container[ic], words );
+		for( int iw = 0; iw < BITSPARSE_WORDS; iw++ ) {
+			if( words[iw] == 0 )
+				continue;
+			for( int ib = 0; ib < 8; ib++ ) {
+				int at = first + iw * 8 + ib;
+				if( at < bytes )
+					dense->data[at] = words[iw] >> (56 - 8 * ib);
+			}
+		}
+	}
+}
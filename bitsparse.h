@@ -0,0 +1,147 @@
+/// @file
+/*******************************************************************************
+ * >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> BitSparse <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<< *
+ *******************************************************************************
+ * Compressed counterpart to the BitString for flag sets where only a handful  *
+ *  of bits are ever raised out of a very large range.  The range is cut into  *
+ *  chunks of 65536 bits and only the chunks holding set bits are stored, each *
+ *  in whichever container is smallest: a sorted array of offsets, a plain     *
+ *  bitmap or a list of runs.  Bits are numbered as in the BitString so that   *
+ *  the two may be converted between one another without reordering.          *
+ ******************************************************************************/
+
+#ifndef INCLUDED_BITSPARSE_H
+#define INCLUDED_BITSPARSE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "bitstring.h"
+
+/* Largest number of offsets kept in an array container */
+#define BITSPARSE_ARRAY_MAX 4096
+
+typedef enum {
+	BITSPARSE_ARRAY,	/* sorted uint16_t offsets */
+	BITSPARSE_BITMAP,	/* 1024 uint64_t words, most significant bit first */
+	BITSPARSE_RUN		/* uint16_t (first, last) pairs, sorted */
+} BitSparse_Kind;
+
+typedef struct {
+	uint16_t key;	/* index of the chunk (upper 16 bits of the bit index) */
+	uint8_t kind;
+	uint32_t cardinality;
+	uint32_t size, capacity;	/* offsets or runs in use/allocated */
+	void *data;
+} BitSparse_Container;
+
+typedef struct {
+	int count;
+	int containers, capacity;
+	BitSparse_Container *container;	/* sorted by key */
+} BitSparse;
+
+/**
+ * Initialize an empty BitSparse
+ *   @param bs		The BitSparse to initialize
+ *   @param len	The number of bits represented
+ */
+void BitSparse_Init( BitSparse *bs, int len );
+
+/**
+ * Cleanup the BitSparse
+ *   @param bs		The BitSparse to be cleaned
+ */
+void BitSparse_Free( BitSparse *bs );
+
+/**
+ * Retrieve the bit-count from the BitSparse
+ *   @param bs		The BitSparse to read
+ */
+int BitSparse_Count( BitSparse *bs );
+
+/**
+ * Set/Get individual bits in the BitSparse
+ *   @param bs		The BitSparse to access
+ *   @param index	The index of the bit to access (starts at 0)
+ *   @param value	The value of the bit accessed (Set Only)
+ *   @return		The value of the bit accessed (Get Only)
+ */
+void BitSparse_Set( BitSparse *bs, int index, bool value );
+bool BitSparse_Get( BitSparse *bs, int index );
+
+/**
+ * Copy bits between BitSparses
+ *   @param destBS		Destination BitSparse
+ *   @param destIndex	Destination start bit
+ *   @param origBS		Origin BitSparse
+ *   @param origIndex	Origin start bit
+ *   @param count			Number of bits to copy
+ */
+void BitSparse_Copy( BitSparse *destBS, int destIndex, BitSparse *origBS, int origIndex, int count );
+
+/**
+ * Fill range of bits in BitSparse
+ *   @param bs		The BitSparse to interact with
+ *   @param index	The first bit to set
+ *   @param count	The number of bits to set
+ *   @param value	The value the bits should contain
+ */
+void BitSparse_Fill( BitSparse *bs, int index, int count, bool value );
+
+/**
+ * Number of bits set in the BitSparse; answered from the containers alone
+ *   @param bs		The BitSparse to read
+ */
+size_t BitSparse_Cardinality( BitSparse *bs );
+
+/**
+ * Boolean operations between BitSparses, container by container
+ *   @param dest	An initialized BitSparse receiving the result; may be a or b
+ *   @param a		Left operand
+ *   @param b		Right operand
+ */
+void BitSparse_And( BitSparse *dest, BitSparse *a, BitSparse *b );
+void BitSparse_Or( BitSparse *dest, BitSparse *a, BitSparse *b );
+void BitSparse_Xor( BitSparse *dest, BitSparse *a, BitSparse *b );
+void BitSparse_AndNot( BitSparse *dest, BitSparse *a, BitSparse *b );
+
+/**
+ * Find the first set bit at or after a given index
+ *   @param bs		The BitSparse to search
+ *   @param index	The first bit to consider
+ *   @return		The index of the set bit, or -1 if there is none
+ */
+int BitSparse_Next( BitSparse *bs, int index );
+
+/**
+ * Find a set bit by its rank, without visiting the bits before it
+ *   @param bs		The BitSparse to search
+ *   @param rank	How many set bits precede the one wanted
+ *   @return		The index of the set bit, or -1 if there are no more than rank of them
+ */
+int BitSparse_Select( BitSparse *bs, size_t rank );
+
+/**
+ * Call back for every set bit in ascending order
+ *   @param bs		The BitSparse to walk
+ *   @param callback	Receives data and the index of the set bit
+ *   @param data		User data passed to the callback
+ */
+void BitSparse_Foreach( BitSparse *bs, void (*callback)(void * /* data */, int /* index */), void *data );
+
+/**
+ * Re-pick the smallest container for every chunk (favours runs after heavy Set use)
+ *   @param bs		The BitSparse to compact
+ */
+void BitSparse_Optimize( BitSparse *bs );
+
+/**
+ * Explicit conversion between the dense and compressed forms
+ *   @param sparse	BitSparse to initialize from dense (Compress) or to read (Decompress)
+ *   @param dense	BitString to read (Compress) or to initialize from sparse (Decompress)
+ */
+void BitSparse_Compress( BitSparse *sparse, BitString *dense );
+void BitSparse_Decompress( BitString *dense, BitSparse *sparse );
+
+#endif
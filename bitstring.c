@@ -7,21 +7,28 @@
  */
 #define BitString_Bits2Bytes( len ) ((len % 8) ? len / 8 + 1 : len / 8)
 
+/* Storage is padded to whole 64-bit words so the atomic routines can work a word at a time */
+#define BitString_Bits2Alloc( len ) ((BitString_Bits2Bytes( len ) + 7) / 8 * 8)
+
 /* Constructor */
 void BitString_Init( BitString *bs, int len ) {
 	bs->count = len;
+	bs->map = NULL;
 	/*bs->data = malloc( BitString_Bits2Bytes( len ) );*/
-	fmalloc( bs->data, BitString_Bits2Bytes( len ) );
+	fmalloc( bs->data, BitString_Bits2Alloc( len ) );
 
 	/* Zero-out allocated memory */
-	for( int ibyte = 0; ibyte < BitString_Bits2Bytes( len ); ibyte++ )
+	for( int ibyte = 0; ibyte < BitString_Bits2Alloc( len ); ibyte++ )
 		bs->data[ibyte] = 0x00;
 };
 
 /* Destructor */
 void BitString_Free( BitString *bs ) {
-	if( bs->data != NULL )
+	if( bs->map != NULL ) {
+		BitString_Unmap( bs );
+	} else if( bs->data != NULL ) {
 		free( bs->data );
+	}
 	bs->data = NULL;
 }
 
@@ -55,6 +62,45 @@ void BitString_Set( BitString *bs, int index, bool value ) {
 	}
 }
 
+/* Common Assertion that a field of bits lies inside the BitString */
+#define BitString_Assert_FieldInRange( mybs, target, width, onfail ) \
+	if( target < 0 || width < 1 || width > 32 || target > mybs->count - width ) { onfail; }
+
+/* Get Field */
+uint32_t BitString_GetBits( BitString *bs, int index, int width ) {
+	int first = index / 8, bytes = (index % 8 + width + 7) / 8;
+	uint64_t buff = 0;
+
+	BitString_Assert_FieldInRange( bs, index, width, return 0 );
+
+	/* at most 39 bits are touched, so five bytes always fit */
+	for( int ibyte = 0; ibyte < bytes; ibyte++ )
+		buff = (buff << 8) | bs->data[first + ibyte];
+
+	return (buff >> (bytes * 8 - index % 8 - width)) & (0xFFFFFFFFULL >> (32 - width));
+}
+
+/* Set Field */
+void BitString_SetBits( BitString *bs, int index, int width, uint32_t value ) {
+	int first = index / 8, bytes = (index % 8 + width + 7) / 8;
+	int shift;
+	uint64_t buff = 0, mask;
+
+	BitString_Assert_FieldInRange( bs, index, width, return );
+
+	for( int ibyte = 0; ibyte < bytes; ibyte++ )
+		buff = (buff << 8) | bs->data[first + ibyte];
+
+	shift = bytes * 8 - index % 8 - width;
+	mask = (0xFFFFFFFFULL >> (32 - width)) << shift;
+	buff = (buff & ~mask) | (((uint64_t)value << shift) & mask);
+
+	for( int ibyte = bytes - 1; ibyte >= 0; ibyte-- ) {
+		bs->data[first + ibyte] = buff & 0xFF;
+		buff >>= 8;
+	}
+}
+
 #define OVERBYTE( bits ) ((bits) % 8)
 #define UNDERBYTE( bits ) (8 - (OVERBYTE( bits ) ? OVERBYTE( bits ) : 8))
 #define ACCESSED_BYTES( start, count ) (((count) + OVERBYTE( start )) / 8 + (OVERBYTE((count) + (start)) ? 1 : 0))
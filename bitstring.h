@@ -15,11 +15,13 @@
 #define INCLUDED_BITSTRING_H
 
 #include <stdbool.h>
+#include <stdint.h>
 
 typedef unsigned char byte;
 typedef struct {
 	int count;
 	byte *data;
+	void *map;	/* base of the mapping when memory-mapped, NULL when allocated */
 } BitString;
 
 /**
@@ -35,6 +37,47 @@ void BitString_Init( BitString *bs, int len );
  */
 void BitString_Free( BitString *bs );
 
+/**
+ * Initialize the BitString over a memory-mapped file.  The file starts with a
+ *  small header recording the bit count and layout version; an existing file
+ *  is opened in constant time and its pages are only read in when touched,
+ *  while a missing (or empty) file is created full of zeroes without writing
+ *  them.  Changes reach the file on BitString_Sync or once unmapped.
+ *  Bits are indexed by int like any BitString, so a mapping holds at most
+ *  INT_MAX bits (256 MiB of storage); larger bitmaps must be split over
+ *  several files.  The header records the count in 64 bits regardless.
+ *   @param bs		The BitString to initialize
+ *   @param path	The file to map
+ *   @param len	The number of bits; -1 accepts whatever an existing file holds
+ *   @return		false if the file could not be mapped or holds a different
+ *          		layout or bit count (errno describes system failures)
+ */
+bool BitString_Map( BitString *bs, const char *path, int len );
+
+/**
+ * Initialize the BitString over anonymous memory which the kernel zeroes a page
+ *  at a time as it is first touched; at most INT_MAX bits, as for BitString_Map
+ *   @param bs			The BitString to initialize
+ *   @param len		The number of bits represented
+ *   @param hugePages	Back the mapping with huge pages where available
+ *   @return			false if the memory could not be mapped
+ */
+bool BitString_MapAnonymous( BitString *bs, int len, bool hugePages );
+
+/**
+ * Flush a file-mapped BitString to disk (no-op for any other BitString)
+ *   @param bs		The BitString to flush
+ *   @param wait	Block until the data is written rather than only scheduling it
+ *   @return		false if the flush failed
+ */
+bool BitString_Sync( BitString *bs, bool wait );
+
+/**
+ * Release a mapped BitString; BitString_Free does this for mapped BitStrings
+ *   @param bs		The BitString to unmap
+ */
+void BitString_Unmap( BitString *bs );
+
 /**
  * Retrieve the bit-count from the BitString
  *   bs := the BitString to read
@@ -70,8 +113,85 @@ void BitString_Copy( BitString *destBS, int destIndex, BitString *origBS, int or
  */
 void BitString_Fill( BitString *bs, int index, int count, bool value );
 
+/**
+ * Read/Write an unsigned field of up to 32 bits; the first bit of the field is
+ *  its most significant bit
+ *   @param bs		The BitString to access
+ *   @param index	The first bit of the field
+ *   @param width	The number of bits in the field (1 to 32)
+ *   @param value	The value to store; bits above width are dropped (Set Only)
+ *   @return		The value of the field (Get Only)
+ */
+uint32_t BitString_GetBits( BitString *bs, int index, int width );
+void BitString_SetBits( BitString *bs, int index, int width, uint32_t value );
+
 /* Insert/Remove bits in the BitString */
 
+/*******************************************************************************
+ * Atomic access for BitStrings shared between threads.  Each routine below is *
+ *  a single atomic read-modify-write on the byte or word holding the bits, so *
+ *  neighbouring flags may be raised from different threads without a lock.   *
+ *  The order argument carries the usual C11 meaning: a worker publishing a    *
+ *  result should set its flag with BITSTRING_RELEASE and the thread that      *
+ *  tests it with BITSTRING_ACQUIRE will then see everything written before    *
+ *  the flag was raised; BITSTRING_RELAXED only guarantees no lost updates.    *
+ *  Loads asked for release semantics are strengthened to the nearest valid    *
+ *  load ordering.  Mixing these with the plain routines on the same bits     *
+ *  while other threads are writing is a data race.                            *
+ ******************************************************************************/
+typedef enum {
+	BITSTRING_RELAXED,
+	BITSTRING_ACQUIRE,
+	BITSTRING_RELEASE,
+	BITSTRING_ACQ_REL,
+	BITSTRING_SEQ_CST
+} BitString_Order;
+
+/**
+ * Atomically Set/Get individual bits
+ *   @param bs		The BitString to access
+ *   @param index	The index of the bit to access (starts at 0)
+ *   @param value	The value of the bit accessed (Set Only)
+ *   @param order	Memory ordering of the access
+ *   @return		The value of the bit accessed (Get Only)
+ */
+bool BitString_AtomicGet( BitString *bs, int index, BitString_Order order );
+void BitString_AtomicSet( BitString *bs, int index, bool value, BitString_Order order );
+
+/**
+ * Atomically raise/lower a bit, reporting its previous value
+ *   @param bs		The BitString to access
+ *   @param index	The index of the bit to access
+ *   @param order	Memory ordering of the access
+ *   @return		The value of the bit before the call
+ */
+bool BitString_TestAndSet( BitString *bs, int index, BitString_Order order );
+bool BitString_TestAndClear( BitString *bs, int index, BitString_Order order );
+
+/**
+ * Atomic access to 64-bit words; word w holds bits 64w to 64w+63 with bit 64w
+ *  in the most significant position, matching the BitString's own bit order
+ *   @param bs		The BitString to access
+ *   @param word	The index of the word to access
+ *   @param bits	Bits to OR in (FetchOr) or to keep (FetchAnd)
+ *   @param order	Memory ordering of the access
+ *   @return		The value of the word before the call
+ */
+uint64_t BitString_AtomicLoadWord( BitString *bs, int word, BitString_Order order );
+uint64_t BitString_FetchOrWord( BitString *bs, int word, uint64_t bits, BitString_Order order );
+uint64_t BitString_FetchAndWord( BitString *bs, int word, uint64_t bits, BitString_Order order );
+
+/**
+ * Fill range of bits one atomic word update at a time; each word changes
+ *  atomically but the range as a whole does not
+ *   @param bs		The BitString to interact with
+ *   @param index	The first bit to set
+ *   @param count	The number of bits to set
+ *   @param value	The value the bits should contain
+ *   @param order	Memory ordering of every word update
+ */
+void BitString_AtomicFill( BitString *bs, int index, int count, bool value, BitString_Order order );
+
 
 #endif
  
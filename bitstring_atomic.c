@@ -0,0 +1,111 @@
+/* Atomic access to BitStrings shared between threads (GCC __atomic builtins) */
+
+#include "bitstring.h"
+
+/* Words are kept in memory as the bytes of the BitString, most significant bit first;
+ *   the public word value reads the same way regardless of the host byte order */
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define BitString_Word_Swap( w ) __builtin_bswap64( w )
+#else
+#define BitString_Word_Swap( w ) (w)
+#endif
+
+#define BitString_Word_Ptr( bs, word ) ((uint64_t *)((bs)->data + (word) * 8))
+#define BitString_Bit_Mask( index ) ((byte)(0x01 << (7 - ((index) % 8))))
+
+#define BitString_Assert_InRange( mybs, target, onfail ) \
+	if( target < 0 || target >= mybs->count ) { onfail; }
+
+#define BitString_Assert_WordInRange( mybs, word, onfail ) \
+	if( word < 0 || word * 64 >= mybs->count ) { onfail; }
+
+/* Translate to a builtin memory order (private) */
+int BitString_Order_RMW( BitString_Order order ) {
+	switch( order ) {
+		case BITSTRING_RELAXED: return __ATOMIC_RELAXED;
+		case BITSTRING_ACQUIRE: return __ATOMIC_ACQUIRE;
+		case BITSTRING_RELEASE: return __ATOMIC_RELEASE;
+		case BITSTRING_ACQ_REL: return __ATOMIC_ACQ_REL;
+		default: return __ATOMIC_SEQ_CST;
+	}
+}
+
+/* Loads may not carry release semantics; strengthen to the nearest valid ordering (private) */
+int BitString_Order_Load( BitString_Order order ) {
+	switch( order ) {
+		case BITSTRING_RELAXED: return __ATOMIC_RELAXED;
+		case BITSTRING_ACQUIRE:
+		case BITSTRING_RELEASE:
+		case BITSTRING_ACQ_REL: return __ATOMIC_ACQUIRE;
+		default: return __ATOMIC_SEQ_CST;
+	}
+}
+
+/* Get Bit */
+bool BitString_AtomicGet( BitString *bs, int index, BitString_Order order ) {
+	BitString_Assert_InRange( bs, index, return false );
+	return (__atomic_load_n( &bs->data[index / 8], BitString_Order_Load( order ) ) & BitString_Bit_Mask( index )) != 0x00;
+}
+
+/* Set Bit */
+void BitString_AtomicSet( BitString *bs, int index, bool value, BitString_Order order ) {
+	BitString_Assert_InRange( bs, index, return );
+	if( value ) {
+		__atomic_fetch_or( &bs->data[index / 8], BitString_Bit_Mask( index ), BitString_Order_RMW( order ) );
+	} else {
+		__atomic_fetch_and( &bs->data[index / 8], (byte)~BitString_Bit_Mask( index ), BitString_Order_RMW( order ) );
+	}
+}
+
+/* Test and Set/Clear */
+bool BitString_TestAndSet( BitString *bs, int index, BitString_Order order ) {
+	BitString_Assert_InRange( bs, index, return false );
+	return (__atomic_fetch_or( &bs->data[index / 8], BitString_Bit_Mask( index ), BitString_Order_RMW( order ) ) & BitString_Bit_Mask( index )) != 0x00;
+}
+
+bool BitString_TestAndClear( BitString *bs, int index, BitString_Order order ) {
+	BitString_Assert_InRange( bs, index, return false );
+	return (__atomic_fetch_and( &bs->data[index / 8], (byte)~BitString_Bit_Mask( index ), BitString_Order_RMW( order ) ) & BitString_Bit_Mask( index )) != 0x00;
+}
+
+/* Word access */
+uint64_t BitString_AtomicLoadWord( BitString *bs, int word, BitString_Order order ) {
+	BitString_Assert_WordInRange( bs, word, return 0 );
+	return BitString_Word_Swap( __atomic_load_n( BitString_Word_Ptr( bs, word ), BitString_Order_Load( order ) ) );
+}
+
+uint64_t BitString_FetchOrWord( BitString *bs, int word, uint64_t bits, BitString_Order order ) {
+	BitString_Assert_WordInRange( bs, word, return 0 );
+	return BitString_Word_Swap( __atomic_fetch_or( BitString_Word_Ptr( bs, word ), BitString_Word_Swap( bits ), BitString_Order_RMW( order ) ) );
+}
+
+uint64_t BitString_FetchAndWord( BitString *bs, int word, uint64_t bits, BitString_Order order ) {
+	BitString_Assert_WordInRange( bs, word, return 0 );
+	return BitString_Word_Swap( __atomic_fetch_and( BitString_Word_Ptr( bs, word ), BitString_Word_Swap( bits ), BitString_Order_RMW( order ) ) );
+}
+
+/* Fill range of bits, a word at a time */
+void BitString_AtomicFill( BitString *bs, int index, int count, bool value, BitString_Order order ) {
+	int end;
+
+	if( index < 0 ) {
+		count += index;
+		index = 0;
+	}
+	if( count > bs->count - index )
+		count = bs->count - index;
+
+	end = index + count;
+	while( index < end ) {
+		int word = index / 64;
+		int stop = (word + 1) * 64 < end ? (word + 1) * 64 : end;
+		uint64_t mask = (~0ULL >> (index % 64)) & (stop % 64 ? ~(~0ULL >> (stop % 64)) : ~0ULL);
+
+		if( value ) {
+			BitString_FetchOrWord( bs, word, mask, order );
+		} else {
+			BitString_FetchAndWord( bs, word, ~mask, order );
+		}
+		index = stop;
+	}
+}
@@ -0,0 +1,269 @@
+/* Micro-benchmarks for the BitString against std::bitset and std::vector<bool> */
+#include <iostream>
+#include <bitset>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+
+extern "C" {
+#include "bitstring.h"
+}
+
+using namespace std;
+
+/* Sizes run from 2^6 to 2^30 bits in steps of 2^3 */
+#define BENCH_MIN_SHIFT 6
+#define BENCH_MAX_SHIFT 30
+#define BENCH_SHIFT_STEP 3
+
+/* Random indices cycled through by the Get/Set benchmarks */
+#define BENCH_INDICES 4096
+
+struct aResult {
+	string impl, op;
+	long long bits;
+	double nsPerOp, gbPerSec;
+};
+
+struct aConfig {
+	string format = "text";
+	long long minBits = 1LL << BENCH_MIN_SHIFT;
+	long long maxBits = 1LL << BENCH_MAX_SHIFT;
+	double minSeconds = 0.05;
+};
+
+volatile uint64_t sink;
+
+/* Repeat a call until the time budget is spent;
+ *   each call performs `ops' operations moving `bytes' bytes between them. */
+template <typename F>
+aResult measure( const aConfig &cfg, const string &impl, const string &op, long long bits, long long ops, double bytes, F body ) {
+	using clock = chrono::steady_clock;
+	long long calls = 0;
+	double elapsed = 0;
+	clock::time_point start = clock::now();
+
+	do {
+		body();
+		calls++;
+		elapsed = chrono::duration<double>( clock::now() - start ).count();
+	} while( elapsed < cfg.minSeconds );
+
+	aResult r;
+	r.impl = impl;
+	r.op = op;
+	r.bits = bits;
+	r.nsPerOp = elapsed * 1e9 / (calls * ops);
+	r.gbPerSec = bytes > 0 ? bytes * calls / elapsed / 1e9 : 0;
+	return r;
+}
+
+vector<int> indices( long long bits ) {
+	vector<int> out( BENCH_INDICES );
+	srand( 31 );
+	for( int ix = 0; ix < BENCH_INDICES; ix++ )
+		out[ix] = (int)((((long long)rand() << 16) ^ rand()) % bits);
+	return out;
+}
+
+/* BitString */
+void bench_bitstring( const aConfig &cfg, long long bits, vector<aResult> &out ) {
+	BitString a, b;
+	vector<int> at = indices( bits );
+	double bytes = bits / 8.0;
+	int n = (int)bits;
+
+	BitString_Init( &a, n );
+	BitString_Init( &b, n );
+
+	out.push_back( measure( cfg, "BitString", "get", bits, BENCH_INDICES, 0, [&]() {
+		uint64_t acc = 0;
+		for( int ix = 0; ix < BENCH_INDICES; ix++ )
+			acc += BitString_Get( &a, at[ix] );
+		sink += acc;
+	} ) );
+	out.push_back( measure( cfg, "BitString", "set", bits, BENCH_INDICES, 0, [&]() {
+		for( int ix = 0; ix < BENCH_INDICES; ix++ )
+			BitString_Set( &a, at[ix], ix & 1 );
+	} ) );
+
+	bool value = false;
+	out.push_back( measure( cfg, "BitString", "fill", bits, 1, bytes, [&]() {
+		BitString_Fill( &a, 0, n, value = !value );
+	} ) );
+	out.push_back( measure( cfg, "BitString", "copy_aligned", bits, 1, bytes, [&]() {
+		BitString_Copy( &b, 0, &a, 0, n );
+	} ) );
+	out.push_back( measure( cfg, "BitString", "copy_misaligned", bits, 1, bytes, [&]() {
+		BitString_Copy( &b, 3, &a, 5, n - 5 );
+	} ) );
+	out.push_back( measure( cfg, "BitString", "copy_overlapping", bits, 1, bytes, [&]() {
+		BitString_Copy( &a, 1, &a, 0, n - 1 );
+	} ) );
+
+	BitString_Free( &a );
+	BitString_Free( &b );
+}
+
+/* std::vector<bool> */
+void bench_vector( const aConfig &cfg, long long bits, vector<aResult> &out ) {
+	vector<bool> a( bits ), b( bits );
+	vector<int> at = indices( bits );
+	double bytes = bits / 8.0;
+
+	out.push_back( measure( cfg, "vector<bool>", "get", bits, BENCH_INDICES, 0, [&]() {
+		uint64_t acc = 0;
+		for( int ix = 0; ix < BENCH_INDICES; ix++ )
+			acc += a[at[ix]];
+		sink += acc;
+	} ) );
+	out.push_back( measure( cfg, "vector<bool>", "set", bits, BENCH_INDICES, 0, [&]() {
+		for( int ix = 0; ix < BENCH_INDICES; ix++ )
+			a[at[ix]] = ix & 1;
+	} ) );
+
+	bool value = false;
+	out.push_back( measure( cfg, "vector<bool>", "fill", bits, 1, bytes, [&]() {
+		fill( a.begin(), a.end(), value = !value );
+	} ) );
+	out.push_back( measure( cfg, "vector<bool>", "copy_aligned", bits, 1, bytes, [&]() {
+		copy( a.begin(), a.end(), b.begin() );
+	} ) );
+	out.push_back( measure( cfg, "vector<bool>", "copy_misaligned", bits, 1, bytes, [&]() {
+		copy( a.begin() + 5, a.end(), b.begin() + 3 );
+	} ) );
+	out.push_back( measure( cfg, "vector<bool>", "copy_overlapping", bits, 1, bytes, [&]() {
+		copy_backward( a.begin(), a.end() - 1, a.end() );
+	} ) );
+}
+
+/* std::bitset; the size is a template parameter so every size is its own instantiation.
+ *   There is no ranged copy, so the copies are whole assignments and shifts. */
+template <size_t N>
+void bench_bitset( const aConfig &cfg, vector<aResult> &out ) {
+	bitset<N> *a = new bitset<N>(), *b = new bitset<N>();
+	vector<int> at = indices( N );
+	double bytes = N / 8.0;
+
+	out.push_back( measure( cfg, "bitset", "get", N, BENCH_INDICES, 0, [&]() {
+		uint64_t acc = 0;
+		for( int ix = 0; ix < BENCH_INDICES; ix++ )
+			acc += (*a)[at[ix]];
+		sink += acc;
+	} ) );
+	out.push_back( measure( cfg, "bitset", "set", N, BENCH_INDICES, 0, [&]() {
+		for( int ix = 0; ix < BENCH_INDICES; ix++ )
+			(*a)[at[ix]] = ix & 1;
+	} ) );
+
+	bool value = false;
+	out.push_back( measure( cfg, "bitset", "fill", N, 1, bytes, [&]() {
+		if( (value = !value) ) {
+			a->set();
+		} else {
+			a->reset();
+		}
+	} ) );
+	out.push_back( measure( cfg, "bitset", "copy_aligned", N, 1, bytes, [&]() {
+		*b = *a;
+	} ) );
+	out.push_back( measure( cfg, "bitset", "copy_misaligned", N, 1, bytes, [&]() {
+		*b = *a << 2;
+	} ) );
+	out.push_back( measure( cfg, "bitset", "copy_overlapping", N, 1, bytes, [&]() {
+		*a <<= 1;
+	} ) );
+
+	delete a;
+	delete b;
+}
+
+template <int SHIFT>
+void bench_bitsets( const aConfig &cfg, vector<aResult> &out ) {
+	if( (1LL << SHIFT) >= cfg.minBits && (1LL << SHIFT) <= cfg.maxBits )
+		bench_bitset<(size_t)1 << SHIFT>( cfg, out );
+	if constexpr( SHIFT + BENCH_SHIFT_STEP <= BENCH_MAX_SHIFT )
+		bench_bitsets<SHIFT + BENCH_SHIFT_STEP>( cfg, out );
+}
+
+/* Output */
+void report( const aConfig &cfg, const vector<aResult> &results ) {
+	if( cfg.format == "csv" ) {
+		cout << "impl,op,bits,ns_per_op,gb_per_s" << endl;
+		for( const aResult &r : results )
+			cout << r.impl << "," << r.op << "," << r.bits << "," << r.nsPerOp << "," << r.gbPerSec << endl;
+	} else if( cfg.format == "json" ) {
+		cout << "[" << endl;
+		for( size_t ix = 0; ix < results.size(); ix++ ) {
+			const aResult &r = results[ix];
+			cout << "  { \"impl\": \"" << r.impl << "\", \"op\": \"" << r.op << "\", \"bits\": " << r.bits
+			     << ", \"ns_per_op\": " << r.nsPerOp << ", \"gb_per_s\": " << r.gbPerSec << " }"
+			     << (ix + 1 < results.size() ? "," : "") << endl;
+		}
+		cout << "]" << endl;
+	} else {
+		for( const aResult &r : results ) {
+			cout << r.impl << "\t" << r.op << "\t" << r.bits << " bits\t" << r.nsPerOp << " ns/op";
+			if( r.gbPerSec > 0 )
+				cout << "\t" << r.gbPerSec << " GB/s";
+			cout << endl;
+		}
+	}
+}
+
+void showhelp() {
+	cout << "Usage: bitstring_bench [options]" << endl;
+	cout << "\t--format=text|csv|json\tOutput format (default text)" << endl;
+	cout << "\t--min-bits=N\t\tSmallest size measured (default " << (1LL << BENCH_MIN_SHIFT) << ")" << endl;
+	cout << "\t--max-bits=N\t\tLargest size measured (default " << (1LL << BENCH_MAX_SHIFT) << ")" << endl;
+	cout << "\t--min-time=S\t\tSeconds spent on each measurement (default 0.05)" << endl;
+}
+
+void argproc( int argc, char **argv, aConfig &cfg ) {
+	for( int ix = 1; ix < argc; ix++ ) {
+		string arg = argv[ix];
+		if( arg == "-h" || arg == "--help" ) {
+			showhelp();
+			exit( EXIT_SUCCESS );
+		} else if( arg.rfind( "--format=", 0 ) == 0 ) {
+			cfg.format = arg.substr( 9 );
+		} else if( arg.rfind( "--min-bits=", 0 ) == 0 ) {
+			cfg.minBits = atoll( arg.c_str() + 11 );
+		} else if( arg.rfind( "--max-bits=", 0 ) == 0 ) {
+			cfg.maxBits = atoll( arg.c_str() + 11 );
+		} else if( arg.rfind( "--min-time=", 0 ) == 0 ) {
+			cfg.minSeconds = atof( arg.c_str() + 11 );
+		} else {
+			cerr << "ERROR: Invalid Option: `" << arg << "'" << endl;
+			cerr << "FATAL: Errors Occurred; Use -h or --help to list valid options." << endl;
+			exit( EXIT_FAILURE );
+		}
+	}
+
+	if( cfg.format != "text" && cfg.format != "csv" && cfg.format != "json" ) {
+		cerr << "FATAL: Unknown format `" << cfg.format << "'" << endl;
+		exit( EXIT_FAILURE );
+	}
+}
+
+int main( int argc, char **argv ) {
+	aConfig cfg;
+	vector<aResult> results;
+
+	argproc( argc, argv, cfg );
+
+	for( int shift = BENCH_MIN_SHIFT; shift <= BENCH_MAX_SHIFT; shift += BENCH_SHIFT_STEP ) {
+		long long bits = 1LL << shift;
+		if( bits < cfg.minBits || bits > cfg.maxBits )
+			continue;
+		bench_bitstring( cfg, bits, results );
+		bench_vector( cfg, bits, results );
+	}
+	bench_bitsets<BENCH_MIN_SHIFT>( cfg, results );
+
+	report( cfg, results );
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,162 @@
+/* Memory-mapped storage for BitStrings (POSIX mmap) */
+
+#include "bitstring.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define BITSTRING_MAP_MAGIC "CUTBITS"
+#define BITSTRING_MAP_VERSION 1
+
+/* Anonymous huge page mappings are rounded up to this size */
+#define BITSTRING_HUGEPAGE ((size_t)2 << 20)
+
+/* Layout of the head of every mapping; the bits follow at header_size,
+ *   which keeps them aligned to a cache line */
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t header_size;
+	int64_t count;		/* bits; no more than INT_MAX while BitStrings are int-indexed */
+	uint64_t length;	/* bytes mapped, header included */
+	byte reserved[32];
+} BitString_MapHeader;
+
+/* Bytes of bit storage, padded to whole words as for allocated BitStrings */
+#define BitString_Map_DataBytes( len ) ((((size_t)(len) + 63) / 64) * 8)
+
+/* Point the BitString at a fresh mapping and stamp its header (private) */
+void BitString_Map_Attach( BitString *bs, void *base, int len, size_t length, bool stamp ) {
+	BitString_MapHeader *head = base;
+
+	if( stamp ) {
+		memcpy( head->magic, BITSTRING_MAP_MAGIC, sizeof( head->magic ) );
+		head->version = BITSTRING_MAP_VERSION;
+		head->header_size = sizeof( BitString_MapHeader );
+		head->count = len;
+		head->length = length;
+	}
+
+	bs->count = head->count;
+	bs->map = base;
+	bs->data = (byte *)base + head->header_size;
+}
+
+/* File-backed */
+bool BitString_Map( BitString *bs, const char *path, int len ) {
+	BitString_MapHeader head;
+	struct stat st;
+	size_t length;
+	void *base;
+	bool create;
+	int fd;
+
+	bs->count = 0;
+	bs->data = NULL;
+	bs->map = NULL;
+
+	fd = open( path, O_RDWR | O_CREAT, 0644 );
+	if( fd < 0 )
+		return false;
+
+	if( fstat( fd, &st ) != 0 ) {
+		close( fd );
+		return false;
+	}
+
+	create = st.st_size == 0;
+	if( create ) {
+		/* Extending the file leaves a hole; the zeroes are never written */
+		if( len < 0 ) {
+			close( fd );
+			errno = EINVAL;
+			return false;
+		}
+		length = sizeof( BitString_MapHeader ) + BitString_Map_DataBytes( len );
+		if( ftruncate( fd, length ) != 0 ) {
+			close( fd );
+			return false;
+		}
+	} else {
+		/* Only the header is read; the bits stay on disk until touched */
+		if( pread( fd, &head, sizeof( head ), 0 ) != sizeof( head )
+				|| memcmp( head.magic, BITSTRING_MAP_MAGIC, sizeof( head.magic ) ) != 0
+				|| head.version != BITSTRING_MAP_VERSION
+				|| head.header_size < sizeof( BitString_MapHeader )
+				|| head.count < 0 || head.count > INT_MAX
+				|| (len >= 0 && head.count != len)
+				|| head.length < head.header_size + BitString_Map_DataBytes( head.count )
+				|| (uint64_t)st.st_size < head.length ) {
+			close( fd );
+			errno = EINVAL;
+			return false;
+		}
+		length = head.length;
+	}
+
+	base = mmap( NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+	close( fd );
+	if( base == MAP_FAILED )
+		return false;
+
+	BitString_Map_Attach( bs, base, len, length, create );
+	return true;
+}
+
+/* Anonymous */
+bool BitString_MapAnonymous( BitString *bs, int len, bool hugePages ) {
+	size_t length = sizeof( BitString_MapHeader ) + BitString_Map_DataBytes( len );
+	void *base = MAP_FAILED;
+
+	bs->count = 0;
+	bs->data = NULL;
+	bs->map = NULL;
+
+	if( len < 0 ) {
+		errno = EINVAL;
+		return false;
+	}
+
+	if( hugePages ) {
+		length = (length + BITSTRING_HUGEPAGE - 1) / BITSTRING_HUGEPAGE * BITSTRING_HUGEPAGE;
+#ifdef MAP_HUGETLB
+		base = mmap( NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0 );
+#endif
+	}
+
+	if( base == MAP_FAILED ) {
+		/* No reserved huge pages; settle for transparent ones if the kernel offers them */
+		base = mmap( NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+		if( base == MAP_FAILED )
+			return false;
+#ifdef MADV_HUGEPAGE
+		if( hugePages )
+			madvise( base, length, MADV_HUGEPAGE );
+#endif
+	}
+
+	BitString_Map_Attach( bs, base, len, length, true );
+	return true;
+}
+
+/* Flush */
+bool BitString_Sync( BitString *bs, bool wait ) {
+	if( bs->map == NULL )
+		return true;
+
+	return msync( bs->map, ((BitString_MapHeader *)bs->map)->length, wait ? MS_SYNC : MS_ASYNC ) == 0;
+}
+
+/* Unmap */
+void BitString_Unmap( BitString *bs ) {
+	if( bs->map == NULL )
+		return;
+
+	munmap( bs->map, ((BitString_MapHeader *)bs->map)->length );
+	bs->map = NULL;
+	bs->data = NULL;
+}
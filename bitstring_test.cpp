@@ -5,9 +5,14 @@
 #include <vector>
 #include <regex>
 #include <cstdlib>
+#include <thread>
+#include <unistd.h>
 
 extern "C" {
 #include "bitstring.h"
+#include "bitsparse.h"
+#include "bitpack.h"
+#include "bloom.h"
 }
 
 using namespace std;
@@ -249,11 +254,385 @@ bool test_copy() {
 	return result;
 }
 
+// Sparse BitString Test: every operation is mirrored on a dense reference
+bool test_sparse() {
+	bool result = true;
+	const int len = 300000;
+	BitSparse s, o, r;
+	vector<bool> ref( len ), oref( len );
+
+	BitSparse_Init( &s, len );
+	BitSparse_Init( &o, len );
+	BitSparse_Init( &r, len );
+	CHECK( BitSparse_Count( &s ) == len, "Bit count not stored correctly", result );
+	CHECK( BitSparse_Cardinality( &s ) == 0, "New BitSparse not empty", result );
+
+	/* Scattered bits (array containers) */
+	srand( 26 );
+	for( int ix = 0; ix < 3000; ix++ ) {
+		int at = rand() % len;
+		bool value = rand() % 4 != 0;
+		BitSparse_Set( &s, at, value );
+		ref[at] = value;
+	}
+
+	/* A dense block (bitmap container) and a long run spanning chunks (run containers) */
+	for( int ix = 70000; ix < 80000; ix += 2 ) {
+		BitSparse_Set( &s, ix, true );
+		ref[ix] = true;
+	}
+	BitSparse_Fill( &s, 120000, 90000, true );
+	BitSparse_Fill( &s, 150001, 7, false );
+	for( int ix = 120000; ix < 210000; ix++ )
+		ref[ix] = ix < 150001 || ix >= 150008;
+
+	bool same = true;
+	size_t card = 0;
+	for( int ix = 0; ix < len; ix++ ) {
+		same &= BitSparse_Get( &s, ix ) == ref[ix];
+		card += ref[ix];
+	}
+	CHECK( same, "Get disagrees with reference", result );
+	CHECK( BitSparse_Cardinality( &s ) == card, "Cardinality incorrect", result );
+	DISPL( "cardinality", BitSparse_Cardinality( &s ) );
+
+	/* Misaligned copy across chunk boundaries */
+	BitSparse_Fill( &o, 1000, 200000, true );
+	for( int ix = 1000; ix < 201000; ix++ )
+		oref[ix] = true;
+	BitSparse_Copy( &o, 65530, &s, 119990, 100000 );
+	for( int ix = 0; ix < 100000; ix++ )
+		oref[65530 + ix] = ref[119990 + ix];
+	same = true;
+	for( int ix = 0; ix < len; ix++ )
+		same &= BitSparse_Get( &o, ix ) == oref[ix];
+	CHECK( same, "Copy disagrees with reference", result );
+
+	/* Boolean operations */
+	BitSparse_And( &r, &s, &o );
+	same = true;
+	for( int ix = 0; ix < len; ix++ )
+		same &= BitSparse_Get( &r, ix ) == (ref[ix] && oref[ix]);
+	CHECK( same, "And disagrees with reference", result );
+
+	BitSparse_Xor( &r, &s, &o );
+	same = true;
+	for( int ix = 0; ix < len; ix++ )
+		same &= BitSparse_Get( &r, ix ) == (ref[ix] != oref[ix]);
+	CHECK( same, "Xor disagrees with reference", result );
+
+	BitSparse_AndNot( &r, &s, &o );
+	BitSparse_Or( &r, &r, &o );
+	same = true;
+	for( int ix = 0; ix < len; ix++ )
+		same &= BitSparse_Get( &r, ix ) == (ref[ix] || oref[ix]);
+	CHECK( same, "AndNot/Or disagrees with reference", result );
+
+	/* Ordered walk */
+	int next = BitSparse_Next( &s, 0 ), seen = 0;
+	same = true;
+	while( next >= 0 ) {
+		same &= ref[next];
+		seen++;
+		next = BitSparse_Next( &s, next + 1 );
+	}
+	CHECK( same && seen == (int)card, "Next does not visit every set bit", result );
+
+	/* Rank selection agrees with the ordered walk */
+	next = BitSparse_Next( &s, 0 );
+	same = BitSparse_Select( &s, card ) == -1;
+	for( size_t rank = 0; next >= 0; rank++ ) {
+		same &= BitSparse_Select( &s, rank ) == next;
+		next = BitSparse_Next( &s, next + 1 );
+	}
+	CHECK( same, "Select disagrees with Next", result );
+
+	/* Dense round trip */
+	BitString d;
+	BitSparse_Decompress( &d, &s );
+	same = true;
+	for( int ix = 0; ix < len; ix++ )
+		same &= BitString_Get( &d, ix ) == ref[ix];
+	CHECK( same, "Decompress disagrees with reference", result );
+
+	BitSparse_Free( &r );
+	BitSparse_Compress( &r, &d );
+	CHECK( BitSparse_Cardinality( &r ) == card, "Compress lost bits", result );
+	BitSparse_Xor( &r, &r, &s );
+	CHECK( BitSparse_Cardinality( &r ) == 0, "Compress disagrees with original", result );
+	BitString_Free( &d );
+
+	/* Single bits against a run container: runs are extended, merged, trimmed and split in place */
+	BitSparse_Free( &r );
+	BitSparse_Init( &r, len );
+	vector<bool> rref( len );
+	for( int ix = 0; ix < 20000; ix++ ) {
+		BitSparse_Set( &r, ix, true );
+		rref[ix] = true;
+	}
+	CHECK( r.containers == 1 && r.container[0].kind == BITSPARSE_RUN && r.container[0].size == 1, "Sequential bits not kept as one run", result );
+	for( int ix = 0; ix < 2000; ix++ ) {
+		int at = rand() % 30000;
+		bool value = rand() % 2 != 0;
+		BitSparse_Set( &r, at, value );
+		rref[at] = value;
+	}
+	CHECK( r.container[0].kind == BITSPARSE_RUN, "Run container not kept", result );
+	same = true;
+	card = 0;
+	for( int ix = 0; ix < len; ix++ ) {
+		same &= BitSparse_Get( &r, ix ) == rref[ix];
+		card += rref[ix];
+	}
+	CHECK( same, "Run edits disagree with reference", result );
+	CHECK( BitSparse_Cardinality( &r ) == card, "Run edits miscount", result );
+	next = BitSparse_Next( &r, 0 );
+	same = true;
+	while( next >= 0 ) {
+		int after = BitSparse_Next( &r, next + 1 );
+		same &= rref[next] && (after < 0 || after > next);
+		next = after;
+	}
+	CHECK( same, "Runs out of order after edits", result );
+
+	/* Scattering enough lone bits gives up the runs */
+	for( int ix = 0; ix < 20000; ix += 2 ) {
+		BitSparse_Set( &r, ix, false );
+		rref[ix] = false;
+	}
+	CHECK( r.container[0].kind != BITSPARSE_RUN, "Fragmented run container kept", result );
+	same = true;
+	for( int ix = 0; ix < len; ix++ )
+		same &= BitSparse_Get( &r, ix ) == rref[ix];
+	CHECK( same, "Run conversion disagrees with reference", result );
+
+	BitSparse_Free( &s );
+	BitSparse_Free( &o );
+	BitSparse_Free( &r );
+	CHECK( s.container == NULL, "Memory not released", result );
+	return result;
+}
+
+// Atomic BitString Test: neighbouring bits raised from several threads
+bool test_atomic() {
+	bool result = true;
+	const int len = 4099, workers = 4;
+	BitString t;
+	int firsts[workers] = { 0 };
+	vector<thread> pool;
+
+	BitString_Init( &t, len );
+
+	/* Every worker races for every bit; exactly one may win each */
+	for( int iw = 0; iw < workers; iw++ ) {
+		pool.push_back( thread( [&t, &firsts, iw, len]() {
+			for( int ix = 0; ix < len; ix++ )
+				if( !BitString_TestAndSet( &t, ix, BITSTRING_ACQ_REL ) )
+					firsts[iw]++;
+		} ) );
+	}
+	for( int iw = 0; iw < workers; iw++ )
+		pool[iw].join();
+
+	bool all = true;
+	for( int ix = 0; ix < len; ix++ )
+		all &= BitString_AtomicGet( &t, ix, BITSTRING_ACQUIRE );
+	CHECK( all, "Not every bit raised", result );
+	CHECK( firsts[0] + firsts[1] + firsts[2] + firsts[3] == len, "A bit was claimed more than once", result );
+
+	/* Word access follows the BitString's own bit order */
+	BitString_AtomicFill( &t, 0, len, false, BITSTRING_RELEASE );
+	BitString_AtomicSet( &t, 64, true, BITSTRING_RELEASE );
+	CHECK( t.data[8] == 0x80, "Bit 64 not set", result );
+	CHECK( BitString_AtomicLoadWord( &t, 1, BITSTRING_ACQUIRE ) == 0x8000000000000000ULL, "Word 1 incorrect", result );
+	CHECK( BitString_FetchOrWord( &t, 1, 0x00FF000000000001ULL, BITSTRING_RELAXED ) == 0x8000000000000000ULL, "FetchOr returned wrong word", result );
+	CHECK( t.data[9] == 0xFF && t.data[15] == 0x01, "FetchOr set wrong bits", result );
+	CHECK( BitString_TestAndClear( &t, 72, BITSTRING_SEQ_CST ), "Bit 72 not set", result );
+	CHECK( !BitString_Get( &t, 72 ), "Bit 72 not cleared", result );
+
+	BitString_AtomicFill( &t, 60, 10, true, BITSTRING_RELEASE );
+	CHECK( t.data[7] == 0x0F && t.data[8] == 0xFC, "Fill across words incorrect", result );
+	DISPL( "bits 60-69 set", t );
+
+	BitString_Free( &t );
+	return result;
+}
+
+// Packed Integer Array Test
+bool test_pack() {
+	bool result = true;
+
+	/* Element access against the raw bits */
+	BitPack p;
+	BitPack_Init( &p, 5, 3 );
+	BitPack_Set( &p, 0, 5 );
+	BitPack_Set( &p, 2, 7 );
+	BitPack_Set( &p, 4, 9 ); /*< truncated to 1 */
+	CHECK( p.bits.data[0] == 0xA3 && p.bits.data[1] == 0x82, "Elements not stored in bit order", result );
+	CHECK( BitPack_Get( &p, 0 ) == 5 && BitPack_Get( &p, 1 ) == 0 && BitPack_Get( &p, 2 ) == 7, "Elements read incorrectly", result );
+	CHECK( BitPack_Get( &p, 4 ) == 1, "Value not truncated to width", result );
+	DISPL( "5, 0, 7, 0, 1 @ 3 bits", p.bits );
+	BitPack_Free( &p );
+
+	/* Bulk round trips for every width, starting off a group boundary */
+	srand( 28 );
+	for( int width = 1; width <= 32; width++ ) {
+		const int count = 1003;
+		vector<uint32_t> in( count ), out( count );
+		uint32_t mask = 0xFFFFFFFFU >> (32 - width);
+
+		for( int ix = 0; ix < count; ix++ )
+			in[ix] = ((uint32_t)rand() << 1) ^ (uint32_t)rand();
+
+		BitPack_Init( &p, count + 5, width );
+		BitPack_Pack( &p, 3, in.data(), count );
+
+		bool same = true;
+		for( int ix = 0; ix < count; ix++ )
+			same &= BitPack_Get( &p, ix + 3 ) == (in[ix] & mask);
+		same &= BitPack_Get( &p, 2 ) == 0 && BitPack_Get( &p, count + 3 ) == 0;
+		CHECK( same, "Pack disagrees with Get at width " << width, result );
+
+		BitPack_Unpack( &p, 3, out.data(), count );
+		same = true;
+		for( int ix = 0; ix < count; ix++ )
+			same &= out[ix] == (in[ix] & mask);
+		CHECK( same, "Unpack disagrees with Pack at width " << width, result );
+
+		BitPack_Free( &p );
+	}
+
+	return result;
+}
+
+// Bloom Filter Test
+bool test_bloom() {
+	bool result = true;
+	const int keys = 10000;
+	BloomFilter a, b;
+	CountingBloom c;
+	vector<string> in, out;
+	vector<const void *> ptrs;
+	vector<size_t> lens;
+
+	for( int ix = 0; ix < keys; ix++ ) {
+		in.push_back( "present-" + to_string( ix ) );
+		out.push_back( "absent-" + to_string( ix ) );
+	}
+
+	BloomFilter_Init( &a, keys, 10, 0 );
+	BloomFilter_Init( &b, keys, 10, 0 );
+	CountingBloom_Init( &c, keys, 10, 0 );
+	DISPL( "blocks", a.blocks );
+	DISPL( "hashes", a.hashes );
+
+	/* Half through single inserts into a, half batched into b */
+	for( int ix = 0; ix < keys / 2; ix++ ) {
+		BloomFilter_Insert( &a, in[ix].data(), in[ix].size() );
+		CountingBloom_Insert( &c, in[ix].data(), in[ix].size() );
+	}
+	for( int ix = keys / 2; ix < keys; ix++ ) {
+		ptrs.push_back( in[ix].data() );
+		lens.push_back( in[ix].size() );
+	}
+	BloomFilter_InsertMany( &b, ptrs.data(), lens.data(), ptrs.size() );
+	CountingBloom_InsertMany( &c, ptrs.data(), lens.data(), ptrs.size() );
+	CHECK( BloomFilter_Merge( &a, &b ), "Merge refused matching filters", result );
+
+	/* No false negatives, few false positives */
+	bool all = true;
+	int falsePositives = 0, countingFalsePositives = 0;
+	for( int ix = 0; ix < keys; ix++ ) {
+		all &= BloomFilter_Query( &a, in[ix].data(), in[ix].size() );
+		all &= CountingBloom_Query( &c, in[ix].data(), in[ix].size() );
+		falsePositives += BloomFilter_Query( &a, out[ix].data(), out[ix].size() );
+		countingFalsePositives += CountingBloom_Query( &c, out[ix].data(), out[ix].size() );
+	}
+	CHECK( all, "Inserted key rejected", result );
+	CHECK( falsePositives < keys / 30, "Too many false positives", result );
+	CHECK( countingFalsePositives < keys / 30, "Too many counting false positives", result );
+	DISPL( "false positives per 10000", falsePositives );
+
+	/* Batched queries agree with single queries */
+	vector<const void *> probe;
+	vector<size_t> probeLens;
+	for( int ix = 0; ix < keys; ix++ ) {
+		probe.push_back( out[ix].data() );
+		probeLens.push_back( out[ix].size() );
+	}
+	bool *answers = new bool[keys];
+	BloomFilter_QueryMany( &a, probe.data(), probeLens.data(), keys, answers );
+	bool same = true;
+	for( int ix = 0; ix < keys; ix++ )
+		same &= answers[ix] == BloomFilter_Query( &a, out[ix].data(), out[ix].size() );
+	CHECK( same, "QueryMany disagrees with Query", result );
+	delete[] answers;
+
+	/* Counting filter forgets removed keys */
+	for( int ix = 0; ix < keys; ix++ )
+		CountingBloom_Remove( &c, in[ix].data(), in[ix].size() );
+	int remaining = 0;
+	for( int ix = 0; ix < keys; ix++ )
+		remaining += CountingBloom_Query( &c, in[ix].data(), in[ix].size() );
+	CHECK( remaining == 0, "Removed keys still present", result );
+
+	BloomFilter_Free( &a );
+	BloomFilter_Free( &b );
+	CountingBloom_Free( &c );
+	return result;
+}
+
+// Memory-mapped BitString Test
+bool test_map() {
+	bool result = true;
+	char path[] = "/tmp/bitstring_test_XXXXXX";
+	BitString t;
+
+	int fd = mkstemp( path );
+	CHECK( fd >= 0, "Temporary file not created", result );
+	close( fd );
+
+	/* Create, write and flush */
+	CHECK( BitString_Map( &t, path, 100003 ), "File not mapped", result );
+	CHECK( t.count == 100003 && t.map != NULL, "Mapping not recorded", result );
+	BitString_Set( &t, 6, true );
+	BitString_Fill( &t, 99990, 13, true );
+	CHECK( t.data[0] == 0x02, "Bit 6 Not Set", result );
+	CHECK( BitString_Sync( &t, true ), "Sync failed", result );
+	BitString_Free( &t );
+	CHECK( t.data == NULL && t.map == NULL, "Mapping not released", result );
+
+	/* Reopen, taking the stored bit count */
+	CHECK( BitString_Map( &t, path, -1 ), "File not reopened", result );
+	CHECK( BitString_Count( &t ) == 100003, "Bit count not persisted", result );
+	CHECK( BitString_Get( &t, 6 ) && !BitString_Get( &t, 7 ), "Bits not persisted", result );
+	CHECK( BitString_Get( &t, 99990 ) && BitString_Get( &t, 100002 ) && !BitString_Get( &t, 99989 ), "Fill not persisted", result );
+	BitString_Free( &t );
+
+	/* A mismatched bit count is refused */
+	CHECK( !BitString_Map( &t, path, 64 ), "Mismatched count accepted", result );
+	unlink( path );
+
+	/* Anonymous memory behaves as an allocated BitString */
+	CHECK( BitString_MapAnonymous( &t, 1 << 20, true ), "Anonymous map failed", result );
+	CHECK( !BitString_Get( &t, 12345 ), "Anonymous map not zeroed", result );
+	BitString_Set( &t, 12345, true );
+	CHECK( BitString_Get( &t, 12345 ), "Anonymous map not writable", result );
+	BitString_Free( &t );
+
+	return result;
+}
+
 void setup( vector<aTest> &ourtests ) {
 	ourtests.push_back( { &test_init, "Initialization Test" } );
 	ourtests.push_back( { &test_count, "Bit Count Accessor Test" } );
 	ourtests.push_back( { &test_bits, "Bit Assignment & Retrival Test" } );
 	ourtests.push_back( { &test_copy, "Bitwise copy Test" } );
+	ourtests.push_back( { &test_sparse, "Sparse BitString Test" } );
+	ourtests.push_back( { &test_atomic, "Atomic BitString Test" } );
+	ourtests.push_back( { &test_pack, "Packed Integer Array Test" } );
+	ourtests.push_back( { &test_bloom, "Bloom Filter Test" } );
+	ourtests.push_back( { &test_map, "Memory-mapped BitString Test" } );
 }
 
 #define RUNTEST( treg, tix, failed ) \
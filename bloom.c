@@ -0,0 +1,276 @@
+#include "bloom.h"
+#include <stdlib.h>
+#include <string.h>
+#include "util.h"
+
+#define BLOOM_BLOCK_BITS (BLOOM_BLOCK_BYTES * 8)
+#define BLOOM_BLOCK_COUNTERS (BLOOM_BLOCK_BYTES * 2)
+#define BLOOM_COUNTER_MAX 15
+
+/* Keys hashed and prefetched ahead of use in the batched routines */
+#define BLOOM_BATCH 16
+
+#define BLOOM_ROTL( x, r ) (((x) << (r)) | ((x) >> (64 - (r))))
+
+/* 64-bit key hash, eight bytes at a time (private) */
+uint64_t Bloom_Hash( const void *key, size_t len ) {
+	const byte *p = key;
+	uint64_t h = 0x9E3779B97F4A7C15ULL ^ (len * 0xC2B2AE3D27D4EB4FULL);
+	uint64_t k;
+
+	while( len >= 8 ) {
+		memcpy( &k, p, 8 );
+		k *= 0x87C37B91114253D5ULL;
+		h ^= BLOOM_ROTL( k, 31 ) * 0x4CF5AD432745937FULL;
+		h = BLOOM_ROTL( h, 27 ) * 5 + 0x52DCE729;
+		p += 8;
+		len -= 8;
+	}
+
+	k = 0;
+	while( len > 0 )
+		k = (k << 8) | p[--len];
+	h ^= BLOOM_ROTL( k * 0x87C37B91114253D5ULL, 31 ) * 0x4CF5AD432745937FULL;
+
+	/* final avalanche */
+	h ^= h >> 33;
+	h *= 0xFF51AFD7ED558CCDULL;
+	h ^= h >> 33;
+	h *= 0xC4CEB9FE1A85EC53ULL;
+	h ^= h >> 33;
+
+	return h;
+}
+
+/* The block a hash lands in: upper half of the hash scaled onto the block count */
+#define BLOOM_BLOCK( hash, blocks ) ((int)(((hash) >> 32) * (uint64_t)(blocks) >> 32))
+
+/* Successive probe positions inside the block come from the top bits of a
+ *   multiplicative sequence seeded by the hash */
+#define BLOOM_PROBE_NEXT( state ) ((state) = (state) * 0x5851F42D4C957F2DULL + 0x14057B7EF767814FULL)
+
+/* Work out filter geometry from the caller's sizing (private) */
+void Bloom_Geometry( int keys, int bitsPerKey, int *hashes, int *blocks, int perBlock ) {
+	long long bits;
+
+	if( keys < 1 ) keys = 1;
+	if( bitsPerKey < 1 ) bitsPerKey = 1;
+
+	/* k = ln(2) * bits per key minimises false positives */
+	if( *hashes < 1 )
+		*hashes = (bitsPerKey * 69 + 50) / 100;
+	if( *hashes < 1 ) *hashes = 1;
+	if( *hashes > 16 ) *hashes = 16;
+
+	bits = (long long)keys * bitsPerKey;
+	*blocks = (int)((bits + perBlock - 1) / perBlock);
+}
+
+/* Cache-line aligned, zeroed BitString storage so a block never straddles two lines (private) */
+void Bloom_Storage( BitString *bs, int blocks ) {
+	size_t bytes = (size_t)blocks * BLOOM_BLOCK_BYTES;
+
+	bs->count = blocks * BLOOM_BLOCK_BITS;
+	bs->map = NULL;
+	bs->data = aligned_alloc( BLOOM_BLOCK_BYTES, bytes );
+	if( bs->data == NULL ) {
+		fprintf( stderr, "Malloc failed at '%s:%i'", __FILE__, __LINE__ );
+		abort();
+	}
+	memset( bs->data, 0x00, bytes );
+}
+
+/*** Plain filter ***/
+
+void BloomFilter_Init( BloomFilter *bf, int keys, int bitsPerKey, int hashes ) {
+	Bloom_Geometry( keys, bitsPerKey, &hashes, &bf->blocks, BLOOM_BLOCK_BITS );
+	bf->hashes = hashes;
+	Bloom_Storage( &bf->bits, bf->blocks );
+}
+
+void BloomFilter_Free( BloomFilter *bf ) {
+	BitString_Free( &bf->bits );
+}
+
+/* Raise or test every probe of one hash (private) */
+void BloomFilter_Insert_Hash( BloomFilter *bf, uint64_t hash ) {
+	byte *block = bf->bits.data + BLOOM_BLOCK( hash, bf->blocks ) * BLOOM_BLOCK_BYTES;
+	uint64_t state = hash;
+
+	for( int ih = 0; ih < bf->hashes; ih++ ) {
+		int bit = BLOOM_PROBE_NEXT( state ) >> (64 - 9);
+		block[bit / 8] |= 0x01 << (7 - bit % 8);
+	}
+}
+
+bool BloomFilter_Query_Hash( BloomFilter *bf, uint64_t hash ) {
+	const byte *block = bf->bits.data + BLOOM_BLOCK( hash, bf->blocks ) * BLOOM_BLOCK_BYTES;
+	uint64_t state = hash;
+	bool found = true;
+
+	/* no early exit: the block is already in cache and the loop stays branch-free */
+	for( int ih = 0; ih < bf->hashes; ih++ ) {
+		int bit = BLOOM_PROBE_NEXT( state ) >> (64 - 9);
+		found &= (block[bit / 8] >> (7 - bit % 8)) & 0x01;
+	}
+
+	return found;
+}
+
+void BloomFilter_Insert( BloomFilter *bf, const void *key, size_t len ) {
+	BloomFilter_Insert_Hash( bf, Bloom_Hash( key, len ) );
+}
+
+bool BloomFilter_Query( BloomFilter *bf, const void *key, size_t len ) {
+	return BloomFilter_Query_Hash( bf, Bloom_Hash( key, len ) );
+}
+
+/* Batched access: hash a batch and prefetch its blocks, then touch them */
+void BloomFilter_InsertMany( BloomFilter *bf, const void **keys, const size_t *lens, int n ) {
+	uint64_t hash[BLOOM_BATCH];
+
+	for( int base = 0; base < n; base += BLOOM_BATCH ) {
+		int batch = n - base < BLOOM_BATCH ? n - base : BLOOM_BATCH;
+
+		for( int ix = 0; ix < batch; ix++ ) {
+			hash[ix] = Bloom_Hash( keys[base + ix], lens[base + ix] );
+			__builtin_prefetch( bf->bits.data + BLOOM_BLOCK( hash[ix], bf->blocks ) * BLOOM_BLOCK_BYTES, 1 );
+		}
+
+		for( int ix = 0; ix < batch; ix++ )
+			BloomFilter_Insert_Hash( bf, hash[ix] );
+	}
+}
+
+void BloomFilter_QueryMany( BloomFilter *bf, const void **keys, const size_t *lens, int n, bool *results ) {
+	uint64_t hash[BLOOM_BATCH];
+
+	for( int base = 0; base < n; base += BLOOM_BATCH ) {
+		int batch = n - base < BLOOM_BATCH ? n - base : BLOOM_BATCH;
+
+		for( int ix = 0; ix < batch; ix++ ) {
+			hash[ix] = Bloom_Hash( keys[base + ix], lens[base + ix] );
+			__builtin_prefetch( bf->bits.data + BLOOM_BLOCK( hash[ix], bf->blocks ) * BLOOM_BLOCK_BYTES, 0 );
+		}
+
+		for( int ix = 0; ix < batch; ix++ )
+			results[base + ix] = BloomFilter_Query_Hash( bf, hash[ix] );
+	}
+}
+
+/* Union */
+bool BloomFilter_Merge( BloomFilter *destBF, BloomFilter *origBF ) {
+	size_t words = (size_t)destBF->blocks * BLOOM_BLOCK_BYTES / sizeof( uint64_t );
+	uint64_t *dest = (uint64_t *)destBF->bits.data;
+	const uint64_t *orig = (const uint64_t *)origBF->bits.data;
+
+	if( destBF->blocks != origBF->blocks || destBF->hashes != origBF->hashes )
+		return false;
+
+	for( size_t iw = 0; iw < words; iw++ )
+		dest[iw] |= orig[iw];
+
+	return true;
+}
+
+/*** Counting filter ***/
+
+void CountingBloom_Init( CountingBloom *cb, int keys, int bitsPerKey, int hashes ) {
+	Bloom_Geometry( keys, bitsPerKey, &hashes, &cb->blocks, BLOOM_BLOCK_COUNTERS );
+	cb->hashes = hashes;
+
+	/* A BitPack of 4-bit counters laid over aligned storage */
+	cb->counters.count = cb->blocks * BLOOM_BLOCK_COUNTERS;
+	cb->counters.width = 4;
+	Bloom_Storage( &cb->counters.bits, cb->blocks );
+}
+
+void CountingBloom_Free( CountingBloom *cb ) {
+	BitPack_Free( &cb->counters );
+}
+
+/* Adjust every counter of one hash by delta, or test them all when delta is 0 (private) */
+bool CountingBloom_Hash( CountingBloom *cb, uint64_t hash, int delta ) {
+	int base = BLOOM_BLOCK( hash, cb->blocks ) * BLOOM_BLOCK_COUNTERS;
+	uint64_t state = hash;
+	bool found = true;
+
+	for( int ih = 0; ih < cb->hashes; ih++ ) {
+		int at = base + (BLOOM_PROBE_NEXT( state ) >> (64 - 7));
+		uint32_t count = BitPack_Get( &cb->counters, at );
+
+		if( delta > 0 && count < BLOOM_COUNTER_MAX ) {
+			BitPack_Set( &cb->counters, at, count + 1 );
+		} else if( delta < 0 && count > 0 && count < BLOOM_COUNTER_MAX ) {
+			BitPack_Set( &cb->counters, at, count - 1 );
+		}
+		found &= count != 0;
+	}
+
+	return found;
+}
+
+void CountingBloom_Insert( CountingBloom *cb, const void *key, size_t len ) {
+	CountingBloom_Hash( cb, Bloom_Hash( key, len ), 1 );
+}
+
+void CountingBloom_Remove( CountingBloom *cb, const void *key, size_t len ) {
+	CountingBloom_Hash( cb, Bloom_Hash( key, len ), -1 );
+}
+
+bool CountingBloom_Query( CountingBloom *cb, const void *key, size_t len ) {
+	return CountingBloom_Hash( cb, Bloom_Hash( key, len ), 0 );
+}
+
+void CountingBloom_InsertMany( CountingBloom *cb, const void **keys, const size_t *lens, int n ) {
+	uint64_t hash[BLOOM_BATCH];
+
+	for( int base = 0; base < n; base += BLOOM_BATCH ) {
+		int batch = n - base < BLOOM_BATCH ? n - base : BLOOM_BATCH;
+
+		for( int ix = 0; ix < batch; ix++ ) {
+			hash[ix] = Bloom_Hash( keys[base + ix], lens[base + ix] );
+			__builtin_prefetch( cb->counters.bits.data + BLOOM_BLOCK( hash[ix], cb->blocks ) * BLOOM_BLOCK_BYTES, 1 );
+		}
+
+		for( int ix = 0; ix < batch; ix++ )
+			CountingBloom_Hash( cb, hash[ix], 1 );
+	}
+}
+
+void CountingBloom_QueryMany( CountingBloom *cb, const void **keys, const size_t *lens, int n, bool *results ) {
+	uint64_t hash[BLOOM_BATCH];
+
+	for( int base = 0; base < n; base += BLOOM_BATCH ) {
+		int batch = n - base < BLOOM_BATCH ? n - base : BLOOM_BATCH;
+
+		for( int ix = 0; ix < batch; ix++ ) {
+			hash[ix] = Bloom_Hash( keys[base + ix], lens[base + ix] );
+			__builtin_prefetch( cb->counters.bits.data + BLOOM_BLOCK( hash[ix], cb->blocks ) * BLOOM_BLOCK_BYTES, 0 );
+		}
+
+		for( int ix = 0; ix < batch; ix++ )
+			results[base + ix] = CountingBloom_Hash( cb, hash[ix], 0 );
+	}
+}
+
+/* Union: counters add, saturating */
+bool CountingBloom_Merge( CountingBloom *destCB, CountingBloom *origCB ) {
+	size_t bytes = (size_t)destCB->blocks * BLOOM_BLOCK_BYTES;
+	byte *dest = destCB->counters.bits.data;
+	const byte *orig = origCB->counters.bits.data;
+
+	if( destCB->blocks != origCB->blocks || destCB->hashes != origCB->hashes )
+		return false;
+
+	/* two counters per byte */
+	for( size_t ib = 0; ib < bytes; ib++ ) {
+		int hi = (dest[ib] >> 4) + (orig[ib] >> 4);
+		int lo = (dest[ib] & 0x0F) + (orig[ib] & 0x0F);
+		if( hi > BLOOM_COUNTER_MAX ) hi = BLOOM_COUNTER_MAX;
+		if( lo > BLOOM_COUNTER_MAX ) lo = BLOOM_COUNTER_MAX;
+		dest[ib] = (hi << 4) | lo;
+	}
+
+	return true;
+}
@@ -0,0 +1,96 @@
+/// @file
+/*******************************************************************************
+ * >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> BloomFilter <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<< *
+ *******************************************************************************
+ * Probabilistic set membership for rejecting keys that were never stored     *
+ *  before paying for a HashTree or Table lookup.  A query answers either      *
+ *  "definitely absent" or "possibly present".  The filter is blocked: every   *
+ *  key hashes to a single cache-line sized block (512 bits) and all of its    *
+ *  probes land inside that block, so an insert or query touches one line of   *
+ *  memory.  The counting variant keeps a 4-bit counter in place of each bit   *
+ *  (in a BitPack) so keys may also be removed.                                *
+ ******************************************************************************/
+
+#ifndef INCLUDED_BLOOM_H
+#define INCLUDED_BLOOM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "bitstring.h"
+#include "bitpack.h"
+
+/* Bytes per block; one cache line */
+#define BLOOM_BLOCK_BYTES 64
+
+typedef struct {
+	int blocks;
+	int hashes;
+	BitString bits;
+} BloomFilter;
+
+typedef struct {
+	int blocks;
+	int hashes;
+	BitPack counters;
+} CountingBloom;
+
+/**
+ * Initialize an empty BloomFilter
+ *   @param bf			The BloomFilter to initialize
+ *   @param keys			The number of keys expected
+ *   @param bitsPerKey	Bits of filter per expected key (about 10 gives 1% false positives)
+ *   @param hashes		Probes per key; 0 picks the best count for bitsPerKey
+ */
+void BloomFilter_Init( BloomFilter *bf, int keys, int bitsPerKey, int hashes );
+
+/**
+ * Cleanup the BloomFilter
+ *   @param bf		The BloomFilter to be cleaned
+ */
+void BloomFilter_Free( BloomFilter *bf );
+
+/**
+ * Add a key to the filter/Test a key against the filter
+ *   @param bf		The BloomFilter to access
+ *   @param key		The key's bytes
+ *   @param len		The key's length in bytes
+ *   @return		false if the key was certainly never inserted (Query Only)
+ */
+void BloomFilter_Insert( BloomFilter *bf, const void *key, size_t len );
+bool BloomFilter_Query( BloomFilter *bf, const void *key, size_t len );
+
+/**
+ * Batched Insert/Query; the blocks of a batch are prefetched before they are touched
+ *   @param bf		The BloomFilter to access
+ *   @param keys		Array of key pointers
+ *   @param lens		Array of key lengths
+ *   @param n			The number of keys
+ *   @param results	Receives one answer per key (Query Only)
+ */
+void BloomFilter_InsertMany( BloomFilter *bf, const void **keys, const size_t *lens, int n );
+void BloomFilter_QueryMany( BloomFilter *bf, const void **keys, const size_t *lens, int n, bool *results );
+
+/**
+ * Union of two filters built with identical parameters
+ *   @param destBF	Receives the keys of both filters
+ *   @param origBF	The filter merged into destBF
+ *   @return			false (and nothing merged) if the filters differ in shape
+ */
+bool BloomFilter_Merge( BloomFilter *destBF, BloomFilter *origBF );
+
+/**
+ * Counting variant; as the BloomFilter routines above with the addition of Remove.
+ *  Counters saturate at 15 and are never decremented from there, so an
+ *  overloaded counter errs towards false positives rather than false negatives.
+ *  Removing a key that was never inserted corrupts the filter.
+ */
+void CountingBloom_Init( CountingBloom *cb, int keys, int bitsPerKey, int hashes );
+void CountingBloom_Free( CountingBloom *cb );
+void CountingBloom_Insert( CountingBloom *cb, const void *key, size_t len );
+void CountingBloom_Remove( CountingBloom *cb, const void *key, size_t len );
+bool CountingBloom_Query( CountingBloom *cb, const void *key, size_t len );
+void CountingBloom_InsertMany( CountingBloom *cb, const void **keys, const size_t *lens, int n );
+void CountingBloom_QueryMany( CountingBloom *cb, const void **keys, const size_t *lens, int n, bool *results );
+bool CountingBloom_Merge( CountingBloom *destCB, CountingBloom *origCB );
+
+#endif
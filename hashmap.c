@@ -0,0 +1,272 @@
+/* Swiss-table style open-addressing hash map */
+
+#include "hashmap.h"
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define HASHMAP_MIN_CAPACITY 16
+
+/* Multipliers for the hash (odd, with well spread bits) */
+#define HASHMAP_K0 0xa0761d6478bd642fULL
+#define HASHMAP_K1 0xe7037ed1a0b428dbULL
+#define HASHMAP_K2 0x8ebc6af09c88c6e3ULL
+
+/* 64x64 -> 128 bit multiply folded back to 64 bits (private) */
+static inline uint64_t HashMap_Mix( uint64_t a, uint64_t b ) {
+	unsigned __int128 product = (unsigned __int128)a * b;
+	return (uint64_t)product ^ (uint64_t)(product >> 64);
+}
+
+uint64_t HashMap_Hash( const void *key, size_t key_len ) {
+	const unsigned char *bytes = key;
+	uint64_t hash = HASHMAP_K0 ^ key_len, word;
+	size_t rem = key_len;
+
+	while( rem >= 8 ) {
+		memcpy( &word, bytes, 8 );
+		hash = HashMap_Mix( hash ^ word, HASHMAP_K1 );
+		bytes += 8;
+		rem -= 8;
+	}
+
+	if( rem > 0 ) {
+		word = 0;
+		memcpy( &word, bytes, rem );
+		hash = HashMap_Mix( hash ^ word, HASHMAP_K1 );
+	}
+
+	return HashMap_Mix( hash ^ HASHMAP_K2, HASHMAP_K1 );
+}
+
+/* The hash's low 7 bits go in the control byte, the rest picks the first group */
+#define HashMap_H1( hash ) ((hash) >> 7)
+#define HashMap_H2( hash ) ((signed char)((hash) & 0x7F))
+
+/* Which of the 16 control bytes from pos equal code / have their top bit set (private) */
+static inline unsigned HashMap_Group_Match( const signed char *ctrl, signed char code ) {
+#ifdef __SSE2__
+	__m128i group = _mm_loadu_si128( (const __m128i *)ctrl );
+	return _mm_movemask_epi8( _mm_cmpeq_epi8( group, _mm_set1_epi8( code ) ) );
+#else
+	unsigned mask = 0;
+	for( int ix = 0; ix < HASHMAP_GROUP; ix++ )
+		mask |= (unsigned)(ctrl[ix] == code) << ix;
+	return mask;
+#endif
+}
+
+/* Empty or deleted: the control codes with the top bit set (private) */
+static inline unsigned HashMap_Group_Free( const signed char *ctrl ) {
+#ifdef __SSE2__
+	return _mm_movemask_epi8( _mm_loadu_si128( (const __m128i *)ctrl ) );
+#else
+	unsigned mask = 0;
+	for( int ix = 0; ix < HASHMAP_GROUP; ix++ )
+		mask |= (unsigned)(ctrl[ix] < 0) << ix;
+	return mask;
+#endif
+}
+
+/* Set a control byte, keeping the copy of the first group in step (private) */
+void HashMap_Ctrl_Set( HashMap map, size_t ix, signed char code ) {
+	map->ctrl[ix] = code;
+	if( ix < HASHMAP_GROUP )
+		map->ctrl[map->capacity + ix] = code;
+}
+
+#define HashMap_Slot_Key( slot ) ((slot)->key_len <= HASHMAP_INLINE_KEY ? (slot)->inline_key : (slot)->key)
+
+/* Allocate an empty table of the given capacity (private) */
+bool HashMap_Table_Init( HashMap map, size_t capacity ) {
+	map->ctrl = malloc( capacity + HASHMAP_GROUP );
+	map->slot = malloc( sizeof( HashMap_Slot ) * capacity );
+	if( map->ctrl == NULL || map->slot == NULL ) {
+		free( map->ctrl );
+		free( map->slot );
+		return false /* error */;
+	}
+
+	memset( map->ctrl, HASHMAP_CTRL_EMPTY, capacity + HASHMAP_GROUP );
+	map->capacity = capacity;
+	map->growth_left = capacity - capacity / 8;
+	return true;
+}
+
+HashMap HashMap_Init() {
+	HashMap newmap;
+
+	newmap = malloc( sizeof( HashMap_Header ) );
+	if( newmap != NULL ) {
+		newmap->count = 0;
+		newmap->key_bytes = 0;
+		if( !HashMap_Table_Init( newmap, HASHMAP_MIN_CAPACITY ) ) {
+			free( newmap );
+			newmap = NULL;
+		}
+	}
+
+	return newmap;
+}
+
+void HashMap_Free( HashMap *map ) {
+	for( size_t ix = 0; ix < (*map)->capacity; ix++ ) {
+		if( (*map)->ctrl[ix] >= 0 && (*map)->slot[ix].key_len > HASHMAP_INLINE_KEY )
+			free( (*map)->slot[ix].key );
+	}
+
+	free( (*map)->ctrl );
+	free( (*map)->slot );
+	free( *map );
+	*map = NULL;
+}
+
+/* Locate a key's slot; -1 if it is not stored (private) */
+long HashMap_Find( HashMap map, const void *key, size_t key_len, uint64_t hash ) {
+	size_t mask = map->capacity - 1, pos = HashMap_H1( hash ) & mask, stride = 0;
+	signed char code = HashMap_H2( hash );
+
+	for( ;; ) {
+		unsigned match = HashMap_Group_Match( map->ctrl + pos, code );
+
+		while( match != 0 ) {
+			size_t ix = (pos + __builtin_ctz( match )) & mask;
+			HashMap_Slot *slot = &map->slot[ix];
+
+			if( slot->hash == hash && slot->key_len == key_len && memcmp( HashMap_Slot_Key( slot ), key, key_len ) == 0 )
+				return ix;
+			match &= match - 1;
+		}
+
+		/* An empty slot ends the probe: the key would have gone there */
+		if( HashMap_Group_Match( map->ctrl + pos, HASHMAP_CTRL_EMPTY ) != 0 )
+			return -1;
+
+		stride += HASHMAP_GROUP;
+		pos = (pos + stride) & mask;
+	}
+}
+
+/* First empty or deleted slot along a hash's probe (private) */
+size_t HashMap_Find_Free( HashMap map, uint64_t hash ) {
+	size_t mask = map->capacity - 1, pos = HashMap_H1( hash ) & mask, stride = 0;
+	unsigned avail;
+
+	while( (avail = HashMap_Group_Free( map->ctrl + pos )) == 0 ) {
+		stride += HASHMAP_GROUP;
+		pos = (pos + stride) & mask;
+	}
+
+	return (pos + __builtin_ctz( avail )) & mask;
+}
+
+/* Move every entry into a fresh table; deleted slots are dropped on the way (private) */
+bool HashMap_Resize( HashMap map, size_t capacity ) {
+	signed char *old_ctrl = map->ctrl;
+	HashMap_Slot *old_slot = map->slot;
+	size_t old_capacity = map->capacity;
+
+	if( !HashMap_Table_Init( map, capacity ) ) {
+		map->ctrl = old_ctrl;
+		map->slot = old_slot;
+		return false /* error */;
+	}
+
+	for( size_t ix = 0; ix < old_capacity; ix++ ) {
+		if( old_ctrl[ix] >= 0 ) {
+			size_t to = HashMap_Find_Free( map, old_slot[ix].hash );
+			HashMap_Ctrl_Set( map, to, old_ctrl[ix] );
+			map->slot[to] = old_slot[ix];
+		}
+	}
+	map->growth_left -= map->count;
+
+	free( old_ctrl );
+	free( old_slot );
+	return true;
+}
+
+void HashMap_Assign( HashMap map, const void *key, size_t key_len, void *data ) {
+	uint64_t hash;
+	HashMap_Slot *slot;
+	long found;
+	size_t ix;
+
+	/* NULL marks an absent entry, so storing it is a release */
+	if( data == NULL ) {
+		HashMap_Release( map, key, key_len );
+		return;
+	}
+
+	hash = HashMap_Hash( key, key_len );
+	found = HashMap_Find( map, key, key_len, hash );
+	if( found >= 0 ) {
+		map->slot[found].data = data;
+		return;
+	}
+
+	/* Out of room: double, or just sweep out the deleted slots if they are most of the load */
+	if( map->growth_left == 0 ) {
+		size_t capacity = map->count * 2 >= map->capacity - map->capacity / 8 ? map->capacity * 2 : map->capacity;
+		if( !HashMap_Resize( map, capacity ) )
+			return /* error */;
+	}
+
+	ix = HashMap_Find_Free( map, hash );
+	slot = &map->slot[ix];
+	slot->hash = hash;
+	slot->key_len = key_len;
+	slot->data = data;
+	if( key_len > HASHMAP_INLINE_KEY ) {
+		slot->key = malloc( key_len );
+		if( slot->key == NULL )
+			return /* error */;
+		memcpy( slot->key, key, key_len );
+		map->key_bytes += key_len;
+	} else if( key_len > 0 ) {
+		memcpy( slot->inline_key, key, key_len );
+	}
+
+	/* Only filling a truly empty slot uses up growth; a deleted one was already counted */
+	if( map->ctrl[ix] == HASHMAP_CTRL_EMPTY )
+		map->growth_left--;
+	HashMap_Ctrl_Set( map, ix, HashMap_H2( hash ) );
+	map->count++;
+}
+
+void *HashMap_Retrieve( HashMap map, const void *key, size_t key_len ) {
+	long found = HashMap_Find( map, key, key_len, HashMap_Hash( key, key_len ) );
+	return found < 0 ? NULL : map->slot[found].data;
+}
+
+void HashMap_Release( HashMap map, const void *key, size_t key_len ) {
+	long found = HashMap_Find( map, key, key_len, HashMap_Hash( key, key_len ) );
+
+	if( found < 0 )
+		return;
+
+	if( map->slot[found].key_len > HASHMAP_INLINE_KEY ) {
+		free( map->slot[found].key );
+		map->key_bytes -= map->slot[found].key_len;
+	}
+
+	/* The slot stays marked so probes carry on past it */
+	HashMap_Ctrl_Set( map, found, HASHMAP_CTRL_DELETED );
+	map->count--;
+}
+
+void HashMap_Foreach( HashMap map, void (*callback)(void *, const void *, size_t, void *), void *data ) {
+	for( size_t ix = 0; ix < map->capacity; ix++ ) {
+		if( map->ctrl[ix] >= 0 )
+			callback( data, HashMap_Slot_Key( &map->slot[ix] ), map->slot[ix].key_len, map->slot[ix].data );
+	}
+}
+
+size_t HashMap_Count( HashMap map ) {
+	return map->count;
+}
+
+size_t HashMap_Bytes( HashMap map ) {
+	return sizeof( HashMap_Header ) + map->capacity + HASHMAP_GROUP + sizeof( HashMap_Slot ) * map->capacity + map->key_bytes;
+}
@@ -0,0 +1,81 @@
+/** @file
+ * @brief	 Open-addressing hash map for unordered point lookups
+ * @details
+ *   A HashMap stores key-value pairs like a HashTree (keys are arbitrary byte strings,
+ *    NULL data marks an absent entry) but keeps them in one flat table instead of a trie,
+ *    so a lookup costs a hash and, almost always, a single probe whatever the key length.
+ *   The table is laid out in the style of a Swiss table: beside the slots sits an array of
+ *    one-byte control codes holding 7 bits of each key's hash (or an empty/deleted mark),
+ *    and a probe compares a whole group of 16 control bytes against the wanted code at once,
+ *    touching slots only for the candidates it finds.  The table doubles at 7/8 full.
+ *   Keys of up to HASHMAP_INLINE_KEY bytes are kept inside their slot; longer keys are copied
+ *    to a block of their own.  Entries have no order.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifndef INCLUDED_HASHMAP_H
+#define INCLUDED_HASHMAP_H
+
+/* Control bytes probed together */
+#define HASHMAP_GROUP 16
+
+/* Longest key stored inline in its slot */
+#define HASHMAP_INLINE_KEY 16
+
+/* Control codes; full slots hold the low 7 bits of their hash (0x00 - 0x7F) */
+#define HASHMAP_CTRL_EMPTY ((signed char)-128)
+#define HASHMAP_CTRL_DELETED ((signed char)-2)
+
+typedef struct {
+	uint64_t hash;
+	size_t key_len;
+	void *data;
+	union {
+		unsigned char inline_key[HASHMAP_INLINE_KEY];
+		unsigned char *key;
+	};
+} HashMap_Slot;
+
+/* Map Header */
+typedef struct {
+	signed char *ctrl;	/* capacity control bytes, then the first group again so probes never wrap */
+	HashMap_Slot *slot;
+	size_t capacity;	/* a power of two, at least HASHMAP_GROUP */
+	size_t count;
+	size_t growth_left;	/* empty slots that may still be filled before the table grows */
+	size_t key_bytes;	/* held by keys too long to be inline */
+} HashMap_Header;
+
+typedef HashMap_Header *HashMap;
+
+/* Built-in hash: 64 bits over an arbitrary byte string, a word at a time */
+uint64_t HashMap_Hash( const void *key, size_t key_len );
+
+/* Constructor */
+HashMap HashMap_Init();
+
+/* Descrtuctor */
+void HashMap_Free( HashMap *map );
+
+/* Data (Re)Assignment; NULL data releases the key */
+void HashMap_Assign( HashMap map, const void *key, size_t key_len, void *data );
+
+/* Data Retreival */
+void *HashMap_Retrieve( HashMap map, const void *key, size_t key_len );
+
+/* Data Release (Unassignment) */
+void HashMap_Release( HashMap map, const void *key, size_t key_len );
+
+/* Foreach Entry, in no particular order; the key is only valid for the duration of the call */
+void HashMap_Foreach( HashMap map, void (*callback)(void * /* data */, const void * /* key */, size_t /* key_len */, void * /* entry */), void *data );
+
+/* Entry Count */
+size_t HashMap_Count( HashMap map );
+
+/* Bytes held by the table and any out-of-line keys */
+size_t HashMap_Bytes( HashMap map );
+
+#endif
@@ -1,187 +1,509 @@
-#include "hashtree.h"
+#include "hashtree_internal.h"
 #include <string.h>
 
-/* Create a root node for the tree */
+/* Allocate a node for the edge bid + prefix (private) */
+HashTree_Node *HashTree_Node_Init( HashTree_Arena *arena, unsigned char bid, const unsigned char *prefix, size_t prefix_len, void *data ) {
+	HashTree_Node *newnode;
+
+	newnode = HashTree_Arena_Alloc( arena, sizeof( HashTree_Node ) + prefix_len );
+	if( newnode != NULL ) {
+		newnode->bid = bid;
+		newnode->kind = HASHTREE_NODE4;
+		newnode->subnode_count = 0;
+		newnode->version = 0;
+		newnode->refs = 1;
+		newnode->subnode = NULL;
+		newnode->data = data;
+		newnode->prefix_len = prefix_len;
+		if( prefix_len > 0 )
+			memcpy( newnode->prefix, prefix, prefix_len );
+	}
+
+	return newnode;
+}
+
+/* Release a node back to the arena (private) */
+void HashTree_Node_Free( HashTree_Arena *arena, HashTree_Node *node ) {
+	HashTree_Arena_Release( arena, node, sizeof( HashTree_Node ) + node->prefix_len );
+}
+
+/* Create an empty tree: the header, its arena and a root node */
 HashTree HashTree_Init() {
-	HashTree newht;
-	
-	newht = malloc( sizeof( HashTree_Node ) );
-	if( newht != NULL ) {
-		newht->bid = 0x00;
-		newht->subnode_count = 0;
-		newht->subnode = NULL;
-		newht->data = NULL;
-	}
-	
-	return newht;
+	HashTree newtree;
+
+	newtree = malloc( sizeof( HashTree_Header ) );
+	if( newtree != NULL ) {
+		HashTree_Arena_Init( &newtree->arena );
+		newtree->root = HashTree_Node_Init( &newtree->arena, 0x00, NULL, 0, NULL );
+		newtree->max_key_len = 0;
+		newtree->count = 0;
+		newtree->image = NULL;
+		newtree->map = NULL;
+		newtree->family = NULL;
+		newtree->snapshot = false;
+		if( newtree->root == NULL ) {
+			free( newtree );
+			newtree = NULL;
+		}
+	}
+
+	return newtree;
 }
 
-/* Recursivly free nodes in a tree */
+/* Create an empty tree over the chosen backend */
+HashTree HashTree_InitBackend( int backend ) {
+	HashTree newtree;
+
+	if( backend == HASHTREE_BACKEND_TRIE )
+		return HashTree_Init();
+	if( backend != HASHTREE_BACKEND_HASHMAP )
+		return NULL /* error */;
+
+	newtree = malloc( sizeof( HashTree_Header ) );
+	if( newtree != NULL ) {
+		HashTree_Arena_Init( &newtree->arena );
+		newtree->root = NULL;
+		newtree->max_key_len = 0;
+		newtree->count = 0;
+		newtree->image = NULL;
+		newtree->family = NULL;
+		newtree->snapshot = false;
+		newtree->map = HashMap_Init();
+		if( newtree->map == NULL ) {
+			free( newtree );
+			newtree = NULL;
+		}
+	}
+
+	return newtree;
+}
+
+int HashTree_Backend( HashTree ht ) {
+	return ht->map != NULL ? HASHTREE_BACKEND_HASHMAP : HASHTREE_BACKEND_TRIE;
+}
+
+/* Every node and listing lives in the arena, so the tree goes in one sweep */
 void HashTree_Free( HashTree *ht ) {
-	for( int ix = 0; ix < (*ht)->subnode_count; ix++ )
-		HashTree_Free( (*ht)->subnode + ix * sizeof( HashTree_Node * ) );
-	
-	if( (*ht)->subnode != NULL )
-		free( (*ht)->subnode );
-	
+	HashTree_Sync *sync = (*ht)->arena.sync;
+
+	/* Nodes shared with snapshots have to be let go one by one */
+	if( (*ht)->family != NULL ) {
+		HashTree_Snapshot_Free( *ht );
+		*ht = NULL;
+		return;
+	}
+
+	if( (*ht)->image != NULL )
+		HashTree_Image_Unmap( *ht );
+	if( (*ht)->map != NULL )
+		HashMap_Free( &(*ht)->map );
+	HashTree_Arena_Free( &(*ht)->arena );
+	if( sync != NULL )
+		HashTree_Sync_Free( sync );
 	free( *ht );
 	*ht = NULL;
 }
 
-/* Assign data to the tree recursivly adding nodes as needed */
-void HashTree_Assign( HashTree ht,  const void *hash, size_t hash_len, void *data ) {
-	int index;
-	
-	/* Assign data if there are no more bytes in the hash */
-	if( hash_len == 0 ) {
-		ht->data = data;
+/* Length of the common run of prefix and key (private) */
+size_t HashTree_Node_Match( HashTree_Node *node, const unsigned char *key, size_t key_len ) {
+	size_t limit = node->prefix_len < key_len ? node->prefix_len : key_len;
+	size_t matched = 0;
+
+	while( matched < limit && node->prefix[matched] == key[matched] )
+		matched++;
+
+	return matched;
+}
+
+/* Assign data to the tree, adding and splitting nodes as needed */
+void HashTree_Assign( HashTree ht, const void *hash, size_t hash_len, void *data ) {
+	const unsigned char *key = hash;
+	HashTree_Node *node = ht->root;
+
+	if( ht->arena.sync != NULL ) {
+		HashTree_Concurrent_Assign( ht, hash, hash_len, data );
 		return;
 	}
-	
-	/* Create new subnode list if empty */
-	if( ht->subnode == NULL ) {
-		ht->subnode = malloc( sizeof( HashTree_Node * ) );
-		
-		if( ht->subnode == NULL )
-			return /* error */;
-		
-		ht->subnode_count = 1;
-		ht->subnode[0] = NULL;
-		index = 0;
-	} else {
-		/* find the index of the next node */
-		int start, end, mid;
-		start = 0;
-		end = ht->subnode_count - 1;
-		do {
-			mid = (start + end) / 2;
-			if( ht->subnode[mid]->bid > ((unsigned char *)(hash))[0] ) {
-				end = mid;
-			} else if ( ht->subnode[mid]->bid < ((unsigned char *)(hash))[0] ) {
-				start = mid; 
-			}
-		} while( start != end || ht->subnode[mid]->bid != ((unsigned char *)(hash))[0] );
-		
-		/* open a space for the subnode if one does not exist */
-		if( ht->subnode[mid]->bid != ((unsigned char *)(hash))[0] ) {
-			HashTree_Node **tmp;
-			tmp = malloc( sizeof( HashTree_Node * ) * ht->subnode_count + 1 );
-			if( tmp == NULL )
+
+	if( ht->map != NULL ) {
+		HashMap_Assign( ht->map, hash, hash_len, data );
+		return;
+	}
+
+	/* Mapped images and snapshots are read-only */
+	if( ht->image != NULL || ht->snapshot )
+		return;
+
+	/* NULL marks an absent entry, so storing it is a release */
+	if( data == NULL ) {
+		HashTree_Release( ht, hash, hash_len );
+		return;
+	}
+
+	/* With snapshots about, every node on the path is copied unless it is ours alone */
+	if( ht->family != NULL && (node = HashTree_Node_Own( &ht->arena, &ht->root )) == NULL )
+		return /* error */;
+
+	if( hash_len > ht->max_key_len )
+		ht->max_key_len = hash_len;
+
+	while( hash_len > 0 ) {
+		HashTree_Node **slot, *child, *split;
+		size_t matched;
+
+		slot = HashTree_Node_Child( node, key[0] );
+
+		/* No branch yet: the rest of the key becomes a single new node */
+		if( slot == NULL ) {
+			child = HashTree_Node_Init( &ht->arena, key[0], key + 1, hash_len - 1, data );
+			if( child == NULL )
 				return /* error */;
-			memcpy( tmp, ht->subnode, sizeof( HashTree_Node * ) * (mid - 1) );
-			memcpy( tmp + mid + 1, ht->subnode + mid, sizeof( HashTree_Node * ) * (ht->subnode_count - mid - 1) );
-			tmp[mid] = NULL;
-			free( ht->subnode );
-			ht->subnode = tmp;
+			if( !HashTree_Node_AddChild( &ht->arena, node, child ) ) {
+				HashTree_Node_Free( &ht->arena, child );
+				return /* error */;
+			}
+			ht->count++;
+			return;
 		}
-		
-		index = mid;
-	}
-	
-	/* Create new subnode if not exists */
-	if( ht->subnode[index] == NULL ) {
-		ht->subnode[index] = malloc( sizeof( HashTree_Node ) );
-		if( ht->subnode[index] == NULL )
+
+		child = ht->family != NULL ? HashTree_Node_Own( &ht->arena, slot ) : *slot;
+		if( child == NULL )
 			return /* error */;
-		
-		ht->subnode[index]->bid = ((unsigned char *)(hash))[0];
-		ht->subnode[index]->subnode_count = 0;
-		ht->subnode[index]->subnode = NULL;
-		ht->subnode[index]->data = NULL;
-	}
-	
-	HashTree_Assign( ht->subnode[index], hash + 1, hash_len - 1, data );
+		matched = HashTree_Node_Match( child, key + 1, hash_len - 1 );
+
+		/* Key diverges inside the child's prefix: split the child at that point */
+		if( matched < child->prefix_len ) {
+			split = HashTree_Node_Init( &ht->arena, child->bid, child->prefix, matched, NULL );
+			if( split == NULL )
+				return /* error */;
+
+			child->bid = child->prefix[matched];
+			child->prefix_len -= matched + 1;
+			memmove( child->prefix, child->prefix + matched + 1, child->prefix_len );
+
+			if( !HashTree_Node_AddChild( &ht->arena, split, child ) ) {
+				/* Undo the cut so the tree is left as it was */
+				memmove( child->prefix + matched + 1, child->prefix, child->prefix_len );
+				child->prefix_len += matched + 1;
+				child->prefix[matched] = child->bid;
+				child->bid = split->bid;
+				HashTree_Node_Free( &ht->arena, split );
+				return /* error */;
+			}
+
+			*slot = split;
+			child = split;
+		}
+
+		node = child;
+		key += matched + 1;
+		hash_len -= matched + 1;
+	}
+
+	if( node->data == NULL )
+		ht->count++;
+	node->data = data;
 }
 
-/* Recursivly find stored data by it's hash */
-void *HashTree_Retrive( HashTree ht, const void *hash, size_t hash_len ) {
-	int start, end, mid;
-	
-	if( hash_len == 0 ) {
-		return ht->data;
+/* Find stored data by it's hash */
+void *HashTree_Retrieve( HashTree ht, const void *hash, size_t hash_len ) {
+	const unsigned char *key = hash;
+	HashTree_Node *node = ht->root, **slot;
+
+	if( ht->arena.sync != NULL )
+		return HashTree_Concurrent_Retrieve( ht, hash, hash_len );
+	if( ht->map != NULL )
+		return HashMap_Retrieve( ht->map, hash, hash_len );
+	if( ht->image != NULL )
+		return HashTree_Image_Retrieve( ht, hash, hash_len );
+
+	while( hash_len > 0 ) {
+		slot = HashTree_Node_Child( node, key[0] );
+		if( slot == NULL )
+			return NULL;
+
+		node = *slot;
+		if( node->prefix_len > hash_len - 1 || memcmp( node->prefix, key + 1, node->prefix_len ) != 0 )
+			return NULL;
+
+		key += node->prefix_len + 1;
+		hash_len -= node->prefix_len + 1;
 	}
-	
-	start = 0;
-	end = ht->subnode_count - 1;
-	do {
-		mid = (start + end) / 2;
-		if( ht->subnode[mid]->bid > ((unsigned char *)(hash))[0] ) {
-			end = mid;
-		} else if ( ht->subnode[mid]->bid < ((unsigned char *)(hash))[0] ) {
-			start = mid; 
-		}
-	} while( start != end || ht->subnode[mid]->bid != ((unsigned char *)(hash))[0] );
-	
-	if( ht->subnode[mid]->bid != ((unsigned char *)(hash))[0] ) {
-		return NULL;
-	} else {
-		return HashTree_Retrive( ht->subnode[mid], hash + 1, hash_len - 1 );
+
+	return node->data;
+}
+
+/* One lookup in flight in HashTree_RetrieveMany (private) */
+typedef struct {
+	int index;				/* into the caller's arrays; -1 when the lane is idle */
+	const unsigned char *key;
+	size_t len;
+	HashTree_Node *node;
+	bool listing;			/* waiting on node's listing rather than on node itself */
+} HashTree_Lane;
+
+/* Prefetch the line of node's listing that a search for bid will read first (private) */
+void HashTree_Node_Prefetch( HashTree_Node *node, unsigned char bid ) {
+	void *listing = node->subnode;
+
+	if( listing == NULL )
+		return;
+
+	switch( node->kind ) {
+		case HASHTREE_NODE48:
+			__builtin_prefetch( &((HashTree_Node48 *)listing)->index[bid], 0 );
+			break;
+		case HASHTREE_NODE256:
+			__builtin_prefetch( &((HashTree_Node256 *)listing)->child[bid], 0 );
+			break;
+		default:
+			__builtin_prefetch( listing, 0 );
 	}
 }
 
-/* Discard data from the tree, recursivly clearing unused nodes */
-void HashTree_Release( HashTree ht, const void *hash, size_t hash_len ) {
-	int start, end, mid, new_subnode_count;
-	HashTree_Node **new_subnode;
-	
-	/* Find the target data and release it from our memory    *
-	 *   It is up to the user to free the actual data stored. */
-	if( hash_len == 0 ) {
-		ht->data = NULL;
+/* Batched lookups; each lane takes the next key as soon as its last one resolves */
+void HashTree_RetrieveMany( HashTree ht, const void **hashes, const size_t *hash_lens, void **out, int n ) {
+	HashTree_Lane lane[HASHTREE_BATCH];
+	int next = 0, active = 0;
+
+	/* The concurrent lookup has its own validation to do per step */
+	if( ht->arena.sync != NULL ) {
+		for( int ix = 0; ix < n; ix++ )
+			out[ix] = HashTree_Concurrent_Retrieve( ht, hashes[ix], hash_lens[ix] );
 		return;
 	}
-	
-	start = 0;
-	end = ht->subnode_count - 1;
+	if( ht->map != NULL ) {
+		for( int ix = 0; ix < n; ix++ )
+			out[ix] = HashMap_Retrieve( ht->map, hashes[ix], hash_lens[ix] );
+		return;
+	}
+	if( ht->image != NULL ) {
+		for( int ix = 0; ix < n; ix++ )
+			out[ix] = HashTree_Image_Retrieve( ht, hashes[ix], hash_lens[ix] );
+		return;
+	}
+
+	for( int ix = 0; ix < HASHTREE_BATCH; ix++ )
+		lane[ix].index = -1;
+
 	do {
-		mid = (start + end) / 2;
-		if( ht->subnode[mid]->bid > ((unsigned char *)(hash))[0] ) {
-			end = mid;
-		} else if ( ht->subnode[mid]->bid < ((unsigned char *)(hash))[0] ) {
-			start = mid; 
+		for( int ix = 0; ix < HASHTREE_BATCH; ix++ ) {
+			HashTree_Lane *ln = &lane[ix];
+
+			/* Feed idle lanes; a fresh lookup starts with the root's prefix already matched */
+			if( ln->index < 0 ) {
+				if( next >= n )
+					continue;
+				ln->index = next++;
+				if( next + HASHTREE_BATCH < n )
+					__builtin_prefetch( hashes[next + HASHTREE_BATCH], 0 );
+				ln->key = hashes[ln->index];
+				ln->len = hash_lens[ln->index];
+				ln->node = ht->root;
+				ln->listing = false;
+				active++;
+			} else if( ln->listing ) {
+				/* Listing arrived: pick the branch and prefetch the node it leads to */
+				HashTree_Node **slot = HashTree_Node_Child( ln->node, ln->key[0] );
+				if( slot == NULL ) {
+					out[ln->index] = NULL;
+					ln->index = -1;
+					active--;
+					continue;
+				}
+				ln->node = *slot;
+				ln->listing = false;
+				__builtin_prefetch( ln->node, 0 );
+				continue;
+			} else {
+				/* Node arrived: it must spell out the next stretch of the key */
+				HashTree_Node *node = ln->node;
+				if( node->prefix_len > ln->len - 1 || memcmp( node->prefix, ln->key + 1, node->prefix_len ) != 0 ) {
+					out[ln->index] = NULL;
+					ln->index = -1;
+					active--;
+					continue;
+				}
+				ln->key += node->prefix_len + 1;
+				ln->len -= node->prefix_len + 1;
+			}
+
+			if( ln->len == 0 ) {
+				out[ln->index] = ln->node->data;
+				ln->index = -1;
+				active--;
+				continue;
+			}
+
+			HashTree_Node_Prefetch( ln->node, ln->key[0] );
+			ln->listing = true;
 		}
-	} while( start != end || ht->subnode[mid]->bid != ((unsigned char *)(hash))[0] );
-	
-	if( ht->subnode[mid]->bid != ((unsigned char *)(hash))[0] ) {
+	} while( active > 0 || next < n );
+}
+
+/* Fold a dataless node with a single subnode into that subnode, storing the result in slot
+ *   (the node's place in its parent); returns the node now standing in its place */
+HashTree_Node *HashTree_Node_Merge( HashTree_Arena *arena, HashTree_Node *node, HashTree_Node **slot ) {
+	int cursor = 0;
+	HashTree_Node *child = HashTree_Node_Next( node, &cursor ), *merged;
+	size_t prefix_len = node->prefix_len + 1 + child->prefix_len;
+
+	merged = HashTree_Arena_Alloc( arena, sizeof( HashTree_Node ) + prefix_len );
+	if( merged == NULL )
+		return node /* error: leave the chain uncompressed */;
+
+	*merged = *child;
+	memcpy( merged->prefix, node->prefix, node->prefix_len );
+	merged->prefix[node->prefix_len] = child->bid;
+	memcpy( merged->prefix + node->prefix_len + 1, child->prefix, child->prefix_len );
+	merged->prefix_len = prefix_len;
+	merged->bid = node->bid;
+	merged->version = 0;
+	merged->refs = 1;
+	__atomic_store_n( slot, merged, __ATOMIC_RELEASE );
+
+	HashTree_Arena_Release( arena, node->subnode, HashTree_Node_Size[node->kind] );
+	HashTree_Node_Free( arena, child );
+	HashTree_Node_Free( arena, node );
+	return merged;
+}
+
+/* Discard data from the tree, removing and merging unused nodes */
+void HashTree_Release( HashTree ht, const void *hash, size_t hash_len ) {
+	const unsigned char *key = hash;
+	HashTree_Node *node = ht->root, *parent = NULL;
+	HashTree_Node **slot = NULL, **parent_slot = NULL;
+
+	if( ht->arena.sync != NULL ) {
+		HashTree_Concurrent_Release( ht, hash, hash_len );
 		return;
-	} else {
-		HashTree_Retrive( ht->subnode[mid], hash + 1, hash_len - 1 );
-	}
-	
-	/* Clear unused nodes in this branch */
-	new_subnode_count = 0;
-	for( int index = 0; index < ht->subnode_count; index++ ) {
-		if( ht->subnode[index]->data == NULL && ht->subnode[index]->subnode == NULL ) {
-			free( ht->subnode[index] );
-			ht->subnode[index] = NULL;
-		} else {
-			ht->subnode[new_subnode_count++] = ht->subnode[index];
-		}
 	}
-	
-	if( new_subnode_count != 0 ) {
-		HashTree_Node **new_subnode;
-		new_subnode = malloc( sizeof( HashTree_Node * ) * new_subnode_count );
-		if( new_subnode != NULL ) {
-			memcpy( new_subnode, ht->subnode, sizeof( HashTree_Node * ) * new_subnode_count );
-			free( ht->subnode );
-			ht->subnode = new_subnode;
-		}
-	} else {
-		free( ht->subnode );
-		ht->subnode = NULL;
+	if( ht->map != NULL ) {
+		HashMap_Release( ht->map, hash, hash_len );
+		return;
+	}
+	if( ht->image != NULL || ht->snapshot )
+		return;
+
+	/* With snapshots about, the path is copied on the way down; only go if there is something to release */
+	if( ht->family != NULL ) {
+		if( HashTree_Retrieve( ht, hash, hash_len ) == NULL )
+			return;
+		if( (node = HashTree_Node_Own( &ht->arena, &ht->root )) == NULL )
+			return /* error */;
+	}
+
+	/* Find the target node, remembering the two slots above it */
+	while( hash_len > 0 ) {
+		HashTree_Node **next, *child;
+
+		next = HashTree_Node_Child( node, key[0] );
+		if( next == NULL )
+			return;
+
+		child = *next;
+		if( child->prefix_len > hash_len - 1 || memcmp( child->prefix, key + 1, child->prefix_len ) != 0 )
+			return;
+		if( ht->family != NULL && (child = HashTree_Node_Own( &ht->arena, next )) == NULL )
+			return /* error */;
+
+		parent_slot = slot;
+		slot = next;
+		parent = node;
+		node = child;
+		key += child->prefix_len + 1;
+		hash_len -= child->prefix_len + 1;
+	}
+
+	/* Release the data from our memory;
+	 *   It is up to the user to free the actual data stored. */
+	if( node->data != NULL )
+		ht->count--;
+	node->data = NULL;
+
+	/* The root always stays */
+	if( parent == NULL )
+		return;
+
+	if( node->subnode_count == 0 ) {
+		/* Remove the empty leaf; its parent may be left as a bare link in a chain */
+		HashTree_Node_DelChild( &ht->arena, parent, node->bid );
+		HashTree_Node_Free( &ht->arena, node );
+
+		/* Merging takes over the remaining subnode, so that has to be ours as well */
+		if( parent_slot != NULL && parent->data == NULL && parent->subnode_count == 1
+				&& (ht->family == NULL || HashTree_Node_OwnChild( &ht->arena, parent )) )
+			HashTree_Node_Merge( &ht->arena, parent, parent_slot );
+	} else if( node->subnode_count == 1 && (ht->family == NULL || HashTree_Node_OwnChild( &ht->arena, node )) ) {
+		HashTree_Node_Merge( &ht->arena, node, slot );
 	}
-	
-	ht->subnode_count = new_subnode_count;
 }
 
 /* Count HashTree Entries */
-void HashTree_Count_Foreach_Callback( void *count, const void *hash, size_t hlen, void *entry ) {
-	(*((size_t *)count))++;
+size_t HashTree_Count( HashTree ht ) {
+	if( ht->map != NULL )
+		return HashMap_Count( ht->map );
+	return __atomic_load_n( &ht->count, __ATOMIC_RELAXED );
 }
 
-size_t HashTree_Count( HashTree ht ) {
-	size_t result = 0;
-	HashTree_Foreach( ht, &HashTree_Count_Foreach_Callback, &result, 1 );
-	return result;
+/* Gather Statistics */
+bool HashTree_Stats( HashTree ht, HashTree_Statistics *stats ) {
+	struct { HashTree_Node *node; int cursor; } *frame;
+	size_t depth_sum = 0;
+	int depth = 0;
+
+	memset( stats, 0, sizeof( HashTree_Statistics ) );
+	stats->entries = HashTree_Count( ht );
+
+	if( ht->image != NULL ) {
+		stats->bytes = HashTree_Image_Length( ht );
+		return true;
+	}
+	if( ht->map != NULL ) {
+		stats->bytes = HashMap_Bytes( ht->map );
+		return true;
+	}
+
+	frame = malloc( sizeof( *frame ) * (ht->max_key_len + 1) );
+	if( frame == NULL )
+		return false /* error */;
+
+	/* Each node is tallied as it is first reached; its depth is its place on the stack */
+	frame[0].node = ht->root;
+	frame[0].cursor = -1;
+	while( depth >= 0 ) {
+		HashTree_Node *node = frame[depth].node, *child;
+
+		if( frame[depth].cursor < 0 ) {
+			frame[depth].cursor = 0;
+			stats->nodes++;
+			stats->bytes += HashTree_Arena_Footprint( sizeof( HashTree_Node ) + node->prefix_len );
+			stats->fanout[node->subnode_count]++;
+			if( node->subnode != NULL ) {
+				stats->bytes += HashTree_Arena_Footprint( HashTree_Node_Size[node->kind] );
+				stats->kind[node->kind]++;
+				stats->wasted_slots += HashTree_Node_Capacity[node->kind] - node->subnode_count;
+			}
+			if( node->data != NULL )
+				depth_sum += depth;
+			if( (size_t)depth > stats->max_depth )
+				stats->max_depth = depth;
+		}
+
+		child = HashTree_Node_Next( node, &frame[depth].cursor );
+		if( child == NULL ) {
+			depth--;
+			continue;
+		}
+
+		depth++;
+		frame[depth].node = child;
+		frame[depth].cursor = -1;
+	}
+
+	if( stats->entries > 0 )
+		stats->avg_depth = (double)depth_sum / stats->entries;
+
+	free( frame );
+	return true;
 }
@@ -5,30 +5,81 @@
  * @details
  *   A Hashtree is a key-value pair structure for storing and retriving data
  *    where the key and the value can be of any type, like a primitive form of C++'s std::map.
+ *   The tree is path compressed (a PATRICIA/radix tree): a chain of nodes with a single
+ *    child and no data is kept as one node holding the chain's bytes as its prefix,
+ *    so a lookup only visits the points where stored keys branch apart.
+ *   Each node keeps its subnodes in the smallest of four listing kinds that fits (4, 16,
+ *    48 or 256 entries, as in an adaptive radix tree) with the branch bytes held beside
+ *    the pointers, so choosing a branch never touches the subnodes themselves.
+ *   Nodes and listings come from an arena owned by the tree, so building and releasing
+ *    entries reuses memory by size class and freeing the tree releases it in bulk.
  */
 
 #include <stdlib.h>
+#include <stdbool.h>
 
 #ifndef INCLUDED_HASHTREE_H
 #define INCLUDED_HASHTREE_H
 
-typedef struct HashTree_Node {
-	/* Branch Identifier */
-	unsigned char bid;
-	
-	/* Subnode Listing */
-	unsigned char subnode_count;
-	struct HashTree_Node **subnode;
-	
-	/* Data Attachment */
-	void *data;
-} HashTree_Node;
+/* Backends: what a tree keeps its entries in */
+#define HASHTREE_BACKEND_TRIE 0		/* the path compressed trie: ordered, prefix queries */
+#define HASHTREE_BACKEND_HASHMAP 1	/* a flat HashMap: point lookups only, no order */
 
-typedef HashTree_Node *HashTree;
+/* Node Kinds: how many subnodes a node's listing has room for */
+#define HASHTREE_NODE4 0
+#define HASHTREE_NODE16 1
+#define HASHTREE_NODE48 2
+#define HASHTREE_NODE256 3
+
+/* Tree Header; its layout is private to the hashtree sources */
+typedef struct HashTree_Header *HashTree;
 
 /* Constructor */
 HashTree HashTree_Init();
 
+/* Backend Constructor: HASHTREE_BACKEND_TRIE gives the same tree as HashTree_Init.
+ *   HASHTREE_BACKEND_HASHMAP keeps the entries in a HashMap, so Retrieve costs one hash and
+ *   a probe rather than a step per key byte; Assign, Retrieve, RetrieveMany, Release,
+ *   Foreach, Count and Stats work as usual (Foreach in no particular order).  ForeachPrefix
+ *   (unordered), Range and the neighbour lookups check every entry, so cost O(n) here;
+ *   HashTree_Save fails. */
+HashTree HashTree_InitBackend( int backend );
+
+/* Which backend a tree was created with */
+int HashTree_Backend( HashTree ht );
+
+/* Concurrent Constructor: Assign, Retrieve and Release may then be called from any number
+ *   of threads at once.  Retrieve takes no locks: it reads each node's version, follows the
+ *   node and checks the version again, starting over if a writer got in between.  Writers
+ *   lock just the nodes they change, and memory they unlink is recycled only once every
+ *   thread that might still be reading it has moved on.  Count may be read at any time;
+ *   everything else (Foreach, Stats, the ordered queries and Free) needs the writers to be quiet. */
+HashTree HashTree_InitConcurrent();
+
+/* Bulk Constructor: build a tree from n key-value pairs in one pass, bottom-up.
+ *   Input already in key order is used as-is, anything else is sorted first; where a key
+ *   repeats the last value given wins, and NULL values are left out.  With threads > 1
+ *   the subtrees under each first byte are built in parallel.  Returns NULL on failure. */
+HashTree HashTree_BulkLoad( const void **keys, const size_t *lens, void **values, size_t n, int threads );
+
+/* Mapped Constructor: open an image written by HashTree_Save read-only, straight from the
+ *   file with mmap.  Retrieve, RetrieveMany, Foreach, ForeachPrefix and Count answer from the
+ *   mapped bytes without deserializing anything; the entries they hand back point at the
+ *   serialized bytes inside the mapping (see HashTree_MappedSize) and stay valid until Free.
+ *   Assign and Release leave the tree untouched; Range and the neighbour lookups check every entry.
+ *   Returns NULL if the file cannot be mapped or is not an image. */
+HashTree HashTree_Map( const char *path );
+
+/* Snapshot: an immutable view of the tree as it is now, taken in O(1).
+ *   The snapshot shares every node with the tree; from then on Assign and Release copy the
+ *   nodes on the path they change instead of changing them in place, so the snapshot never
+ *   sees a write, and a node goes back to the arena only once nothing refers to it.
+ *   Snapshots answer every query but ignore Assign and Release, may be read (and freed) from
+ *   other threads while the tree is written to, and are freed with HashTree_Free, before or
+ *   after the tree itself.  Taking one needs the writers to be quiet; concurrent trees, mapped
+ *   images and the hashmap backend cannot be snapshotted.  Returns NULL on failure. */
+HashTree HashTree_Snapshot( HashTree ht );
+
 /* Descrtuctor */
 void HashTree_Free( HashTree *ht );
 
@@ -38,13 +89,64 @@ void HashTree_Assign( HashTree ht, const void *hash, size_t hash_len, void *data
 /* Data Retreival */
 void *HashTree_Retrieve( HashTree ht, const void *hash, size_t hash_len );
 
+/* Batched Retreival: out[ix] receives the data stored under hashes[ix] (or NULL).
+ *   Up to HASHTREE_BATCH lookups advance in lockstep, each prefetching the next node
+ *   or listing it needs while the others work, so their memory stalls overlap. */
+#define HASHTREE_BATCH 16
+void HashTree_RetrieveMany( HashTree ht, const void **hashes, const size_t *hash_lens, void **out, int n );
+
 /* Data Release (Unassignment) */
 void HashTree_Release( HashTree ht, const void *hash, size_t hash_len );
 
-/* Foreach Entry */
+/* Foreach Entry; the hash passed to the callback is only valid for the duration of that call.
+ *   With threads > 1 the top-level subtrees are shared out between workers, which steal
+ *   from one another when they run dry, so callbacks arrive in no particular order. */
 void HashTree_Foreach( HashTree ht, void (*callback)(void * /* data */, const void * /* hash */, size_t /* hash_len */, void * /* entry */), void *data, int threads );
 
-/* Entry Count */
+/* Ordered Access
+ *   Keys order byte by byte as unsigned values, with a key sorting before every key it is a prefix of.
+ *   Each walk only descends into subtrees that can hold keys in the requested span.
+ *   As with Foreach, the hash passed to a callback is only valid for the duration of that call. */
+
+/* Visit every entry whose key begins with prefix, in order */
+void HashTree_ForeachPrefix( HashTree ht, const void *prefix, size_t prefix_len, void (*callback)(void * /* data */, const void * /* hash */, size_t /* hash_len */, void * /* entry */), void *data );
+
+/* Visit every entry with lo <= key < hi, in order; a NULL hi leaves the range open-ended */
+void HashTree_Range( HashTree ht, const void *lo, size_t lo_len, const void *hi, size_t hi_len, void (*callback)(void * /* data */, const void * /* hash */, size_t /* hash_len */, void * /* entry */), void *data );
+
+/* Find the first entry with key >= hash (LowerBound), key > hash (Successor) or the last with key < hash (Predecessor);
+ *   returns false if there is none.  When key is not NULL it receives a copy of the entry's key.
+ *   WARNING: failing to free( *key ) when you are done with it will result in a memory leak! */
+bool HashTree_LowerBound( HashTree ht, const void *hash, size_t hash_len, void **key, size_t *key_len, void **entry );
+bool HashTree_Successor( HashTree ht, const void *hash, size_t hash_len, void **key, size_t *key_len, void **entry );
+bool HashTree_Predecessor( HashTree ht, const void *hash, size_t hash_len, void **key, size_t *key_len, void **entry );
+
+/* Serialization: write the tree to path as a flat image with offsets in place of pointers.
+ *   serialize is called once per entry and must point *bytes at the entry's serialized form
+ *   and set *len; those bytes are copied out before the next call.  Images use the native
+ *   byte order.  Returns false (leaving no file behind) on failure. */
+bool HashTree_Save( HashTree ht, const char *path, void (*serialize)(void * /* data */, void * /* entry */, const void ** /* bytes */, size_t * /* len */), void *data );
+
+/* Length of the serialized bytes behind an entry of a mapped tree */
+size_t HashTree_MappedSize( const void *entry );
+
+/* Entry Count; kept up to date by every change, so this costs nothing */
 size_t HashTree_Count( HashTree );
 
+/* Shape and Memory Statistics */
+typedef struct {
+	size_t entries;
+	size_t nodes;
+	size_t bytes;		/* arena memory taken by nodes and listings, as rounded by the arena */
+	size_t max_depth;	/* nodes below the root on the longest path */
+	double avg_depth;	/* nodes below the root, averaged over entries */
+	size_t fanout[257];	/* nodes by number of subnodes */
+	size_t kind[4];		/* listings by kind (HASHTREE_NODE4 .. HASHTREE_NODE256) */
+	size_t wasted_slots;	/* child slots allocated in listings but unused */
+} HashTree_Statistics;
+
+/* Walk the whole tree to fill in stats; returns false on failure.
+ *   For a mapped tree or the hashmap backend only entries and bytes are reported. */
+bool HashTree_Stats( HashTree ht, HashTree_Statistics *stats );
+
 #endif
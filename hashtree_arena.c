@@ -0,0 +1,249 @@
+/* Size-classed arena backing the nodes and listings of a hashtree */
+
+#include "hashtree_internal.h"
+#include <string.h>
+
+/* Header placed before every oversized block */
+typedef struct HashTree_Arena_Large {
+	struct HashTree_Arena_Large *prev, *next;
+} HashTree_Arena_Large;
+
+#define HashTree_Arena_Class( size ) (((size) + HASHTREE_ARENA_GRAIN - 1) / HASHTREE_ARENA_GRAIN - 1)
+
+void HashTree_Arena_Init( HashTree_Arena *arena ) {
+	memset( arena, 0, sizeof( HashTree_Arena ) );
+	arena->chunk_size = HASHTREE_ARENA_CHUNK_MIN;
+}
+
+/* Bulk release; nothing handed out by the arena survives this */
+void HashTree_Arena_Free( HashTree_Arena *arena ) {
+	while( arena->chunks != NULL ) {
+		void *next = *(void **)arena->chunks;
+		free( arena->chunks );
+		arena->chunks = next;
+	}
+
+	while( arena->large != NULL ) {
+		HashTree_Arena_Large *next = ((HashTree_Arena_Large *)arena->large)->next;
+		free( arena->large );
+		arena->large = next;
+	}
+
+	HashTree_Arena_Init( arena );
+}
+
+/* Concurrent mode serializes the arena behind the tree's mutex, snapshots behind the family's */
+void *HashTree_Arena_Carve( HashTree_Arena *arena, size_t size );
+
+void *HashTree_Arena_Alloc( HashTree_Arena *arena, size_t size ) {
+	void *block;
+
+	if( arena->lock != NULL ) {
+		pthread_mutex_lock( arena->lock );
+		block = HashTree_Arena_Carve( arena, size );
+		pthread_mutex_unlock( arena->lock );
+		return block;
+	}
+
+	if( arena->sync == NULL )
+		return HashTree_Arena_Carve( arena, size );
+
+	pthread_mutex_lock( &arena->sync->mutex );
+	block = HashTree_Arena_Carve( arena, size );
+	pthread_mutex_unlock( &arena->sync->mutex );
+	return block;
+}
+
+/* Allocation proper (private) */
+void *HashTree_Arena_Carve( HashTree_Arena *arena, size_t size ) {
+	size_t class, rounded;
+	void *block;
+
+	if( size == 0 )
+		size = 1;
+
+	/* Oversized: straight from malloc, linked in for the bulk release */
+	if( size > HASHTREE_ARENA_GRAIN * HASHTREE_ARENA_CLASSES ) {
+		HashTree_Arena_Large *large = malloc( sizeof( HashTree_Arena_Large ) + size );
+		if( large == NULL )
+			return NULL /* error */;
+		large->prev = NULL;
+		large->next = arena->large;
+		if( large->next != NULL )
+			large->next->prev = large;
+		arena->large = large;
+		return large + 1;
+	}
+
+	/* Reuse a freed block of the same class first */
+	class = HashTree_Arena_Class( size );
+	if( arena->free[class] != NULL ) {
+		block = arena->free[class];
+		arena->free[class] = *(void **)block;
+		return block;
+	}
+
+	/* Otherwise carve from the newest chunk, starting a larger one when it runs dry;
+	 *   the leftover tail of the old chunk is abandoned until the bulk release */
+	rounded = (class + 1) * HASHTREE_ARENA_GRAIN;
+	if( arena->remain < rounded ) {
+		void *chunk = malloc( arena->chunk_size );
+		if( chunk == NULL )
+			return NULL /* error */;
+		*(void **)chunk = arena->chunks;
+		arena->chunks = chunk;
+		arena->cursor = (unsigned char *)chunk + HASHTREE_ARENA_GRAIN;
+		arena->remain = arena->chunk_size - HASHTREE_ARENA_GRAIN;
+		if( arena->chunk_size < HASHTREE_ARENA_CHUNK_MAX )
+			arena->chunk_size *= 2;
+	}
+
+	block = arena->cursor;
+	arena->cursor += rounded;
+	arena->remain -= rounded;
+	return block;
+}
+
+/* Memory a block of size really takes from the arena */
+size_t HashTree_Arena_Footprint( size_t size ) {
+	if( size == 0 )
+		size = 1;
+	if( size > HASHTREE_ARENA_GRAIN * HASHTREE_ARENA_CLASSES )
+		return sizeof( HashTree_Arena_Large ) + size;
+	return (HashTree_Arena_Class( size ) + 1) * HASHTREE_ARENA_GRAIN;
+}
+
+/* Return a block; size must be the size it was allocated with.
+ *   In concurrent mode the block is only retired here, readers may still be inside it */
+void HashTree_Arena_Retire( HashTree_Arena *arena, void *block, size_t size );
+void HashTree_Arena_Recycle( HashTree_Arena *arena, void *block, size_t size );
+
+void HashTree_Arena_Release( HashTree_Arena *arena, void *block, size_t size ) {
+	if( block == NULL )
+		return;
+
+	if( arena->sync != NULL ) {
+		HashTree_Arena_Retire( arena, block, size );
+		return;
+	}
+
+	if( arena->lock != NULL ) {
+		pthread_mutex_lock( arena->lock );
+		HashTree_Arena_Recycle( arena, block, size );
+		pthread_mutex_unlock( arena->lock );
+		return;
+	}
+
+	HashTree_Arena_Recycle( arena, block, size );
+}
+
+/* Hand a block back for reuse at once (private) */
+void HashTree_Arena_Recycle( HashTree_Arena *arena, void *block, size_t size ) {
+	size_t class;
+
+	if( size == 0 )
+		size = 1;
+
+	if( size > HASHTREE_ARENA_GRAIN * HASHTREE_ARENA_CLASSES ) {
+		HashTree_Arena_Large *large = (HashTree_Arena_Large *)block - 1;
+		if( large->prev != NULL ) {
+			large->prev->next = large->next;
+		} else {
+			arena->large = large->next;
+		}
+		if( large->next != NULL )
+			large->next->prev = large->prev;
+		free( large );
+		return;
+	}
+
+	class = HashTree_Arena_Class( size );
+	*(void **)block = arena->free[class];
+	arena->free[class] = block;
+}
+
+/* Take over everything src has handed out, leaving src empty;
+ *   the unused tail of src's newest chunk is given up */
+void HashTree_Arena_Adopt( HashTree_Arena *dest, HashTree_Arena *src ) {
+	while( src->chunks != NULL ) {
+		void *next = *(void **)src->chunks;
+		*(void **)src->chunks = dest->chunks;
+		dest->chunks = src->chunks;
+		src->chunks = next;
+	}
+
+	while( src->large != NULL ) {
+		HashTree_Arena_Large *large = src->large;
+		src->large = large->next;
+		large->prev = NULL;
+		large->next = dest->large;
+		if( large->next != NULL )
+			large->next->prev = large;
+		dest->large = large;
+	}
+
+	for( int class = 0; class < HASHTREE_ARENA_CLASSES; class++ ) {
+		while( src->free[class] != NULL ) {
+			void *block = src->free[class];
+			src->free[class] = *(void **)block;
+			*(void **)block = dest->free[class];
+			dest->free[class] = block;
+		}
+	}
+
+	HashTree_Arena_Init( src );
+}
+
+/* Concurrent mode: park a block with the epoch it was unlinked in,
+ *   recycling every so often whatever no thread can still be reading */
+void HashTree_Arena_Retire( HashTree_Arena *arena, void *block, size_t size ) {
+	HashTree_Sync *sync = arena->sync;
+	unsigned long oldest = (unsigned long)-1;
+	size_t kept = 0;
+
+	pthread_mutex_lock( &sync->mutex );
+
+	if( sync->retired_count == sync->retired_capacity ) {
+		size_t capacity = sync->retired_capacity == 0 ? HASHTREE_RETIRE_BATCH : sync->retired_capacity * 2;
+		HashTree_Retired *tmp = realloc( sync->retired, sizeof( HashTree_Retired ) * capacity );
+		if( tmp == NULL ) {
+			/* Leave the block to the bulk release */
+			pthread_mutex_unlock( &sync->mutex );
+			return /* error */;
+		}
+		sync->retired = tmp;
+		sync->retired_capacity = capacity;
+	}
+
+	/* Threads entering from here on announce a later epoch and cannot reach the block */
+	sync->retired[sync->retired_count].block = block;
+	sync->retired[sync->retired_count].size = size;
+	sync->retired[sync->retired_count].epoch = __atomic_fetch_add( &sync->epoch, 1, __ATOMIC_SEQ_CST );
+	sync->retired_count++;
+
+	if( sync->retired_count % HASHTREE_RETIRE_BATCH == 0 ) {
+		for( int ix = 0; ix < HASHTREE_EPOCH_SLOTS; ix++ ) {
+			unsigned long epoch = __atomic_load_n( &sync->slot[ix].epoch, __ATOMIC_SEQ_CST );
+			if( epoch != 0 && epoch < oldest )
+				oldest = epoch;
+		}
+
+		for( size_t ix = 0; ix < sync->retired_count; ix++ ) {
+			if( sync->retired[ix].epoch < oldest ) {
+				HashTree_Arena_Recycle( arena, sync->retired[ix].block, sync->retired[ix].size );
+			} else {
+				sync->retired[kept++] = sync->retired[ix];
+			}
+		}
+		sync->retired_count = kept;
+	}
+
+	pthread_mutex_unlock( &sync->mutex );
+}
+
+/* Retired blocks need no attention here; they still belong to the arena's chunks */
+void HashTree_Sync_Free( HashTree_Sync *sync ) {
+	pthread_mutex_destroy( &sync->mutex );
+	free( sync->retired );
+	free( sync );
+}
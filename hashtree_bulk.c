@@ -0,0 +1,218 @@
+/* Bottom-up bulk construction of a hashtree from sorted key-value pairs */
+
+#include "hashtree_internal.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <string.h>
+
+typedef struct {
+	const unsigned char *key;
+	size_t len;
+	void *value;
+	size_t order;	/* position in the caller's input; breaks ties so the last repeat wins */
+} HashTree_Bulk_Entry;
+
+/* Tree order, then input order (private) */
+int HashTree_Bulk_Compare( const void *a, const void *b ) {
+	const HashTree_Bulk_Entry *ea = a, *eb = b;
+	int cmp = memcmp( ea->key, eb->key, ea->len < eb->len ? ea->len : eb->len );
+
+	if( cmp != 0 )
+		return cmp;
+	if( ea->len != eb->len )
+		return ea->len < eb->len ? -1 : 1;
+	return ea->order < eb->order ? -1 : ea->order > eb->order;
+}
+
+/* Fill a node whose path is the first depth bytes shared by entries [lo, hi) (private) */
+bool HashTree_Bulk_Build( HashTree_Arena *arena, HashTree_Node *node, HashTree_Bulk_Entry *entry, size_t lo, size_t hi, size_t depth ) {
+	size_t start, end;
+	int groups = 0;
+
+	/* A key ending here sorts first and belongs to this node */
+	if( lo < hi && entry[lo].len == depth )
+		node->data = entry[lo++].value;
+
+	/* Count the distinct next bytes so the listing is sized once */
+	for( start = lo; start < hi; start = end ) {
+		for( end = start + 1; end < hi && entry[end].key[depth] == entry[start].key[depth]; end++ );
+		groups++;
+	}
+	if( !HashTree_Node_Reserve( arena, node, groups ) )
+		return false /* error */;
+
+	for( start = lo; start < hi; start = end ) {
+		const HashTree_Bulk_Entry *first = &entry[start], *last;
+		HashTree_Node *child;
+		size_t lcp = 0, limit;
+
+		for( end = start + 1; end < hi && entry[end].key[depth] == first->key[depth]; end++ );
+		last = &entry[end - 1];
+
+		/* The group's common run past the branch byte becomes the child's prefix;
+		 *   in sorted input the first and last keys bound it */
+		limit = (first->len < last->len ? first->len : last->len) - depth - 1;
+		while( lcp < limit && first->key[depth + 1 + lcp] == last->key[depth + 1 + lcp] )
+			lcp++;
+
+		child = HashTree_Node_Init( arena, first->key[depth], first->key + depth + 1, lcp, NULL );
+		if( child == NULL || !HashTree_Bulk_Build( arena, child, entry, start, end, depth + 1 + lcp ) )
+			return false /* error */;
+
+		/* Children arrive in order, so each lands at the end of the listing */
+		HashTree_Node_AddChild( arena, node, child );
+	}
+
+	return true;
+}
+
+/* Parallel mode: one first-byte group per task, each worker with an arena of its own */
+typedef struct {
+	HashTree_Bulk_Entry *entry;
+	size_t *bound;		/* group g spans [bound[g], bound[g + 1]) */
+	HashTree_Node **child;
+	int groups;
+	int next;
+	bool failed;
+} HashTree_Bulk_Job;
+
+typedef struct {
+	HashTree_Bulk_Job *job;
+	HashTree_Arena arena;
+} HashTree_Bulk_Worker;
+
+void *HashTree_Bulk_Worker_Run( void *data ) {
+	HashTree_Bulk_Worker *worker = data;
+	HashTree_Bulk_Job *job = worker->job;
+	int group;
+
+	while( (group = __atomic_fetch_add( &job->next, 1, __ATOMIC_RELAXED )) < job->groups ) {
+		HashTree_Bulk_Entry *first = &job->entry[job->bound[group]], *last = &job->entry[job->bound[group + 1] - 1];
+		size_t lcp = 0, limit = (first->len < last->len ? first->len : last->len) - 1;
+		HashTree_Node *child;
+
+		while( lcp < limit && first->key[1 + lcp] == last->key[1 + lcp] )
+			lcp++;
+
+		child = HashTree_Node_Init( &worker->arena, first->key[0], first->key + 1, lcp, NULL );
+		if( child == NULL || !HashTree_Bulk_Build( &worker->arena, child, job->entry, job->bound[group], job->bound[group + 1], 1 + lcp ) ) {
+			job->failed = true;
+			child = NULL;
+		}
+		job->child[group] = child;
+	}
+
+	return NULL;
+}
+
+bool HashTree_Bulk_Parallel( HashTree ht, HashTree_Bulk_Entry *entry, size_t lo, size_t hi, int threads ) {
+	size_t bound[257];
+	HashTree_Node *child[256];
+	HashTree_Bulk_Job job;
+
+	job.entry = entry;
+	job.bound = bound;
+	job.child = child;
+	job.groups = 0;
+	job.next = 0;
+	job.failed = false;
+
+	for( size_t ix = lo; ix < hi; ix++ ) {
+		if( ix == lo || entry[ix].key[0] != entry[ix - 1].key[0] )
+			bound[job.groups++] = ix;
+	}
+	bound[job.groups] = hi;
+
+	if( threads > job.groups )
+		threads = job.groups;
+
+	pthread_t thread_list[threads > 1 ? threads - 1 : 1];
+	HashTree_Bulk_Worker worker[threads > 0 ? threads : 1];
+
+	for( int ix = 0; ix < threads; ix++ ) {
+		worker[ix].job = &job;
+		HashTree_Arena_Init( &worker[ix].arena );
+	}
+
+	/* Spin up workers with this thread as the last worker; groups are claimed as they go,
+	 *   so if a thread cannot be started the ones that were (and this one) build its share */
+	int started = 0;
+	while( started < threads - 1 && pthread_create( &thread_list[started], NULL, &HashTree_Bulk_Worker_Run, &worker[started] ) == 0 )
+		started++;
+	if( threads > 0 )
+		HashTree_Bulk_Worker_Run( &worker[threads - 1] );
+
+	/* make sure all workers die before continuing */
+	for( int ix = 0; ix < started; ix++ ) {
+		pthread_join( thread_list[ix], NULL );
+	}
+
+	/* Every subtree now becomes the tree's to keep (or to drop) */
+	for( int ix = 0; ix < threads; ix++ )
+		HashTree_Arena_Adopt( &ht->arena, &worker[ix].arena );
+
+	if( job.failed || !HashTree_Node_Reserve( &ht->arena, ht->root, job.groups ) )
+		return false /* error */;
+
+	for( int group = 0; group < job.groups; group++ )
+		HashTree_Node_AddChild( &ht->arena, ht->root, child[group] );
+
+	return true;
+}
+
+HashTree HashTree_BulkLoad( const void **keys, const size_t *lens, void **values, size_t n, int threads ) {
+	HashTree_Bulk_Entry *entry;
+	HashTree newtree;
+	bool sorted = true, built;
+	size_t kept = 0, lo = 0;
+
+	newtree = HashTree_Init();
+	if( newtree == NULL )
+		return NULL;
+
+	entry = malloc( sizeof( HashTree_Bulk_Entry ) * (n > 0 ? n : 1) );
+	if( entry == NULL ) {
+		HashTree_Free( &newtree );
+		return NULL;
+	}
+
+	for( size_t ix = 0; ix < n; ix++ ) {
+		entry[ix].key = keys[ix];
+		entry[ix].len = lens[ix];
+		entry[ix].value = values[ix];
+		entry[ix].order = ix;
+		if( ix > 0 && sorted && HashTree_Bulk_Compare( &entry[ix - 1], &entry[ix] ) > 0 )
+			sorted = false;
+		if( lens[ix] > newtree->max_key_len )
+			newtree->max_key_len = lens[ix];
+	}
+
+	if( !sorted )
+		qsort( entry, n, sizeof( HashTree_Bulk_Entry ), &HashTree_Bulk_Compare );
+
+	/* Keep the last of each run of equal keys, then drop the absent ones */
+	for( size_t ix = 0; ix < n; ix++ ) {
+		if( ix + 1 < n && entry[ix].len == entry[ix + 1].len && memcmp( entry[ix].key, entry[ix + 1].key, entry[ix].len ) == 0 )
+			continue;
+		if( entry[ix].value != NULL )
+			entry[kept++] = entry[ix];
+	}
+
+	if( threads > 1 ) {
+		/* The empty key rides on the root itself */
+		if( kept > 0 && entry[0].len == 0 )
+			newtree->root->data = entry[lo++].value;
+		built = HashTree_Bulk_Parallel( newtree, entry, lo, kept, threads );
+	} else {
+		built = HashTree_Bulk_Build( &newtree->arena, newtree->root, entry, 0, kept, 0 );
+	}
+
+	free( entry );
+	if( !built ) {
+		HashTree_Free( &newtree );
+	} else {
+		newtree->count = kept;
+	}
+
+	return newtree;
+}
@@ -0,0 +1,425 @@
+/* Concurrent hashtree: optimistic lock coupling with epoch-based reclamation */
+
+#include "hashtree_internal.h"
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#define HASHTREE_VERSION_OBSOLETE 1
+#define HASHTREE_VERSION_LOCKED 2
+
+/* Create an empty tree open to concurrent access */
+HashTree HashTree_InitConcurrent() {
+	HashTree newtree;
+	HashTree_Sync *sync;
+
+	newtree = HashTree_Init();
+	if( newtree == NULL )
+		return NULL;
+
+	sync = calloc( 1, sizeof( HashTree_Sync ) );
+	if( sync == NULL ) {
+		HashTree_Free( &newtree );
+		return NULL;
+	}
+
+	pthread_mutex_init( &sync->mutex, NULL );
+	sync->epoch = 1;
+	newtree->arena.sync = sync;
+	return newtree;
+}
+
+/* Epochs: claim a slot announcing the current epoch for the length of one operation (private) */
+HashTree_Epoch_Slot *HashTree_Concurrent_Enter( HashTree ht ) {
+	HashTree_Sync *sync = ht->arena.sync;
+	int ix = (int)(((uintptr_t)pthread_self() >> 6) % HASHTREE_EPOCH_SLOTS);
+
+	for( ;; ix = (ix + 1) % HASHTREE_EPOCH_SLOTS ) {
+		unsigned long expect = 0;
+		unsigned long epoch = __atomic_load_n( &sync->epoch, __ATOMIC_SEQ_CST );
+
+		if( __atomic_load_n( &sync->slot[ix].epoch, __ATOMIC_RELAXED ) == 0
+				&& __atomic_compare_exchange_n( &sync->slot[ix].epoch, &expect, epoch, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED ) )
+			return &sync->slot[ix];
+
+		/* Every slot taken: wait for one to come free */
+		if( ix == HASHTREE_EPOCH_SLOTS - 1 )
+			sched_yield();
+	}
+}
+
+void HashTree_Concurrent_Exit( HashTree_Epoch_Slot *slot ) {
+	__atomic_store_n( &slot->epoch, 0, __ATOMIC_RELEASE );
+}
+
+/* Versions (private) */
+
+/* Wait out any writer and take the node's version; sets restart if the node was unlinked */
+unsigned int HashTree_Concurrent_Stable( HashTree_Node *node, bool *restart ) {
+	unsigned int version;
+
+	while( ((version = __atomic_load_n( &node->version, __ATOMIC_ACQUIRE )) & HASHTREE_VERSION_LOCKED) != 0 )
+		sched_yield();
+
+	if( (version & HASHTREE_VERSION_OBSOLETE) != 0 )
+		*restart = true;
+	return version;
+}
+
+/* Everything read from the node since version was taken is consistent */
+bool HashTree_Concurrent_Valid( HashTree_Node *node, unsigned int version ) {
+	__atomic_thread_fence( __ATOMIC_ACQUIRE );
+	return __atomic_load_n( &node->version, __ATOMIC_RELAXED ) == version;
+}
+
+/* Lock the node if it is still as it was at version */
+bool HashTree_Concurrent_Upgrade( HashTree_Node *node, unsigned int version ) {
+	return __atomic_compare_exchange_n( &node->version, &version, version + HASHTREE_VERSION_LOCKED, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED );
+}
+
+/* Lock a node whatever its version; only for nodes below one already locked */
+void HashTree_Concurrent_Lock( HashTree_Node *node ) {
+	bool unused = false;
+	while( !HashTree_Concurrent_Upgrade( node, HashTree_Concurrent_Stable( node, &unused ) ) );
+}
+
+void HashTree_Concurrent_Unlock( HashTree_Node *node ) {
+	__atomic_fetch_add( &node->version, HASHTREE_VERSION_LOCKED, __ATOMIC_RELEASE );
+}
+
+/* Unlock for good: the node has been unlinked */
+void HashTree_Concurrent_Obsolete( HashTree_Node *node ) {
+	__atomic_fetch_add( &node->version, HASHTREE_VERSION_LOCKED + HASHTREE_VERSION_OBSOLETE, __ATOMIC_RELEASE );
+}
+
+/* Find a subnode without locking; the listing is only searched once the node's version
+ *   vouches for the kind it was read as, and the result must still be validated (private) */
+HashTree_Node *HashTree_Concurrent_Child( HashTree_Node *node, unsigned int version, unsigned char bid, bool *restart ) {
+	unsigned char kind = __atomic_load_n( &node->kind, __ATOMIC_RELAXED );
+	unsigned short count = __atomic_load_n( &node->subnode_count, __ATOMIC_RELAXED );
+	void *listing = __atomic_load_n( &node->subnode, __ATOMIC_ACQUIRE );
+	int ix;
+
+	if( !HashTree_Concurrent_Valid( node, version ) ) {
+		*restart = true;
+		return NULL;
+	}
+
+	if( listing == NULL )
+		return NULL;
+
+	switch( kind ) {
+		case HASHTREE_NODE4:
+			ix = HashTree_Node_Search( ((HashTree_Node4 *)listing)->key, count < 4 ? count : 4, bid );
+			return ix < 0 ? NULL : __atomic_load_n( &((HashTree_Node4 *)listing)->child[ix], __ATOMIC_RELAXED );
+		case HASHTREE_NODE16:
+			ix = HashTree_Node_Search( ((HashTree_Node16 *)listing)->key, count < 16 ? count : 16, bid );
+			return ix < 0 ? NULL : __atomic_load_n( &((HashTree_Node16 *)listing)->child[ix], __ATOMIC_RELAXED );
+		case HASHTREE_NODE48:
+			ix = __atomic_load_n( &((HashTree_Node48 *)listing)->index[bid], __ATOMIC_RELAXED );
+			return ix == 0 || ix > 48 ? NULL : __atomic_load_n( &((HashTree_Node48 *)listing)->child[ix - 1], __ATOMIC_RELAXED );
+		default:
+			return __atomic_load_n( &((HashTree_Node256 *)listing)->child[bid], __ATOMIC_RELAXED );
+	}
+}
+
+/* Step from node into the subnode for key[0], checking the subnode's prefix against the key.
+ *   Returns the subnode with its version in cversion, or NULL when there is no such branch;
+ *   whole tells whether the key ran through all of the prefix (private) */
+HashTree_Node *HashTree_Concurrent_Step( HashTree_Node *node, unsigned int version, const unsigned char *key, size_t key_len, size_t *matched, bool *whole, unsigned int *cversion, bool *restart ) {
+	HashTree_Node *child;
+	size_t prefix_len;
+
+	child = HashTree_Concurrent_Child( node, version, key[0], restart );
+	if( *restart || !HashTree_Concurrent_Valid( node, version ) ) {
+		*restart = true;
+		return NULL;
+	}
+	if( child == NULL )
+		return NULL;
+
+	/* Coupling: the child was still attached when its version was taken */
+	*cversion = HashTree_Concurrent_Stable( child, restart );
+	if( *restart || !HashTree_Concurrent_Valid( node, version ) ) {
+		*restart = true;
+		return NULL;
+	}
+
+	prefix_len = __atomic_load_n( &child->prefix_len, __ATOMIC_RELAXED );
+	*matched = HashTree_Node_Match( child, key + 1, key_len - 1 );
+	*whole = *matched == prefix_len;
+	if( !HashTree_Concurrent_Valid( child, *cversion ) ) {
+		*restart = true;
+		return NULL;
+	}
+
+	return child;
+}
+
+/* Lock-free lookup */
+void *HashTree_Concurrent_Retrieve( HashTree ht, const void *hash, size_t hash_len ) {
+	HashTree_Epoch_Slot *slot = HashTree_Concurrent_Enter( ht );
+	const unsigned char *key;
+	HashTree_Node *node, *child;
+	unsigned int version, cversion;
+	size_t len, matched;
+	bool restart, whole;
+	void *data;
+
+	do {
+		restart = false;
+		key = hash;
+		len = hash_len;
+		node = ht->root;
+		version = HashTree_Concurrent_Stable( node, &restart );
+		data = NULL;
+
+		while( !restart && len > 0 ) {
+			child = HashTree_Concurrent_Step( node, version, key, len, &matched, &whole, &cversion, &restart );
+			if( child == NULL || !whole ) {
+				node = NULL;
+				break;
+			}
+			node = child;
+			version = cversion;
+			key += matched + 1;
+			len -= matched + 1;
+		}
+
+		if( !restart && node != NULL ) {
+			data = __atomic_load_n( &node->data, __ATOMIC_RELAXED );
+			restart = !HashTree_Concurrent_Valid( node, version );
+		}
+	} while( restart );
+
+	HashTree_Concurrent_Exit( slot );
+	return data;
+}
+
+/* Insert or overwrite, locking the one node that changes (two when splitting a prefix) */
+void HashTree_Concurrent_Assign( HashTree ht, const void *hash, size_t hash_len, void *data ) {
+	HashTree_Epoch_Slot *slot;
+	const unsigned char *key;
+	HashTree_Node *node, *child, *split;
+	unsigned int version, cversion;
+	size_t len, matched, longest;
+	bool restart, whole;
+
+	/* NULL marks an absent entry, so storing it is a release */
+	if( data == NULL ) {
+		HashTree_Concurrent_Release( ht, hash, hash_len );
+		return;
+	}
+
+	longest = __atomic_load_n( &ht->max_key_len, __ATOMIC_RELAXED );
+	while( hash_len > longest && !__atomic_compare_exchange_n( &ht->max_key_len, &longest, hash_len, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED ) );
+
+	slot = HashTree_Concurrent_Enter( ht );
+
+restart:
+	restart = false;
+	key = hash;
+	len = hash_len;
+	node = ht->root;
+	version = HashTree_Concurrent_Stable( node, &restart );
+
+	while( len > 0 ) {
+		child = HashTree_Concurrent_Step( node, version, key, len, &matched, &whole, &cversion, &restart );
+		if( restart )
+			goto restart;
+
+		/* No branch yet: hang the rest of the key off this node */
+		if( child == NULL ) {
+			if( !HashTree_Concurrent_Upgrade( node, version ) )
+				goto restart;
+			child = HashTree_Node_Init( &ht->arena, key[0], key + 1, len - 1, data );
+			if( child != NULL ) {
+				if( HashTree_Node_AddChild( &ht->arena, node, child ) ) {
+					__atomic_add_fetch( &ht->count, 1, __ATOMIC_RELAXED );
+				} else {
+					HashTree_Node_Free( &ht->arena, child );
+				}
+			}
+			HashTree_Concurrent_Unlock( node );
+			goto done;
+		}
+
+		/* Key diverges inside the child's prefix: split it, then go round again */
+		if( !whole ) {
+			if( !HashTree_Concurrent_Upgrade( node, version ) )
+				goto restart;
+			if( !HashTree_Concurrent_Upgrade( child, cversion ) ) {
+				HashTree_Concurrent_Unlock( node );
+				goto restart;
+			}
+
+			split = HashTree_Node_Init( &ht->arena, child->bid, child->prefix, matched, NULL );
+			if( split != NULL ) {
+				unsigned char bid = child->bid;
+
+				child->bid = child->prefix[matched];
+				child->prefix_len -= matched + 1;
+				memmove( child->prefix, child->prefix + matched + 1, child->prefix_len );
+
+				if( HashTree_Node_AddChild( &ht->arena, split, child ) ) {
+					__atomic_store_n( HashTree_Node_Child( node, bid ), split, __ATOMIC_RELEASE );
+				} else {
+					/* Undo the cut so the tree is left as it was */
+					memmove( child->prefix + matched + 1, child->prefix, child->prefix_len );
+					child->prefix_len += matched + 1;
+					child->prefix[matched] = child->bid;
+					child->bid = bid;
+					HashTree_Node_Free( &ht->arena, split );
+					split = NULL;
+				}
+			}
+
+			HashTree_Concurrent_Unlock( child );
+			HashTree_Concurrent_Unlock( node );
+			if( split == NULL )
+				goto done /* error */;
+			goto restart;
+		}
+
+		node = child;
+		version = cversion;
+		key += matched + 1;
+		len -= matched + 1;
+	}
+
+	if( !HashTree_Concurrent_Upgrade( node, version ) )
+		goto restart;
+	if( __atomic_exchange_n( &node->data, data, __ATOMIC_RELEASE ) == NULL )
+		__atomic_add_fetch( &ht->count, 1, __ATOMIC_RELAXED );
+	HashTree_Concurrent_Unlock( node );
+
+done:
+	HashTree_Concurrent_Exit( slot );
+}
+
+/* Remove, locking top-down the parent (and grandparent, when the parent is left a bare
+ *   link to be merged away) along with the node itself */
+void HashTree_Concurrent_Release( HashTree ht, const void *hash, size_t hash_len ) {
+	HashTree_Epoch_Slot *slot = HashTree_Concurrent_Enter( ht );
+	const unsigned char *key;
+	HashTree_Node *grandparent, *parent, *node, *child, *sibling;
+	unsigned int gversion, pversion, version, cversion;
+	unsigned short count, pcount;
+	size_t len, matched;
+	bool restart, whole, merge;
+	void *data, *pdata;
+	int cursor;
+
+restart:
+	restart = false;
+	key = hash;
+	len = hash_len;
+	grandparent = parent = NULL;
+	gversion = pversion = 0;
+	node = ht->root;
+	version = HashTree_Concurrent_Stable( node, &restart );
+
+	while( len > 0 ) {
+		child = HashTree_Concurrent_Step( node, version, key, len, &matched, &whole, &cversion, &restart );
+		if( restart )
+			goto restart;
+		if( child == NULL || !whole )
+			goto done;
+
+		grandparent = parent;
+		gversion = pversion;
+		parent = node;
+		pversion = version;
+		node = child;
+		version = cversion;
+		key += matched + 1;
+		len -= matched + 1;
+	}
+
+	data = __atomic_load_n( &node->data, __ATOMIC_RELAXED );
+	count = __atomic_load_n( &node->subnode_count, __ATOMIC_RELAXED );
+	if( !HashTree_Concurrent_Valid( node, version ) )
+		goto restart;
+	if( data == NULL )
+		goto done;
+
+	/* A branching node (or the root) just loses its data */
+	if( parent == NULL || count >= 2 ) {
+		if( !HashTree_Concurrent_Upgrade( node, version ) )
+			goto restart;
+		__atomic_store_n( &node->data, NULL, __ATOMIC_RELEASE );
+		HashTree_Concurrent_Unlock( node );
+		goto removed;
+	}
+
+	/* A link in a chain: fold it into its only subnode */
+	if( count == 1 ) {
+		if( !HashTree_Concurrent_Upgrade( parent, pversion ) )
+			goto restart;
+		if( !HashTree_Concurrent_Upgrade( node, version ) ) {
+			HashTree_Concurrent_Unlock( parent );
+			goto restart;
+		}
+
+		cursor = 0;
+		child = HashTree_Node_Next( node, &cursor );
+		HashTree_Concurrent_Lock( child );
+		node->data = NULL;
+		if( HashTree_Node_Merge( &ht->arena, node, HashTree_Node_Child( parent, node->bid ) ) != node ) {
+			HashTree_Concurrent_Obsolete( child );
+			HashTree_Concurrent_Obsolete( node );
+		} else {
+			HashTree_Concurrent_Unlock( child );
+			HashTree_Concurrent_Unlock( node );
+		}
+		HashTree_Concurrent_Unlock( parent );
+		goto removed;
+	}
+
+	/* A leaf: cut it off, and merge the parent away if that leaves it a bare link */
+	pdata = __atomic_load_n( &parent->data, __ATOMIC_RELAXED );
+	pcount = __atomic_load_n( &parent->subnode_count, __ATOMIC_RELAXED );
+	if( !HashTree_Concurrent_Valid( parent, pversion ) )
+		goto restart;
+	merge = grandparent != NULL && pdata == NULL && pcount == 2;
+
+	if( merge && !HashTree_Concurrent_Upgrade( grandparent, gversion ) )
+		goto restart;
+	if( !HashTree_Concurrent_Upgrade( parent, pversion ) ) {
+		if( merge )
+			HashTree_Concurrent_Unlock( grandparent );
+		goto restart;
+	}
+	if( !HashTree_Concurrent_Upgrade( node, version ) ) {
+		HashTree_Concurrent_Unlock( parent );
+		if( merge )
+			HashTree_Concurrent_Unlock( grandparent );
+		goto restart;
+	}
+
+	HashTree_Node_DelChild( &ht->arena, parent, node->bid );
+	HashTree_Node_Free( &ht->arena, node );
+	HashTree_Concurrent_Obsolete( node );
+
+	if( merge ) {
+		cursor = 0;
+		sibling = HashTree_Node_Next( parent, &cursor );
+		HashTree_Concurrent_Lock( sibling );
+		if( HashTree_Node_Merge( &ht->arena, parent, HashTree_Node_Child( grandparent, parent->bid ) ) != parent ) {
+			HashTree_Concurrent_Obsolete( sibling );
+			HashTree_Concurrent_Obsolete( parent );
+		} else {
+			HashTree_Concurrent_Unlock( sibling );
+			HashTree_Concurrent_Unlock( parent );
+		}
+		HashTree_Concurrent_Unlock( grandparent );
+	} else {
+		HashTree_Concurrent_Unlock( parent );
+	}
+
+removed:
+	__atomic_sub_fetch( &ht->count, 1, __ATOMIC_RELAXED );
+done:
+	HashTree_Concurrent_Exit( slot );
+}
@@ -1,172 +1,291 @@
 /* implimentation of foreach on the hashtree using POSIX threads */
 
-#include "hashtree.h"
+#include "hashtree_internal.h"
 #include <pthread.h>
+#include <sched.h>
 #include <stdbool.h>
 #include <string.h>
 
-typedef struct HashTree_Foreach_Stack_Node {
-	HashTree_Node *current_node;
-	unsigned char last_subnode;
-	struct HashTree_Foreach_Stack_Node *parrent;
-} HashTree_Foreach_Stack_Node;
+/* A subtree waiting to be walked; the key_len bytes leading up to the node's bid
+ *   are already in the key buffer of the worker that walks it */
+typedef struct {
+	HashTree_Node *node;
+	size_t key_len;
+} HashTree_Foreach_Task;
+
+/* Worker states, for handing subtrees to idle workers */
+#define HASHTREE_FOREACH_BUSY 0
+#define HASHTREE_FOREACH_IDLE 1		/* waiting: open to a hand-off */
+#define HASHTREE_FOREACH_CLAIMED 2	/* a walker is copying a subtree's key in */
+#define HASHTREE_FOREACH_HANDED 3	/* hand holds the subtree to walk */
+#define HASHTREE_FOREACH_DONE 4
+
+/* One level of a walk in progress */
+typedef struct {
+	HashTree_Node *node;
+	int cursor;
+	size_t key_len;
+} HashTree_Foreach_Frame;
 
+/* Per-worker state; the owner takes tasks from the tail, thieves from the head */
 typedef struct {
-	bool started;
-	HashTree_Foreach_Stack_Node *htStack;
+	HashTree_Foreach_Task *task;	/* room for every subtree of the root, allocated up front */
+	int head, tail;
 	pthread_mutex_t mutex;
-} HashTree_Foreach_Queue;
+
+	int state;
+	HashTree_Foreach_Task hand;
+
+	/* Fixed for the whole walk: deep enough for the longest key in the tree */
+	unsigned char *key;
+	HashTree_Foreach_Frame *frame;
+} HashTree_Foreach_Worker_Meta;
 
 typedef struct {
-	HashTree_Foreach_Queue htQueue;
+	HashTree_Foreach_Worker_Meta *worker;
+	int workers;
+	int outstanding;	/* tasks queued or running */
+	int idle;			/* workers open to a hand-off */
 	void (*cb)(void *, const void *, size_t, void *);
 	void *cb_data;
 } HashTree_Foreach_JobMeta;
 
-void HashTree_Foreach_Stack_Push( HashTree_Foreach_Stack_Node **stack, HashTree_Node *htn ) {
-	HashTree_Foreach_Stack_Node *tmp;
-	
-	/* Create Node */
-	tmp = malloc( sizeof( HashTree_Foreach_Stack_Node ) );
-	/* Would perform this check, but need the program to crash in the next step
-		for want of a better "out of memory" notification:
-	if( stack == NULL ) return stack; */
-	
-	tmp->current_node = htn;
-	tmp->last_subnode = 0;
-	tmp->parrent = *stack;
-	
-	*stack = tmp;
-}
+typedef struct {
+	HashTree_Foreach_JobMeta *job;
+	int id;
+} HashTree_Foreach_Worker_Arg;
+
+/* Queue a top-level subtree on a worker's deque, before the walk begins */
+void HashTree_Foreach_Push( HashTree_Foreach_JobMeta *htfjm, int id, HashTree_Node *node ) {
+	HashTree_Foreach_Worker_Meta *me = &htfjm->worker[id];
+	HashTree_Foreach_Task task;
+
+	task.node = node;
+	task.key_len = 0;
+
+	__atomic_add_fetch( &htfjm->outstanding, 1, __ATOMIC_SEQ_CST );
 
-void HashTree_Foreach_Stack_Pop( HashTree_Foreach_Stack_Node **stack ) {
-	HashTree_Foreach_Stack_Node *tmp;
-	
-	tmp = *stack;
-	*stack = tmp->parrent;
-	free( tmp );
+	pthread_mutex_lock( &me->mutex );
+	me->task[me->tail++] = task;
+	pthread_mutex_unlock( &me->mutex );
 }
 
-int HashTree_Foreach_Stack_Count( HashTree_Foreach_Stack_Node *stack ) {
-	int count = 0;
-	HashTree_Foreach_Stack_Node *cur = stack;
+/* Take work: own deque first (newest), then steal the oldest from the others */
+bool HashTree_Foreach_Take( HashTree_Foreach_JobMeta *htfjm, int id, HashTree_Foreach_Task *task ) {
+	for( int ix = 0; ix < htfjm->workers; ix++ ) {
+		HashTree_Foreach_Worker_Meta *victim = &htfjm->worker[(id + ix) % htfjm->workers];
+		bool found = false;
+
+		pthread_mutex_lock( &victim->mutex );
+		if( victim->head < victim->tail ) {
+			found = true;
+			if( ix == 0 ) {
+				*task = victim->task[--victim->tail];
+			} else {
+				*task = victim->task[victim->head++];
+			}
+		}
+		pthread_mutex_unlock( &victim->mutex );
 
-	while( cur != NULL ) {
-		cur = cur->parrent;
-		count++;
+		if( found )
+			return true;
 	}
 
-	return count;
+	return false;
 }
 
-void HashTree_Foreach_Queue_Setup( HashTree_Foreach_Queue *htfq, HashTree ht ) {
-	htfq->htStack = NULL;
-	htfq->started = false;
-	HashTree_Foreach_Stack_Push( &htfq->htStack, ht );
-	pthread_mutex_init( &htfq->mutex, NULL );
-}
+/* Give a subtree to an idle worker, copying the key leading to it into that worker's own
+ *   buffer (which it leaves alone while idle); false if every idle worker was taken first */
+bool HashTree_Foreach_Hand( HashTree_Foreach_JobMeta *htfjm, int id, HashTree_Node *node, size_t key_len ) {
+	for( int ix = 1; ix < htfjm->workers; ix++ ) {
+		HashTree_Foreach_Worker_Meta *thief = &htfjm->worker[(id + ix) % htfjm->workers];
+		int expect = HASHTREE_FOREACH_IDLE;
+
+		if( __atomic_load_n( &thief->state, __ATOMIC_RELAXED ) != HASHTREE_FOREACH_IDLE )
+			continue;
+		if( !__atomic_compare_exchange_n( &thief->state, &expect, HASHTREE_FOREACH_CLAIMED, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED ) )
+			continue;
 
-void HashTree_Foreach_Queue_Teardown( HashTree_Foreach_Queue *htfq ) {
-	while( htfq->htStack != NULL ) {
-		HashTree_Foreach_Stack_Pop( &htfq->htStack );
+		/* The walk handing this off is still outstanding, so the count cannot reach 0 meanwhile */
+		__atomic_sub_fetch( &htfjm->idle, 1, __ATOMIC_SEQ_CST );
+		__atomic_add_fetch( &htfjm->outstanding, 1, __ATOMIC_SEQ_CST );
+		memcpy( thief->key, htfjm->worker[id].key, key_len );
+		thief->hand.node = node;
+		thief->hand.key_len = key_len;
+		__atomic_store_n( &thief->state, HASHTREE_FOREACH_HANDED, __ATOMIC_RELEASE );
+		return true;
 	}
-	pthread_mutex_destroy( &htfq->mutex );
-}
 
-void HashTree_Foreach_JobMeta_Setup( HashTree_Foreach_JobMeta *htfjm, HashTree ht, void (*cb)(void *, const void*, size_t, void *), void *cb_data ) {
-	htfjm->cb = cb;
-	htfjm->cb_data = cb_data;
-	HashTree_Foreach_Queue_Setup( &htfjm->htQueue, ht );
+	return false;
 }
 
-void HashTree_Foreach_JobMeta_Teardown( HashTree_Foreach_JobMeta *htfjm ) {
-	HashTree_Foreach_Queue_Teardown( &htfjm->htQueue );
+/* Append a node's bid and prefix to the key buffer at len; returns the new length */
+size_t HashTree_Foreach_Spell( unsigned char *key, size_t len, HashTree_Node *node ) {
+	key[len] = node->bid;
+	memcpy( key + len + 1, node->prefix, node->prefix_len );
+	return len + 1 + node->prefix_len;
 }
 
-/* WARNING: failing to free( hash ) when you are done with it will result in a memory leak! */
-void HashTree_Foreach_Queue_Next( HashTree_Foreach_Queue *htfq, void **hash,  int *hashlen, void **data) {
-	pthread_mutex_lock( &htfq->mutex );
-	
-	/* Goto next/first entry in the stack */
-	do {
-		if( htfq->started ) {
-			HashTree_Foreach_Stack_Pop( &htfq->htStack );
-			if(htfq->htStack->last_subnode < htfq->htStack->current_node->subnode_count - 1 ) {
-				htfq->htStack->last_subnode++;
-				while( htfq->htStack->current_node->subnode_count != 0 ) {
-					HashTree_Foreach_Stack_Push( &htfq->htStack, htfq->htStack->current_node->subnode[ htfq->htStack->last_subnode ] );
-				}
-			} 
-		} else {
-			while( htfq->htStack->current_node->subnode_count != 0 ) {
-				HashTree_Foreach_Stack_Push( &htfq->htStack, htfq->htStack->current_node->subnode[ htfq->htStack->last_subnode ] );
-			}
-			htfq->started = true;
-		}
-		
-		/* check for work (validate stack); short-circuit if no work (invalid stack) */
-		if( htfq->htStack == NULL ) {
-			pthread_mutex_unlock( &htfq->mutex );
-			*hash = NULL;
-			*data = NULL;
-			*hashlen = 0;
-			return;
+/* Walk one subtree depth-first without recursion or allocation;
+ *   while other workers sit idle, children are handed off instead of descended into */
+void HashTree_Foreach_Walk( HashTree_Foreach_JobMeta *htfjm, int id, HashTree_Foreach_Task *task ) {
+	HashTree_Foreach_Worker_Meta *me = &htfjm->worker[id];
+	HashTree_Foreach_Frame *frame = me->frame;
+	HashTree_Node *child;
+	int depth = 0;
+
+	frame[0].node = task->node;
+	frame[0].cursor = 0;
+	frame[0].key_len = HashTree_Foreach_Spell( me->key, task->key_len, task->node );
+	if( task->node->data != NULL )
+		htfjm->cb( htfjm->cb_data, me->key, frame[0].key_len, task->node->data );
+
+	while( depth >= 0 ) {
+		HashTree_Foreach_Frame *top = &frame[depth];
+
+		child = HashTree_Node_Next( top->node, &top->cursor );
+		if( child == NULL ) {
+			depth--;
+			continue;
 		}
-	} while( htfq->htStack->current_node->data != NULL );
-	
-	/* Get data and hash */
-	*hashlen = HashTree_Foreach_Stack_Count( htfq->htStack );
-	*hash = malloc( sizeof( unsigned char ) * *hashlen );
-	
-	HashTree_Foreach_Stack_Node *tmp = htfq->htStack;
-	int stackItr = *hashlen - 1;
-	while( tmp != NULL ) {
-		memcpy( *hash + sizeof( unsigned char ) * stackItr, &htfq->htStack, sizeof( unsigned char ) );
-		tmp = tmp->parrent;
-		stackItr--;
+
+		if( __atomic_load_n( &htfjm->idle, __ATOMIC_RELAXED ) > 0 && HashTree_Foreach_Hand( htfjm, id, child, top->key_len ) )
+			continue;
+
+		depth++;
+		frame[depth].node = child;
+		frame[depth].cursor = 0;
+		frame[depth].key_len = HashTree_Foreach_Spell( me->key, top->key_len, child );
+		if( child->data != NULL )
+			htfjm->cb( htfjm->cb_data, me->key, frame[depth].key_len, child->data );
 	}
-	
-	*data = htfq->htStack->current_node->data;
-	
-	pthread_mutex_unlock( &htfq->mutex );
 }
 
 void *HashTree_Foreach_Worker( void *data ) {
-	HashTree_Foreach_JobMeta *htfjm = (HashTree_Foreach_JobMeta *)data;
-	void *htHash, *htData;
-	int htHashLen;
-	
-	do {
-		HashTree_Foreach_Queue_Next( &htfjm->htQueue, &htHash, &htHashLen, &htData );
-		
-		/* Work as long as there is work to be done! */
-		if( htHash != NULL ) {
-			htfjm->cb( htfjm->cb_data, htHash, htHashLen, htData );
-			free( htHash );
-			htHash = (void *)0b1;
-		} else {
-			htHash = (void *)0b0;
+	HashTree_Foreach_Worker_Arg *arg = (HashTree_Foreach_Worker_Arg *)data;
+	HashTree_Foreach_JobMeta *htfjm = arg->job;
+	HashTree_Foreach_Worker_Meta *me = &htfjm->worker[arg->id];
+	HashTree_Foreach_Task task;
+
+	/* Work as long as there is work to be done! */
+	for( ;; ) {
+		if( HashTree_Foreach_Take( htfjm, arg->id, &task ) ) {
+			HashTree_Foreach_Walk( htfjm, arg->id, &task );
+			__atomic_sub_fetch( &htfjm->outstanding, 1, __ATOMIC_SEQ_CST );
+			continue;
 		}
-	} while( htHash == (void *)0b1 );
+
+		/* The deques are only filled before the walk begins; from here on work comes by hand-off */
+		__atomic_store_n( &me->state, HASHTREE_FOREACH_IDLE, __ATOMIC_SEQ_CST );
+		__atomic_add_fetch( &htfjm->idle, 1, __ATOMIC_SEQ_CST );
+		for( ;; ) {
+			int state = __atomic_load_n( &me->state, __ATOMIC_ACQUIRE );
+
+			if( state == HASHTREE_FOREACH_HANDED )
+				break;
+
+			/* Nobody is walking, so nobody can hand anything over: done, unless claimed just now */
+			if( state == HASHTREE_FOREACH_IDLE && __atomic_load_n( &htfjm->outstanding, __ATOMIC_SEQ_CST ) == 0 ) {
+				int expect = HASHTREE_FOREACH_IDLE;
+				if( __atomic_compare_exchange_n( &me->state, &expect, HASHTREE_FOREACH_DONE, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST ) ) {
+					__atomic_sub_fetch( &htfjm->idle, 1, __ATOMIC_SEQ_CST );
+					return NULL;
+				}
+				continue;
+			}
+
+			sched_yield();
+		}
+
+		__atomic_store_n( &me->state, HASHTREE_FOREACH_BUSY, __ATOMIC_RELAXED );
+		task = me->hand;
+		HashTree_Foreach_Walk( htfjm, arg->id, &task );
+		__atomic_sub_fetch( &htfjm->outstanding, 1, __ATOMIC_SEQ_CST );
+	}
 }
 
 void HashTree_Foreach( HashTree ht, void (*callback)(void * /* data */, const void * /* hash */, size_t /* hash_len */, void * /* entry */), void *data, int threads ) {
-	pthread_t thread_list[threads - 1];
-	void *result;
-	
 	HashTree_Foreach_JobMeta htfjm;
-	HashTree_Foreach_JobMeta_Setup( &htfjm, ht, callback, data );
-	
-	/* Spin up workers with this thread as the last worker */
+	HashTree_Node *child;
+	int cursor = 0, subtrees = 0;
+
+	if( ht->map != NULL ) {
+		HashMap_Foreach( ht->map, callback, data );
+		return;
+	}
+
+	/* A mapped image is walked in order on this thread */
+	if( ht->image != NULL ) {
+		HashTree_Image_ForeachPrefix( ht, NULL, 0, callback, data );
+		return;
+	}
+
+	if( threads < 1 )
+		threads = 1;
+
+	pthread_t thread_list[threads];
+	HashTree_Foreach_Worker_Meta worker[threads];
+	HashTree_Foreach_Worker_Arg arg[threads];
+
+	while( HashTree_Node_Next( ht->root, &cursor ) != NULL )
+		subtrees++;
+
+	/* Each worker's buffers are allocated before the walk begins; if some cannot be,
+	 *   the walk goes ahead with the workers that could be set up */
+	int ready = 0;
+	for( ; ready < threads; ready++ ) {
+		memset( &worker[ready], 0, sizeof( HashTree_Foreach_Worker_Meta ) );
+		worker[ready].task = malloc( sizeof( HashTree_Foreach_Task ) * (subtrees > 0 ? subtrees : 1) );
+		worker[ready].key = malloc( ht->max_key_len + 1 );
+		worker[ready].frame = malloc( sizeof( HashTree_Foreach_Frame ) * (ht->max_key_len + 1) );
+		if( worker[ready].task == NULL || worker[ready].key == NULL || worker[ready].frame == NULL ) {
+			free( worker[ready].task );
+			free( worker[ready].key );
+			free( worker[ready].frame );
+			break;
+		}
+		pthread_mutex_init( &worker[ready].mutex, NULL );
+		arg[ready].job = &htfjm;
+		arg[ready].id = ready;
+	}
+	if( ready == 0 )
+		return /* error */;
+	threads = ready;
+
+	htfjm.worker = worker;
+	htfjm.workers = threads;
+	htfjm.outstanding = 0;
+	htfjm.idle = 0;
+	htfjm.cb = callback;
+	htfjm.cb_data = data;
+
+	/* The empty key is stored on the root itself */
+	if( ht->root->data != NULL )
+		callback( data, "", 0, ht->root->data );
+
+	/* Deal the top-level subtrees out round-robin; stealing evens out the rest */
+	cursor = 0;
+	for( int ix = 0; (child = HashTree_Node_Next( ht->root, &cursor )) != NULL; ix = (ix + 1) % threads )
+		HashTree_Foreach_Push( &htfjm, ix, child );
+
+	/* Spin up workers with this thread as the last worker; a worker that cannot be started
+	 *   is never idle, so nothing is handed to it, and the others steal what was dealt to it */
+	int started = 0;
 	for( int ix = 0; ix < threads - 1; ix++ ) {
-		pthread_create( &thread_list[ix], NULL, &HashTree_Foreach_Worker, &htfjm );
+		if( pthread_create( &thread_list[started], NULL, &HashTree_Foreach_Worker, &arg[ix] ) == 0 )
+			started++;
 	}
-	result = HashTree_Foreach_Worker( &htfjm );
-	
+	HashTree_Foreach_Worker( &arg[threads - 1] );
+
 	/* make sure all workers die before continuing */
-	for( int ix = 0; ix < threads - 1; ix++ ) {
-		pthread_join( thread_list[ix], result );
+	for( int ix = 0; ix < started; ix++ ) {
+		pthread_join( thread_list[ix], NULL );
+	}
+
+	for( int ix = 0; ix < threads; ix++ ) {
+		pthread_mutex_destroy( &worker[ix].mutex );
+		free( worker[ix].task );
+		free( worker[ix].key );
+		free( worker[ix].frame );
 	}
-	
-	HashTree_Foreach_JobMeta_Teardown( &htfjm );
 }
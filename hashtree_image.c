@@ -0,0 +1,454 @@
+/* Flat, pointer-free hashtree images: written by HashTree_Save, queried in place through HashTree_Map */
+
+#include "hashtree_internal.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define HASHTREE_IMAGE_MAGIC "CUTTREE"
+#define HASHTREE_IMAGE_VERSION 1
+
+/* Head of every image; everything after it is addressed by offset from the start of the file */
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t header_size;
+	uint64_t length;	/* bytes in the image, header included */
+	uint64_t root;		/* offset of the root node */
+	uint64_t count;		/* entries */
+	uint64_t max_key_len;
+	unsigned char reserved[16];
+} HashTree_ImageHeader;
+
+/* A node as laid out in the image, 8 byte aligned.  It is followed by
+ *   count branch ids in order (padded to 8 bytes), count child offsets to match,
+ *   then the prefix (padded to 8 bytes).  Children are written before their parent. */
+typedef struct {
+	uint64_t value;		/* offset of the serialized entry; 0 when the node holds none */
+	uint32_t prefix_len;
+	uint16_t count;
+	uint8_t bid;
+	uint8_t reserved;
+} HashTree_ImageNode;
+
+#define HashTree_Image_Pad( len ) (((uint64_t)(len) + 7) & ~(uint64_t)7)
+#define HashTree_Image_NodeSize( count, prefix_len ) \
+	(sizeof( HashTree_ImageNode ) + HashTree_Image_Pad( count ) + 8 * (uint64_t)(count) + HashTree_Image_Pad( prefix_len ))
+
+/* Save State */
+typedef struct {
+	FILE *file;
+	uint64_t offset;	/* where the next write lands */
+	uint64_t count;		/* entries written */
+	uint64_t *child;	/* offsets of finished subtrees not yet claimed by their parent */
+	size_t child_count, child_capacity;
+	void (*serialize)(void *, void *, const void **, size_t *);
+	void *data;
+} HashTree_Save_State;
+
+/* Append bytes followed by zero padding out to a multiple of 8 (private) */
+bool HashTree_Save_Write( HashTree_Save_State *st, const void *bytes, size_t len ) {
+	static const unsigned char zero[8] = { 0 };
+	size_t pad = HashTree_Image_Pad( len ) - len;
+
+	if( len > 0 && fwrite( bytes, 1, len, st->file ) != len )
+		return false /* error */;
+	if( pad > 0 && fwrite( zero, 1, pad, st->file ) != pad )
+		return false /* error */;
+	st->offset += len + pad;
+	return true;
+}
+
+/* Write a node whose subtrees are already out; their offsets are the last
+ *   subnode_count on the child stack, and are replaced there by the node's own (private) */
+bool HashTree_Save_Node( HashTree_Save_State *st, HashTree_Node *node ) {
+	HashTree_ImageNode rec;
+	unsigned char key[256];
+	HashTree_Node *sub;
+	int cursor = 0, ix = 0;
+
+	if( node->prefix_len > UINT32_MAX )
+		return false /* error */;
+
+	rec.value = 0;
+	rec.prefix_len = node->prefix_len;
+	rec.count = node->subnode_count;
+	rec.bid = node->bid;
+	rec.reserved = 0;
+
+	/* The entry goes first, as its length and then its bytes */
+	if( node->data != NULL ) {
+		const void *bytes = NULL;
+		size_t len = 0;
+		uint64_t len64;
+
+		st->serialize( st->data, node->data, &bytes, &len );
+		len64 = len;
+		if( !HashTree_Save_Write( st, &len64, sizeof( len64 ) ) )
+			return false /* error */;
+		rec.value = st->offset;
+		if( !HashTree_Save_Write( st, bytes, len ) )
+			return false /* error */;
+		st->count++;
+	}
+
+	while( (sub = HashTree_Node_Next( node, &cursor )) != NULL )
+		key[ix++] = sub->bid;
+
+	st->child_count -= node->subnode_count;
+	if( !HashTree_Save_Write( st, &rec, sizeof( rec ) )
+			|| !HashTree_Save_Write( st, key, node->subnode_count )
+			|| !HashTree_Save_Write( st, st->child + st->child_count, sizeof( uint64_t ) * node->subnode_count )
+			|| !HashTree_Save_Write( st, node->prefix, node->prefix_len ) )
+		return false /* error */;
+
+	/* Step back over the record just written: that is the node's offset */
+	st->child[st->child_count++] = st->offset - HashTree_Image_NodeSize( node->subnode_count, node->prefix_len );
+	return true;
+}
+
+/* Room for one more finished subtree on the child stack (private) */
+bool HashTree_Save_Reserve( HashTree_Save_State *st ) {
+	if( st->child_count == st->child_capacity ) {
+		size_t capacity = st->child_capacity == 0 ? 256 : st->child_capacity * 2;
+		uint64_t *tmp = realloc( st->child, sizeof( uint64_t ) * capacity );
+		if( tmp == NULL )
+			return false /* error */;
+		st->child = tmp;
+		st->child_capacity = capacity;
+	}
+	return true;
+}
+
+/* Serialize */
+bool HashTree_Save( HashTree ht, const char *path, void (*serialize)(void *, void *, const void **, size_t *), void *data ) {
+	HashTree_ImageHeader head;
+	HashTree_Save_State st;
+	struct { HashTree_Node *node; int cursor; } *frame;
+	int depth = 0;
+	bool saved = false;
+
+	/* Only a trie can be written out; an image is already flat */
+	if( ht->root == NULL ) {
+		errno = EINVAL;
+		return false /* error */;
+	}
+
+	frame = malloc( sizeof( *frame ) * (ht->max_key_len + 1) );
+	if( frame == NULL )
+		return false /* error */;
+
+	st.file = fopen( path, "wb" );
+	if( st.file == NULL ) {
+		free( frame );
+		return false /* error */;
+	}
+	st.offset = 0;
+	st.count = 0;
+	st.child = NULL;
+	st.child_count = 0;
+	st.child_capacity = 0;
+	st.serialize = serialize;
+	st.data = data;
+
+	/* The header is filled in once the root's offset is known */
+	memset( &head, 0, sizeof( head ) );
+	if( !HashTree_Save_Write( &st, &head, sizeof( head ) ) )
+		goto done;
+
+	/* Post-order, so every child offset is known by the time its parent is written */
+	frame[0].node = ht->root;
+	frame[0].cursor = 0;
+	while( depth >= 0 ) {
+		HashTree_Node *child = HashTree_Node_Next( frame[depth].node, &frame[depth].cursor );
+
+		if( child != NULL ) {
+			depth++;
+			frame[depth].node = child;
+			frame[depth].cursor = 0;
+			continue;
+		}
+
+		if( !HashTree_Save_Reserve( &st ) || !HashTree_Save_Node( &st, frame[depth].node ) )
+			goto done;
+		depth--;
+	}
+
+	memcpy( head.magic, HASHTREE_IMAGE_MAGIC, sizeof( head.magic ) );
+	head.version = HASHTREE_IMAGE_VERSION;
+	head.header_size = sizeof( HashTree_ImageHeader );
+	head.length = st.offset;
+	head.root = st.child[0];
+	head.count = st.count;
+	head.max_key_len = ht->max_key_len;
+	saved = fseek( st.file, 0, SEEK_SET ) == 0 && fwrite( &head, sizeof( head ), 1, st.file ) == 1;
+
+done:
+	free( frame );
+	free( st.child );
+	if( fclose( st.file ) != 0 )
+		saved = false;
+	/* Never leave a half written image behind to be mapped later */
+	if( !saved )
+		unlink( path );
+	return saved;
+}
+
+/* Locate a node record, checking that all of it lies inside the image (private) */
+const HashTree_ImageNode *HashTree_Image_Node( const unsigned char *image, uint64_t offset ) {
+	const HashTree_ImageHeader *head = (const HashTree_ImageHeader *)image;
+	const HashTree_ImageNode *node;
+
+	if( offset < head->header_size || offset > head->length || offset % 8 != 0
+			|| head->length - offset < sizeof( HashTree_ImageNode ) )
+		return NULL /* error: corrupt image */;
+
+	node = (const HashTree_ImageNode *)(image + offset);
+	if( head->length - offset < HashTree_Image_NodeSize( node->count, node->prefix_len ) )
+		return NULL /* error: corrupt image */;
+
+	return node;
+}
+
+#define HashTree_Image_Keys( node ) ((const unsigned char *)((node) + 1))
+#define HashTree_Image_Children( node ) ((const uint64_t *)(HashTree_Image_Keys( node ) + HashTree_Image_Pad( (node)->count )))
+#define HashTree_Image_Prefix( node ) ((const unsigned char *)(HashTree_Image_Children( node ) + (node)->count))
+
+/* Follow the branch for bid; NULL if there is none (private) */
+const HashTree_ImageNode *HashTree_Image_Child( const unsigned char *image, const HashTree_ImageNode *node, unsigned char bid ) {
+	const unsigned char *key = HashTree_Image_Keys( node );
+	int lo = 0, hi = node->count;
+
+	if( hi == 256 ) {
+		lo = bid;
+	} else if( hi <= 16 ) {
+		lo = HashTree_Node_Search( key, hi, bid );
+		if( lo < 0 )
+			return NULL;
+	} else {
+		/* Branch ids are stored in order */
+		while( lo < hi ) {
+			int mid = (lo + hi) / 2;
+			if( key[mid] < bid ) {
+				lo = mid + 1;
+			} else {
+				hi = mid;
+			}
+		}
+		if( lo == node->count || key[lo] != bid )
+			return NULL;
+	}
+
+	return HashTree_Image_Node( image, HashTree_Image_Children( node )[lo] );
+}
+
+/* Entry stored at node, its length and bytes checked to lie inside the image;
+ *   NULL when there is none (private) */
+void *HashTree_Image_Entry( const unsigned char *image, const HashTree_ImageNode *node ) {
+	const HashTree_ImageHeader *head = (const HashTree_ImageHeader *)image;
+	uint64_t len;
+
+	if( node->value == 0 )
+		return NULL;
+
+	if( node->value < head->header_size + sizeof( len ) || node->value > head->length || node->value % 8 != 0 )
+		return NULL /* error: corrupt image */;
+
+	memcpy( &len, image + node->value - sizeof( len ), sizeof( len ) );
+	if( len > head->length - node->value )
+		return NULL /* error: corrupt image */;
+
+	return (void *)(image + node->value);
+}
+
+/* Deserialize-free Constructor */
+HashTree HashTree_Map( const char *path ) {
+	HashTree_ImageHeader head;
+	HashTree newtree;
+	struct stat st;
+	void *base;
+	int fd;
+
+	fd = open( path, O_RDONLY );
+	if( fd < 0 )
+		return NULL /* error */;
+
+	if( fstat( fd, &st ) != 0 ) {
+		close( fd );
+		return NULL /* error */;
+	}
+
+	/* Only the header is read; the nodes stay on disk until a lookup touches them */
+	if( pread( fd, &head, sizeof( head ), 0 ) != sizeof( head )
+			|| memcmp( head.magic, HASHTREE_IMAGE_MAGIC, sizeof( head.magic ) ) != 0
+			|| head.version != HASHTREE_IMAGE_VERSION
+			|| head.header_size < sizeof( HashTree_ImageHeader )
+			|| head.length < head.header_size
+			|| (uint64_t)st.st_size < head.length
+			|| head.max_key_len > SIZE_MAX - 1 ) {
+		close( fd );
+		errno = EINVAL;
+		return NULL /* error */;
+	}
+
+	base = mmap( NULL, head.length, PROT_READ, MAP_SHARED, fd, 0 );
+	close( fd );
+	if( base == MAP_FAILED )
+		return NULL /* error */;
+
+	if( HashTree_Image_Node( base, head.root ) == NULL ) {
+		munmap( base, head.length );
+		errno = EINVAL;
+		return NULL /* error */;
+	}
+
+	newtree = malloc( sizeof( HashTree_Header ) );
+	if( newtree == NULL ) {
+		munmap( base, head.length );
+		return NULL /* error */;
+	}
+
+	HashTree_Arena_Init( &newtree->arena );
+	newtree->root = NULL;
+	newtree->max_key_len = head.max_key_len;
+	newtree->count = head.count;
+	newtree->image = base;
+	newtree->map = NULL;
+	newtree->family = NULL;
+	newtree->snapshot = false;
+	return newtree;
+}
+
+/* Bytes in the mapped image (private) */
+size_t HashTree_Image_Length( HashTree ht ) {
+	return ((const HashTree_ImageHeader *)ht->image)->length;
+}
+
+/* Release the mapping (private) */
+void HashTree_Image_Unmap( HashTree ht ) {
+	munmap( (void *)ht->image, ((const HashTree_ImageHeader *)ht->image)->length );
+	ht->image = NULL;
+}
+
+/* Serialized Entry Length; HashTree_Image_Entry has checked it against the image */
+size_t HashTree_MappedSize( const void *entry ) {
+	uint64_t len;
+
+	memcpy( &len, (const unsigned char *)entry - sizeof( len ), sizeof( len ) );
+	return len;
+}
+
+/* Lookup against the mapped bytes (private) */
+void *HashTree_Image_Retrieve( HashTree ht, const void *hash, size_t hash_len ) {
+	const unsigned char *key = hash;
+	const HashTree_ImageNode *node;
+
+	node = HashTree_Image_Node( ht->image, ((const HashTree_ImageHeader *)ht->image)->root );
+	while( node != NULL && hash_len > 0 ) {
+		node = HashTree_Image_Child( ht->image, node, key[0] );
+		if( node == NULL )
+			return NULL;
+
+		if( node->prefix_len > hash_len - 1 || memcmp( HashTree_Image_Prefix( node ), key + 1, node->prefix_len ) != 0 )
+			return NULL;
+
+		key += node->prefix_len + 1;
+		hash_len -= node->prefix_len + 1;
+	}
+
+	return node == NULL ? NULL : HashTree_Image_Entry( ht->image, node );
+}
+
+/* One level of an ordered walk over the image; a node is yielded before its subnodes */
+typedef struct {
+	const HashTree_ImageNode *node;
+	int cursor;
+	size_t key_len;
+} HashTree_Image_Frame;
+
+/* Ordered prefix scan against the mapped bytes (private) */
+void HashTree_Image_ForeachPrefix( HashTree ht, const void *prefix, size_t prefix_len, void (*callback)(void *, const void *, size_t, void *), void *data ) {
+	const unsigned char *target = prefix;
+	const HashTree_ImageNode *node;
+	HashTree_Image_Frame *frame;
+	unsigned char *key;
+	void *entry;
+	size_t pos = 0;
+	int depth = 0;
+
+	node = HashTree_Image_Node( ht->image, ((const HashTree_ImageHeader *)ht->image)->root );
+
+	/* Descend to the subtree holding every key that begins with prefix */
+	while( node != NULL && pos < prefix_len ) {
+		size_t rem, limit;
+
+		node = HashTree_Image_Child( ht->image, node, target[pos] );
+		if( node == NULL )
+			return;
+
+		rem = prefix_len - pos - 1;
+		limit = rem < node->prefix_len ? rem : node->prefix_len;
+		if( memcmp( HashTree_Image_Prefix( node ), target + pos + 1, limit ) != 0 )
+			return;
+		pos += 1 + node->prefix_len;
+	}
+	if( node == NULL )
+		return /* error: corrupt image */;
+
+	key = malloc( ht->max_key_len + 1 );
+	frame = malloc( sizeof( HashTree_Image_Frame ) * (ht->max_key_len + 1) );
+	if( key == NULL || frame == NULL ) {
+		free( key );
+		free( frame );
+		return /* error */;
+	}
+
+	/* The subtree's own key is the prefix carried on through the node's prefix */
+	if( pos > 0 ) {
+		memcpy( key, target, pos - 1 - node->prefix_len );
+		key[pos - 1 - node->prefix_len] = node->bid;
+		memcpy( key + pos - node->prefix_len, HashTree_Image_Prefix( node ), node->prefix_len );
+	}
+
+	frame[0].node = node;
+	frame[0].cursor = 0;
+	frame[0].key_len = pos;
+	entry = HashTree_Image_Entry( ht->image, node );
+	if( entry != NULL )
+		callback( data, key, pos, entry );
+
+	while( depth >= 0 ) {
+		HashTree_Image_Frame *top = &frame[depth];
+		const HashTree_ImageNode *child;
+		size_t base;
+
+		if( top->cursor == top->node->count ) {
+			depth--;
+			continue;
+		}
+
+		child = HashTree_Image_Node( ht->image, HashTree_Image_Children( top->node )[top->cursor++] );
+		if( child == NULL || top->key_len + 1 + child->prefix_len > ht->max_key_len )
+			continue /* error: corrupt image, skip the branch */;
+
+		base = top->key_len;
+		key[base] = child->bid;
+		memcpy( key + base + 1, HashTree_Image_Prefix( child ), child->prefix_len );
+
+		top = &frame[++depth];
+		top->node = child;
+		top->cursor = 0;
+		top->key_len = base + 1 + child->prefix_len;
+		entry = HashTree_Image_Entry( ht->image, child );
+		if( entry != NULL )
+			callback( data, key, top->key_len, entry );
+	}
+
+	free( key );
+	free( frame );
+}
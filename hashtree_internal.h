@@ -0,0 +1,168 @@
+/** @file
+ * @brief	 Hashtree internals, shared by the hashtree sources
+ * @details
+ *   The node layout, the arena and the state behind concurrent mode, snapshots and mapped
+ *    images.  Only the hashtree_*.c sources (and the IntTree, which allocates from the same
+ *    arena) include this; everyone else sees a HashTree as an opaque handle.
+ */
+
+#ifndef INCLUDED_HASHTREE_INTERNAL_H
+#define INCLUDED_HASHTREE_INTERNAL_H
+
+#include <pthread.h>
+#include "hashmap.h"
+#include "hashtree.h"
+
+struct HashTree_Node;
+
+/* Up to 4/16 subnodes; branch ids sorted and stored inline beside their pointers */
+typedef struct {
+	unsigned char key[4];
+	struct HashTree_Node *child[4];
+} HashTree_Node4;
+
+typedef struct {
+	unsigned char key[16];
+	struct HashTree_Node *child[16];
+} HashTree_Node16;
+
+/* Up to 48 subnodes; index maps a branch id to its slot + 1 (0 is empty) */
+typedef struct {
+	unsigned char index[256];
+	struct HashTree_Node *child[48];
+} HashTree_Node48;
+
+/* Up to 256 subnodes; indexed directly by branch id */
+typedef struct {
+	struct HashTree_Node *child[256];
+} HashTree_Node256;
+
+typedef struct HashTree_Node {
+	/* Branch Identifier */
+	unsigned char bid;
+	
+	/* Subnode Listing; one of the kinds above, NULL while there are no subnodes */
+	unsigned char kind;
+	unsigned short subnode_count;
+	
+	/* Concurrent Mode: bumped on every change; bit 1 marks it locked, bit 0 unlinked */
+	unsigned int version;
+	
+	/* Snapshots: listings (and tree headers) pointing here; shared nodes are copied before any change */
+	unsigned int refs;
+	
+	void *subnode;
+	
+	/* Data Attachment */
+	void *data;
+	
+	/* Compressed Path: the key bytes following bid that lead to this node */
+	size_t prefix_len;
+	unsigned char prefix[];
+} HashTree_Node;
+
+/* Node Storage: a per-tree arena carved from chunks into 16 byte size classes,
+ *   each class recycling its freed blocks; blocks beyond the largest class are
+ *   allocated individually but still tracked so the tree can be dropped at once */
+#define HASHTREE_ARENA_GRAIN 16
+#define HASHTREE_ARENA_CLASSES 128
+#define HASHTREE_ARENA_CHUNK_MIN 4096
+#define HASHTREE_ARENA_CHUNK_MAX (1 << 20)
+
+/* Concurrent Mode: threads announce the epoch they entered in;
+ *   a block retired in some epoch is only recycled once every announced epoch is later */
+#define HASHTREE_EPOCH_SLOTS 64
+#define HASHTREE_RETIRE_BATCH 64
+
+typedef struct {
+	unsigned long epoch;	/* 0 while unclaimed */
+	char pad[64 - sizeof( unsigned long )];	/* one cache line per slot */
+} HashTree_Epoch_Slot;
+
+typedef struct {
+	void *block;
+	size_t size;
+	unsigned long epoch;
+} HashTree_Retired;
+
+typedef struct HashTree_Sync {
+	pthread_mutex_t mutex;	/* guards the arena and the retired list */
+	unsigned long epoch;
+	HashTree_Epoch_Slot slot[HASHTREE_EPOCH_SLOTS];
+	HashTree_Retired *retired;
+	size_t retired_count, retired_capacity;
+} HashTree_Sync;
+
+typedef struct HashTree_Arena {
+	void *chunks;		/* chunks in use, each linked through its first word */
+	unsigned char *cursor;	/* unused tail of the newest chunk */
+	size_t remain;
+	size_t chunk_size;	/* doubles per chunk up to HASHTREE_ARENA_CHUNK_MAX */
+	void *free[HASHTREE_ARENA_CLASSES];
+	void *large;		/* oversized blocks, doubly linked */
+	HashTree_Sync *sync;	/* set in concurrent mode: releases are deferred by epoch */
+	pthread_mutex_t *lock;	/* set once snapshots share the arena: guards every allocation and release */
+} HashTree_Arena;
+
+/* Snapshots: a tree and the snapshots taken of it share nodes, and so the tree's arena */
+typedef struct {
+	pthread_mutex_t mutex;
+	HashTree_Arena *arena;	/* of the tree the snapshots were taken from */
+	void *owner;		/* that tree's header, which holds the arena until the last member goes */
+	unsigned long members;	/* the tree itself (until freed) and each live snapshot */
+} HashTree_Family;
+
+/* Tree Header */
+typedef struct HashTree_Header {
+	HashTree_Node *root;
+	HashTree_Arena arena;
+	size_t max_key_len;	/* longest key ever assigned; sizes traversal buffers */
+	size_t count;		/* entries held; atomic in concurrent mode */
+	const unsigned char *image;	/* set by HashTree_Map: the read-only mapping queried in place of root */
+	HashMap map;		/* set for the hashmap backend: entries live there in place of root */
+	HashTree_Family *family;	/* set once a snapshot has been taken of (or from) this tree */
+	bool snapshot;		/* an immutable view returned by HashTree_Snapshot */
+} HashTree_Header;
+
+/* Arena Access */
+void HashTree_Arena_Init( HashTree_Arena *arena );
+void HashTree_Arena_Free( HashTree_Arena *arena );
+void *HashTree_Arena_Alloc( HashTree_Arena *arena, size_t size );
+void HashTree_Arena_Release( HashTree_Arena *arena, void *block, size_t size );
+void HashTree_Arena_Adopt( HashTree_Arena *dest, HashTree_Arena *src );
+size_t HashTree_Arena_Footprint( size_t size );
+
+/* Subnode Listing Access */
+HashTree_Node *HashTree_Node_Init( HashTree_Arena *arena, unsigned char bid, const unsigned char *prefix, size_t prefix_len, void *data );
+extern const size_t HashTree_Node_Size[];
+extern const unsigned short HashTree_Node_Capacity[];
+HashTree_Node **HashTree_Node_Child( HashTree_Node *node, unsigned char bid );
+HashTree_Node *HashTree_Node_Next( HashTree_Node *node, int *cursor );
+int HashTree_Node_Cursor( HashTree_Node *node, unsigned char bid );
+HashTree_Node *HashTree_Node_Below( HashTree_Node *node, int limit );
+int HashTree_Node_Search( const unsigned char *key, int count, unsigned char bid );
+HashTree_Node *HashTree_Node_Merge( HashTree_Arena *arena, HashTree_Node *node, HashTree_Node **slot );
+void HashTree_Node_Free( HashTree_Arena *arena, HashTree_Node *node );
+size_t HashTree_Node_Match( HashTree_Node *node, const unsigned char *key, size_t key_len );
+bool HashTree_Node_Reserve( HashTree_Arena *arena, HashTree_Node *node, int count );
+bool HashTree_Node_AddChild( HashTree_Arena *arena, HashTree_Node *node, HashTree_Node *child );
+void HashTree_Node_DelChild( HashTree_Arena *arena, HashTree_Node *node, unsigned char bid );
+
+/* Concurrent Mode */
+void HashTree_Concurrent_Assign( HashTree ht, const void *hash, size_t hash_len, void *data );
+void *HashTree_Concurrent_Retrieve( HashTree ht, const void *hash, size_t hash_len );
+void HashTree_Concurrent_Release( HashTree ht, const void *hash, size_t hash_len );
+void HashTree_Sync_Free( HashTree_Sync *sync );
+
+/* Snapshots */
+HashTree_Node *HashTree_Node_Own( HashTree_Arena *arena, HashTree_Node **slot );
+bool HashTree_Node_OwnChild( HashTree_Arena *arena, HashTree_Node *node );
+void HashTree_Snapshot_Free( HashTree ht );
+
+/* Mapped Images */
+void *HashTree_Image_Retrieve( HashTree ht, const void *hash, size_t hash_len );
+void HashTree_Image_ForeachPrefix( HashTree ht, const void *prefix, size_t prefix_len, void (*callback)(void *, const void *, size_t, void *), void *data );
+size_t HashTree_Image_Length( HashTree ht );
+void HashTree_Image_Unmap( HashTree ht );
+
+#endif
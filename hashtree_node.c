@@ -0,0 +1,311 @@
+/* Adaptive subnode listings for the hashtree (Node4/16/48/256) */
+
+#include "hashtree_internal.h"
+#include <stdbool.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* Capacity of each kind */
+const unsigned short HashTree_Node_Capacity[] = { 4, 16, 48, 256 };
+
+/* Shrink a listing once it falls to this many subnodes; kept below the next kind's
+ *   capacity so a node hovering at a boundary does not convert on every change */
+static const unsigned short HashTree_Node_Shrink[] = { 0, 3, 12, 40 };
+
+const size_t HashTree_Node_Size[] = {
+	sizeof( HashTree_Node4 ), sizeof( HashTree_Node16 ), sizeof( HashTree_Node48 ), sizeof( HashTree_Node256 )
+};
+
+/* Position of bid within a sorted key array of 16 or fewer; -1 if absent (private) */
+int HashTree_Node_Search( const unsigned char *key, int count, unsigned char bid ) {
+#ifdef __SSE2__
+	if( count > 4 ) {
+		/* one compare against all 16 branch ids at once */
+		__m128i match = _mm_cmpeq_epi8( _mm_set1_epi8( (char)bid ), _mm_loadu_si128( (const __m128i *)key ) );
+		int mask = _mm_movemask_epi8( match ) & ((1 << count) - 1);
+		return mask != 0 ? __builtin_ctz( mask ) : -1;
+	}
+#endif
+	for( int ix = 0; ix < count; ix++ ) {
+		if( key[ix] == bid )
+			return ix;
+	}
+	return -1;
+}
+
+/* Locate the slot holding a subnode; NULL if there is no such branch */
+HashTree_Node **HashTree_Node_Child( HashTree_Node *node, unsigned char bid ) {
+	int ix;
+
+	if( node->subnode == NULL )
+		return NULL;
+
+	switch( node->kind ) {
+		case HASHTREE_NODE4: {
+			HashTree_Node4 *n4 = node->subnode;
+			ix = HashTree_Node_Search( n4->key, node->subnode_count, bid );
+			return ix < 0 ? NULL : &n4->child[ix];
+		}
+		case HASHTREE_NODE16: {
+			HashTree_Node16 *n16 = node->subnode;
+			ix = HashTree_Node_Search( n16->key, node->subnode_count, bid );
+			return ix < 0 ? NULL : &n16->child[ix];
+		}
+		case HASHTREE_NODE48: {
+			HashTree_Node48 *n48 = node->subnode;
+			ix = n48->index[bid];
+			return ix == 0 ? NULL : &n48->child[ix - 1];
+		}
+		default: {
+			HashTree_Node256 *n256 = node->subnode;
+			return n256->child[bid] == NULL ? NULL : &n256->child[bid];
+		}
+	}
+}
+
+/* Ordered walk of the subnodes; start cursor at 0, returns NULL when exhausted */
+HashTree_Node *HashTree_Node_Next( HashTree_Node *node, int *cursor ) {
+	if( node->subnode == NULL )
+		return NULL;
+
+	switch( node->kind ) {
+		case HASHTREE_NODE4:
+			return *cursor < node->subnode_count ? ((HashTree_Node4 *)node->subnode)->child[(*cursor)++] : NULL;
+		case HASHTREE_NODE16:
+			return *cursor < node->subnode_count ? ((HashTree_Node16 *)node->subnode)->child[(*cursor)++] : NULL;
+		case HASHTREE_NODE48: {
+			HashTree_Node48 *n48 = node->subnode;
+			while( *cursor < 256 ) {
+				int slot = n48->index[(*cursor)++];
+				if( slot != 0 )
+					return n48->child[slot - 1];
+			}
+			return NULL;
+		}
+		default: {
+			HashTree_Node256 *n256 = node->subnode;
+			while( *cursor < 256 ) {
+				HashTree_Node *child = n256->child[(*cursor)++];
+				if( child != NULL )
+					return child;
+			}
+			return NULL;
+		}
+	}
+}
+
+/* Cursor from which HashTree_Node_Next yields the subnodes with bid at or above the one given */
+int HashTree_Node_Cursor( HashTree_Node *node, unsigned char bid ) {
+	const unsigned char *key;
+	int ix = 0;
+
+	if( node->kind == HASHTREE_NODE48 || node->kind == HASHTREE_NODE256 )
+		return bid;
+
+	if( node->subnode == NULL )
+		return 0;
+
+	key = node->kind == HASHTREE_NODE4 ? ((HashTree_Node4 *)node->subnode)->key : ((HashTree_Node16 *)node->subnode)->key;
+	while( ix < node->subnode_count && key[ix] < bid )
+		ix++;
+	return ix;
+}
+
+/* The subnode with the greatest bid below limit (256 for the last subnode); NULL if none */
+HashTree_Node *HashTree_Node_Below( HashTree_Node *node, int limit ) {
+	if( node->subnode == NULL )
+		return NULL;
+
+	switch( node->kind ) {
+		case HASHTREE_NODE4:
+		case HASHTREE_NODE16: {
+			const unsigned char *key = node->kind == HASHTREE_NODE4 ? ((HashTree_Node4 *)node->subnode)->key : ((HashTree_Node16 *)node->subnode)->key;
+			HashTree_Node **child = node->kind == HASHTREE_NODE4 ? ((HashTree_Node4 *)node->subnode)->child : ((HashTree_Node16 *)node->subnode)->child;
+			for( int ix = node->subnode_count - 1; ix >= 0; ix-- ) {
+				if( key[ix] < limit )
+					return child[ix];
+			}
+			return NULL;
+		}
+		case HASHTREE_NODE48: {
+			HashTree_Node48 *n48 = node->subnode;
+			for( int bid = limit - 1; bid >= 0; bid-- ) {
+				if( n48->index[bid] != 0 )
+					return n48->child[n48->index[bid] - 1];
+			}
+			return NULL;
+		}
+		default: {
+			HashTree_Node256 *n256 = node->subnode;
+			for( int bid = limit - 1; bid >= 0; bid-- ) {
+				if( n256->child[bid] != NULL )
+					return n256->child[bid];
+			}
+			return NULL;
+		}
+	}
+}
+
+/* Rebuild a listing as another kind (private) */
+bool HashTree_Node_Convert( HashTree_Arena *arena, HashTree_Node *node, unsigned char kind ) {
+	HashTree_Node *child, *children[256];
+	int cursor = 0, count = 0;
+	unsigned char old_kind;
+	void *listing, *old;
+
+	listing = HashTree_Arena_Alloc( arena, HashTree_Node_Size[kind] );
+	if( listing == NULL )
+		return false /* error */;
+	memset( listing, 0, HashTree_Node_Size[kind] );
+
+	/* Subnodes come out ordered, which is all the sorted kinds need */
+	while( (child = HashTree_Node_Next( node, &cursor )) != NULL )
+		children[count++] = child;
+
+	for( int ix = 0; ix < count; ix++ ) {
+		unsigned char bid = children[ix]->bid;
+		switch( kind ) {
+			case HASHTREE_NODE4:
+				((HashTree_Node4 *)listing)->key[ix] = bid;
+				((HashTree_Node4 *)listing)->child[ix] = children[ix];
+				break;
+			case HASHTREE_NODE16:
+				((HashTree_Node16 *)listing)->key[ix] = bid;
+				((HashTree_Node16 *)listing)->child[ix] = children[ix];
+				break;
+			case HASHTREE_NODE48:
+				((HashTree_Node48 *)listing)->index[bid] = ix + 1;
+				((HashTree_Node48 *)listing)->child[ix] = children[ix];
+				break;
+			default:
+				((HashTree_Node256 *)listing)->child[bid] = children[ix];
+		}
+	}
+
+	/* Publish before releasing; in concurrent mode release is what starts the grace period */
+	old = node->subnode;
+	old_kind = node->kind;
+	__atomic_store_n( &node->subnode, listing, __ATOMIC_RELEASE );
+	node->kind = kind;
+	HashTree_Arena_Release( arena, old, HashTree_Node_Size[old_kind] );
+	return true;
+}
+
+/* Insert into a sorted inline key array with room to spare (private) */
+void HashTree_Node_Place( unsigned char *key, HashTree_Node **child, int count, HashTree_Node *newchild ) {
+	int ix = count;
+
+	while( ix > 0 && key[ix - 1] > newchild->bid ) {
+		key[ix] = key[ix - 1];
+		child[ix] = child[ix - 1];
+		ix--;
+	}
+
+	key[ix] = newchild->bid;
+	child[ix] = newchild;
+}
+
+/* Add a subnode under its bid, growing the listing as needed; the bid must be new */
+bool HashTree_Node_AddChild( HashTree_Arena *arena, HashTree_Node *node, HashTree_Node *child ) {
+	if( node->subnode == NULL ) {
+		node->subnode = HashTree_Arena_Alloc( arena, sizeof( HashTree_Node4 ) );
+		if( node->subnode == NULL )
+			return false /* error */;
+		memset( node->subnode, 0, sizeof( HashTree_Node4 ) );
+		node->kind = HASHTREE_NODE4;
+	} else if( node->subnode_count == HashTree_Node_Capacity[node->kind] ) {
+		if( !HashTree_Node_Convert( arena, node, node->kind + 1 ) )
+			return false /* error */;
+	}
+
+	switch( node->kind ) {
+		case HASHTREE_NODE4: {
+			HashTree_Node4 *n4 = node->subnode;
+			HashTree_Node_Place( n4->key, n4->child, node->subnode_count, child );
+			break;
+		}
+		case HASHTREE_NODE16: {
+			HashTree_Node16 *n16 = node->subnode;
+			HashTree_Node_Place( n16->key, n16->child, node->subnode_count, child );
+			break;
+		}
+		case HASHTREE_NODE48: {
+			HashTree_Node48 *n48 = node->subnode;
+			/* Slots are only ever taken from the end; DelChild keeps them packed */
+			n48->child[node->subnode_count] = child;
+			n48->index[child->bid] = node->subnode_count + 1;
+			break;
+		}
+		default:
+			((HashTree_Node256 *)node->subnode)->child[child->bid] = child;
+	}
+
+	node->subnode_count++;
+	return true;
+}
+
+/* Give a node without subnodes a listing of the smallest kind holding count of them,
+ *   so that count AddChild calls follow without any conversion */
+bool HashTree_Node_Reserve( HashTree_Arena *arena, HashTree_Node *node, int count ) {
+	unsigned char kind = HASHTREE_NODE4;
+
+	if( count == 0 )
+		return true;
+
+	while( HashTree_Node_Capacity[kind] < count )
+		kind++;
+
+	node->subnode = HashTree_Arena_Alloc( arena, HashTree_Node_Size[kind] );
+	if( node->subnode == NULL )
+		return false /* error */;
+	memset( node->subnode, 0, HashTree_Node_Size[kind] );
+	node->kind = kind;
+	return true;
+}
+
+/* Remove the subnode under bid (the subnode itself is left to the caller),
+ *   shrinking the listing when it has become sparse */
+void HashTree_Node_DelChild( HashTree_Arena *arena, HashTree_Node *node, unsigned char bid ) {
+	int ix;
+
+	switch( node->kind ) {
+		case HASHTREE_NODE4:
+		case HASHTREE_NODE16: {
+			unsigned char *key = node->kind == HASHTREE_NODE4 ? ((HashTree_Node4 *)node->subnode)->key : ((HashTree_Node16 *)node->subnode)->key;
+			HashTree_Node **child = node->kind == HASHTREE_NODE4 ? ((HashTree_Node4 *)node->subnode)->child : ((HashTree_Node16 *)node->subnode)->child;
+			ix = HashTree_Node_Search( key, node->subnode_count, bid );
+			memmove( key + ix, key + ix + 1, node->subnode_count - ix - 1 );
+			memmove( child + ix, child + ix + 1, sizeof( HashTree_Node * ) * (node->subnode_count - ix - 1) );
+			break;
+		}
+		case HASHTREE_NODE48: {
+			HashTree_Node48 *n48 = node->subnode;
+			int last = node->subnode_count - 1;
+			/* Move the last slot into the hole to keep the slots packed */
+			ix = n48->index[bid] - 1;
+			n48->index[bid] = 0;
+			if( ix != last ) {
+				n48->child[ix] = n48->child[last];
+				n48->index[n48->child[ix]->bid] = ix + 1;
+			}
+			n48->child[last] = NULL;
+			break;
+		}
+		default:
+			((HashTree_Node256 *)node->subnode)->child[bid] = NULL;
+	}
+
+	node->subnode_count--;
+
+	if( node->subnode_count == 0 ) {
+		void *old = node->subnode;
+		__atomic_store_n( &node->subnode, NULL, __ATOMIC_RELEASE );
+		HashTree_Arena_Release( arena, old, HashTree_Node_Size[node->kind] );
+		node->kind = HASHTREE_NODE4;
+	} else if( node->subnode_count <= HashTree_Node_Shrink[node->kind] ) {
+		/* On failure the larger listing simply stays */
+		HashTree_Node_Convert( arena, node, node->kind - 1 );
+	}
+}
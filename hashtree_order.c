@@ -0,0 +1,471 @@
+/* Ordered walks over the hashtree: prefix scans, ranges and neighbour lookups */
+
+#include "hashtree_internal.h"
+#include <stdbool.h>
+#include <string.h>
+
+/* One level of an ordered walk; a node is yielded before its subnodes */
+typedef struct {
+	HashTree_Node *node;
+	int cursor;
+	size_t key_len;
+	bool visited;
+} HashTree_Order_Frame;
+
+typedef struct {
+	HashTree_Order_Frame *frame;
+	int depth;
+	unsigned char *key;
+} HashTree_Order_Iter;
+
+bool HashTree_Order_Iter_Init( HashTree_Order_Iter *it, HashTree ht ) {
+	it->depth = -1;
+	it->key = malloc( ht->max_key_len + 1 );
+	it->frame = malloc( sizeof( HashTree_Order_Frame ) * (ht->max_key_len + 1) );
+	if( it->key == NULL || it->frame == NULL ) {
+		free( it->key );
+		free( it->frame );
+		return false /* error */;
+	}
+	return true;
+}
+
+void HashTree_Order_Iter_Free( HashTree_Order_Iter *it ) {
+	free( it->key );
+	free( it->frame );
+}
+
+/* Stack a node, spelling its bid and prefix after the key of the level below (private) */
+HashTree_Order_Frame *HashTree_Order_Iter_Push( HashTree_Order_Iter *it, HashTree_Node *node, bool visited ) {
+	HashTree_Order_Frame *frame = &it->frame[++it->depth];
+	size_t base = it->depth > 0 ? it->frame[it->depth - 1].key_len : 0;
+
+	frame->node = node;
+	frame->cursor = 0;
+	frame->visited = visited;
+	frame->key_len = base;
+	if( it->depth > 0 ) {
+		it->key[base] = node->bid;
+		memcpy( it->key + base + 1, node->prefix, node->prefix_len );
+		frame->key_len += 1 + node->prefix_len;
+	}
+
+	return frame;
+}
+
+/* Position the walk so that the next entry yielded is the first with key >= lo;
+ *   only the path towards lo is descended, everything to its left is never touched */
+void HashTree_Order_Iter_Seek( HashTree_Order_Iter *it, HashTree ht, const unsigned char *lo, size_t lo_len ) {
+	HashTree_Order_Frame *top;
+	size_t pos = 0;
+
+	it->depth = -1;
+	top = HashTree_Order_Iter_Push( it, ht->root, lo_len > 0 );
+
+	while( pos < lo_len ) {
+		HashTree_Node **slot, *child;
+		size_t rem, match;
+
+		/* Subnodes above lo[pos] all follow lo; the one equal to it needs a closer look */
+		top->cursor = HashTree_Node_Cursor( top->node, lo[pos] );
+		slot = HashTree_Node_Child( top->node, lo[pos] );
+		if( slot == NULL )
+			return;
+		child = *slot;
+		HashTree_Node_Next( top->node, &top->cursor );
+
+		rem = lo_len - pos - 1;
+		match = 0;
+		while( match < rem && match < child->prefix_len && child->prefix[match] == lo[pos + 1 + match] )
+			match++;
+
+		if( match < rem && match < child->prefix_len ) {
+			/* Paths part ways inside the prefix: the subtree lies wholly to one side of lo */
+			if( child->prefix[match] > lo[pos + 1 + match] )
+				HashTree_Order_Iter_Push( it, child, false );
+			return;
+		}
+
+		if( rem <= child->prefix_len ) {
+			/* lo ends on or inside this node, so the whole subtree is >= lo */
+			HashTree_Order_Iter_Push( it, child, false );
+			return;
+		}
+
+		top = HashTree_Order_Iter_Push( it, child, true );
+		pos += 1 + child->prefix_len;
+	}
+}
+
+/* Step to the next entry in key order; the key is left in it->key */
+bool HashTree_Order_Iter_Next( HashTree_Order_Iter *it, size_t *key_len, void **entry ) {
+	while( it->depth >= 0 ) {
+		HashTree_Order_Frame *top = &it->frame[it->depth];
+		HashTree_Node *child;
+
+		if( !top->visited ) {
+			top->visited = true;
+			if( top->node->data != NULL ) {
+				*key_len = top->key_len;
+				*entry = top->node->data;
+				return true;
+			}
+		} else if( (child = HashTree_Node_Next( top->node, &top->cursor )) != NULL ) {
+			HashTree_Order_Iter_Push( it, child, false );
+		} else {
+			it->depth--;
+		}
+	}
+
+	return false;
+}
+
+/* Three-way key comparison in tree order (private) */
+int HashTree_Order_Compare( const void *a, size_t a_len, const void *b, size_t b_len ) {
+	int cmp = memcmp( a, b, a_len < b_len ? a_len : b_len );
+	if( cmp != 0 )
+		return cmp;
+	return a_len < b_len ? -1 : a_len > b_len;
+}
+
+/* No trie to walk: every entry is checked (private) */
+typedef struct {
+	const void *prefix;
+	size_t prefix_len;
+	void (*callback)(void *, const void *, size_t, void *);
+	void *data;
+} HashTree_Order_Filter;
+
+void HashTree_Order_Filter_Callback( void *data, const void *hash, size_t hash_len, void *entry ) {
+	HashTree_Order_Filter *filter = data;
+
+	if( hash_len >= filter->prefix_len && memcmp( hash, filter->prefix, filter->prefix_len ) == 0 )
+		filter->callback( filter->data, hash, hash_len, entry );
+}
+
+/* Prefix Scan */
+void HashTree_ForeachPrefix( HashTree ht, const void *prefix, size_t prefix_len, void (*callback)(void *, const void *, size_t, void *), void *data ) {
+	HashTree_Order_Iter it;
+	size_t key_len;
+	void *entry;
+
+	if( ht->image != NULL ) {
+		HashTree_Image_ForeachPrefix( ht, prefix, prefix_len, callback, data );
+		return;
+	}
+	if( ht->map != NULL ) {
+		HashTree_Order_Filter filter = { prefix, prefix_len, callback, data };
+		HashMap_Foreach( ht->map, &HashTree_Order_Filter_Callback, &filter );
+		return;
+	}
+
+	if( !HashTree_Order_Iter_Init( &it, ht ) )
+		return /* error */;
+
+	/* Keys sharing the prefix are contiguous and start at the prefix itself */
+	HashTree_Order_Iter_Seek( &it, ht, prefix, prefix_len );
+	while( HashTree_Order_Iter_Next( &it, &key_len, &entry ) ) {
+		if( key_len < prefix_len || memcmp( it.key, prefix, prefix_len ) != 0 )
+			break;
+		callback( data, it.key, key_len, entry );
+	}
+
+	HashTree_Order_Iter_Free( &it );
+}
+
+/* No trie to walk (the hashmap backend, mapped images): the range is gathered from
+ *   every entry, then sorted (private) */
+typedef struct {
+	unsigned char *key;
+	size_t key_len;
+	void *entry;
+} HashTree_Order_Item;
+
+typedef struct {
+	const void *lo, *hi;
+	size_t lo_len, hi_len;
+	HashTree_Order_Item *item;
+	size_t items, capacity;
+	bool failed;
+} HashTree_Order_Gather;
+
+void HashTree_Order_Gather_Callback( void *data, const void *hash, size_t hash_len, void *entry ) {
+	HashTree_Order_Gather *gather = data;
+	HashTree_Order_Item *item;
+
+	if( gather->failed || HashTree_Order_Compare( hash, hash_len, gather->lo, gather->lo_len ) < 0 )
+		return;
+	if( gather->hi != NULL && HashTree_Order_Compare( hash, hash_len, gather->hi, gather->hi_len ) >= 0 )
+		return;
+
+	if( gather->items == gather->capacity ) {
+		size_t capacity = gather->capacity == 0 ? 64 : gather->capacity * 2;
+		HashTree_Order_Item *tmp = realloc( gather->item, sizeof( HashTree_Order_Item ) * capacity );
+		if( tmp == NULL ) {
+			gather->failed = true;
+			return /* error */;
+		}
+		gather->item = tmp;
+		gather->capacity = capacity;
+	}
+
+	item = &gather->item[gather->items];
+	item->key = malloc( hash_len + 1 );
+	if( item->key == NULL ) {
+		gather->failed = true;
+		return /* error */;
+	}
+	memcpy( item->key, hash, hash_len );
+	item->key_len = hash_len;
+	item->entry = entry;
+	gather->items++;
+}
+
+int HashTree_Order_Item_Compare( const void *a, const void *b ) {
+	const HashTree_Order_Item *ia = a, *ib = b;
+	return HashTree_Order_Compare( ia->key, ia->key_len, ib->key, ib->key_len );
+}
+
+void HashTree_Order_Scan_Range( HashTree ht, const void *lo, size_t lo_len, const void *hi, size_t hi_len, void (*callback)(void *, const void *, size_t, void *), void *data ) {
+	HashTree_Order_Gather gather = { lo, hi, lo_len, hi_len, NULL, 0, 0, false };
+
+	HashTree_Foreach( ht, &HashTree_Order_Gather_Callback, &gather, 1 );
+	if( !gather.failed && gather.items > 0 ) {
+		qsort( gather.item, gather.items, sizeof( HashTree_Order_Item ), &HashTree_Order_Item_Compare );
+		for( size_t ix = 0; ix < gather.items; ix++ )
+			callback( data, gather.item[ix].key, gather.item[ix].key_len, gather.item[ix].entry );
+	}
+
+	for( size_t ix = 0; ix < gather.items; ix++ )
+		free( gather.item[ix].key );
+	free( gather.item );
+}
+
+/* Range Scan */
+void HashTree_Range( HashTree ht, const void *lo, size_t lo_len, const void *hi, size_t hi_len, void (*callback)(void *, const void *, size_t, void *), void *data ) {
+	HashTree_Order_Iter it;
+	size_t key_len;
+	void *entry;
+
+	if( ht->root == NULL ) {
+		HashTree_Order_Scan_Range( ht, lo, lo_len, hi, hi_len, callback, data );
+		return;
+	}
+
+	if( !HashTree_Order_Iter_Init( &it, ht ) )
+		return /* error */;
+
+	HashTree_Order_Iter_Seek( &it, ht, lo, lo_len );
+	while( HashTree_Order_Iter_Next( &it, &key_len, &entry ) ) {
+		if( hi != NULL && HashTree_Order_Compare( it.key, key_len, hi, hi_len ) >= 0 )
+			break;
+		callback( data, it.key, key_len, entry );
+	}
+
+	HashTree_Order_Iter_Free( &it );
+}
+
+/* Hand a found key back to the caller (private) */
+bool HashTree_Order_Result( const unsigned char *found, size_t found_len, void *found_entry, void **key, size_t *key_len, void **entry ) {
+	if( key != NULL ) {
+		*key = malloc( found_len + 1 );
+		if( *key == NULL )
+			return false /* error */;
+		memcpy( *key, found, found_len );
+	}
+	if( key_len != NULL )
+		*key_len = found_len;
+	if( entry != NULL )
+		*entry = found_entry;
+	return true;
+}
+
+/* No trie to walk: every entry is checked against the best found so far (private) */
+#define HASHTREE_ORDER_BELOW -1		/* greatest key < hash */
+#define HASHTREE_ORDER_AT 0		/* least key >= hash */
+#define HASHTREE_ORDER_ABOVE 1		/* least key > hash */
+
+typedef struct {
+	const void *hash;
+	size_t hash_len;
+	int want;
+	unsigned char *best;
+	size_t best_len, best_capacity;
+	void *entry;
+	bool found, failed;
+} HashTree_Order_Nearest;
+
+void HashTree_Order_Nearest_Callback( void *data, const void *hash, size_t hash_len, void *entry ) {
+	HashTree_Order_Nearest *nearest = data;
+	int cmp = HashTree_Order_Compare( hash, hash_len, nearest->hash, nearest->hash_len );
+
+	if( nearest->failed )
+		return;
+	if( nearest->want == HASHTREE_ORDER_BELOW ? cmp >= 0 : nearest->want == HASHTREE_ORDER_AT ? cmp < 0 : cmp <= 0 )
+		return;
+
+	/* Below wants the greatest candidate, the others the least */
+	if( nearest->found ) {
+		cmp = HashTree_Order_Compare( hash, hash_len, nearest->best, nearest->best_len );
+		if( nearest->want == HASHTREE_ORDER_BELOW ? cmp <= 0 : cmp >= 0 )
+			return;
+	}
+
+	if( hash_len + 1 > nearest->best_capacity ) {
+		unsigned char *tmp = realloc( nearest->best, hash_len + 1 );
+		if( tmp == NULL ) {
+			nearest->failed = true;
+			return /* error */;
+		}
+		nearest->best = tmp;
+		nearest->best_capacity = hash_len + 1;
+	}
+	memcpy( nearest->best, hash, hash_len );
+	nearest->best_len = hash_len;
+	nearest->entry = entry;
+	nearest->found = true;
+}
+
+bool HashTree_Order_Scan_Nearest( HashTree ht, const void *hash, size_t hash_len, int want, void **key, size_t *key_len, void **entry ) {
+	HashTree_Order_Nearest nearest = { hash, hash_len, want, NULL, 0, 0, NULL, false, false };
+	bool result = false;
+
+	HashTree_Foreach( ht, &HashTree_Order_Nearest_Callback, &nearest, 1 );
+	if( nearest.found && !nearest.failed )
+		result = HashTree_Order_Result( nearest.best, nearest.best_len, nearest.entry, key, key_len, entry );
+
+	free( nearest.best );
+	return result;
+}
+
+/* Neighbour Lookups */
+bool HashTree_LowerBound( HashTree ht, const void *hash, size_t hash_len, void **key, size_t *key_len, void **entry ) {
+	HashTree_Order_Iter it;
+	size_t found_len;
+	void *found;
+	bool result = false;
+
+	if( ht->root == NULL )
+		return HashTree_Order_Scan_Nearest( ht, hash, hash_len, HASHTREE_ORDER_AT, key, key_len, entry );
+
+	if( !HashTree_Order_Iter_Init( &it, ht ) )
+		return false /* error */;
+
+	HashTree_Order_Iter_Seek( &it, ht, hash, hash_len );
+	if( HashTree_Order_Iter_Next( &it, &found_len, &found ) )
+		result = HashTree_Order_Result( it.key, found_len, found, key, key_len, entry );
+
+	HashTree_Order_Iter_Free( &it );
+	return result;
+}
+
+bool HashTree_Successor( HashTree ht, const void *hash, size_t hash_len, void **key, size_t *key_len, void **entry ) {
+	HashTree_Order_Iter it;
+	size_t found_len;
+	void *found;
+	bool result = false;
+
+	if( ht->root == NULL )
+		return HashTree_Order_Scan_Nearest( ht, hash, hash_len, HASHTREE_ORDER_ABOVE, key, key_len, entry );
+
+	if( !HashTree_Order_Iter_Init( &it, ht ) )
+		return false /* error */;
+
+	/* The lower bound, unless it is the key itself */
+	HashTree_Order_Iter_Seek( &it, ht, hash, hash_len );
+	if( HashTree_Order_Iter_Next( &it, &found_len, &found ) ) {
+		if( found_len != hash_len || memcmp( it.key, hash, hash_len ) != 0 ) {
+			result = HashTree_Order_Result( it.key, found_len, found, key, key_len, entry );
+		} else if( HashTree_Order_Iter_Next( &it, &found_len, &found ) ) {
+			result = HashTree_Order_Result( it.key, found_len, found, key, key_len, entry );
+		}
+	}
+
+	HashTree_Order_Iter_Free( &it );
+	return result;
+}
+
+/* Descend along hash, remembering the nearest subtree (or node) lying wholly below it;
+ *   the answer is then the greatest key of that subtree */
+bool HashTree_Predecessor( HashTree ht, const void *hash, size_t hash_len, void **key, size_t *key_len, void **entry ) {
+	const unsigned char *target = hash;
+	HashTree_Node *node = ht->root, *best = NULL;
+	size_t pos = 0, best_pos = 0;
+	bool best_whole = false;	/* best is a subtree to take the maximum of, not just its own entry */
+	unsigned char *found;
+	size_t found_len;
+	bool result;
+
+	if( ht->root == NULL )
+		return HashTree_Order_Scan_Nearest( ht, hash, hash_len, HASHTREE_ORDER_BELOW, key, key_len, entry );
+
+	while( pos < hash_len ) {
+		HashTree_Node **slot, *below, *child;
+		size_t rem, match;
+
+		/* A lesser sibling's subtree beats this node's own key, which is a prefix of it */
+		below = HashTree_Node_Below( node, target[pos] );
+		if( below != NULL ) {
+			best = below;
+			best_pos = pos;
+			best_whole = true;
+		} else if( node->data != NULL ) {
+			best = node;
+			best_pos = pos;
+			best_whole = false;
+		}
+
+		slot = HashTree_Node_Child( node, target[pos] );
+		if( slot == NULL )
+			break;
+		child = *slot;
+
+		rem = hash_len - pos - 1;
+		match = 0;
+		while( match < rem && match < child->prefix_len && child->prefix[match] == target[pos + 1 + match] )
+			match++;
+
+		if( match < rem && match < child->prefix_len ) {
+			if( child->prefix[match] < target[pos + 1 + match] ) {
+				best = child;
+				best_pos = pos;
+				best_whole = true;
+			}
+			break;
+		}
+
+		/* The child's key equals or extends hash: nothing at or under it is smaller */
+		if( rem <= child->prefix_len )
+			break;
+
+		node = child;
+		pos += 1 + child->prefix_len;
+	}
+
+	if( best == NULL )
+		return false;
+
+	/* Rebuild the key: the shared part of hash, then down the right edge of best */
+	found = malloc( ht->max_key_len + 1 );
+	if( found == NULL )
+		return false /* error */;
+	memcpy( found, target, best_pos );
+	found_len = best_pos;
+
+	if( best_whole ) {
+		HashTree_Node *edge = best;
+		for( ;; ) {
+			found[found_len] = edge->bid;
+			memcpy( found + found_len + 1, edge->prefix, edge->prefix_len );
+			found_len += 1 + edge->prefix_len;
+			if( edge->subnode_count == 0 )
+				break;
+			edge = HashTree_Node_Below( edge, 256 );
+		}
+		best = edge;
+	}
+
+	result = HashTree_Order_Result( found, found_len, best->data, key, key_len, entry );
+	free( found );
+	return result;
+}
@@ -0,0 +1,144 @@
+/* Persistent snapshots of the hashtree: structural sharing with path copying */
+
+#include "hashtree_internal.h"
+#include <stdbool.h>
+#include <string.h>
+
+/* Drop one reference to a node, releasing it (and, in turn, whatever only it referred to)
+ *   once none are left (private) */
+void HashTree_Node_Unref( HashTree_Arena *arena, HashTree_Node *node ) {
+	HashTree_Node **stack = NULL, *child;
+	size_t depth = 0, capacity = 0;
+
+	if( __atomic_sub_fetch( &node->refs, 1, __ATOMIC_ACQ_REL ) != 0 )
+		return;
+
+	while( node != NULL ) {
+		int cursor = 0;
+
+		while( (child = HashTree_Node_Next( node, &cursor )) != NULL ) {
+			if( __atomic_sub_fetch( &child->refs, 1, __ATOMIC_ACQ_REL ) != 0 )
+				continue;
+			if( depth == capacity ) {
+				size_t grown = capacity == 0 ? 64 : capacity * 2;
+				HashTree_Node **tmp = realloc( stack, sizeof( HashTree_Node * ) * grown );
+				if( tmp == NULL )
+					continue /* error: the subtree stays in the arena until the bulk release */;
+				stack = tmp;
+				capacity = grown;
+			}
+			stack[depth++] = child;
+		}
+
+		HashTree_Arena_Release( arena, node->subnode, HashTree_Node_Size[node->kind] );
+		HashTree_Node_Free( arena, node );
+		node = depth > 0 ? stack[--depth] : NULL;
+	}
+
+	free( stack );
+}
+
+/* Make the node in slot this tree's alone, copying it if anything else shares it;
+ *   the copy takes a reference to each subnode.  Returns the node now in slot, NULL on failure */
+HashTree_Node *HashTree_Node_Own( HashTree_Arena *arena, HashTree_Node **slot ) {
+	HashTree_Node *node = *slot, *copy, *child;
+	int cursor = 0;
+
+	if( __atomic_load_n( &node->refs, __ATOMIC_ACQUIRE ) == 1 )
+		return node;
+
+	copy = HashTree_Node_Init( arena, node->bid, node->prefix, node->prefix_len, node->data );
+	if( copy == NULL )
+		return NULL /* error */;
+
+	if( node->subnode != NULL ) {
+		copy->subnode = HashTree_Arena_Alloc( arena, HashTree_Node_Size[node->kind] );
+		if( copy->subnode == NULL ) {
+			HashTree_Node_Free( arena, copy );
+			return NULL /* error */;
+		}
+		memcpy( copy->subnode, node->subnode, HashTree_Node_Size[node->kind] );
+		copy->kind = node->kind;
+		copy->subnode_count = node->subnode_count;
+		while( (child = HashTree_Node_Next( node, &cursor )) != NULL )
+			__atomic_add_fetch( &child->refs, 1, __ATOMIC_RELAXED );
+	}
+
+	*slot = copy;
+	HashTree_Node_Unref( arena, node );
+	return copy;
+}
+
+/* Own the single subnode of a node about to be merged with it */
+bool HashTree_Node_OwnChild( HashTree_Arena *arena, HashTree_Node *node ) {
+	int cursor = 0;
+	HashTree_Node *child = HashTree_Node_Next( node, &cursor );
+
+	return HashTree_Node_Own( arena, HashTree_Node_Child( node, child->bid ) ) != NULL;
+}
+
+HashTree HashTree_Snapshot( HashTree ht ) {
+	HashTree_Family *family = ht->family;
+	HashTree snap;
+
+	if( ht->root == NULL || ht->arena.sync != NULL )
+		return NULL /* unsupported */;
+
+	/* The first snapshot puts the tree's arena under a lock; snapshots may free from any thread */
+	if( family == NULL ) {
+		family = malloc( sizeof( HashTree_Family ) );
+		if( family == NULL )
+			return NULL /* error */;
+		pthread_mutex_init( &family->mutex, NULL );
+		family->arena = &ht->arena;
+		family->owner = ht;
+		family->members = 1;
+		ht->family = family;
+		ht->arena.lock = &family->mutex;
+	}
+
+	snap = malloc( sizeof( HashTree_Header ) );
+	if( snap == NULL )
+		return NULL /* error */;
+
+	/* The snapshot's own arena stays empty; its nodes belong to the family's */
+	HashTree_Arena_Init( &snap->arena );
+	snap->root = ht->root;
+	snap->max_key_len = ht->max_key_len;
+	snap->count = ht->count;
+	snap->image = NULL;
+	snap->map = NULL;
+	snap->family = family;
+	snap->snapshot = true;
+	__atomic_add_fetch( &ht->root->refs, 1, __ATOMIC_RELAXED );
+
+	pthread_mutex_lock( &family->mutex );
+	family->members++;
+	pthread_mutex_unlock( &family->mutex );
+
+	return snap;
+}
+
+/* Free one member of a family: its nodes go as their last reference does,
+ *   the arena (and the header holding it) with the last member */
+void HashTree_Snapshot_Free( HashTree ht ) {
+	HashTree_Family *family = ht->family;
+	bool last;
+
+	HashTree_Node_Unref( family->arena, ht->root );
+	ht->root = NULL;
+
+	pthread_mutex_lock( &family->mutex );
+	last = --family->members == 0;
+	pthread_mutex_unlock( &family->mutex );
+
+	if( ht != family->owner )
+		free( ht );
+
+	if( last ) {
+		HashTree_Arena_Free( family->arena );
+		free( family->owner );
+		pthread_mutex_destroy( &family->mutex );
+		free( family );
+	}
+}
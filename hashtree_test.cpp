@@ -0,0 +1,1223 @@
+/* HashTree verification: every operation is checked against a std::map reference */
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <regex>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <unistd.h>
+#include <fcntl.h>
+
+extern "C" {
+#include "hashtree.h"
+#include "hashmap.h"
+}
+#include "inttree.hpp"
+
+using namespace std;
+
+#define DISPLAY_DEBUG true
+
+struct aTest {
+	bool (*test)();
+	string name;
+};
+
+void showhelp( const vector<aTest> &mytests ) {
+	cout << "Tests:" << endl;
+	cout << "\t0. All Tests" << endl;
+	for( int ix = 0; ix < mytests.size(); ix++ ) {
+		cout << "\t" << ix + 1 << ". " << mytests[ix].name << endl;
+	}
+}
+
+void argproc( int argc, char **argv, const vector<aTest> &mytests, vector<int> &runtests ) {
+	regex test("[0-9]+");
+	regex help("-h|--help");
+	cmatch m;
+	
+	vector<char *> fail;
+	
+	for( int ix = 1; ix < argc; ix++ ) {
+		regex_match( argv[ix], m, test );
+		if( !m.empty() ) {
+			int id = atoi( argv[ix] );
+			if( id <= mytests.size() ) {
+				runtests.push_back( id );
+			} else {
+				fail.push_back( argv[ ix ] );
+			}
+		} else {
+			regex_match( argv[ix], m, help );
+			if( !m.empty() ) {
+				showhelp( mytests );
+				exit( EXIT_SUCCESS );
+			} else {
+				fail.push_back( argv[ix] );
+			}
+		}
+	}
+	
+	for( int ie = 0; ie < fail.size(); ie++ ) {
+		cerr << "ERROR: Invalid Test: `" << fail[ie] << "'" << endl;
+	}
+	
+	if( fail.size() > 0 ) {
+		cerr << "FATAL: Errors Occurred; Use -h or --help to list valid tests." << endl;
+		exit( EXIT_FAILURE );
+	}
+}
+
+#define CHECK( test, fmsg, res ) \
+	if( !(test) ) { \
+		if( DISPLAY_DEBUG ) \
+			cout << "FAIL: " << fmsg << " (" #test ")" << endl; \
+		res = false; \
+	}
+
+#define DISPL( msg, d ) \
+	if( DISPLAY_DEBUG ) \
+		cout << "(" << msg << "): " << d << endl;
+
+typedef map<string, void *> Reference;
+
+/* Entries as a walk hands them back */
+typedef vector< pair<string, void *> > Visits;
+
+extern "C" void collect( void *data, const void *hash, size_t hash_len, void *entry ) {
+	((Visits *)data)->push_back( make_pair( string( (const char *)hash, hash_len ), entry ) );
+}
+
+/* Concurrent walks hand entries back from several threads at once */
+mutex collect_lock;
+
+extern "C" void collect_locked( void *data, const void *hash, size_t hash_len, void *entry ) {
+	lock_guard<mutex> hold( collect_lock );
+	collect( data, hash, hash_len, entry );
+}
+
+/* A random key of up to max bytes, drawn from a small alphabet so that keys share prefixes
+ *   (and from every byte value now and then, so that listings fill up) */
+string randkey( size_t max ) {
+	string key;
+	size_t len = rand() % (max + 1);
+
+	for( size_t ix = 0; ix < len; ix++ )
+		key += (char)(rand() % 8 == 0 ? rand() % 256 : "abcd"[rand() % 4]);
+	return key;
+}
+
+/* Every entry of the reference is found, and nothing else is counted */
+bool matches( HashTree ht, const Reference &ref ) {
+	bool same = HashTree_Count( ht ) == ref.size();
+
+	for( Reference::const_iterator it = ref.begin(); it != ref.end(); it++ )
+		same &= HashTree_Retrieve( ht, it->first.data(), it->first.size() ) == it->second;
+	return same;
+}
+
+/* A walk visited exactly the reference's entries, in order if it is meant to be */
+bool visited( Visits seen, const Reference &ref, bool ordered ) {
+	if( !ordered )
+		sort( seen.begin(), seen.end() );
+	return seen == Visits( ref.begin(), ref.end() );
+}
+
+/* The reference's entries in [lo, hi); an empty hi leaves the range open-ended */
+Reference span( const Reference &ref, const string &lo, const string *hi ) {
+	Reference part;
+
+	for( Reference::const_iterator it = ref.lower_bound( lo ); it != ref.end() && (hi == NULL || it->first < *hi); it++ )
+		part.insert( *it );
+	return part;
+}
+
+// Basic Setup/Teardown test
+bool test_init() {
+	bool result = true;
+	int one = 1, two = 2;
+	HashTree ht = HashTree_Init();
+
+	CHECK( ht != NULL, "Tree not allocated", result );
+	CHECK( HashTree_Backend( ht ) == HASHTREE_BACKEND_TRIE, "Default backend not the trie", result );
+	CHECK( HashTree_Count( ht ) == 0, "New tree not empty", result );
+	CHECK( HashTree_Retrieve( ht, "a", 1 ) == NULL, "Empty tree found an entry", result );
+
+	HashTree_Assign( ht, "abc", 3, &one );
+	HashTree_Assign( ht, "", 0, &two );
+	CHECK( HashTree_Retrieve( ht, "abc", 3 ) == &one, "Entry not stored", result );
+	CHECK( HashTree_Retrieve( ht, "", 0 ) == &two, "Empty key not stored", result );
+	CHECK( HashTree_Retrieve( ht, "ab", 2 ) == NULL, "Prefix of a key found", result );
+	CHECK( HashTree_Count( ht ) == 2, "Count incorrect", result );
+
+	HashTree_Assign( ht, "abc", 3, &two );
+	CHECK( HashTree_Retrieve( ht, "abc", 3 ) == &two, "Entry not reassigned", result );
+	CHECK( HashTree_Count( ht ) == 2, "Reassignment counted", result );
+
+	HashTree_Release( ht, "abc", 3 );
+	HashTree_Release( ht, "zzz", 3 );
+	CHECK( HashTree_Retrieve( ht, "abc", 3 ) == NULL, "Entry not released", result );
+	CHECK( HashTree_Count( ht ) == 1, "Release miscounted", result );
+
+	HashTree_Free( &ht );
+	CHECK( ht == NULL, "Memory not released", result );
+	return result;
+}
+
+// Path compression test: chains split as keys branch apart and merge back as they go
+bool test_patricia() {
+	bool result = true;
+	int v[4] = { 0, 1, 2, 3 };
+	HashTree_Statistics stats;
+	HashTree ht = HashTree_Init();
+
+	/* One long key is a single node below the root */
+	string lone( 200, 'x' );
+	HashTree_Assign( ht, lone.data(), lone.size(), &v[0] );
+	CHECK( HashTree_Stats( ht, &stats ), "Stats failed", result );
+	CHECK( stats.entries == 1 && stats.max_depth == 1, "Long key not compressed", result );
+	DISPL( "nodes for one 200 byte key", stats.nodes );
+
+	/* Branching part way along splits it; a key ending at the split point sits on the split node */
+	string fork = lone.substr( 0, 100 ) + "y";
+	string stem = lone.substr( 0, 100 );
+	HashTree_Assign( ht, fork.data(), fork.size(), &v[1] );
+	HashTree_Assign( ht, stem.data(), stem.size(), &v[2] );
+	CHECK( HashTree_Retrieve( ht, lone.data(), lone.size() ) == &v[0], "Split lost the long key", result );
+	CHECK( HashTree_Retrieve( ht, fork.data(), fork.size() ) == &v[1], "Branch not stored", result );
+	CHECK( HashTree_Retrieve( ht, stem.data(), stem.size() ) == &v[2], "Key at the split not stored", result );
+	CHECK( HashTree_Retrieve( ht, lone.data(), 150 ) == NULL, "Key inside a prefix found", result );
+	CHECK( HashTree_Stats( ht, &stats ), "Stats failed", result );
+	CHECK( stats.max_depth == 2, "Split not at the branch point", result );
+	DISPL( "nodes after the split", stats.nodes );
+
+	/* Releasing the branch and the split key merges the chain back into one node */
+	HashTree_Release( ht, fork.data(), fork.size() );
+	HashTree_Release( ht, stem.data(), stem.size() );
+	CHECK( HashTree_Retrieve( ht, lone.data(), lone.size() ) == &v[0], "Merge lost the long key", result );
+	CHECK( HashTree_Stats( ht, &stats ), "Stats failed", result );
+	CHECK( stats.entries == 1 && stats.max_depth == 1, "Chain not merged back", result );
+
+	/* Releasing the last entry leaves nothing behind */
+	HashTree_Release( ht, lone.data(), lone.size() );
+	CHECK( HashTree_Stats( ht, &stats ), "Stats failed", result );
+	CHECK( stats.entries == 0 && stats.max_depth == 0, "Released tree not empty", result );
+
+	HashTree_Free( &ht );
+	return result;
+}
+
+// Node kind test: one node's listing grows through every kind and shrinks back
+bool test_kinds() {
+	bool result = true;
+	static int v[256];
+	const int grow[4] = { 4, 16, 48, 256 };
+	HashTree_Statistics stats;
+	HashTree ht = HashTree_Init();
+	unsigned char key[2] = { 'k', 0 };
+
+	/* Children of "k" under every byte value, checking the kind as each limit is reached */
+	int kind = 0;
+	for( int ix = 0; ix < 256; ix++ ) {
+		key[1] = (unsigned char)(ix * 37);
+		HashTree_Assign( ht, key, 2, &v[ix] );
+		if( ix + 1 == grow[kind] ) {
+			CHECK( HashTree_Stats( ht, &stats ), "Stats failed", result );
+			/* The root's own Node4 is counted alongside */
+			CHECK( stats.kind[kind] == (kind == HASHTREE_NODE4 ? 2 : 1), "Listing not of the expected kind while growing", result );
+			CHECK( stats.fanout[ix + 1] == 1, "Fanout not recorded", result );
+			kind++;
+		}
+	}
+	CHECK( HashTree_Stats( ht, &stats ), "Stats failed", result );
+	CHECK( stats.kind[HASHTREE_NODE256] == 1 && stats.kind[HASHTREE_NODE48] == 0, "Full listing not a Node256", result );
+	CHECK( stats.wasted_slots == 3, "Waste other than the root's Node4 reported", result );
+
+	bool same = true;
+	for( int ix = 0; ix < 256; ix++ ) {
+		key[1] = (unsigned char)(ix * 37);
+		same &= HashTree_Retrieve( ht, key, 2 ) == &v[ix];
+	}
+	CHECK( same, "Entries lost while growing", result );
+
+	/* Releasing them again walks back down through the kinds */
+	for( int ix = 255; ix >= 2; ix-- ) {
+		key[1] = (unsigned char)(ix * 37);
+		HashTree_Release( ht, key, 2 );
+	}
+	CHECK( HashTree_Stats( ht, &stats ), "Stats failed", result );
+	CHECK( stats.kind[HASHTREE_NODE256] == 0 && stats.kind[HASHTREE_NODE48] == 0 && stats.kind[HASHTREE_NODE16] == 0, "Sparse listing not shrunk", result );
+	CHECK( stats.kind[HASHTREE_NODE4] == 2 && stats.fanout[2] == 1, "Shrunk listing not a Node4", result );
+	same = true;
+	for( int ix = 0; ix < 2; ix++ ) {
+		key[1] = (unsigned char)(ix * 37);
+		same &= HashTree_Retrieve( ht, key, 2 ) == &v[ix];
+	}
+	CHECK( same, "Entries lost while shrinking", result );
+
+	HashTree_Free( &ht );
+	return result;
+}
+
+// Random mix of changes against a reference; the arena recycles what is released
+bool test_random() {
+	bool result = true;
+	static int v[4096];
+	Reference ref;
+	HashTree_Statistics stats;
+	size_t bytes = 0;
+
+	srand( 32 );
+	for( int backend = HASHTREE_BACKEND_TRIE; backend <= HASHTREE_BACKEND_HASHMAP; backend++ ) {
+		HashTree ht = HashTree_InitBackend( backend );
+		ref.clear();
+		CHECK( HashTree_Backend( ht ) == backend, "Backend not recorded", result );
+
+		for( int round = 0; round < 3; round++ ) {
+			for( int ix = 0; ix < 20000; ix++ ) {
+				string key = randkey( 24 );
+				if( rand() % 3 == 0 ) {
+					HashTree_Release( ht, key.data(), key.size() );
+					ref.erase( key );
+				} else {
+					void *value = &v[rand() % 4096];
+					HashTree_Assign( ht, key.data(), key.size(), value );
+					ref[key] = value;
+				}
+			}
+			CHECK( matches( ht, ref ), "Tree disagrees with reference", result );
+
+			/* Empty it out; the same keys coming back should take no more arena than before */
+			for( Reference::iterator it = ref.begin(); it != ref.end(); it++ )
+				HashTree_Release( ht, it->first.data(), it->first.size() );
+			ref.clear();
+			CHECK( HashTree_Count( ht ) == 0, "Tree not emptied", result );
+			if( backend == HASHTREE_BACKEND_TRIE ) {
+				CHECK( HashTree_Stats( ht, &stats ), "Stats failed", result );
+				CHECK( stats.nodes == 1 && stats.max_depth == 0, "Nodes left behind the root", result );
+			}
+		}
+
+		/* Refill once more */
+		for( int ix = 0; ix < 20000; ix++ ) {
+			string key = randkey( 24 );
+			HashTree_Assign( ht, key.data(), key.size(), &v[ix % 4096] );
+			ref[key] = &v[ix % 4096];
+		}
+		CHECK( matches( ht, ref ), "Refilled tree disagrees with reference", result );
+
+		CHECK( HashTree_Stats( ht, &stats ), "Stats failed", result );
+		CHECK( stats.entries == ref.size(), "Stats miscount entries", result );
+		if( backend == HASHTREE_BACKEND_TRIE ) {
+			CHECK( stats.avg_depth > 0 && stats.max_depth >= stats.avg_depth, "Depths inconsistent", result );
+			bytes = stats.bytes;
+		}
+		DISPL( (backend == HASHTREE_BACKEND_TRIE ? "trie bytes" : "hashmap bytes"), stats.bytes );
+
+		HashTree_Free( &ht );
+	}
+	CHECK( bytes > 0, "Arena use not reported", result );
+	return result;
+}
+
+// Foreach test: every entry visited once, by any number of threads
+bool test_foreach() {
+	bool result = true;
+	static int v[4096];
+	Reference ref;
+
+	srand( 35 );
+	for( int backend = HASHTREE_BACKEND_TRIE; backend <= HASHTREE_BACKEND_HASHMAP; backend++ ) {
+		HashTree ht = HashTree_InitBackend( backend );
+		ref.clear();
+
+		/* Nothing to visit, then just the empty key */
+		Visits seen;
+		HashTree_Foreach( ht, &collect_locked, &seen, 4 );
+		CHECK( seen.empty(), "Empty tree visited", result );
+		HashTree_Assign( ht, "", 0, &v[0] );
+		ref[""] = &v[0];
+		HashTree_Foreach( ht, &collect_locked, &seen, 4 );
+		CHECK( visited( seen, ref, false ), "Empty key not visited", result );
+
+		/* Deep and shallow subtrees alike, more threads than the root has children */
+		for( int ix = 0; ix < 20000; ix++ ) {
+			string key = randkey( ix % 10 == 0 ? 200 : 24 );
+			HashTree_Assign( ht, key.data(), key.size(), &v[ix % 4096] );
+			ref[key] = &v[ix % 4096];
+		}
+		for( int threads = 1; threads <= 16; threads *= 2 ) {
+			seen.clear();
+			HashTree_Foreach( ht, threads > 1 ? &collect_locked : &collect, &seen, threads );
+			CHECK( visited( seen, ref, false ), "Foreach disagrees with reference", result );
+		}
+		DISPL( (backend == HASHTREE_BACKEND_TRIE ? "trie entries walked" : "hashmap entries walked"), seen.size() );
+
+		HashTree_Free( &ht );
+	}
+	return result;
+}
+
+// Ordered query test: prefixes, ranges and neighbours on every backend that answers them
+bool test_order() {
+	bool result = true;
+	static int v[512];
+	Reference ref;
+
+	srand( 43 );
+	HashTree trie = HashTree_Init(), flat = HashTree_InitBackend( HASHTREE_BACKEND_HASHMAP );
+	for( int ix = 0; ix < 3000; ix++ ) {
+		string key = randkey( 6 );
+		HashTree_Assign( trie, key.data(), key.size(), &v[ix % 512] );
+		HashTree_Assign( flat, key.data(), key.size(), &v[ix % 512] );
+		ref[key] = &v[ix % 512];
+	}
+
+	HashTree trees[2] = { trie, flat };
+	for( int it = 0; it < 2; it++ ) {
+		HashTree ht = trees[it];
+		bool ordered = it == 0;
+		bool same = true;
+
+		for( int probe = 0; probe < 300; probe++ ) {
+			string lo = randkey( 4 ), hi = randkey( 4 );
+			Visits seen;
+
+			/* Prefix */
+			HashTree_ForeachPrefix( ht, lo.data(), lo.size(), &collect, &seen );
+			Reference part;
+			for( Reference::iterator jt = ref.lower_bound( lo ); jt != ref.end() && jt->first.compare( 0, lo.size(), lo ) == 0; jt++ )
+				part.insert( *jt );
+			same &= visited( seen, part, ordered );
+
+			/* Closed and open-ended ranges */
+			if( hi < lo )
+				swap( lo, hi );
+			seen.clear();
+			HashTree_Range( ht, lo.data(), lo.size(), hi.data(), hi.size(), &collect, &seen );
+			same &= visited( seen, span( ref, lo, &hi ), true );
+			seen.clear();
+			HashTree_Range( ht, lo.data(), lo.size(), NULL, 0, &collect, &seen );
+			same &= visited( seen, span( ref, lo, NULL ), true );
+
+			/* Neighbours */
+			void *key, *entry;
+			size_t key_len;
+			Reference::iterator at = ref.lower_bound( lo );
+			bool found = HashTree_LowerBound( ht, lo.data(), lo.size(), &key, &key_len, &entry );
+			same &= found == (at != ref.end());
+			if( found ) {
+				same &= string( (char *)key, key_len ) == at->first && entry == at->second;
+				free( key );
+			}
+
+			at = ref.upper_bound( lo );
+			found = HashTree_Successor( ht, lo.data(), lo.size(), NULL, NULL, &entry );
+			same &= found == (at != ref.end()) && (!found || entry == at->second);
+
+			at = ref.lower_bound( lo );
+			found = HashTree_Predecessor( ht, lo.data(), lo.size(), &key, &key_len, &entry );
+			same &= found == (at != ref.begin());
+			if( found ) {
+				at--;
+				same &= string( (char *)key, key_len ) == at->first && entry == at->second;
+				free( key );
+			}
+		}
+		CHECK( same, (ordered ? "Trie ordered queries disagree with reference" : "Hashmap ordered queries disagree with reference"), result );
+
+		/* The empty prefix is every entry */
+		Visits all;
+		HashTree_ForeachPrefix( ht, "", 0, &collect, &all );
+		CHECK( visited( all, ref, ordered ), "Empty prefix walk disagrees with reference", result );
+	}
+
+	HashTree_Free( &trie );
+	HashTree_Free( &flat );
+	return result;
+}
+
+// Bulk load test: unsorted input with repeats and NULLs, built serially and in parallel
+bool test_bulk() {
+	bool result = true;
+	static int v[1024];
+	const size_t n = 30000;
+	Reference ref;
+	vector<string> keys( n );
+	vector<const void *> kp( n );
+	vector<size_t> kl( n );
+	vector<void *> vals( n );
+
+	srand( 32 );
+	for( size_t ix = 0; ix < n; ix++ ) {
+		keys[ix] = randkey( 20 );
+		vals[ix] = rand() % 50 == 0 ? NULL : &v[ix % 1024];
+	}
+	for( size_t ix = 0; ix < n; ix++ ) {
+		kp[ix] = keys[ix].data();
+		kl[ix] = keys[ix].size();
+		if( vals[ix] != NULL )
+			ref[keys[ix]] = vals[ix];
+		else
+			ref.erase( keys[ix] );
+	}
+
+	for( int threads = 1; threads <= 4; threads *= 4 ) {
+		HashTree ht = HashTree_BulkLoad( kp.data(), kl.data(), vals.data(), n, threads );
+		CHECK( ht != NULL, "Bulk load failed", result );
+		if( ht == NULL )
+			continue;
+		CHECK( matches( ht, ref ), "Bulk loaded tree disagrees with reference", result );
+
+		Visits seen;
+		HashTree_ForeachPrefix( ht, "", 0, &collect, &seen );
+		CHECK( visited( seen, ref, true ), "Bulk loaded tree out of order", result );
+
+		/* A bulk loaded tree takes changes like any other */
+		HashTree_Assign( ht, "new", 3, &v[0] );
+		CHECK( HashTree_Retrieve( ht, "new", 3 ) == &v[0], "Bulk loaded tree not writable", result );
+		HashTree_Free( &ht );
+	}
+
+	/* Sorted input is taken as-is */
+	vector<string> sorted;
+	for( Reference::iterator it = ref.begin(); it != ref.end(); it++ )
+		sorted.push_back( it->first );
+	kp.clear();
+	kl.clear();
+	vals.clear();
+	for( size_t ix = 0; ix < sorted.size(); ix++ ) {
+		kp.push_back( sorted[ix].data() );
+		kl.push_back( sorted[ix].size() );
+		vals.push_back( ref[sorted[ix]] );
+	}
+	HashTree ht = HashTree_BulkLoad( kp.data(), kl.data(), vals.data(), kp.size(), 2 );
+	CHECK( ht != NULL && matches( ht, ref ), "Sorted bulk load disagrees with reference", result );
+	if( ht != NULL )
+		HashTree_Free( &ht );
+
+	ht = HashTree_BulkLoad( NULL, NULL, NULL, 0, 1 );
+	CHECK( ht != NULL && HashTree_Count( ht ) == 0, "Empty bulk load not an empty tree", result );
+	if( ht != NULL )
+		HashTree_Free( &ht );
+	return result;
+}
+
+// Batched retrieval test: more lookups than one batch, hits and misses mixed
+bool test_many() {
+	bool result = true;
+	static int v[256];
+	Reference ref;
+
+	srand( 32 );
+	for( int backend = HASHTREE_BACKEND_TRIE; backend <= HASHTREE_BACKEND_HASHMAP; backend++ ) {
+		HashTree ht = HashTree_InitBackend( backend );
+		ref.clear();
+		for( int ix = 0; ix < 5000; ix++ ) {
+			string key = randkey( 30 );
+			HashTree_Assign( ht, key.data(), key.size(), &v[ix % 256] );
+			ref[key] = &v[ix % 256];
+		}
+
+		const int n = HASHTREE_BATCH * 7 + 5;
+		vector<string> probe( n );
+		vector<const void *> hp( n );
+		vector<size_t> hl( n );
+		vector<void *> out( n, &v[0] );
+		Reference::iterator it = ref.begin();
+		for( int ix = 0; ix < n; ix++ ) {
+			probe[ix] = ix % 3 == 0 ? randkey( 30 ) + "!" : (it++)->first;
+			hp[ix] = probe[ix].data();
+			hl[ix] = probe[ix].size();
+		}
+		HashTree_RetrieveMany( ht, hp.data(), hl.data(), out.data(), n );
+
+		bool same = true;
+		for( int ix = 0; ix < n; ix++ ) {
+			Reference::iterator at = ref.find( probe[ix] );
+			same &= out[ix] == (at == ref.end() ? NULL : at->second);
+		}
+		CHECK( same, "RetrieveMany disagrees with reference", result );
+		HashTree_Free( &ht );
+	}
+	return result;
+}
+
+// Concurrent mode test: writers change their own keys while readers follow shared ones
+bool test_concurrent() {
+	bool result = true;
+	const int writers = 4, readers = 2, ops = 40000;
+	static int v[64];
+	HashTree ht = HashTree_InitConcurrent();
+	vector<Reference> own( writers );
+	bool writer_ok[writers], reader_ok[readers];
+	atomic<bool> stop( false );
+	vector<thread> pool;
+
+	/* Keys every reader expects to find throughout */
+	for( int ix = 0; ix < 256; ix++ ) {
+		string key = "shared" + to_string( ix );
+		HashTree_Assign( ht, key.data(), key.size(), &v[ix % 64] );
+	}
+
+	for( int iw = 0; iw < writers; iw++ ) {
+		pool.push_back( thread( [&ht, &own, &writer_ok, iw, ops]() {
+			unsigned int seed = iw;
+			Reference &ref = own[iw];
+			writer_ok[iw] = true;
+			for( int ix = 0; ix < ops; ix++ ) {
+				string key = to_string( iw ) + "/" + to_string( rand_r( &seed ) % 2000 );
+				switch( rand_r( &seed ) % 3 ) {
+					case 0:
+						HashTree_Release( ht, key.data(), key.size() );
+						ref.erase( key );
+						break;
+					case 1: {
+						void *value = &v[rand_r( &seed ) % 64];
+						HashTree_Assign( ht, key.data(), key.size(), value );
+						ref[key] = value;
+						break;
+					}
+					default: {
+						Reference::iterator at = ref.find( key );
+						writer_ok[iw] &= HashTree_Retrieve( ht, key.data(), key.size() ) == (at == ref.end() ? NULL : at->second);
+					}
+				}
+			}
+		} ) );
+	}
+	for( int ir = 0; ir < readers; ir++ ) {
+		pool.push_back( thread( [&ht, &reader_ok, &stop, ir]() {
+			reader_ok[ir] = true;
+			while( !stop ) {
+				for( int ix = 0; ix < 256; ix++ ) {
+					string key = "shared" + to_string( ix );
+					reader_ok[ir] &= HashTree_Retrieve( ht, key.data(), key.size() ) == &v[ix % 64];
+				}
+			}
+		} ) );
+	}
+	for( int iw = 0; iw < writers; iw++ )
+		pool[iw].join();
+	stop = true;
+	for( int ir = 0; ir < readers; ir++ )
+		pool[writers + ir].join();
+
+	bool all = true;
+	for( int iw = 0; iw < writers; iw++ )
+		all &= writer_ok[iw];
+	CHECK( all, "A writer did not read back its own changes", result );
+	all = true;
+	for( int ir = 0; ir < readers; ir++ )
+		all &= reader_ok[ir];
+	CHECK( all, "A reader lost a shared key", result );
+
+	/* Once quiet, the tree holds exactly what the writers left */
+	Reference ref;
+	for( int iw = 0; iw < writers; iw++ )
+		ref.insert( own[iw].begin(), own[iw].end() );
+	for( int ix = 0; ix < 256; ix++ )
+		ref["shared" + to_string( ix )] = &v[ix % 64];
+	CHECK( matches( ht, ref ), "Concurrent tree disagrees with reference", result );
+	Visits seen;
+	HashTree_Foreach( ht, &collect, &seen, 1 );
+	CHECK( visited( seen, ref, false ), "Concurrent tree walk disagrees with reference", result );
+	DISPL( "entries left", HashTree_Count( ht ) );
+
+	HashTree_Free( &ht );
+	return result;
+}
+
+extern "C" void serialize( void *data, void *entry, const void **bytes, size_t *len ) {
+	*bytes = entry;
+	*len = sizeof( int );
+}
+
+// Image test: save, map and query in place
+bool test_image() {
+	bool result = true;
+	static int v[128];
+	char path[] = "/tmp/hashtree_test_XXXXXX";
+	HashTree_Statistics stats;
+	Reference ref;
+
+	int fd = mkstemp( path );
+	CHECK( fd >= 0, "Temporary file not created", result );
+	close( fd );
+
+	srand( 32 );
+	for( int ix = 0; ix < 128; ix++ )
+		v[ix] = ix * 1000;
+	HashTree ht = HashTree_Init();
+	for( int ix = 0; ix < 5000; ix++ ) {
+		string key = randkey( 12 );
+		HashTree_Assign( ht, key.data(), key.size(), &v[ix % 128] );
+		ref[key] = &v[ix % 128];
+	}
+	CHECK( HashTree_Save( ht, path, &serialize, NULL ), "Save failed", result );
+
+	HashTree flat = HashTree_InitBackend( HASHTREE_BACKEND_HASHMAP );
+	CHECK( !HashTree_Save( flat, path, &serialize, NULL ), "Hashmap backend saved", result );
+	HashTree_Free( &flat );
+
+	HashTree mt = HashTree_Map( path );
+	CHECK( mt != NULL, "Image not mapped", result );
+	if( mt == NULL ) {
+		HashTree_Free( &ht );
+		unlink( path );
+		return result;
+	}
+	CHECK( HashTree_Count( mt ) == ref.size(), "Mapped count incorrect", result );
+
+	/* Entries come back as the serialized bytes */
+	bool same = true;
+	for( Reference::iterator it = ref.begin(); it != ref.end(); it++ ) {
+		void *entry = HashTree_Retrieve( mt, it->first.data(), it->first.size() );
+		same &= entry != NULL && HashTree_MappedSize( entry ) == sizeof( int ) && memcmp( entry, it->second, sizeof( int ) ) == 0;
+	}
+	CHECK( same, "Mapped entries disagree with reference", result );
+	CHECK( HashTree_Retrieve( mt, "\xff\xff\xff", 3 ) == NULL || ref.count( "\xff\xff\xff" ), "Mapped tree found a missing key", result );
+
+	/* Walks see the same keys, prefix walks in the same order */
+	Visits seen, want;
+	HashTree_Foreach( mt, &collect, &seen, 1 );
+	HashTree_Foreach( ht, &collect, &want, 1 );
+	sort( seen.begin(), seen.end() );
+	sort( want.begin(), want.end() );
+	same = seen.size() == want.size();
+	for( size_t ix = 0; same && ix < seen.size(); ix++ )
+		same &= seen[ix].first == want[ix].first;
+	CHECK( same, "Mapped walk disagrees with the tree's", result );
+
+	seen.clear();
+	want.clear();
+	HashTree_ForeachPrefix( mt, "ab", 2, &collect, &seen );
+	HashTree_ForeachPrefix( ht, "ab", 2, &collect, &want );
+	same = seen.size() == want.size();
+	for( size_t ix = 0; same && ix < seen.size(); ix++ )
+		same &= seen[ix].first == want[ix].first;
+	CHECK( same, "Mapped prefix walk disagrees with the tree's", result );
+
+	seen.clear();
+	HashTree_Range( mt, "b", 1, "c", 1, &collect, &seen );
+	string c = "c";
+	Reference part = span( ref, "b", &c );
+	same = seen.size() == part.size();
+	Reference::iterator it = part.begin();
+	for( size_t ix = 0; same && ix < seen.size(); ix++, it++ )
+		same &= seen[ix].first == it->first;
+	CHECK( same, "Mapped range disagrees with reference", result );
+
+	void *key, *entry;
+	size_t key_len;
+	Reference::iterator at = ref.lower_bound( "c" );
+	bool found = HashTree_Predecessor( mt, "c", 1, &key, &key_len, &entry );
+	CHECK( found == (at != ref.begin()), "Mapped predecessor not found", result );
+	if( found ) {
+		at--;
+		CHECK( string( (char *)key, key_len ) == at->first, "Mapped predecessor incorrect", result );
+		free( key );
+	}
+
+	/* Mapped trees are read-only */
+	HashTree_Assign( mt, "fresh", 5, &v[0] );
+	HashTree_Release( mt, ref.begin()->first.data(), ref.begin()->first.size() );
+	CHECK( HashTree_Count( mt ) == ref.size() && HashTree_Retrieve( mt, "fresh", 5 ) == NULL, "Mapped tree changed", result );
+
+	CHECK( HashTree_Stats( mt, &stats ), "Mapped stats failed", result );
+	CHECK( stats.entries == ref.size() && stats.bytes > 0, "Mapped stats incorrect", result );
+
+	HashTree_Free( &mt );
+	HashTree_Free( &ht );
+
+	/* Entries whose offset or length would run past the end of the image are not handed out;
+	 *   a one entry image holds its length at the end of the header, then the node soon after */
+	ht = HashTree_Init();
+	HashTree_Assign( ht, "k", 1, &v[5] );
+	CHECK( HashTree_Save( ht, path, &serialize, NULL ), "Save failed", result );
+	HashTree_Free( &ht );
+	vector<uint64_t> words( 64 );
+	fd = open( path, O_RDWR );
+	ssize_t got = pread( fd, words.data(), words.size() * 8, 0 );
+	CHECK( got > 0 && got % 8 == 0, "Image not read back", result );
+	size_t len_at = words[1] >> 32, value_at = 0;
+	for( size_t ix = len_at / 8 + 1; value_at == 0 && ix < (size_t)got / 8; ix++ )
+		if( words[ix] == len_at + 8 )
+			value_at = ix;
+	CHECK( value_at > 0 && words[len_at / 8] == sizeof( int ), "Image layout not as expected", result );
+	for( int corrupt = 0; corrupt < 3 && value_at > 0; corrupt++ ) {
+		uint64_t bad = corrupt == 0 ? 1 << 20 : corrupt == 1 ? (uint64_t)got : UINT64_MAX - 7;
+		uint64_t *at = corrupt == 0 ? &words[len_at / 8] : &words[value_at];
+		uint64_t good = *at;
+		*at = bad;
+		CHECK( pwrite( fd, words.data(), got, 0 ) == got, "Image not rewritten", result );
+		*at = good;
+		mt = HashTree_Map( path );
+		CHECK( mt != NULL, "Corrupt entry refused the whole image", result );
+		if( mt == NULL )
+			continue;
+		Visits walked;
+		HashTree_Foreach( mt, &collect, &walked, 1 );
+		CHECK( HashTree_Retrieve( mt, "k", 1 ) == NULL && walked.empty(), "Entry outside the image handed out", result );
+		HashTree_Free( &mt );
+	}
+	close( fd );
+
+	/* Anything but an image is refused */
+	fd = open( path, O_WRONLY | O_TRUNC );
+	CHECK( fd >= 0 && write( fd, "not an image", 12 ) == 12, "Temporary file not rewritten", result );
+	close( fd );
+	CHECK( HashTree_Map( path ) == NULL, "Garbage mapped", result );
+	unlink( path );
+	return result;
+}
+
+// Snapshot test: views keep their contents while the tree changes underneath
+bool test_snapshot() {
+	bool result = true;
+	static int v[64];
+	Reference ref;
+	HashTree_Statistics stats;
+
+	srand( 32 );
+	HashTree ht = HashTree_Init();
+	for( int ix = 0; ix < 8000; ix++ ) {
+		string key = randkey( 16 );
+		HashTree_Assign( ht, key.data(), key.size(), &v[ix % 64] );
+		ref[key] = &v[ix % 64];
+	}
+
+	HashTree first = HashTree_Snapshot( ht );
+	CHECK( first != NULL, "Snapshot failed", result );
+	Reference before = ref;
+
+	/* Change the tree well past recognition, taking a second snapshot halfway */
+	HashTree second = NULL;
+	Reference middle;
+	for( int ix = 0; ix < 16000; ix++ ) {
+		/* Half the changes land on keys already there */
+		string key = randkey( 16 );
+		if( rand() % 2 && ref.lower_bound( key ) != ref.end() )
+			key = ref.lower_bound( key )->first;
+		if( rand() % 2 ) {
+			HashTree_Release( ht, key.data(), key.size() );
+			ref.erase( key );
+		} else {
+			HashTree_Assign( ht, key.data(), key.size(), &v[(ix + 1) % 64] );
+			ref[key] = &v[(ix + 1) % 64];
+		}
+		if( ix == 8000 ) {
+			second = HashTree_Snapshot( ht );
+			middle = ref;
+		}
+	}
+	CHECK( second != NULL, "Second snapshot failed", result );
+	CHECK( matches( ht, ref ), "Tree disagrees with reference after snapshots", result );
+	CHECK( matches( first, before ), "First snapshot saw later writes", result );
+	CHECK( second == NULL || matches( second, middle ), "Second snapshot saw later writes", result );
+
+	/* Snapshots answer queries like the tree, but take no changes */
+	Visits seen;
+	HashTree_ForeachPrefix( first, "", 0, &collect, &seen );
+	CHECK( visited( seen, before, true ), "Snapshot walk disagrees with reference", result );
+	HashTree_Assign( first, "fresh", 5, &v[0] );
+	CHECK( HashTree_Retrieve( first, "fresh", 5 ) == NULL && HashTree_Count( first ) == before.size(), "Snapshot changed", result );
+	CHECK( HashTree_Stats( first, &stats ) && stats.entries == before.size(), "Snapshot stats incorrect", result );
+
+	/* Snapshots read from another thread while the tree is written */
+	bool reader_ok = true;
+	thread reader( [&first, &before, &reader_ok]() {
+		for( int round = 0; round < 3; round++ )
+			reader_ok &= matches( first, before );
+	} );
+	for( int ix = 0; ix < 5000; ix++ ) {
+		string key = randkey( 16 );
+		HashTree_Assign( ht, key.data(), key.size(), &v[ix % 64] );
+		ref[key] = &v[ix % 64];
+	}
+	reader.join();
+	CHECK( reader_ok, "Snapshot disagreed while read from another thread", result );
+
+	/* Free in either order: the tree before one snapshot, after the other */
+	HashTree flat = HashTree_InitBackend( HASHTREE_BACKEND_HASHMAP );
+	CHECK( HashTree_Snapshot( flat ) == NULL, "Hashmap backend snapshotted", result );
+	HashTree_Free( &flat );
+
+	if( second != NULL )
+		HashTree_Free( &second );
+	HashTree_Free( &ht );
+	CHECK( matches( first, before ), "Snapshot did not outlive its tree", result );
+	HashTree_Free( &first );
+	return result;
+}
+
+// Statistics test: the count is kept as the tree changes, and the shape adds up
+bool test_stats() {
+	bool result = true;
+	static int v[64];
+	HashTree_Statistics stats;
+	Reference ref;
+
+	srand( 41 );
+	for( int backend = HASHTREE_BACKEND_TRIE; backend <= HASHTREE_BACKEND_HASHMAP; backend++ ) {
+		HashTree ht = HashTree_InitBackend( backend );
+		ref.clear();
+
+		/* Reassigning or releasing what is not there leaves the count alone */
+		HashTree_Assign( ht, "abc", 3, &v[0] );
+		HashTree_Assign( ht, "abc", 3, &v[1] );
+		HashTree_Release( ht, "ab", 2 );
+		HashTree_Release( ht, "abcd", 4 );
+		CHECK( HashTree_Count( ht ) == 1, "Count disturbed by a reassignment or a missing key", result );
+		HashTree_Release( ht, "abc", 3 );
+		CHECK( HashTree_Count( ht ) == 0, "Count not dropped by a release", result );
+
+		bool same = true;
+		for( int ix = 0; ix < 20000; ix++ ) {
+			string key = randkey( 16 );
+			if( rand() % 3 == 0 ) {
+				HashTree_Release( ht, key.data(), key.size() );
+				ref.erase( key );
+			} else {
+				HashTree_Assign( ht, key.data(), key.size(), &v[ix % 64] );
+				ref[key] = &v[ix % 64];
+			}
+			if( ix % 1000 == 0 )
+				same &= HashTree_Count( ht ) == ref.size();
+		}
+		CHECK( same && HashTree_Count( ht ) == ref.size(), "Count drifted from reference", result );
+
+		CHECK( HashTree_Stats( ht, &stats ), "Stats failed", result );
+		CHECK( stats.entries == ref.size() && stats.bytes > 0, "Entries or bytes not reported", result );
+		if( backend == HASHTREE_BACKEND_TRIE ) {
+			size_t nodes = 0, listings = 0;
+			for( int ix = 0; ix <= 256; ix++ )
+				nodes += stats.fanout[ix];
+			for( int ix = 0; ix < 4; ix++ )
+				listings += stats.kind[ix];
+			CHECK( nodes == stats.nodes, "Fanouts do not add up to the nodes", result );
+			CHECK( listings == stats.nodes - stats.fanout[0], "Kinds do not add up to the nodes with subnodes", result );
+			CHECK( stats.avg_depth >= 1 && stats.max_depth >= stats.avg_depth && stats.max_depth <= 16, "Depths out of range", result );
+			DISPL( "nodes", stats.nodes );
+			DISPL( "wasted slots", stats.wasted_slots );
+		}
+		DISPL( (backend == HASHTREE_BACKEND_TRIE ? "trie bytes" : "hashmap bytes"), stats.bytes );
+
+		HashTree_Free( &ht );
+	}
+	return result;
+}
+
+typedef map<uint64_t, void *> IntReference;
+
+extern "C" void collect_int( void *data, uint64_t key, void *entry ) {
+	((vector< pair<uint64_t, void *> > *)data)->push_back( make_pair( key, entry ) );
+}
+
+/* A random key of the given width; half are small, so that the low subtrees fill in
+ *   while the rest stay sparse leaves */
+uint64_t randint( int width ) {
+	uint64_t key = ((uint64_t)rand() << 42) ^ ((uint64_t)rand() << 21) ^ (uint64_t)rand();
+
+	if( rand() % 2 )
+		key = rand() % 4096;
+	return width == 4 ? key & 0xFFFFFFFF : key;
+}
+
+// Integer key tree test: every shape of the C API against a reference
+bool test_inttree() {
+	bool result = true;
+	static int v[256];
+	const int shapes[4][2] = { { 4, 4 }, { 4, 8 }, { 8, 4 }, { 8, 8 } };
+
+	CHECK( IntTree_Init( 2, 8 ) == NULL && IntTree_Init( 8, 2 ) == NULL, "Invalid shape accepted", result );
+
+	srand( 42 );
+	for( int is = 0; is < 4; is++ ) {
+		int width = shapes[is][0], bits = shapes[is][1];
+		IntTree it = IntTree_Init( width, bits );
+		IntReference ref;
+
+		CHECK( it != NULL, "Tree not allocated", result );
+		if( it == NULL )
+			continue;
+		CHECK( it->depth == width * 8 / bits, "Depth incorrect", result );
+
+		for( int ix = 0; ix < 30000; ix++ ) {
+			uint64_t key = randint( width );
+			if( rand() % 3 == 0 ) {
+				IntTree_Release( it, key );
+				ref.erase( key );
+			} else {
+				IntTree_Assign( it, key, &v[ix % 256] );
+				ref[key] = &v[ix % 256];
+			}
+		}
+
+		/* NULL data is a release, and keys of a 4 byte tree wrap */
+		if( !ref.empty() ) {
+			IntTree_Assign( it, ref.begin()->first, NULL );
+			ref.erase( ref.begin() );
+		}
+		if( width == 4 ) {
+			IntTree_Assign( it, 0x500000007ULL, &v[7] );
+			ref[7] = &v[7];
+			CHECK( IntTree_Retrieve( it, 0x300000007ULL ) == &v[7], "4 byte key not taken modulo 2^32", result );
+		}
+
+		bool same = IntTree_Count( it ) == ref.size();
+		for( IntReference::iterator jt = ref.begin(); jt != ref.end(); jt++ )
+			same &= IntTree_Retrieve( it, jt->first ) == jt->second;
+		for( int ix = 0; ix < 1000; ix++ ) {
+			uint64_t key = randint( width );
+			IntReference::iterator at = ref.find( key );
+			same &= IntTree_Retrieve( it, key ) == (at == ref.end() ? NULL : at->second);
+		}
+		CHECK( same, "Tree disagrees with reference", result );
+
+		vector< pair<uint64_t, void *> > seen;
+		IntTree_Foreach( it, &collect_int, &seen );
+		CHECK( (seen == vector< pair<uint64_t, void *> >( ref.begin(), ref.end() )), "Foreach not the reference in ascending order", result );
+
+		/* Emptied, it behaves as new */
+		for( IntReference::iterator jt = ref.begin(); jt != ref.end(); jt++ )
+			IntTree_Release( it, jt->first );
+		CHECK( IntTree_Count( it ) == 0 && it->root == NULL, "Emptied tree not empty", result );
+		IntTree_Assign( it, 1, &v[1] );
+		CHECK( IntTree_Retrieve( it, 1 ) == &v[1], "Emptied tree not reusable", result );
+
+		IntTree_Free( &it );
+		CHECK( it == NULL, "Memory not released", result );
+	}
+	return result;
+}
+
+// Integer key template test: an instantiation agrees with the C tree it wraps
+template<unsigned Width, unsigned Bits>
+bool test_inttree_template() {
+	bool result = true;
+	static int v[64];
+	typedef CUtility::IntTree<Width, Bits> Tree;
+	typedef typename Tree::key_type Key;
+	Tree tree;
+	map<Key, void *> ref;
+
+	CHECK( sizeof( Key ) == Width, "Key type not the tree's width", result );
+	CHECK( Tree::depth == Width * 8 / Bits && tree.handle()->depth == Tree::depth, "Depth constant disagrees with the C tree", result );
+
+	srand( Width * 10 + Bits );
+	for( int ix = 0; ix < 20000; ix++ ) {
+		Key key = (Key)randint( Width );
+		if( rand() % 4 == 0 ) {
+			tree.release( key );
+			ref.erase( key );
+		} else if( rand() % 16 == 0 ) {
+			tree.assign( key, NULL );
+			ref.erase( key );
+		} else {
+			tree.assign( key, &v[ix % 64] );
+			ref[key] = &v[ix % 64];
+		}
+	}
+
+	/* The inlined descent and the C one find the same entries */
+	bool same = tree.count() == ref.size();
+	for( typename map<Key, void *>::iterator it = ref.begin(); it != ref.end(); it++ )
+		same &= tree.retrieve( it->first ) == it->second && IntTree_Retrieve( tree.handle(), it->first ) == it->second;
+	for( int ix = 0; ix < 2000; ix++ ) {
+		Key key = (Key)randint( Width );
+		same &= tree.retrieve( key ) == IntTree_Retrieve( tree.handle(), key );
+	}
+	CHECK( same, "Template retrieval disagrees with reference", result );
+
+	vector< pair<Key, void *> > seen;
+	tree.foreach( [&seen]( Key key, void *entry ) { seen.push_back( make_pair( key, entry ) ); } );
+	CHECK( (seen == vector< pair<Key, void *> >( ref.begin(), ref.end() )), "Template foreach not the reference in ascending order", result );
+	DISPL( "entries", tree.count() );
+	return result;
+}
+
+// Hash map test: inline and out-of-line keys, and deleted slots swept out as the table refills
+bool test_hashmap() {
+	bool result = true;
+	static int v[64];
+	Reference ref;
+	HashMap map = HashMap_Init();
+
+	CHECK( map != NULL && HashMap_Count( map ) == 0, "Map not allocated", result );
+	CHECK( HashMap_Hash( "abc", 3 ) == HashMap_Hash( string( "abc" ).data(), 3 ), "Hash not a function of the bytes", result );
+	CHECK( HashMap_Hash( "a", 1 ) != HashMap_Hash( "a", 2 ), "Hash ignores the length", result );
+
+	/* Keys either side of the inline limit, the long ones differing only past it */
+	const size_t lens[] = { 0, 1, HASHMAP_INLINE_KEY - 1, HASHMAP_INLINE_KEY, HASHMAP_INLINE_KEY + 1, 64, 300 };
+	size_t outside = 0;
+	for( int il = 0; il < 7; il++ ) {
+		for( int ix = 0; ix < 4; ix++ ) {
+			string key( lens[il], 'k' );
+			if( lens[il] > 0 )
+				key[lens[il] - 1] = (char)('0' + ix);
+			if( ref.count( key ) )
+				continue;
+			HashMap_Assign( map, key.data(), key.size(), &v[il * 4 + ix] );
+			ref[key] = &v[il * 4 + ix];
+			if( key.size() > HASHMAP_INLINE_KEY )
+				outside += key.size();
+		}
+	}
+	CHECK( map->key_bytes == outside, "Out-of-line key bytes miscounted", result );
+	bool same = HashMap_Count( map ) == ref.size();
+	for( Reference::iterator it = ref.begin(); it != ref.end(); it++ )
+		same &= HashMap_Retrieve( map, it->first.data(), it->first.size() ) == it->second;
+	string near( 300, 'k' );
+	same &= HashMap_Retrieve( map, near.data(), near.size() ) == NULL;
+	CHECK( same, "Keys around the inline limit disagree with reference", result );
+
+	Visits seen;
+	HashMap_Foreach( map, &collect, &seen );
+	CHECK( visited( seen, ref, false ), "Foreach disagrees with reference", result );
+
+	/* Releasing (or assigning NULL) gives the out-of-line bytes back */
+	for( Reference::iterator it = ref.begin(); it != ref.end(); it++ ) {
+		if( it->first.size() % 2 )
+			HashMap_Release( map, it->first.data(), it->first.size() );
+		else
+			HashMap_Assign( map, it->first.data(), it->first.size(), NULL );
+	}
+	ref.clear();
+	CHECK( HashMap_Count( map ) == 0 && map->key_bytes == 0, "Released keys not given back", result );
+
+	/* Churn at a steady count: once the table has settled, the deleted slots are swept out
+	 *   at the same capacity rather than the table doubling again */
+	srand( 43 );
+	vector<string> live;
+	for( int ix = 0; ix < 300; ix++ ) {
+		string key = randkey( 40 ) + to_string( ix );
+		HashMap_Assign( map, key.data(), key.size(), &v[ix % 64] );
+		ref[key] = &v[ix % 64];
+		live.push_back( key );
+	}
+	size_t capacity = 0, bytes = 0;
+	int serial = 0;
+	for( int round = 0; round < 2; round++ ) {
+		for( int ix = 0; ix < 20000; ix++ ) {
+			size_t at = rand() % live.size();
+			HashMap_Release( map, live[at].data(), live[at].size() );
+			ref.erase( live[at] );
+			live[at] = randkey( 40 ) + "#" + to_string( serial++ );
+			HashMap_Assign( map, live[at].data(), live[at].size(), &v[ix % 64] );
+			ref[live[at]] = &v[ix % 64];
+		}
+		if( round == 0 ) {
+			capacity = map->capacity;
+			bytes = HashMap_Bytes( map ) - map->key_bytes;
+		}
+	}
+	CHECK( map->capacity == capacity, "Table grew under a steady count", result );
+	CHECK( HashMap_Bytes( map ) - map->key_bytes == bytes, "Table memory grew under a steady count", result );
+	CHECK( map->growth_left > 0 && map->growth_left <= map->capacity - map->capacity / 8 - map->count, "Growth left inconsistent", result );
+	DISPL( "capacity for 300 entries", map->capacity );
+
+	size_t deleted = 0;
+	for( size_t ix = 0; ix < map->capacity; ix++ )
+		deleted += map->ctrl[ix] == HASHMAP_CTRL_DELETED;
+	CHECK( deleted < map->capacity - map->count, "Deleted slots never swept", result );
+	same = HashMap_Count( map ) == ref.size();
+	for( Reference::iterator it = ref.begin(); it != ref.end(); it++ )
+		same &= HashMap_Retrieve( map, it->first.data(), it->first.size() ) == it->second;
+	CHECK( same, "Churned map disagrees with reference", result );
+
+	/* Growing for real still doubles */
+	for( int ix = 0; ix < 5000; ix++ ) {
+		string key = "grow" + to_string( ix );
+		HashMap_Assign( map, key.data(), key.size(), &v[0] );
+	}
+	CHECK( map->capacity > capacity && HashMap_Count( map ) == ref.size() + 5000, "Table did not grow", result );
+
+	HashMap_Free( &map );
+	CHECK( map == NULL, "Memory not released", result );
+	return result;
+}
+
+void setup( vector<aTest> &ourtests ) {
+	ourtests.push_back( { &test_init, "Initialization Test" } );
+	ourtests.push_back( { &test_patricia, "Path Compression Test" } );
+	ourtests.push_back( { &test_kinds, "Node Kind Growth & Shrink Test" } );
+	ourtests.push_back( { &test_random, "Random Changes & Arena Test" } );
+	ourtests.push_back( { &test_foreach, "Foreach Test" } );
+	ourtests.push_back( { &test_order, "Ordered Access Test" } );
+	ourtests.push_back( { &test_bulk, "Bulk Load Test" } );
+	ourtests.push_back( { &test_concurrent, "Concurrent Mode Test" } );
+	ourtests.push_back( { &test_many, "Batched Retrieval Test" } );
+	ourtests.push_back( { &test_image, "Saved & Mapped Image Test" } );
+	ourtests.push_back( { &test_stats, "Count & Statistics Test" } );
+	ourtests.push_back( { &test_inttree, "Integer Key Tree Test" } );
+	ourtests.push_back( { &test_inttree_template<4, 4>, "Integer Key Template Test <4, 4>" } );
+	ourtests.push_back( { &test_inttree_template<4, 8>, "Integer Key Template Test <4, 8>" } );
+	ourtests.push_back( { &test_inttree_template<8, 4>, "Integer Key Template Test <8, 4>" } );
+	ourtests.push_back( { &test_inttree_template<8, 8>, "Integer Key Template Test <8, 8>" } );
+	ourtests.push_back( { &test_hashmap, "Hash Map Test" } );
+	ourtests.push_back( { &test_snapshot, "Snapshot Test" } );
+}
+
+#define RUNTEST( treg, tix, failed ) \
+	if( DISPLAY_DEBUG ) { \
+		cout << "  :: " << treg[tix].name << " ::  " << endl; \
+		bool status = treg[tix].test(); \
+		cout << endl << "+---------------------+" << endl; \
+		cout << "| Test Status: "; \
+		if( status ) { \
+			cout << "Passed"; \
+		} else { \
+			cout << "Failed"; \
+			failed.push_back(tix); \
+		} \
+		cout << " |" << endl; \
+		cout << "+---------------------+" << endl << endl << endl; \
+	} else { \
+		if( treg[tix].test() ) { \
+			cout << "."; \
+		} else { \
+			cout << "F"; \
+			failed.push_back(tix); \
+		} \
+	}
+
+int main( int argc, char **argv ) {
+	vector<aTest> registry;
+	vector<int> schedual, failures;
+	setup( registry );
+	argproc( argc, argv, registry, schedual );
+	if( schedual.size() == 0 ) {
+		schedual.push_back( 0 );
+	}
+	
+	// Iterate over the schedual
+	for( int ix = 0; ix < schedual.size(); ix++ ) {
+		if( schedual[ix] == 0 ) {
+			// Run all tests
+			for( int iy = 0; iy < registry.size(); iy++ ) {
+				RUNTEST( registry, iy, failures );
+			}
+		} else {
+			RUNTEST( registry, schedual[ix] - 1, failures );
+		}
+	}
+	
+	if( failures.size() > 0 ) {
+		cout << endl << "Failures: ";
+		for( int ifail = 0; ifail < failures.size(); ifail++ ) {
+			cout << failures[ifail] << " ";
+		}
+		cout << endl;
+	}
+	
+	return EXIT_SUCCESS;
+}
+
+
+#undef RUNTEST
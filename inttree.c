@@ -0,0 +1,228 @@
+/* Fixed-width integer keyed hashtree */
+
+#include "inttree.h"
+#include "hashtree_internal.h"
+#include <stdbool.h>
+#include <string.h>
+
+#define IntTree_Mask( width ) ((width) == 8 ? ~(uint64_t)0 : ((uint64_t)1 << ((width) * 8)) - 1)
+#define IntTree_Digit( key, level, bits, depth ) \
+	((unsigned)((key) >> (((depth) - 1 - (level)) * (bits))) & ((1u << (bits)) - 1))
+#define IntTree_Node_Bytes( bits ) (sizeof( IntTree_Node ) + sizeof( void * ) * ((size_t)1 << (bits)))
+
+/* Descent with the shape fixed at compile time, so the loop unrolls (private) */
+static inline void *IntTree_Find( void *slot, uint64_t key, const unsigned bits, const unsigned depth ) {
+#pragma GCC unroll 16
+	for( unsigned level = 0; level < depth; level++ ) {
+		if( slot == NULL || IntTree_IsLeaf( slot ) )
+			break;
+		slot = ((IntTree_Node *)slot)->slot[IntTree_Digit( key, level, bits, depth )];
+	}
+
+	/* Every path ends in a leaf (or nothing) by the last level */
+	if( slot == NULL || IntTree_Leaf_Of( slot )->key != key )
+		return NULL;
+	return IntTree_Leaf_Of( slot )->data;
+}
+
+void *IntTree_Find_4_4( void *root, uint64_t key ) { return IntTree_Find( root, key, 4, 8 ); }
+void *IntTree_Find_4_8( void *root, uint64_t key ) { return IntTree_Find( root, key, 8, 4 ); }
+void *IntTree_Find_8_4( void *root, uint64_t key ) { return IntTree_Find( root, key, 4, 16 ); }
+void *IntTree_Find_8_8( void *root, uint64_t key ) { return IntTree_Find( root, key, 8, 8 ); }
+
+IntTree IntTree_Init( int width, int bits ) {
+	IntTree newtree;
+
+	if( (width != 4 && width != 8) || (bits != 4 && bits != 8) )
+		return NULL /* error */;
+
+	/* The arena's layout is the hashtree's business, so it rides behind the header */
+	newtree = malloc( sizeof( IntTree_Header ) + sizeof( HashTree_Arena ) );
+	if( newtree != NULL ) {
+		newtree->root = NULL;
+		newtree->arena = (HashTree_Arena *)(newtree + 1);
+		HashTree_Arena_Init( newtree->arena );
+		newtree->width = width;
+		newtree->bits = bits;
+		newtree->depth = width * 8 / bits;
+		newtree->count = 0;
+	}
+
+	return newtree;
+}
+
+/* Everything lives in the arena, so the tree goes in one sweep */
+void IntTree_Free( IntTree *it ) {
+	HashTree_Arena_Free( (*it)->arena );
+	free( *it );
+	*it = NULL;
+}
+
+void *IntTree_Retrieve( IntTree it, uint64_t key ) {
+	key &= IntTree_Mask( it->width );
+
+	switch( it->width * 16 + it->bits ) {
+		case 4 * 16 + 4:
+			return IntTree_Find_4_4( it->root, key );
+		case 4 * 16 + 8:
+			return IntTree_Find_4_8( it->root, key );
+		case 8 * 16 + 4:
+			return IntTree_Find_8_4( it->root, key );
+		default:
+			return IntTree_Find_8_8( it->root, key );
+	}
+}
+
+void IntTree_Assign( IntTree it, uint64_t key, void *data ) {
+	IntTree_Node *node = NULL, *chain[64];
+	IntTree_Leaf *leaf, *old;
+	void **slot = &it->root;
+	unsigned level = 0, split;
+
+	/* NULL marks an absent entry, so storing it is a release */
+	if( data == NULL ) {
+		IntTree_Release( it, key );
+		return;
+	}
+
+	key &= IntTree_Mask( it->width );
+
+	while( *slot != NULL && !IntTree_IsLeaf( *slot ) ) {
+		node = *slot;
+		slot = &node->slot[IntTree_Digit( key, level, it->bits, it->depth )];
+		level++;
+	}
+
+	if( *slot != NULL && IntTree_Leaf_Of( *slot )->key == key ) {
+		IntTree_Leaf_Of( *slot )->data = data;
+		return;
+	}
+
+	leaf = HashTree_Arena_Alloc( it->arena, sizeof( IntTree_Leaf ) );
+	if( leaf == NULL )
+		return /* error */;
+	leaf->key = key;
+	leaf->data = data;
+
+	/* An empty slot takes the leaf as it is */
+	if( *slot == NULL ) {
+		*slot = (void *)((uintptr_t)leaf | 1);
+		if( node != NULL )
+			node->count++;
+		it->count++;
+		return;
+	}
+
+	/* Another key sits here unexpanded: grow nodes down to where the two part ways,
+	 *   allocating them all first so a failure leaves the tree as it was */
+	old = IntTree_Leaf_Of( *slot );
+	for( split = level; IntTree_Digit( old->key, split, it->bits, it->depth ) == IntTree_Digit( key, split, it->bits, it->depth ); split++ );
+
+	for( unsigned ix = 0; ix <= split - level; ix++ ) {
+		chain[ix] = HashTree_Arena_Alloc( it->arena, IntTree_Node_Bytes( it->bits ) );
+		if( chain[ix] == NULL ) {
+			while( ix-- > 0 )
+				HashTree_Arena_Release( it->arena, chain[ix], IntTree_Node_Bytes( it->bits ) );
+			HashTree_Arena_Release( it->arena, leaf, sizeof( IntTree_Leaf ) );
+			return /* error */;
+		}
+		memset( chain[ix], 0, IntTree_Node_Bytes( it->bits ) );
+	}
+
+	for( unsigned ix = 0; level + ix < split; ix++ ) {
+		chain[ix]->count = 1;
+		chain[ix]->slot[IntTree_Digit( key, level + ix, it->bits, it->depth )] = chain[ix + 1];
+	}
+	node = chain[split - level];
+	node->count = 2;
+	node->slot[IntTree_Digit( old->key, split, it->bits, it->depth )] = *slot;
+	node->slot[IntTree_Digit( key, split, it->bits, it->depth )] = (void *)((uintptr_t)leaf | 1);
+
+	*slot = chain[0];
+	it->count++;
+}
+
+void IntTree_Release( IntTree it, uint64_t key ) {
+	IntTree_Node *node[64];
+	void **slot[65];
+	unsigned level = 0;
+
+	key &= IntTree_Mask( it->width );
+
+	/* slot[level] holds node[level]; the leaf sits in slot[level] at the bottom */
+	slot[0] = &it->root;
+	while( *slot[level] != NULL && !IntTree_IsLeaf( *slot[level] ) ) {
+		node[level] = *slot[level];
+		slot[level + 1] = &node[level]->slot[IntTree_Digit( key, level, it->bits, it->depth )];
+		level++;
+	}
+
+	if( *slot[level] == NULL || IntTree_Leaf_Of( *slot[level] )->key != key )
+		return;
+
+	HashTree_Arena_Release( it->arena, IntTree_Leaf_Of( *slot[level] ), sizeof( IntTree_Leaf ) );
+	*slot[level] = NULL;
+	it->count--;
+	if( level == 0 )
+		return;
+	node[level - 1]->count--;
+
+	/* A node left holding a lone leaf gives way to it, which may cascade up a chain */
+	while( level-- > 0 && node[level]->count == 1 ) {
+		void *only = NULL;
+
+		for( size_t ix = 0; only == NULL; ix++ )
+			only = node[level]->slot[ix];
+		if( !IntTree_IsLeaf( only ) )
+			break;
+
+		*slot[level] = only;
+		HashTree_Arena_Release( it->arena, node[level], IntTree_Node_Bytes( it->bits ) );
+	}
+}
+
+/* One level of the ordered walk */
+typedef struct {
+	IntTree_Node *node;
+	unsigned cursor;
+} IntTree_Frame;
+
+void IntTree_Foreach( IntTree it, void (*callback)(void *, uint64_t, void *), void *data ) {
+	IntTree_Frame frame[64];
+	unsigned fanout = 1u << it->bits;
+	int depth = 0;
+
+	if( it->root == NULL )
+		return;
+	if( IntTree_IsLeaf( it->root ) ) {
+		callback( data, IntTree_Leaf_Of( it->root )->key, IntTree_Leaf_Of( it->root )->data );
+		return;
+	}
+
+	frame[0].node = it->root;
+	frame[0].cursor = 0;
+	while( depth >= 0 ) {
+		IntTree_Frame *top = &frame[depth];
+		void *next;
+
+		if( top->cursor == fanout ) {
+			depth--;
+			continue;
+		}
+
+		next = top->node->slot[top->cursor++];
+		if( next == NULL )
+			continue;
+
+		if( IntTree_IsLeaf( next ) ) {
+			callback( data, IntTree_Leaf_Of( next )->key, IntTree_Leaf_Of( next )->data );
+		} else {
+			frame[++depth].node = next;
+			frame[depth].cursor = 0;
+		}
+	}
+}
+
+size_t IntTree_Count( IntTree it ) {
+	return it->count;
+}
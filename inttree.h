@@ -0,0 +1,75 @@
+/** @file
+ * @brief	 Hashtree specialized for fixed-width integer keys
+ * @details
+ *   An IntTree maps 4 or 8 byte unsigned integers to data with the same semantics as a
+ *    HashTree (NULL data marks an absent entry), but without any length handling: the key
+ *    is split into digits of a fixed number of bits (4 for nibble, 8 for byte fan-out),
+ *    most significant first, and each level of the tree is indexed directly by one digit.
+ *    The depth is therefore known in advance (width * 8 / bits) and a lookup is a fixed,
+ *    unrolled run of array indexing with no prefix comparisons.
+ *   A subtree holding a single key is not expanded: its slot points straight at the key's
+ *    leaf (tagged in the pointer's low bit), so sparse keys do not pay for the full depth.
+ *   Nodes and leaves come from the same arena the HashTree uses.
+ *   inttree.hpp wraps the tree in a C++ template whose width and fan-out are compile-time
+ *    constants, so lookups through it are inlined into the caller.
+ */
+
+#include <stdint.h>
+#include "hashtree.h"
+
+#ifndef INCLUDED_INTTREE_H
+#define INCLUDED_INTTREE_H
+
+/* A stored key and its data */
+typedef struct {
+	uint64_t key;
+	void *data;
+} IntTree_Leaf;
+
+/* An inner node: one slot per digit value, each NULL, an inner node or a tagged leaf */
+typedef struct {
+	unsigned short count;	/* slots in use */
+	void *slot[];
+} IntTree_Node;
+
+#define IntTree_IsLeaf( slot ) (((uintptr_t)(slot) & 1) != 0)
+#define IntTree_Leaf_Of( slot ) ((IntTree_Leaf *)((uintptr_t)(slot) & ~(uintptr_t)1))
+
+struct HashTree_Arena;
+
+/* Tree Header */
+typedef struct {
+	void *root;		/* slot above the top level */
+	struct HashTree_Arena *arena;	/* allocated just past the header */
+	unsigned char width;	/* key bytes: 4 or 8 */
+	unsigned char bits;	/* bits per digit: 4 or 8 */
+	unsigned char depth;	/* levels: width * 8 / bits */
+	size_t count;
+} IntTree_Header;
+
+typedef IntTree_Header *IntTree;
+
+/* Constructor: width is 4 or 8 bytes, bits 4 (16-way nodes) or 8 (256-way nodes);
+ *   returns NULL for any other shape or when out of memory.
+ *   Keys of a 4 byte tree are taken modulo 2^32. */
+IntTree IntTree_Init( int width, int bits );
+
+/* Descrtuctor */
+void IntTree_Free( IntTree *it );
+
+/* Data (Re)Assignment; NULL data releases the key */
+void IntTree_Assign( IntTree it, uint64_t key, void *data );
+
+/* Data Retreival */
+void *IntTree_Retrieve( IntTree it, uint64_t key );
+
+/* Data Release (Unassignment) */
+void IntTree_Release( IntTree it, uint64_t key );
+
+/* Foreach Entry, in ascending key order */
+void IntTree_Foreach( IntTree it, void (*callback)(void * /* data */, uint64_t /* key */, void * /* entry */), void *data );
+
+/* Entry Count */
+size_t IntTree_Count( IntTree it );
+
+#endif
@@ -0,0 +1,102 @@
+/** @file
+ * @brief	 Compile-time shaped C++ front end for the IntTree
+ * @details
+ *   CUtility::IntTree<Width, Bits> owns a C IntTree of that shape.  Changes go through the
+ *    C functions, while retrieve() walks the nodes itself with the depth and digit size as
+ *    template constants, so the whole descent is unrolled and inlined at the call site.
+ */
+
+#ifndef INCLUDED_INTTREE_HPP
+#define INCLUDED_INTTREE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+
+extern "C" {
+#include "inttree.h"
+}
+
+namespace CUtility {
+
+template<unsigned Width, unsigned Bits = 8>
+class IntTree {
+	static_assert( Width == 4 || Width == 8, "IntTree keys are 4 or 8 bytes wide" );
+	static_assert( Bits == 4 || Bits == 8, "IntTree digits are 4 or 8 bits" );
+
+public:
+	typedef typename std::conditional<Width == 4, uint32_t, uint64_t>::type key_type;
+	static constexpr unsigned depth = Width * 8 / Bits;
+
+	IntTree() : tree( IntTree_Init( Width, Bits ) ) {
+		if( tree == nullptr )
+			throw std::bad_alloc();
+	}
+
+	~IntTree() {
+		IntTree_Free( &tree );
+	}
+
+	IntTree( const IntTree& ) = delete;
+	IntTree& operator=( const IntTree& ) = delete;
+
+	/* NULL data releases the key, as with the C API */
+	void assign( key_type key, void *data ) {
+		IntTree_Assign( tree, key, data );
+	}
+
+	void *retrieve( key_type key ) const {
+		return find( tree->root, key, std::integral_constant<unsigned, 0>() );
+	}
+
+	void release( key_type key ) {
+		IntTree_Release( tree, key );
+	}
+
+	size_t count() const {
+		return IntTree_Count( tree );
+	}
+
+	/* In ascending key order; f is called as f( key, entry ) */
+	template<class F>
+	void foreach( F f ) const {
+		IntTree_Foreach( tree, &IntTree::trampoline<F>, &f );
+	}
+
+	/* The C tree underneath, for code that takes an ::IntTree */
+	::IntTree handle() const {
+		return tree;
+	}
+
+private:
+	::IntTree tree;
+
+	/* One level per instantiation; a leaf or an empty slot ends the walk early */
+	template<unsigned Level>
+	static void *find( void *slot, key_type key, std::integral_constant<unsigned, Level> ) {
+		if( slot == nullptr || IntTree_IsLeaf( slot ) )
+			return leaf( slot, key );
+		unsigned digit = (unsigned)(key >> ((depth - 1 - Level) * Bits)) & ((1u << Bits) - 1);
+		return find( static_cast<IntTree_Node *>( slot )->slot[digit], key, std::integral_constant<unsigned, Level + 1>() );
+	}
+
+	static void *find( void *slot, key_type key, std::integral_constant<unsigned, depth> ) {
+		return leaf( slot, key );
+	}
+
+	static void *leaf( void *slot, key_type key ) {
+		if( slot == nullptr || IntTree_Leaf_Of( slot )->key != key )
+			return nullptr;
+		return IntTree_Leaf_Of( slot )->data;
+	}
+
+	template<class F>
+	static void trampoline( void *data, uint64_t key, void *entry ) {
+		(*static_cast<F *>( data ))( static_cast<key_type>( key ), entry );
+	}
+};
+
+}
+
+#endif
@@ -1,141 +1,316 @@
 #include <string.h>
-#include "tabulation.h"
+#include "tabulation_internal.h"
 
-typedef struct {
-	Table_Index_Hasher hashgen;
-	Table_Index_Hasher_Clean hashclean;
-	HashTree data;
-} Table_Index;
-
-Table_Index *Table_Index_Init( Table_Index_Hasher hasher, Table_Index_Hasher_Clean cleaner ) {
+Table_Index *Table_Index_Init( Table_Rows *rows, int backend, Table_Index_Hasher hasher, Table_Index_Hasher_Clean cleaner ) {
 	Table_Index *newti;
 	
 	newti = malloc( sizeof( Table_Index ) );
 	if( newti != NULL ) {
-		newti->data = HashTree_Init();
+		newti->data = HashTree_InitBackend( backend );
+		newti->keys = IntTree_Init( 8, 8 );
+		newti->rows = rows;
 		newti->hashgen = hasher;
 		newti->hashclean = cleaner;
+		newti->hashmany = NULL;
+		newti->next = NULL;
+		if( newti->data == NULL || newti->keys == NULL ) {
+			if( newti->data != NULL )
+				HashTree_Free( &newti->data );
+			if( newti->keys != NULL )
+				IntTree_Free( &newti->keys );
+			free( newti );
+			newti = NULL;
+		}
 	}
 	
 	return newti;
 }
 
-void Table_Index_Hashtree_Foreach_Listing_Free_Wrapper( void *data, const void *hash, size_t hashlen, void *listing ) {
-	Listing tmpl = (Listing)listing;
-	Listing_Free( &tmpl );
+void Table_Index_Hashtree_Foreach_Bucket_Free_Wrapper( void *data, const void *hash, size_t hashlen, void *bucket ) {
+	Table_Bucket tmpb = (Table_Bucket)bucket;
+	(void)data;
+	(void)hash;
+	(void)hashlen;
+	Table_Bucket_Free( &tmpb );
+}
+
+void Table_Index_IntTree_Foreach_Key_Free_Wrapper( void *data, uint64_t row, void *key ) {
+	(void)data;
+	(void)row;
+	free( key );
 }
 
 void Table_Index_Free( Table_Index **tabind ) {
-	HashTree_Foreach( (*tabind)->data, &Table_Index_Hashtree_Foreach_Listing_Free_Wrapper, NULL, 1 );
+	HashTree_Foreach( (*tabind)->data, &Table_Index_Hashtree_Foreach_Bucket_Free_Wrapper, NULL, 1 );
 	HashTree_Free( &((*tabind)->data) );
+	IntTree_Foreach( (*tabind)->keys, &Table_Index_IntTree_Foreach_Key_Free_Wrapper, NULL );
+	IntTree_Free( &((*tabind)->keys) );
 	free( *tabind );
 	*tabind = NULL;
 }
 
+/* Row registry (private, but for Table_Rows_Id) */
+bool Table_Rows_Init( Table_Rows *rows ) {
+	rows->ids = IntTree_Init( 8, 8 );
+	rows->row = NULL;
+	rows->capacity = 0;
+	rows->next = 0;
+	rows->spare = NULL;
+	rows->spares = 0;
+	rows->spare_capacity = 0;
+	BitSparse_Init( &rows->live, TABLE_ROWS_MAX );
+	return rows->ids != NULL;
+}
+
+void Table_Rows_Free( Table_Rows *rows ) {
+	if( rows->ids != NULL )
+		IntTree_Free( &rows->ids );
+	free( rows->row );
+	free( rows->spare );
+	BitSparse_Free( &rows->live );
+}
+
+int Table_Rows_Id( Table_Rows *rows, void *data ) {
+	return (int)(intptr_t)IntTree_Retrieve( rows->ids, (uintptr_t)data ) - 1;
+}
+
+/* Register an entry, numbering it with a freed id if there is one; returns its id, -1 on failure */
+int Table_Rows_Add( Table_Rows *rows, void *data ) {
+	int id = Table_Rows_Id( rows, data );
+	
+	if( id >= 0 )
+		return id;
+	
+	if( rows->spares > 0 ) {
+		id = rows->spare[--rows->spares];
+	} else {
+		if( rows->next == rows->capacity ) {
+			int capacity = rows->capacity == 0 ? 64 : rows->capacity * 2;
+			void **tmp;
+			
+			if( rows->capacity >= TABLE_ROWS_MAX / 2 )
+				return -1 /* error */;
+			tmp = realloc( rows->row, sizeof( void * ) * capacity );
+			if( tmp == NULL )
+				return -1 /* error */;
+			rows->row = tmp;
+			rows->capacity = capacity;
+		}
+		id = rows->next++;
+	}
+	
+	rows->row[id] = data;
+	BitSparse_Set( &rows->live, id, true );
+	IntTree_Assign( rows->ids, (uintptr_t)data, (void *)(intptr_t)(id + 1) );
+	return id;
+}
+
+/* Unregister an entry, keeping its id for the next one */
+void Table_Rows_Del( Table_Rows *rows, void *data ) {
+	int id = Table_Rows_Id( rows, data );
+	
+	if( id < 0 )
+		return;
+	
+	IntTree_Release( rows->ids, (uintptr_t)data );
+	BitSparse_Set( &rows->live, id, false );
+	rows->row[id] = NULL;
+	
+	if( rows->spares == rows->spare_capacity ) {
+		int capacity = rows->spare_capacity == 0 ? 64 : rows->spare_capacity * 2;
+		int *tmp = realloc( rows->spare, sizeof( int ) * capacity );
+		
+		if( tmp == NULL )
+			return /* error: the id just goes unused */;
+		rows->spare = tmp;
+		rows->spare_capacity = capacity;
+	}
+	rows->spare[rows->spares++] = id;
+}
+
+Table Table_InitBackend( int backend ) {
+	Table newtab;
+	
+	newtab = malloc( sizeof( Table_Header ) );
+	if( newtab != NULL ) {
+		newtab->indexes = HashTree_InitBackend( backend );
+		if( !Table_Rows_Init( &newtab->rows ) || newtab->indexes == NULL ) {
+			if( newtab->indexes != NULL )
+				HashTree_Free( &newtab->indexes );
+			Table_Rows_Free( &newtab->rows );
+			free( newtab );
+			newtab = NULL;
+		} else {
+			pthread_mutex_init( &newtab->lock, NULL );
+			pthread_cond_init( &newtab->published, NULL );
+			newtab->building = NULL;
+			newtab->retired = NULL;
+		}
+	}
+	
+	return newtab;
+}
+
+Table Table_Init() {
+	return Table_InitBackend( HASHTREE_BACKEND_TRIE );
+}
+
 void Table_Hashtree_Foreach_Table_Index_Free_Wrapper( void *data, const void *hash, size_t hashlen, void *tableIndex ) {
 	Table_Index *tti = (Table_Index *)tableIndex;
+	(void)data;
+	(void)hash;
+	(void)hashlen;
 	Table_Index_Free( &tti );
 }
 
 void Table_Free( Table *tab ) {
-	HashTree_Foreach( *tab, &Table_Hashtree_Foreach_Table_Index_Free_Wrapper, NULL, 1 );
-	HashTree_Free( tab );
+	/* Builds under way still write to the table when they publish */
+	pthread_mutex_lock( &(*tab)->lock );
+	while( (*tab)->building != NULL )
+		pthread_cond_wait( &(*tab)->published, &(*tab)->lock );
+	pthread_mutex_unlock( &(*tab)->lock );
+	
+	Table_Retired_Free( *tab );
+	HashTree_Foreach( (*tab)->indexes, &Table_Hashtree_Foreach_Table_Index_Free_Wrapper, NULL, 1 );
+	HashTree_Free( &(*tab)->indexes );
+	Table_Rows_Free( &(*tab)->rows );
+	pthread_mutex_destroy( &(*tab)->lock );
+	pthread_cond_destroy( &(*tab)->published );
+	free( *tab );
+	*tab = NULL;
 }
 
-/* Add an entry to an index */
-void Table_Index_Add( Table_Index *index, void *data ) {
-	Listing dl;
-	void *dh;
-	size_t dhl;
+void Table_Retired_Free( Table tab ) {
+	Table_Index *ti;
 	
-	/* Generate the data's hash for the target listing */
-	index->hashgen( data, &dh, &dhl );
+	while( tab->retired != NULL ) {
+		ti = tab->retired;
+		tab->retired = ti->next;
+		Table_Index_Free( &ti );
+	}
+}
+
+/* Take a copy of a hash to keep as a row's key (private) */
+Table_Key *Table_Key_Init( const void *hash, size_t hashlen ) {
+	Table_Key *key;
 	
-	/* Retrieve the listing of datas with the same hash */
-	dl = HashTree_Retrieve( index->data, dh, dhl );
-	if( dl == NULL ) {
-		/* or create one if it does not exist */
-		dl = Listing_Init();
-		HashTree_Assign( index->data, dh, dhl, dl );
+	key = malloc( sizeof( Table_Key ) + hashlen );
+	if( key != NULL ) {
+		key->len = hashlen;
+		memcpy( key->bytes, hash, hashlen );
 	}
 	
-	/* Append the data, if it does not exist */
-	if( Listing_IndexOf( dl, data ) < 0 )
-		Listing_PushBack( dl, data );
+	return key;
+}
+
+/* Take a row out of the bucket filed under key, letting the bucket go if it empties;
+ *   rows go in and out of buckets by id, so building an index never reads the registry (private) */
+void Table_Index_Unfile( Table_Index *index, int id, Table_Key *key ) {
+	Table_Bucket db;
 	
-	/* Clean the hash */
-	index->hashclean( &data );
+	db = HashTree_Retrieve( index->data, key->bytes, key->len );
+	if( db != NULL ) {
+		BitSparse_Set( &db->ids, id, false );
+		if( Table_Bucket_Count( db ) == 0 ) {
+			Table_Bucket_Free( &db );
+			HashTree_Release( index->data, key->bytes, key->len );
+		}
+	}
 }
 
-/* Remove an entry from an index */
-void Table_Index_Del( Table_Index *index, void *data ) {
-	Listing dl;
-	void *dh;
-	size_t dhl;
+/* File a row under a hash, moving it out of its old bucket if its key changed */
+void Table_Index_Place( Table_Index *index, void *data, int id, void *dh, size_t dhl ) {
+	Table_Key *old, *key;
+	Table_Bucket db;
 	
-	/* Generate the data's hash for the target listing */
-	index->hashgen( data, &dh, &dhl );
+	/* Already filed under this key: nothing to do */
+	old = IntTree_Retrieve( index->keys, (uintptr_t)data );
+	if( old != NULL && old->len == dhl && memcmp( old->bytes, dh, dhl ) == 0 )
+		return;
 	
-	/* Retrieve the listing of datas with the same hash */
-	dl = HashTree_Retrieve( index->data, dh, dhl );
-	if( dl != NULL ) {
-		int di;
-		di = Listing_IndexOf( dl, data );
-		
-		/* Delete entry if it exists */
-		if( di >= 0 )
-			Listing_Remove( dl, di );
-		
-		/* Cleanup after deletion */
-		if( Listing_Count( dl ) == 0 ) {
-			Listing_Free( &dl );
-			HashTree_Release( index->data, dh, dhl );
+	key = Table_Key_Init( dh, dhl );
+	if( key == NULL )
+		return /* error */;
+	
+	/* Retrieve the bucket of datas with the same hash */
+	db = HashTree_Retrieve( index->data, dh, dhl );
+	if( db == NULL ) {
+		/* or create one if it does not exist */
+		db = Table_Bucket_Init( index->rows );
+		if( db == NULL ) {
+			free( key );
+			return /* error */;
 		}
+		HashTree_Assign( index->data, dh, dhl, db );
 	}
 	
-	/* Cleanup hash */
-	index->hashclean( &dh );
+	if( old != NULL )
+		Table_Index_Unfile( index, id, old );
+	BitSparse_Set( &db->ids, id, true );
+	IntTree_Assign( index->keys, (uintptr_t)data, key );
+	free( old );
 }
 
-/* Create a new index for the table; replaces any old index with the same identifier */
-typedef struct {
-	int targetIndexNum;
-	Table_Index *destinationIndex;
-} Table_CreateIndex_HashTree_Foreach_Metadata;
-
-void Table_Index_HashTree_Listing_Foreach_Wrapper( void *destIndex, void *data ) {
-	Table_Index_Add( (Table_Index *)destIndex, data );
+void Table_Index_Hash( Table_Index *index, void **rows, int n, void **dh, size_t *dhl ) {
+	if( index->hashmany != NULL ) {
+		index->hashmany( rows, n, dh, dhl );
+	} else {
+		for( int ix = 0; ix < n; ix++ )
+			index->hashgen( rows[ix], &dh[ix], &dhl[ix] );
+	}
 }
 
-void Table_Index_HashTree_Foreach_Wrapper( void *destIndex, const void *hash, size_t hashlen, void *dataListing ) {
-	Listing_Foreach( (Listing)dataListing, &Table_Index_HashTree_Listing_Foreach_Wrapper, destIndex, 1 );
+/* Add (or refile) an entry in an index */
+void Table_Index_Add( Table_Index *index, void *data, int id ) {
+	void *dh;
+	size_t dhl;
+	
+	/* Generate the data's hash for the target bucket */
+	index->hashgen( data, &dh, &dhl );
+	
+	Table_Index_Place( index, data, id, dh, dhl );
+	
+	/* Clean the hash */
+	index->hashclean( &dh );
 }
 
-void Table_CreateIndex_HashTree_Foreach_Wrapper( void *data, const void *hash, size_t hashlen, void *tableIndex ) {
-	Table_CreateIndex_HashTree_Foreach_Metadata *meta = (Table_CreateIndex_HashTree_Foreach_Metadata *)data;
-	if( meta->targetIndexNum < 1 ) {
-		HashTree_Foreach( meta->destinationIndex->data, &Table_Index_HashTree_Foreach_Wrapper, &meta->destinationIndex, 1 );
-		meta->targetIndexNum++;
+/* Remove an entry from an index; it is found by its stored key, without rehashing */
+void Table_Index_Del( Table_Index *index, void *data, int id ) {
+	Table_Key *key;
+	
+	key = IntTree_Retrieve( index->keys, (uintptr_t)data );
+	if( key != NULL ) {
+		Table_Index_Unfile( index, id, key );
+		IntTree_Release( index->keys, (uintptr_t)data );
+		free( key );
 	}
 }
 
+/* Create a new index for the table; replaces any old index with the same identifier */
+void Table_CreateIndex_BitSparse_Foreach_Wrapper( void *destIndex, int id ) {
+	Table_Index *ti = (Table_Index *)destIndex;
+	Table_Index_Add( ti, ti->rows->row[id], id );
+}
+
 void Table_CreateIndex( Table tab, const char *id, Table_Index_Hasher hash_generator, Table_Index_Hasher_Clean hash_cleaner ) {
 	Table_Index *newti, *oldti;
 	
-	newti = Table_Index_Init( hash_generator, hash_cleaner );
+	newti = Table_Index_Init( &tab->rows, HashTree_Backend( tab->indexes ), hash_generator, hash_cleaner );
+	if( newti == NULL )
+		return /* error */;
+	
+	pthread_mutex_lock( &tab->lock );
+	Table_Retired_Free( tab );
 	
 	/* Populate our new index with our existing data */
-	if( HashTree_Count( tab ) != 0 ) {
-		Table_CreateIndex_HashTree_Foreach_Metadata meta;
-		meta.targetIndexNum = 0;
-		meta.destinationIndex = newti;
-		HashTree_Foreach( tab, &Table_CreateIndex_HashTree_Foreach_Wrapper, &meta, 1 );
-	}
+	BitSparse_Foreach( &tab->rows.live, &Table_CreateIndex_BitSparse_Foreach_Wrapper, newti );
 	
 	/* Do not forget the old index with the same name, if any; doing so will cause a memory leak. */
-	oldti = HashTree_Retrieve( tab, id, strlen( id ) );
+	oldti = HashTree_Retrieve( tab->indexes, id, strlen( id ) );
+	
+	HashTree_Assign( tab->indexes, id, strlen( id ), newti );
 	
-	HashTree_Assign( tab, id, strlen( id ), newti );
+	pthread_mutex_unlock( &tab->lock );
 	
 	if( oldti != NULL )
 		Table_Index_Free( &oldti );
@@ -145,40 +320,382 @@ void Table_CreateIndex( Table tab, const char *id, Table_Index_Hasher hash_gener
 void Table_DropIndex( Table tab, const char *indexId ) {
 	Table_Index *ti;
 	
-	ti = HashTree_Retrieve( tab, indexId, strlen( indexId ) );
-	HashTree_Release( tab, indexId, strlen( indexId ) );
+	pthread_mutex_lock( &tab->lock );
+	Table_Retired_Free( tab );
+	ti = HashTree_Retrieve( tab->indexes, indexId, strlen( indexId ) );
+	HashTree_Release( tab->indexes, indexId, strlen( indexId ) );
+	pthread_mutex_unlock( &tab->lock );
 	
 	if( ti != NULL )
 		Table_Index_Free( &ti );
 }
 
-/* Add an entry to the Table */
+void Table_SetBatchHasher( Table tab, const char *indexId, Table_Index_Batch_Hasher hasher ) {
+	Table_Index *ti;
+	
+	pthread_mutex_lock( &tab->lock );
+	ti = HashTree_Retrieve( tab->indexes, indexId, strlen( indexId ) );
+	if( ti != NULL )
+		ti->hashmany = hasher;
+	pthread_mutex_unlock( &tab->lock );
+}
+
+/* An entry on its way through the indexes, with its id in the registry */
+typedef struct {
+	void *data;
+	int id;
+} Table_Entry;
+
+/* Add an entry to the Table; the Table_Entry_* calls expect the table's lock held (private) */
 void Table_Hashtree_Foreach_Table_Index_Add_Wrapper( void *data, const void *hash, size_t hashlen, void *tableIndex ) {
-	Table_Index_Add( tableIndex, data );
+	Table_Entry *entry = (Table_Entry *)data;
+	(void)hash;
+	(void)hashlen;
+	Table_Index_Add( tableIndex, entry->data, entry->id );
+}
+
+void Table_Entry_Add( Table tab, void *data ) {
+	Table_Entry entry;
+	
+	entry.data = data;
+	entry.id = Table_Rows_Add( &tab->rows, data );
+	if( entry.id < 0 )
+		return /* error */;
+	HashTree_Foreach( tab->indexes, &Table_Hashtree_Foreach_Table_Index_Add_Wrapper, &entry, 1 );
+	Table_Build_Log( tab, TABLE_DELTA_ADD, data, entry.id );
 }
 
 void Table_Add( Table tab, void *data ) {
-	HashTree_Foreach( tab, &Table_Hashtree_Foreach_Table_Index_Add_Wrapper, data, 1 );
+	pthread_mutex_lock( &tab->lock );
+	Table_Retired_Free( tab );
+	Table_Entry_Add( tab, data );
+	pthread_mutex_unlock( &tab->lock );
+}
+
+/* Reindex an entry of the Table; refiling it is a no-op in indexes where its key is unchanged */
+void Table_Update( Table tab, void *data ) {
+	Table_Entry entry;
+	
+	pthread_mutex_lock( &tab->lock );
+	Table_Retired_Free( tab );
+	entry.data = data;
+	entry.id = Table_Rows_Id( &tab->rows, data );
+	if( entry.id >= 0 ) {
+		HashTree_Foreach( tab->indexes, &Table_Hashtree_Foreach_Table_Index_Add_Wrapper, &entry, 1 );
+		Table_Build_Log( tab, TABLE_DELTA_ADD, data, entry.id );
+	}
+	pthread_mutex_unlock( &tab->lock );
 }
 
 /* Delete an entry from the Table */
 void Table_Hashtree_Foreach_Table_Index_Del_Wrapper( void *data, const void *hash, size_t hashlen, void *tableIndex ) {
-	Table_Index_Del( tableIndex, data );
+	Table_Entry *entry = (Table_Entry *)data;
+	(void)hash;
+	(void)hashlen;
+	Table_Index_Del( tableIndex, entry->data, entry->id );
+}
+
+void Table_Entry_Del( Table tab, void *data ) {
+	Table_Entry entry;
+	
+	entry.data = data;
+	entry.id = Table_Rows_Id( &tab->rows, data );
+	if( entry.id < 0 )
+		return;
+	
+	HashTree_Foreach( tab->indexes, &Table_Hashtree_Foreach_Table_Index_Del_Wrapper, &entry, 1 );
+	Table_Build_Log( tab, TABLE_DELTA_DEL, data, entry.id );
+	Table_Rows_Del( &tab->rows, data );
 }
 
 void Table_Del( Table tab, void *data ) {
-	HashTree_Foreach( tab, &Table_Hashtree_Foreach_Table_Index_Del_Wrapper, data, 1 );
+	pthread_mutex_lock( &tab->lock );
+	Table_Retired_Free( tab );
+	Table_Entry_Del( tab, data );
+	pthread_mutex_unlock( &tab->lock );
 }
 
-/* Get entries from the table that "look like" a given data object by index */
-Listing Table_Query( Table tab, const char *index, void *data ) {
+/* Add a batch of rows to one index: every row is hashed in one pass up front,
+ *   then the buckets are fetched together before any of them changes */
+void Table_Index_AddMany( Table_Index *index, void **rows, int *ids, int n ) {
+	void **dh;
+	size_t *dhl;
+	Table_Bucket *db;
+	
+	if( n <= 0 )
+		return;
+	
+	/* Hashers fill dhl in through a pointer the compiler cannot follow; start it zeroed */
+	dh = malloc( sizeof( void * ) * n );
+	dhl = calloc( n, sizeof( size_t ) );
+	db = malloc( sizeof( Table_Bucket ) * n );
+	if( dh == NULL || dhl == NULL || db == NULL ) {
+		/* Short on memory: fall back to a row at a time */
+		free( dh );
+		free( dhl );
+		free( db );
+		for( int ix = 0; ix < n; ix++ ) {
+			if( ids[ix] >= 0 )
+				Table_Index_Add( index, rows[ix], ids[ix] );
+		}
+		return;
+	}
+	
+	Table_Index_Hash( index, rows, n, dh, dhl );
+	
+	/* Rows the index already holds may move, which can let a bucket go;
+	 *   settle them before any bucket is fetched */
+	for( int ix = 0; ix < n; ix++ ) {
+		if( IntTree_Retrieve( index->keys, (uintptr_t)rows[ix] ) != NULL )
+			Table_Index_Place( index, rows[ix], ids[ix], dh[ix], dhl[ix] );
+	}
+	
+	HashTree_RetrieveMany( index->data, (const void **)dh, dhl, (void **)db, n );
+	
+	for( int ix = 0; ix < n; ix++ ) {
+		Table_Key *key;
+	
+		/* Rows the registry could not take are left out */
+		if( ids[ix] < 0 )
+			continue /* error */;
+	
+		/* An earlier row of the batch may have started this bucket */
+		if( db[ix] == NULL )
+			db[ix] = HashTree_Retrieve( index->data, dh[ix], dhl[ix] );
+		if( db[ix] == NULL ) {
+			db[ix] = Table_Bucket_Init( index->rows );
+			if( db[ix] == NULL )
+				continue /* error */;
+			HashTree_Assign( index->data, dh[ix], dhl[ix], db[ix] );
+		}
+	
+		/* A row already in its bucket was settled above, or came earlier in the batch */
+		if( BitSparse_Get( &db[ix]->ids, ids[ix] ) )
+			continue;
+	
+		key = Table_Key_Init( dh[ix], dhl[ix] );
+		if( key == NULL )
+			continue /* error */;
+		BitSparse_Set( &db[ix]->ids, ids[ix], true );
+		IntTree_Assign( index->keys, (uintptr_t)rows[ix], key );
+	}
+	
+	for( int ix = 0; ix < n; ix++ )
+		index->hashclean( &dh[ix] );
+	
+	free( dh );
+	free( dhl );
+	free( db );
+}
+
+/* Remove a batch of rows from one index: their stored keys are gathered first,
+ *   then the buckets are fetched together before any of them changes */
+void Table_Index_DelMany( Table_Index *index, void **rows, int *ids, int n ) {
+	Table_Key **key;
+	const void **kh;
+	size_t *khl;
+	Table_Bucket *db;
+	int *kept;
+	int m = 0;
+	
+	if( n <= 0 )
+		return;
+	
+	key = malloc( sizeof( Table_Key * ) * n );
+	kh = malloc( sizeof( void * ) * n );
+	khl = malloc( sizeof( size_t ) * n );
+	db = malloc( sizeof( Table_Bucket ) * n );
+	kept = malloc( sizeof( int ) * n );
+	if( key == NULL || kh == NULL || khl == NULL || db == NULL || kept == NULL ) {
+		/* Short on memory: fall back to a row at a time */
+		free( key );
+		free( kh );
+		free( khl );
+		free( db );
+		free( kept );
+		for( int ix = 0; ix < n; ix++ )
+			Table_Index_Del( index, rows[ix], ids[ix] );
+		return;
+	}
+	
+	/* Unlinking each key as it is taken means a row listed twice is only taken once */
+	for( int ix = 0; ix < n; ix++ ) {
+		Table_Key *found = IntTree_Retrieve( index->keys, (uintptr_t)rows[ix] );
+		if( found != NULL ) {
+			IntTree_Release( index->keys, (uintptr_t)rows[ix] );
+			kept[m] = ids[ix];
+			key[m] = found;
+			kh[m] = found->bytes;
+			khl[m] = found->len;
+			m++;
+		}
+	}
+	
+	/* None of the rows were filed here */
+	if( m == 0 ) {
+		free( key );
+		free( kh );
+		free( khl );
+		free( db );
+		free( kept );
+		return;
+	}
+	
+	HashTree_RetrieveMany( index->data, kh, khl, (void **)db, m );
+	
+	for( int ix = 0; ix < m; ix++ ) {
+		if( db[ix] != NULL )
+			BitSparse_Set( &db[ix]->ids, kept[ix], false );
+	}
+	
+	/* Emptied buckets go only once every row is out, since rows may share them;
+	 *   a bucket already let go no longer matches what the index holds */
+	for( int ix = 0; ix < m; ix++ ) {
+		if( db[ix] != NULL && HashTree_Retrieve( index->data, kh[ix], khl[ix] ) == db[ix] && Table_Bucket_Count( db[ix] ) == 0 ) {
+			HashTree_Release( index->data, kh[ix], khl[ix] );
+			Table_Bucket_Free( &db[ix] );
+		}
+	}
+	
+	for( int ix = 0; ix < m; ix++ )
+		free( key[ix] );
+	
+	free( key );
+	free( kh );
+	free( khl );
+	free( db );
+	free( kept );
+}
+
+/* Bulk changes: each index is one task, so only one thread ever touches it and none needs a lock */
+typedef struct {
+	Table_Index **index;
+	int indexes;
+	int next;
+	void **rows;
+	int *ids;
+	int n;
+	bool add;
+} Table_Many_Job;
+
+void Table_Many_Hashtree_Foreach_Collect_Wrapper( void *data, const void *hash, size_t hashlen, void *tableIndex ) {
+	Table_Many_Job *job = (Table_Many_Job *)data;
+	(void)hash;
+	(void)hashlen;
+	job->index[job->indexes++] = tableIndex;
+}
+
+void *Table_Many_Worker( void *data ) {
+	Table_Many_Job *job = (Table_Many_Job *)data;
+	int ix;
+	
+	while( (ix = __atomic_fetch_add( &job->next, 1, __ATOMIC_RELAXED )) < job->indexes ) {
+		if( job->add )
+			Table_Index_AddMany( job->index[ix], job->rows, job->ids, job->n );
+		else
+			Table_Index_DelMany( job->index[ix], job->rows, job->ids, job->n );
+	}
+	
+	return NULL;
+}
+
+void Table_Many( Table tab, void **rows, int n, int threads, bool add ) {
+	Table_Many_Job job;
+	size_t indexes;
+	
+	if( n <= 0 )
+		return;
+	
+	pthread_mutex_lock( &tab->lock );
+	Table_Retired_Free( tab );
+	
+	indexes = HashTree_Count( tab->indexes );
+	job.index = malloc( sizeof( Table_Index * ) * (indexes > 0 ? indexes : 1) );
+	job.ids = malloc( sizeof( int ) * n );
+	if( job.index == NULL || job.ids == NULL ) {
+		/* Short on memory: fall back to a row at a time */
+		free( job.index );
+		free( job.ids );
+		for( int ix = 0; ix < n; ix++ ) {
+			if( add )
+				Table_Entry_Add( tab, rows[ix] );
+			else
+				Table_Entry_Del( tab, rows[ix] );
+		}
+		pthread_mutex_unlock( &tab->lock );
+		return;
+	}
+	
+	/* The registry is the table's alone: it changes here, before the indexes do */
+	for( int ix = 0; ix < n; ix++ )
+		job.ids[ix] = add ? Table_Rows_Add( &tab->rows, rows[ix] ) : Table_Rows_Id( &tab->rows, rows[ix] );
+	
+	job.indexes = 0;
+	job.next = 0;
+	job.rows = rows;
+	job.n = n;
+	job.add = add;
+	HashTree_Foreach( tab->indexes, &Table_Many_Hashtree_Foreach_Collect_Wrapper, &job, 1 );
+	
+	if( threads > job.indexes )
+		threads = job.indexes;
+	if( threads < 1 )
+		threads = 1;
+	
+	pthread_t thread_list[threads > 1 ? threads - 1 : 1];
+	int started = 0;
+	
+	/* Spin up workers with this thread as the last worker; indexes are claimed as they go,
+	 *   so if a thread cannot be started the ones that were take up its share */
+	while( started < threads - 1 && pthread_create( &thread_list[started], NULL, &Table_Many_Worker, &job ) == 0 )
+		started++;
+	Table_Many_Worker( &job );
+	
+	/* make sure all workers die before continuing */
+	for( int ix = 0; ix < started; ix++ ) {
+		pthread_join( thread_list[ix], NULL );
+	}
+	
+	for( int ix = 0; ix < n; ix++ ) {
+		if( job.ids[ix] >= 0 )
+			Table_Build_Log( tab, add ? TABLE_DELTA_ADD : TABLE_DELTA_DEL, rows[ix], job.ids[ix] );
+	}
+	
+	if( !add ) {
+		for( int ix = 0; ix < n; ix++ )
+			Table_Rows_Del( &tab->rows, rows[ix] );
+	}
+	
+	pthread_mutex_unlock( &tab->lock );
+	
+	free( job.index );
+	free( job.ids );
+}
+
+void Table_AddMany( Table tab, void **rows, int n, int threads ) {
+	Table_Many( tab, rows, n, threads, true );
+}
+
+void Table_DelMany( Table tab, void **rows, int n, int threads ) {
+	Table_Many( tab, rows, n, threads, false );
+}
+
+/* An index by name, once any build of it that queries block on is done (private) */
+Table_Index *Table_Index_Find( Table tab, const char *index ) {
+	Table_Build_Await( tab, index );
+	return HashTree_Retrieve( tab->indexes, index, strlen( index ) );
+}
+
+/* Get the bucket of entries that "look like" a given data object by index */
+Table_Bucket Table_Lookup( Table tab, const char *index, void *data ) {
 	Table_Index *ti;
 	void *hash;
 	size_t hashlen;
-	Listing output;
+	Table_Bucket output;
 	
-	ti = HashTree_Retrieve( tab, index, strlen( index ) );
-	/* if( ti == NULL ) return NULL; */
+	ti = Table_Index_Find( tab, index );
+	if( ti == NULL )
+		return NULL;
 	
 	ti->hashgen( data, &hash, &hashlen );
 	output = HashTree_Retrieve( ti->data, hash, hashlen );
@@ -186,3 +703,82 @@ Listing Table_Query( Table tab, const char *index, void *data ) {
 	
 	return output;
 }
+
+/* Get entries from the table that "look like" a given data object by index */
+Table_Cursor Table_Query( Table tab, const char *index, void *data ) {
+	Table_Cursor output;
+	
+	pthread_mutex_lock( &tab->lock );
+	output = Table_Cursor_Init( Table_Lookup( tab, index, data ) );
+	pthread_mutex_unlock( &tab->lock );
+	
+	return output;
+}
+
+/* Aggregates */
+size_t Table_Count( Table tab ) {
+	size_t output;
+	
+	pthread_mutex_lock( &tab->lock );
+	output = BitSparse_Cardinality( &tab->rows.live );
+	pthread_mutex_unlock( &tab->lock );
+	
+	return output;
+}
+
+size_t Table_Query_Count( Table tab, const char *index, void *data ) {
+	size_t output;
+	
+	pthread_mutex_lock( &tab->lock );
+	output = Table_Bucket_Count( Table_Lookup( tab, index, data ) );
+	pthread_mutex_unlock( &tab->lock );
+	
+	return output;
+}
+
+/* Empty buckets are let go, so any bucket at all means a match */
+bool Table_Exists( Table tab, const char *index, void *data ) {
+	bool output;
+	
+	pthread_mutex_lock( &tab->lock );
+	output = Table_Lookup( tab, index, data ) != NULL;
+	pthread_mutex_unlock( &tab->lock );
+	
+	return output;
+}
+
+size_t Table_Distinct( Table tab, const char *indexId ) {
+	Table_Index *ti;
+	size_t output;
+	
+	pthread_mutex_lock( &tab->lock );
+	ti = Table_Index_Find( tab, indexId );
+	output = ti == NULL ? 0 : HashTree_Count( ti->data );
+	pthread_mutex_unlock( &tab->lock );
+	
+	return output;
+}
+
+typedef struct {
+	void (*callback)(void *, const void *, size_t, size_t);
+	void *data;
+} Table_GroupCount_Metadata;
+
+void Table_GroupCount_HashTree_Foreach_Wrapper( void *data, const void *hash, size_t hashlen, void *bucket ) {
+	Table_GroupCount_Metadata *meta = (Table_GroupCount_Metadata *)data;
+	meta->callback( meta->data, hash, hashlen, Table_Bucket_Count( (Table_Bucket)bucket ) );
+}
+
+void Table_GroupCount( Table tab, const char *indexId, void (*callback)(void *, const void *, size_t, size_t), void *data ) {
+	Table_GroupCount_Metadata meta;
+	Table_Index *ti;
+	
+	pthread_mutex_lock( &tab->lock );
+	ti = Table_Index_Find( tab, indexId );
+	if( ti != NULL ) {
+		meta.callback = callback;
+		meta.data = data;
+		HashTree_Foreach( ti->data, &Table_GroupCount_HashTree_Foreach_Wrapper, &meta, 1 );
+	}
+	pthread_mutex_unlock( &tab->lock );
+}
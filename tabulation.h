@@ -6,17 +6,59 @@
 #ifndef INCLUDED_TABULATION_H
 #define INCLUDED_TABULATION_H
 
-#include "listing.h"
 #include "hashtree.h"
 
 /* C-string (null terminated char array) returning hashing routine */
 typedef void (*Table_Index_Hasher)( void *data, void **hash, size_t *hashlen );
 typedef void (*Table_Index_Hasher_Clean)( void **hash );
-typedef HashTree Table; /* HashTrees are the basic structure for our table */
 
-/* Nothing Special about Table Initialization,
- *   just use base Initializer.       */
-#define Table_Init() HashTree_Init()
+/* Batch form of a hasher: hashes n rows at once, each freed with the index's Table_Index_Hasher_Clean */
+typedef void (*Table_Index_Batch_Hasher)( void **rows, int n, void **hash, size_t *hashlen );
+
+/* Tables, buckets of their entries and background index builds are opaque handles */
+typedef struct Table_Header *Table;
+typedef struct Table_Bucket_Header *Table_Bucket;
+typedef struct Table_Build_Header *Table_Build;
+
+/* Read-only cursor over query results: it reads the bucket in place, copying nothing,
+ *   so it holds good only until the table next changes */
+typedef struct {
+	Table_Bucket bucket;	/* NULL for no results */
+	size_t position;	/* as for Table_Bucket_Next */
+	size_t offset;		/* results passed over before the first */
+	size_t limit;		/* most results to yield; SIZE_MAX for all */
+	size_t yielded;
+} Table_Cursor;
+
+/* Query expressions: a term matches the entries an index files under the probe's key;
+ *   AND and OR combine any number of operands, NOT takes the one operand's complement */
+typedef enum {
+	TABLE_EXPR_TERM,
+	TABLE_EXPR_AND,
+	TABLE_EXPR_OR,
+	TABLE_EXPR_NOT
+} Table_Expr_Op;
+
+typedef struct Table_Expr {
+	Table_Expr_Op op;
+	const char *index;		/* TERM: the index to look in */
+	void *probe;			/* TERM: data for the index's hasher */
+	int count;			/* AND, OR: number of operands; NOT: 1 */
+	struct Table_Expr **operand;
+} Table_Expr;
+
+/* Background index builds: what queries on an index see while it is being built */
+typedef enum {
+	TABLE_BUILD_FALLBACK,	/* whatever is published under its name meanwhile: the index it replaces, or none */
+	TABLE_BUILD_BLOCK	/* they wait for the build to finish */
+} Table_Build_Policy;
+
+/* Table Constructor */
+Table Table_Init();
+
+/* Tables over a chosen HashTree backend (HASHTREE_BACKEND_*);
+ *   the table's indexes are created over the same backend. */
+Table Table_InitBackend( int backend );
 
 /* Table destructor (not simply a wrapper) */
 void Table_Free( Table *tab );
@@ -24,16 +66,102 @@ void Table_Free( Table *tab );
 /* Create a table index */
 void Table_CreateIndex( Table, const char *index, Table_Index_Hasher, Table_Index_Hasher_Clean );
 
+/* Create a table index in the background and return at once; NULL on failure.
+ *   The entries already in the table are hashed on up to threads threads while the table stays
+ *   in use, then the changes made meanwhile are replayed and the index is published in place of
+ *   any of the same name (cursors reading that one hold good until the table next changes).
+ *   The hashers run on the build's own threads, so entries must stay valid until the build
+ *   finishes, even once removed from the table, and must not be changed (then Table_Update'd)
+ *   until then either.  Release the handle with Table_Build_Wait. */
+Table_Build Table_CreateIndexAsync( Table, const char *index, Table_Index_Hasher, Table_Index_Hasher_Clean, int threads, Table_Build_Policy policy );
+
+/* Build progress: entries hashed so far, of those in the table when the build began */
+void Table_Build_Progress( Table_Build build, size_t *done, size_t *total );
+
+/* Whether a build has finished, published or not */
+bool Table_Build_Done( Table_Build build );
+
+/* Wait for a build to finish and release its handle; true if the index was published */
+bool Table_Build_Wait( Table_Build *build );
+
+/* Give an index a batch form of its hasher, used where many rows are hashed together
+ *   (Table_AddMany, and background rebuilds with the same hashers); NULL to go back to one
+ *   row at a time.  Ignored if there is no such index. */
+void Table_SetBatchHasher( Table, const char *index, Table_Index_Batch_Hasher );
+
 /* Remove a table index */
 void Table_DropIndex( Table, const char *index );
 
 /* Add an entry to the table */
 void Table_Add( Table, void *data );
 
-/* Remove an entry from the table */
+/* Remove an entry from the table; each index finds it by the key it was filed under,
+ *   without rerunning the hashers */
 void Table_Del( Table, void *data );
 
-/* Query data in the table */
-Listing Table_Query( Table, const char *index, void *data );
+/* Reindex an entry that has changed since it was added: it moves only in the indexes
+ *   whose key for it changed.  Entries not in the table are ignored. */
+void Table_Update( Table, void *data );
+
+/* Add many entries to the table; the indexes are shared out between up to threads threads,
+ *   each index being updated by just one of them (so hashers may run on several threads at once) */
+void Table_AddMany( Table, void **rows, int n, int threads );
+
+/* Remove many entries from the table, shared out as with Table_AddMany */
+void Table_DelMany( Table, void **rows, int n, int threads );
+
+/* Query data in the table; the cursor is empty if nothing matches or there is no such index */
+Table_Cursor Table_Query( Table, const char *index, void *data );
+
+/* Entries matching a boolean expression over the indexes, as a bucket of the caller's own
+ *   (free with Table_Bucket_Free); NULL when out of memory.  AND operands are applied
+ *   most selective first, judged by bucket cardinalities, and stop once nothing is left.
+ *   The bucket holds the entries' row ids, so like a cursor it holds good only until the
+ *   table next changes: walks skip entries removed since, but ids are reused, so an entry
+ *   added since may turn up in place of one removed. */
+Table_Bucket Table_Select( Table, Table_Expr *expr );
+
+/* Aggregates, answered from the indexes' buckets without visiting any entry */
+size_t Table_Count( Table );					/* entries in the table */
+size_t Table_Query_Count( Table, const char *index, void *data );	/* entries Table_Query would yield */
+bool Table_Exists( Table, const char *index, void *data );		/* whether it would yield any */
+size_t Table_Distinct( Table, const char *index );			/* keys the index holds entries under */
+
+/* Group By: the number of entries under each key of an index, in no particular order;
+ *   the callback runs with the table locked, so it must not call back into the table */
+void Table_GroupCount( Table, const char *index, void (*callback)(void * /* data */, const void * /* key */, size_t /* key_len */, size_t /* count */), void *data );
+
+/* Cursor over a bucket's rows (such as Table_Select's), in row id order */
+Table_Cursor Table_Cursor_Init( Table_Bucket bucket );
+
+/* Restart a cursor at its offset'th result (counting from 0), yielding at most limit;
+ *   the offset is found from the bucket's container cardinalities, not by stepping */
+void Table_Cursor_Limit( Table_Cursor *cursor, size_t offset, size_t limit );
+
+/* Results the cursor yields in all, from its offset and up to its limit */
+size_t Table_Cursor_Count( Table_Cursor *cursor );
+
+/* Next result; NULL once done */
+void *Table_Cursor_Next( Table_Cursor *cursor );
+
+/* Bucket Descrtuctor */
+void Table_Bucket_Free( Table_Bucket *bucket );
+
+/* Add a row; false if it was already there (or is not in the table) */
+bool Table_Bucket_Insert( Table_Bucket bucket, void *row );
+
+/* Remove a row; false if it was not there */
+bool Table_Bucket_Remove( Table_Bucket bucket, void *row );
+
+/* Bucket queries; a NULL bucket is an empty one */
+bool Table_Bucket_Contains( Table_Bucket bucket, void *row );
+size_t Table_Bucket_Count( Table_Bucket bucket );
+
+/* Iterate a bucket in row id order: start with *cursor = 0; returns NULL once done.
+ *   Ids whose entry has left the table are passed over. */
+void *Table_Bucket_Next( Table_Bucket bucket, size_t *cursor );
+
+/* Foreach Row, in row id order, passing over ids whose entry has left the table */
+void Table_Bucket_Foreach( Table_Bucket bucket, void (*callback)(void * /* data */, void * /* row */), void *data );
 
 #endif
@@ -0,0 +1,147 @@
+/* Sets of row ids: the buckets of a table index */
+
+#include "tabulation_internal.h"
+
+Table_Bucket Table_Bucket_Init( Table_Rows *rows ) {
+	Table_Bucket newbucket;
+
+	newbucket = malloc( sizeof( Table_Bucket_Header ) );
+	if( newbucket != NULL ) {
+		BitSparse_Init( &newbucket->ids, TABLE_ROWS_MAX );
+		newbucket->rows = rows;
+	}
+
+	return newbucket;
+}
+
+void Table_Bucket_Free( Table_Bucket *bucket ) {
+	BitSparse_Free( &(*bucket)->ids );
+	free( *bucket );
+	*bucket = NULL;
+}
+
+bool Table_Bucket_Insert( Table_Bucket bucket, void *row ) {
+	int id = Table_Rows_Id( bucket->rows, row );
+
+	if( id < 0 || BitSparse_Get( &bucket->ids, id ) )
+		return false;
+
+	BitSparse_Set( &bucket->ids, id, true );
+	return true;
+}
+
+bool Table_Bucket_Remove( Table_Bucket bucket, void *row ) {
+	int id = Table_Rows_Id( bucket->rows, row );
+
+	if( id < 0 || !BitSparse_Get( &bucket->ids, id ) )
+		return false;
+
+	BitSparse_Set( &bucket->ids, id, false );
+	return true;
+}
+
+bool Table_Bucket_Contains( Table_Bucket bucket, void *row ) {
+	int id;
+
+	if( bucket == NULL )
+		return false;
+
+	id = Table_Rows_Id( bucket->rows, row );
+	return id >= 0 && BitSparse_Get( &bucket->ids, id );
+}
+
+size_t Table_Bucket_Count( Table_Bucket bucket ) {
+	return bucket == NULL ? 0 : BitSparse_Cardinality( &bucket->ids );
+}
+
+void *Table_Bucket_Next( Table_Bucket bucket, size_t *cursor ) {
+	void *row = NULL;
+	int id;
+
+	if( bucket == NULL )
+		return NULL;
+
+	/* An index's buckets only hold live ids; a bucket of the caller's own may outlive some */
+	while( row == NULL && *cursor < TABLE_ROWS_MAX ) {
+		id = BitSparse_Next( &bucket->ids, (int)*cursor );
+		if( id < 0 ) {
+			*cursor = TABLE_ROWS_MAX;
+			return NULL;
+		}
+
+		*cursor = (size_t)id + 1;
+		row = bucket->rows->row[id];
+	}
+
+	return row;
+}
+
+/* Hand each id's entry on to the caller's callback */
+typedef struct {
+	Table_Rows *rows;
+	void (*callback)(void *, void *);
+	void *data;
+} Table_Bucket_Foreach_Metadata;
+
+void Table_Bucket_BitSparse_Foreach_Wrapper( void *data, int id ) {
+	Table_Bucket_Foreach_Metadata *meta = (Table_Bucket_Foreach_Metadata *)data;
+
+	if( meta->rows->row[id] != NULL )
+		meta->callback( meta->data, meta->rows->row[id] );
+}
+
+void Table_Bucket_Foreach( Table_Bucket bucket, void (*callback)(void *, void *), void *data ) {
+	Table_Bucket_Foreach_Metadata meta;
+
+	if( bucket == NULL )
+		return;
+
+	meta.rows = bucket->rows;
+	meta.callback = callback;
+	meta.data = data;
+	BitSparse_Foreach( &bucket->ids, &Table_Bucket_BitSparse_Foreach_Wrapper, &meta );
+}
+
+/* Cursors */
+Table_Cursor Table_Cursor_Init( Table_Bucket bucket ) {
+	Table_Cursor cursor;
+
+	cursor.bucket = bucket;
+	cursor.position = 0;
+	cursor.offset = 0;
+	cursor.limit = SIZE_MAX;
+	cursor.yielded = 0;
+
+	return cursor;
+}
+
+void Table_Cursor_Limit( Table_Cursor *cursor, size_t offset, size_t limit ) {
+	int id = 0;
+
+	if( cursor->bucket != NULL && offset > 0 )
+		id = BitSparse_Select( &cursor->bucket->ids, offset );
+
+	cursor->position = id < 0 ? TABLE_ROWS_MAX : (size_t)id;
+	cursor->offset = offset;
+	cursor->limit = limit;
+	cursor->yielded = 0;
+}
+
+size_t Table_Cursor_Count( Table_Cursor *cursor ) {
+	size_t total = Table_Bucket_Count( cursor->bucket );
+
+	total = total > cursor->offset ? total - cursor->offset : 0;
+	return total < cursor->limit ? total : cursor->limit;
+}
+
+void *Table_Cursor_Next( Table_Cursor *cursor ) {
+	void *row;
+
+	if( cursor->yielded == cursor->limit )
+		return NULL;
+
+	row = Table_Bucket_Next( cursor->bucket, &cursor->position );
+	if( row != NULL )
+		cursor->yielded++;
+	return row;
+}
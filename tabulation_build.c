@@ -0,0 +1,297 @@
+/* Online index builds: a table index populated in the background while the table stays in use */
+
+#include <string.h>
+#include "tabulation_internal.h"
+
+/* Entries hashed per claim of the parallel scan */
+#define TABLE_BUILD_CHUNK 1024
+
+/* Changes left over from catching up that are few enough to replay with the table locked */
+#define TABLE_BUILD_CATCHUP 256
+
+void Table_Build_Log( Table tab, Table_Delta_Op op, void *data, int id ) {
+	for( Table_Build build = tab->building; build != NULL; build = build->next ) {
+		if( build->failed )
+			continue;
+
+		if( build->deltas == build->delta_capacity ) {
+			size_t capacity = build->delta_capacity == 0 ? 64 : build->delta_capacity * 2;
+			Table_Delta *tmp = realloc( build->delta, sizeof( Table_Delta ) * capacity );
+
+			if( tmp == NULL ) {
+				/* A change the new index would miss: better not to publish it at all */
+				build->failed = true;
+				continue /* error */;
+			}
+			build->delta = tmp;
+			build->delta_capacity = capacity;
+		}
+
+		build->delta[build->deltas].op = op;
+		build->delta[build->deltas].data = data;
+		build->delta[build->deltas].id = id;
+		build->deltas++;
+	}
+}
+
+bool Table_Build_Await( Table tab, const char *index ) {
+	Table_Build build = tab->building;
+	bool waited = false;
+
+	while( build != NULL ) {
+		if( build->policy == TABLE_BUILD_BLOCK && strcmp( build->id, index ) == 0 ) {
+			/* The list may have changed by the time we wake; look again from the start */
+			pthread_cond_wait( &tab->published, &tab->lock );
+			waited = true;
+			build = tab->building;
+		} else {
+			build = build->next;
+		}
+	}
+
+	return waited;
+}
+
+/* The parallel scan: hashes for the snapshot's entries, claimed a chunk at a time */
+typedef struct {
+	Table_Build build;
+	void **dh;
+	size_t *dhl;
+	size_t next;
+} Table_Build_Scan;
+
+void *Table_Build_Scan_Worker( void *data ) {
+	Table_Build_Scan *scan = (Table_Build_Scan *)data;
+	Table_Build build = scan->build;
+	size_t start, end;
+
+	while( (start = __atomic_fetch_add( &scan->next, TABLE_BUILD_CHUNK, __ATOMIC_RELAXED )) < build->total ) {
+		end = start + TABLE_BUILD_CHUNK < build->total ? start + TABLE_BUILD_CHUNK : build->total;
+		Table_Index_Hash( build->index, &build->row[start], end - start, &scan->dh[start], &scan->dhl[start] );
+		__atomic_add_fetch( &build->done, end - start, __ATOMIC_RELAXED );
+	}
+
+	return NULL;
+}
+
+/* File the snapshot's entries into the new index, hashing them on the build's threads (private) */
+bool Table_Build_Populate( Table_Build build ) {
+	Table_Build_Scan scan;
+	int threads = build->threads;
+
+	if( build->total == 0 )
+		return true;
+
+	scan.build = build;
+	scan.next = 0;
+	scan.dh = malloc( sizeof( void * ) * build->total );
+	scan.dhl = malloc( sizeof( size_t ) * build->total );
+	if( scan.dh == NULL || scan.dhl == NULL ) {
+		free( scan.dh );
+		free( scan.dhl );
+		return false /* error */;
+	}
+
+	if( (size_t)threads > (build->total + TABLE_BUILD_CHUNK - 1) / TABLE_BUILD_CHUNK )
+		threads = (build->total + TABLE_BUILD_CHUNK - 1) / TABLE_BUILD_CHUNK;
+	if( threads < 1 )
+		threads = 1;
+
+	pthread_t thread_list[threads > 1 ? threads - 1 : 1];
+	int started = 0;
+
+	/* Spin up workers with this thread as the last worker; chunks are claimed as they go,
+	 *   so if a thread cannot be started the ones that were take up its share */
+	while( started < threads - 1 && pthread_create( &thread_list[started], NULL, &Table_Build_Scan_Worker, &scan ) == 0 )
+		started++;
+	Table_Build_Scan_Worker( &scan );
+
+	/* make sure all workers die before continuing */
+	for( int ix = 0; ix < started; ix++ ) {
+		pthread_join( thread_list[ix], NULL );
+	}
+
+	/* Filing stays on this thread: the new index is not shared until it is published */
+	for( size_t ix = 0; ix < build->total; ix++ ) {
+		Table_Index_Place( build->index, build->row[ix], build->row_id[ix], scan.dh[ix], scan.dhl[ix] );
+		build->index->hashclean( &scan.dh[ix] );
+	}
+
+	free( scan.dh );
+	free( scan.dhl );
+	return true;
+}
+
+/* Bring the new index up to date with changes made during the build (private) */
+void Table_Build_Replay( Table_Build build, Table_Delta *delta, size_t deltas ) {
+	for( size_t ix = 0; ix < deltas; ix++ ) {
+		if( delta[ix].op == TABLE_DELTA_ADD )
+			Table_Index_Add( build->index, delta[ix].data, delta[ix].id );
+		else
+			Table_Index_Del( build->index, delta[ix].data, delta[ix].id );
+	}
+}
+
+void *Table_Build_Run( void *data ) {
+	Table_Build build = (Table_Build)data;
+	Table tab = build->tab;
+	Table_Index *oldti = NULL;
+	Table_Delta *delta;
+	size_t deltas;
+	bool ok;
+
+	ok = Table_Build_Populate( build );
+	free( build->row );
+	free( build->row_id );
+	build->row = NULL;
+	build->row_id = NULL;
+
+	/* Catch up without the lock for as long as there is much to replay */
+	pthread_mutex_lock( &tab->lock );
+	if( !ok )
+		build->failed = true;
+	while( !build->failed && build->deltas > TABLE_BUILD_CATCHUP ) {
+		delta = build->delta;
+		deltas = build->deltas;
+		build->delta = NULL;
+		build->deltas = 0;
+		build->delta_capacity = 0;
+		pthread_mutex_unlock( &tab->lock );
+
+		Table_Build_Replay( build, delta, deltas );
+		free( delta );
+
+		pthread_mutex_lock( &tab->lock );
+	}
+
+	/* The last few go in with the table locked, so nothing can slip in before publishing */
+	if( !build->failed ) {
+		Table_Build_Replay( build, build->delta, build->deltas );
+		/* Cursors may still be reading the index being replaced: it goes when the table next changes */
+		oldti = HashTree_Retrieve( tab->indexes, build->id, strlen( build->id ) );
+		if( oldti != NULL ) {
+			oldti->next = tab->retired;
+			tab->retired = oldti;
+			oldti = NULL;
+		}
+		HashTree_Assign( tab->indexes, build->id, strlen( build->id ), build->index );
+		build->index = NULL;
+		build->published = true;
+	} else {
+		/* Never published, so nothing reads it */
+		oldti = build->index;
+		build->index = NULL;
+	}
+	free( build->delta );
+	build->delta = NULL;
+	build->deltas = 0;
+
+	/* Unlink the build; Table_Free and blocked queries wait on this */
+	for( Table_Build *link = &tab->building; *link != NULL; link = &(*link)->next ) {
+		if( *link == build ) {
+			*link = build->next;
+			break;
+		}
+	}
+	__atomic_store_n( &build->finished, true, __ATOMIC_RELEASE );
+	pthread_cond_broadcast( &tab->published );
+	pthread_mutex_unlock( &tab->lock );
+
+	if( oldti != NULL )
+		Table_Index_Free( &oldti );
+
+	return NULL;
+}
+
+/* Take note of the table's entries as the build begins (private) */
+typedef struct {
+	Table_Build build;
+	Table_Rows *rows;
+} Table_Build_Snapshot_Metadata;
+
+void Table_Build_BitSparse_Foreach_Snapshot_Wrapper( void *data, int id ) {
+	Table_Build_Snapshot_Metadata *meta = (Table_Build_Snapshot_Metadata *)data;
+	Table_Build build = meta->build;
+
+	build->row[build->total] = meta->rows->row[id];
+	build->row_id[build->total] = id;
+	build->total++;
+}
+
+Table_Build Table_CreateIndexAsync( Table tab, const char *id, Table_Index_Hasher hash_generator, Table_Index_Hasher_Clean hash_cleaner, int threads, Table_Build_Policy policy ) {
+	Table_Build_Snapshot_Metadata meta;
+	Table_Build build;
+	Table_Index *oldti;
+	size_t count;
+
+	build = calloc( 1, sizeof( Table_Build_Header ) );
+	if( build == NULL )
+		return NULL /* error */;
+
+	build->tab = tab;
+	build->policy = policy;
+	build->threads = threads;
+	build->id = strdup( id );
+	build->index = Table_Index_Init( &tab->rows, HashTree_Backend( tab->indexes ), hash_generator, hash_cleaner );
+	if( build->id == NULL || build->index == NULL )
+		goto fail;
+
+	/* The snapshot and joining the build list happen together, so every later change is logged */
+	pthread_mutex_lock( &tab->lock );
+
+	/* A rebuild with the same hashers can use the batch form the index it replaces was given */
+	oldti = HashTree_Retrieve( tab->indexes, id, strlen( id ) );
+	if( oldti != NULL && oldti->hashgen == hash_generator && oldti->hashclean == hash_cleaner )
+		build->index->hashmany = oldti->hashmany;
+	count = BitSparse_Cardinality( &tab->rows.live );
+	build->row = malloc( sizeof( void * ) * (count > 0 ? count : 1) );
+	build->row_id = malloc( sizeof( int ) * (count > 0 ? count : 1) );
+	if( build->row == NULL || build->row_id == NULL ) {
+		pthread_mutex_unlock( &tab->lock );
+		goto fail;
+	}
+	meta.build = build;
+	meta.rows = &tab->rows;
+	BitSparse_Foreach( &tab->rows.live, &Table_Build_BitSparse_Foreach_Snapshot_Wrapper, &meta );
+
+	if( pthread_create( &build->thread, NULL, &Table_Build_Run, build ) != 0 ) {
+		pthread_mutex_unlock( &tab->lock );
+		goto fail;
+	}
+	build->next = tab->building;
+	tab->building = build;
+	pthread_mutex_unlock( &tab->lock );
+
+	return build;
+
+fail:
+	if( build->index != NULL )
+		Table_Index_Free( &build->index );
+	free( build->row );
+	free( build->row_id );
+	free( build->id );
+	free( build );
+	return NULL /* error */;
+}
+
+void Table_Build_Progress( Table_Build build, size_t *done, size_t *total ) {
+	*done = __atomic_load_n( &build->done, __ATOMIC_RELAXED );
+	*total = build->total;
+}
+
+bool Table_Build_Done( Table_Build build ) {
+	return __atomic_load_n( &build->finished, __ATOMIC_ACQUIRE );
+}
+
+bool Table_Build_Wait( Table_Build *build ) {
+	bool published;
+
+	pthread_join( (*build)->thread, NULL );
+	published = (*build)->published;
+
+	free( (*build)->id );
+	free( *build );
+	*build = NULL;
+
+	return published;
+}
@@ -0,0 +1,125 @@
+/* Tabulation internals, shared by the tabulation sources; everyone else sees
+ *   tables, buckets and builds as opaque handles */
+
+#ifndef INCLUDED_TABULATION_INTERNAL_H
+#define INCLUDED_TABULATION_INTERNAL_H
+
+#include <pthread.h>
+#include "tabulation.h"
+#include "inttree.h"
+#include "bitsparse.h"
+
+/* Row registry: every entry of a table, numbered with a small id (reused once freed)
+ *   so that buckets can hold sets of ids */
+typedef struct {
+	IntTree ids;		/* entry address -> its id + 1 */
+	void **row;		/* id -> entry, NULL for ids not in use */
+	int capacity;
+	int next;		/* ids below next have been handed out */
+	int *spare;		/* freed ids, for reuse */
+	int spares, spare_capacity;
+	BitSparse live;		/* ids in use */
+} Table_Rows;
+
+/* Table Header */
+typedef struct Table_Header {
+	HashTree indexes;	/* index name -> index; HashTrees are the basic structure for our table */
+	Table_Rows rows;
+	pthread_mutex_t lock;	/* held by every table call, so background builds can run alongside them */
+	pthread_cond_t published;	/* broadcast as each background build finishes */
+	struct Table_Build_Header *building;	/* background builds under way */
+	struct Table_Index *retired;	/* indexes builds have replaced, kept for cursors until the next change */
+} Table_Header;
+
+/* Index bucket: the set of rows sharing one hash, kept as a BitSparse of row ids,
+ *   so it is a sorted posting list while small and a bitmap once dense, and
+ *   buckets combine with the BitSparse boolean operations */
+typedef struct Table_Bucket_Header {
+	BitSparse ids;
+	Table_Rows *rows;	/* the table's registry, turning ids back into entries */
+} Table_Bucket_Header;
+
+/* Bucket Constructor: an empty bucket of a table's entries */
+Table_Bucket Table_Bucket_Init( Table_Rows *rows );
+
+/* A change made to the table during a build, to replay on the new index */
+typedef enum {
+	TABLE_DELTA_ADD,	/* also an Update */
+	TABLE_DELTA_DEL
+} Table_Delta_Op;
+
+typedef struct {
+	Table_Delta_Op op;
+	void *data;
+	int id;
+} Table_Delta;
+
+typedef struct Table_Build_Header {
+	Table tab;
+	char *id;			/* the index's name */
+	struct Table_Index *index;	/* the index being built, until it is published */
+	Table_Build_Policy policy;
+	int threads;
+	void **row;			/* the entries in the table as the build began, with their ids */
+	int *row_id;
+	size_t done, total;		/* progress: entries hashed, of those */
+	Table_Delta *delta;		/* changes made since, not yet replayed */
+	size_t deltas, delta_capacity;
+	bool failed;			/* out of memory: the index will not be published */
+	bool finished, published;
+	pthread_t thread;
+	struct Table_Build_Header *next;
+} Table_Build_Header;
+
+/* Row registry */
+#define TABLE_ROWS_MAX 0x7FFFFFFF
+
+/* A registered entry's id, -1 if it is not in the table */
+int Table_Rows_Id( Table_Rows *rows, void *data );
+
+/* Indexes */
+
+/* A row's key in one index, as the index's hasher gave it when the row was last filed */
+typedef struct {
+	size_t len;
+	unsigned char bytes[];
+} Table_Key;
+
+typedef struct Table_Index {
+	Table_Index_Hasher hashgen;
+	Table_Index_Hasher_Clean hashclean;
+	Table_Index_Batch_Hasher hashmany;	/* NULL: hashgen a row at a time */
+	HashTree data;
+	IntTree keys;	/* row -> the Table_Key it is filed under */
+	Table_Rows *rows;
+	struct Table_Index *next;	/* on the table's retired list */
+} Table_Index;
+
+Table_Index *Table_Index_Init( Table_Rows *rows, int backend, Table_Index_Hasher hasher, Table_Index_Hasher_Clean cleaner );
+void Table_Index_Free( Table_Index **tabind );
+
+/* Hash n rows, in one call to the batch hasher if the index has one */
+void Table_Index_Hash( Table_Index *index, void **rows, int n, void **dh, size_t *dhl );
+
+/* File the row with the given id under a hash / its hasher's hash, or take it out */
+void Table_Index_Place( Table_Index *index, void *data, int id, void *dh, size_t dhl );
+void Table_Index_Add( Table_Index *index, void *data, int id );
+void Table_Index_Del( Table_Index *index, void *data, int id );
+
+/* The rest expect the caller to hold the table's lock */
+
+/* Free the indexes background builds have replaced; called as the table changes,
+ *   which is when cursors still reading them stop holding good */
+void Table_Retired_Free( Table tab );
+
+/* The index's own bucket for data; NULL if nothing matches or there is no such index */
+Table_Bucket Table_Lookup( Table tab, const char *index, void *data );
+
+/* Note a change for every build under way */
+void Table_Build_Log( Table tab, Table_Delta_Op op, void *data, int id );
+
+/* Wait out any build of the index that queries are to block on; true if that meant
+ *   letting go of the lock, so anything read from the table before may be stale */
+bool Table_Build_Await( Table tab, const char *index );
+
+#endif
@@ -0,0 +1,193 @@
+/* Boolean queries over a table's indexes */
+
+#include "tabulation_internal.h"
+
+/* An expression annotated for evaluation: terms are resolved to their buckets once,
+ *   and every node carries an estimate of the rows it can match */
+typedef struct Table_Plan {
+	Table_Expr *expr;
+	Table_Bucket bucket;	/* TERM: the matching bucket, NULL if nothing matches */
+	size_t estimate;
+	int count;
+	struct Table_Plan **operand;
+} Table_Plan;
+
+void Table_Plan_Free( Table_Plan *plan ) {
+	for( int ix = 0; ix < plan->count; ix++ )
+		Table_Plan_Free( plan->operand[ix] );
+	free( plan->operand );
+	free( plan );
+}
+
+/* Selective operands first; complements, which can only take rows away, last (private) */
+int Table_Plan_Compare( const void *a, const void *b ) {
+	const Table_Plan *pa = *(Table_Plan * const *)a, *pb = *(Table_Plan * const *)b;
+	bool na = pa->expr->op == TABLE_EXPR_NOT, nb = pb->expr->op == TABLE_EXPR_NOT;
+
+	if( na != nb )
+		return na ? 1 : -1;
+	if( pa->estimate != pb->estimate )
+		return pa->estimate < pb->estimate ? -1 : 1;
+	return 0;
+}
+
+/* Wait out blocking builds of every index the expression names; true if any wait let go
+ *   of the lock, after which those already waited on may have had new builds started (private) */
+bool Table_Plan_Await( Table tab, Table_Expr *expr ) {
+	bool waited = false;
+	int count;
+
+	if( expr->op == TABLE_EXPR_TERM )
+		return Table_Build_Await( tab, expr->index );
+
+	count = expr->op == TABLE_EXPR_NOT ? 1 : expr->count;
+	for( int ix = 0; ix < count; ix++ ) {
+		if( Table_Plan_Await( tab, expr->operand[ix] ) )
+			waited = true;
+	}
+
+	return waited;
+}
+
+/* Build the plan for an expression; NULL when out of memory.  Terms hold on to their
+ *   buckets, so no build the plan would block on may be left under way (private) */
+Table_Plan *Table_Plan_Init( Table tab, Table_Expr *expr ) {
+	size_t total = BitSparse_Cardinality( &tab->rows.live );
+	Table_Plan *plan;
+
+	plan = malloc( sizeof( Table_Plan ) );
+	if( plan == NULL )
+		return NULL /* error */;
+
+	plan->expr = expr;
+	plan->bucket = NULL;
+	plan->count = expr->op == TABLE_EXPR_TERM ? 0 : expr->op == TABLE_EXPR_NOT ? 1 : expr->count;
+	plan->operand = NULL;
+
+	if( plan->count > 0 ) {
+		plan->operand = calloc( plan->count, sizeof( Table_Plan * ) );
+		if( plan->operand == NULL ) {
+			free( plan );
+			return NULL /* error */;
+		}
+		for( int ix = 0; ix < plan->count; ix++ ) {
+			plan->operand[ix] = Table_Plan_Init( tab, expr->operand[ix] );
+			if( plan->operand[ix] == NULL ) {
+				plan->count = ix;
+				Table_Plan_Free( plan );
+				return NULL /* error */;
+			}
+		}
+	}
+
+	switch( expr->op ) {
+		case TABLE_EXPR_TERM:
+			plan->bucket = Table_Lookup( tab, expr->index, expr->probe );
+			plan->estimate = Table_Bucket_Count( plan->bucket );
+			break;
+		case TABLE_EXPR_AND:
+			/* No more than the smallest operand that is not a complement */
+			plan->estimate = total;
+			for( int ix = 0; ix < plan->count; ix++ ) {
+				if( plan->operand[ix]->expr->op != TABLE_EXPR_NOT && plan->operand[ix]->estimate < plan->estimate )
+					plan->estimate = plan->operand[ix]->estimate;
+			}
+			if( plan->count > 1 )
+				qsort( plan->operand, plan->count, sizeof( Table_Plan * ), &Table_Plan_Compare );
+			break;
+		case TABLE_EXPR_OR:
+			plan->estimate = 0;
+			for( int ix = 0; ix < plan->count; ix++ )
+				plan->estimate += plan->operand[ix]->estimate;
+			if( plan->estimate > total )
+				plan->estimate = total;
+			break;
+		case TABLE_EXPR_NOT:
+			plan->estimate = total - (plan->operand[0]->estimate < total ? plan->operand[0]->estimate : total);
+			break;
+	}
+
+	return plan;
+}
+
+void Table_Plan_Eval( Table tab, Table_Plan *plan, BitSparse *result );
+
+/* A plan's rows without copying anything a term can lend: a term hands over its bucket's
+ *   ids, anything else is evaluated into scratch (private) */
+BitSparse *Table_Plan_Borrow( Table tab, Table_Plan *plan, BitSparse *scratch ) {
+	if( plan->expr->op == TABLE_EXPR_TERM )
+		return plan->bucket != NULL ? &plan->bucket->ids : scratch;
+
+	Table_Plan_Eval( tab, plan, scratch );
+	return scratch;
+}
+
+/* Combine result with a plan's rows, freeing whatever was evaluated for it (private) */
+void Table_Plan_Apply( Table tab, Table_Plan *plan, BitSparse *result, void (*op)(BitSparse *, BitSparse *, BitSparse *) ) {
+	BitSparse scratch;
+
+	BitSparse_Init( &scratch, TABLE_ROWS_MAX );
+	op( result, result, Table_Plan_Borrow( tab, plan, &scratch ) );
+	BitSparse_Free( &scratch );
+}
+
+/* Evaluate a plan into result, an initialized and empty BitSparse (private) */
+void Table_Plan_Eval( Table tab, Table_Plan *plan, BitSparse *result ) {
+	int ix = 0;
+
+	switch( plan->expr->op ) {
+		case TABLE_EXPR_TERM:
+			Table_Plan_Apply( tab, plan, result, &BitSparse_Or );
+			break;
+		case TABLE_EXPR_AND:
+			/* Start from the most selective operand, or from every row if all are complements */
+			if( plan->count > 0 && plan->operand[0]->expr->op != TABLE_EXPR_NOT ) {
+				Table_Plan_Eval( tab, plan->operand[0], result );
+				ix = 1;
+			} else {
+				BitSparse_Or( result, result, &tab->rows.live );
+			}
+
+			for( ; ix < plan->count && result->containers > 0; ix++ ) {
+				if( plan->operand[ix]->expr->op == TABLE_EXPR_NOT )
+					Table_Plan_Apply( tab, plan->operand[ix]->operand[0], result, &BitSparse_AndNot );
+				else
+					Table_Plan_Apply( tab, plan->operand[ix], result, &BitSparse_And );
+			}
+			break;
+		case TABLE_EXPR_OR:
+			for( ix = 0; ix < plan->count; ix++ )
+				Table_Plan_Apply( tab, plan->operand[ix], result, &BitSparse_Or );
+			break;
+		case TABLE_EXPR_NOT:
+			BitSparse_Or( result, result, &tab->rows.live );
+			Table_Plan_Apply( tab, plan->operand[0], result, &BitSparse_AndNot );
+			break;
+	}
+}
+
+Table_Bucket Table_Select( Table tab, Table_Expr *expr ) {
+	Table_Bucket output;
+	Table_Plan *plan;
+
+	output = Table_Bucket_Init( &tab->rows );
+	if( output == NULL )
+		return NULL /* error */;
+
+	pthread_mutex_lock( &tab->lock );
+	/* Every wait lets the table change under us, so only plan after a pass with none */
+	while( Table_Plan_Await( tab, expr ) )
+		;
+	plan = Table_Plan_Init( tab, expr );
+	if( plan == NULL ) {
+		pthread_mutex_unlock( &tab->lock );
+		Table_Bucket_Free( &output );
+		return NULL /* error */;
+	}
+
+	Table_Plan_Eval( tab, plan, &output->ids );
+	pthread_mutex_unlock( &tab->lock );
+	Table_Plan_Free( plan );
+
+	return output;
+}
@@ -0,0 +1,878 @@
+/* Tabulation verification: every query is checked against a brute force reference */
+#include <iostream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <regex>
+#include <cstdlib>
+#include <cstdint>
+#include <thread>
+#include <atomic>
+#include <chrono>
+
+extern "C" {
+#include "tabulation_internal.h"
+}
+
+using namespace std;
+
+#define DISPLAY_DEBUG true
+
+struct aTest {
+	bool (*test)();
+	string name;
+};
+
+void showhelp( const vector<aTest> &mytests ) {
+	cout << "Tests:" << endl;
+	cout << "\t0. All Tests" << endl;
+	for( int ix = 0; ix < mytests.size(); ix++ ) {
+		cout << "\t" << ix + 1 << ". " << mytests[ix].name << endl;
+	}
+}
+
+void argproc( int argc, char **argv, const vector<aTest> &mytests, vector<int> &runtests ) {
+	regex test("[0-9]+");
+	regex help("-h|--help");
+	cmatch m;
+	
+	vector<char *> fail;
+	
+	for( int ix = 1; ix < argc; ix++ ) {
+		regex_match( argv[ix], m, test );
+		if( !m.empty() ) {
+			int id = atoi( argv[ix] );
+			if( id <= mytests.size() ) {
+				runtests.push_back( id );
+			} else {
+				fail.push_back( argv[ ix ] );
+			}
+		} else {
+			regex_match( argv[ix], m, help );
+			if( !m.empty() ) {
+				showhelp( mytests );
+				exit( EXIT_SUCCESS );
+			} else {
+				fail.push_back( argv[ix] );
+			}
+		}
+	}
+	
+	for( int ie = 0; ie < fail.size(); ie++ ) {
+		cerr << "ERROR: Invalid Test: `" << fail[ie] << "'" << endl;
+	}
+	
+	if( fail.size() > 0 ) {
+		cerr << "FATAL: Errors Occurred; Use -h or --help to list valid tests." << endl;
+		exit( EXIT_FAILURE );
+	}
+}
+
+#define CHECK( test, fmsg, res ) \
+	if( !(test) ) { \
+		if( DISPLAY_DEBUG ) \
+			cout << "FAIL: " << fmsg << " (" #test ")" << endl; \
+		res = false; \
+	}
+
+#define DISPL( msg, d ) \
+	if( DISPLAY_DEBUG ) \
+		cout << "(" << msg << "): " << d << endl;
+
+/* Rows with a few small fields, each indexed on its own */
+struct Row {
+	int a, b, c;
+};
+
+extern "C" void hash_a( void *data, void **hash, size_t *hashlen ) {
+	int *key = (int *)malloc( sizeof( int ) );
+	*key = ((Row *)data)->a;
+	*hash = key;
+	*hashlen = sizeof( int );
+}
+
+extern "C" void hash_b( void *data, void **hash, size_t *hashlen ) {
+	int *key = (int *)malloc( sizeof( int ) );
+	*key = ((Row *)data)->b;
+	*hash = key;
+	*hashlen = sizeof( int );
+}
+
+extern "C" void hash_c( void *data, void **hash, size_t *hashlen ) {
+	int *key = (int *)malloc( sizeof( int ) );
+	*key = ((Row *)data)->c;
+	*hash = key;
+	*hashlen = sizeof( int );
+}
+
+extern "C" void hash_clean( void **hash ) {
+	free( *hash );
+	*hash = NULL;
+}
+
+/* Batch form of hash_a, counting its calls */
+atomic<int> batch_calls( 0 );
+
+extern "C" void hash_a_many( void **rows, int n, void **hash, size_t *hashlen ) {
+	batch_calls++;
+	for( int ix = 0; ix < n; ix++ )
+		hash_a( rows[ix], &hash[ix], &hashlen[ix] );
+}
+
+/* Every row a cursor yields, in order */
+vector<void *> drain( Table_Cursor cursor ) {
+	vector<void *> out;
+	void *row;
+
+	while( (row = Table_Cursor_Next( &cursor )) != NULL )
+		out.push_back( row );
+	return out;
+}
+
+/* Every index answers as the reference says: the same keys, each with the same count */
+bool agrees( Table tab, const vector<Row> &rows, const vector<bool> &in, const char *indexes ) {
+	map<int, size_t> want[3];
+	size_t live = 0;
+
+	for( size_t ix = 0; ix < rows.size(); ix++ ) {
+		if( in[ix] ) {
+			live++;
+			want[0][rows[ix].a]++;
+			want[1][rows[ix].b]++;
+			want[2][rows[ix].c]++;
+		}
+	}
+
+	bool same = Table_Count( tab ) == live;
+	for( const char *index = indexes; *index != '\0'; index++ ) {
+		char name[2] = { *index, '\0' };
+		map<int, size_t> &keys = want[*index - 'a'];
+		same &= Table_Distinct( tab, name ) == keys.size();
+		for( map<int, size_t>::iterator it = keys.begin(); it != keys.end(); it++ ) {
+			Row probe = { it->first, it->first, it->first };
+			same &= Table_Query_Count( tab, name, &probe ) == it->second;
+		}
+	}
+	return same;
+}
+
+// Basic Setup/Teardown test
+bool test_init() {
+	bool result = true;
+	Row probe = { 1, 2, 3 };
+	Table tab = Table_Init();
+
+	CHECK( tab != NULL, "Table not allocated", result );
+	CHECK( Table_Count( tab ) == 0, "New table not empty", result );
+	Table_Cursor cursor = Table_Query( tab, "a", &probe );
+	CHECK( Table_Cursor_Next( &cursor ) == NULL && Table_Cursor_Count( &cursor ) == 0, "Missing index answered", result );
+
+	Table_CreateIndex( tab, "a", &hash_a, &hash_clean );
+	Table_Add( tab, &probe );
+	CHECK( Table_Count( tab ) == 1 && Table_Exists( tab, "a", &probe ), "Entry not added", result );
+	Table_DropIndex( tab, "a" );
+	CHECK( !Table_Exists( tab, "a", &probe ) && Table_Count( tab ) == 1, "Index not dropped", result );
+
+	Table_Free( &tab );
+	CHECK( tab == NULL, "Memory not released", result );
+
+	tab = Table_InitBackend( HASHTREE_BACKEND_HASHMAP );
+	CHECK( tab != NULL, "Hashmap backed table not allocated", result );
+	Table_Free( &tab );
+	return result;
+}
+
+extern "C" void gather( void *data, void *row ) {
+	((vector<void *> *)data)->push_back( row );
+}
+
+// Bucket test: a few keys with many entries each, churned; and a bucket of the caller's own
+bool test_bucket() {
+	bool result = true;
+	const int n = 100000;
+	vector<Row> rows( n );
+	vector<bool> in( n, true );
+	Table tab = Table_Init();
+
+	Table_CreateIndex( tab, "a", &hash_a, &hash_clean );
+	for( int ix = 0; ix < n; ix++ ) {
+		rows[ix] = { ix % 3, 0, 0 };
+		Table_Add( tab, &rows[ix] );
+	}
+	for( int ix = 0; ix < n; ix += 2 ) {
+		Table_Del( tab, &rows[ix] );
+		in[ix] = false;
+	}
+	for( int ix = 0; ix < n; ix += 8 ) {
+		Table_Add( tab, &rows[ix] );
+		in[ix] = true;
+	}
+	Table_Add( tab, &rows[8] );
+	CHECK( agrees( tab, rows, in, "a" ), "Churned buckets disagree with reference", result );
+
+	/* Each bucket holds exactly its key's entries */
+	bool same = true;
+	for( int key = 0; key < 3; key++ ) {
+		Row probe = { key, 0, 0 };
+		Table_Cursor cursor = Table_Query( tab, "a", &probe );
+		size_t want = 0;
+		for( int ix = 0; ix < n; ix++ ) {
+			want += in[ix] && rows[ix].a == key;
+			same &= Table_Bucket_Contains( cursor.bucket, &rows[ix] ) == (in[ix] && rows[ix].a == key);
+		}
+		same &= Table_Bucket_Count( cursor.bucket ) == want && drain( cursor ).size() == want;
+	}
+	CHECK( same, "Bucket membership disagrees with reference", result );
+
+	/* A bucket of the caller's own, over the table's entries */
+	Table_Bucket mine = Table_Bucket_Init( &tab->rows );
+	CHECK( mine != NULL && Table_Bucket_Count( mine ) == 0, "Bucket not allocated", result );
+	CHECK( Table_Bucket_Insert( mine, &rows[1] ) && !Table_Bucket_Insert( mine, &rows[1] ), "Insert not reported", result );
+	CHECK( Table_Bucket_Insert( mine, &rows[3] ) && !Table_Bucket_Insert( mine, &rows[2] ), "Row outside the table inserted", result );
+	CHECK( Table_Bucket_Remove( mine, &rows[1] ) && !Table_Bucket_Remove( mine, &rows[1] ), "Remove not reported", result );
+	CHECK( Table_Bucket_Contains( mine, &rows[3] ) && !Table_Bucket_Contains( mine, &rows[1] ), "Contains incorrect", result );
+	Table_Bucket_Insert( mine, &rows[5] );
+
+	vector<void *> each;
+	Table_Bucket_Foreach( mine, &gather, &each );
+	vector<void *> walked = drain( Table_Cursor_Init( mine ) );
+	CHECK( each == walked && each.size() == Table_Bucket_Count( mine ) && each.size() == 2, "Foreach disagrees with the cursor", result );
+	Table_Bucket_Free( &mine );
+	CHECK( mine == NULL, "Bucket not released", result );
+
+	CHECK( Table_Bucket_Count( NULL ) == 0 && !Table_Bucket_Contains( NULL, &rows[0] ), "NULL bucket not empty", result );
+	Table_Free( &tab );
+	return result;
+}
+
+// Row registry test: entries are numbered in order and freed ids are taken by the next
+bool test_registry() {
+	bool result = true;
+	Row rows[6] = { { 0, 0, 0 }, { 0, 1, 0 }, { 0, 2, 0 }, { 0, 3, 0 }, { 0, 4, 0 }, { 0, 5, 0 } };
+	Row probe = { 0, 0, 0 };
+	Table tab = Table_Init();
+
+	Table_CreateIndex( tab, "a", &hash_a, &hash_clean );
+	for( int ix = 0; ix < 4; ix++ )
+		Table_Add( tab, &rows[ix] );
+	Table_Add( tab, &rows[1] );
+	CHECK( Table_Count( tab ) == 4, "Entry added twice", result );
+
+	/* Cursors yield rows in id order, which is the order they came in */
+	vector<void *> order = drain( Table_Query( tab, "a", &probe ) );
+	CHECK( (order == vector<void *>{ &rows[0], &rows[1], &rows[2], &rows[3] }), "Rows not numbered in order", result );
+
+	/* The latest freed id is the next one handed out */
+	Table_Del( tab, &rows[1] );
+	Table_Del( tab, &rows[2] );
+	Table_Del( tab, &rows[5] );
+	CHECK( Table_Count( tab ) == 2, "Removal miscounted", result );
+	Table_Add( tab, &rows[4] );
+	Table_Add( tab, &rows[5] );
+	order = drain( Table_Query( tab, "a", &probe ) );
+	CHECK( (order == vector<void *>{ &rows[0], &rows[5], &rows[4], &rows[3] }), "Freed ids not reused", result );
+
+	/* Once the freed ids are used up, numbering carries on past the last */
+	Table_Del( tab, &rows[0] );
+	Table_Add( tab, &rows[1] );
+	Table_Add( tab, &rows[2] );
+	order = drain( Table_Query( tab, "a", &probe ) );
+	CHECK( (order == vector<void *>{ &rows[1], &rows[5], &rows[4], &rows[3], &rows[2] }), "Numbering not resumed", result );
+
+	Table_Free( &tab );
+	return result;
+}
+
+// Update test: only the indexes whose key changed move the entry
+bool test_update() {
+	bool result = true;
+	Row rows[3] = { { 1, 10, 100 }, { 1, 20, 100 }, { 2, 20, 200 } };
+	Row outside = { 1, 10, 100 };
+	Table tab = Table_Init();
+
+	Table_CreateIndex( tab, "a", &hash_a, &hash_clean );
+	Table_CreateIndex( tab, "b", &hash_b, &hash_clean );
+	for( int ix = 0; ix < 3; ix++ )
+		Table_Add( tab, &rows[ix] );
+
+	Row p1 = { 1, 1, 1 }, p2 = { 2, 2, 2 }, p10 = { 10, 10, 10 }, p20 = { 20, 20, 20 };
+	rows[0].a = 2;
+	Table_Update( tab, &rows[0] );
+	CHECK( Table_Query_Count( tab, "a", &p1 ) == 1 && Table_Query_Count( tab, "a", &p2 ) == 2, "Entry not moved", result );
+	CHECK( Table_Query_Count( tab, "b", &p10 ) == 1 && Table_Query_Count( tab, "b", &p20 ) == 2, "Unchanged index disturbed", result );
+
+	/* The old key is remembered, so removal finds the entry wherever it was filed */
+	rows[1].b = 10;
+	Table_Update( tab, &rows[1] );
+	rows[1].b = 30;
+	Table_Del( tab, &rows[1] );
+	CHECK( Table_Query_Count( tab, "b", &p10 ) == 1 && Table_Count( tab ) == 2, "Removal missed the filed key", result );
+
+	/* Entries not in the table are ignored */
+	Table_Update( tab, &outside );
+	CHECK( Table_Count( tab ) == 2 && Table_Query_Count( tab, "a", &p1 ) == 0, "Update added an entry", result );
+
+	Table_Free( &tab );
+	return result;
+}
+
+// Batch test: AddMany and DelMany against a reference, on both backends and any number of threads
+bool test_many() {
+	bool result = true;
+	const int n = 20000;
+
+	srand( 45 );
+	for( int backend = HASHTREE_BACKEND_TRIE; backend <= HASHTREE_BACKEND_HASHMAP; backend++ ) {
+		for( int threads = 1; threads <= 4; threads++ ) {
+			vector<Row> rows( n );
+			vector<bool> in( n );
+			vector<void *> batch;
+			Table tab = Table_InitBackend( backend );
+
+			Table_CreateIndex( tab, "a", &hash_a, &hash_clean );
+			Table_CreateIndex( tab, "b", &hash_b, &hash_clean );
+			Table_CreateIndex( tab, "c", &hash_c, &hash_clean );
+			if( threads % 2 == 0 )
+				Table_SetBatchHasher( tab, "a", &hash_a_many );
+			for( int ix = 0; ix < n; ix++ )
+				rows[ix] = { rand() % 7, rand() % 60, rand() % 500 };
+
+			/* Every row once, and some twice */
+			for( int ix = 0; ix < n; ix++ ) {
+				batch.push_back( &rows[ix] );
+				if( ix % 10 == 0 )
+					batch.push_back( &rows[ix / 2] );
+				in[ix] = true;
+			}
+			batch_calls = 0;
+			Table_AddMany( tab, batch.data(), batch.size(), threads );
+			CHECK( agrees( tab, rows, in, "abc" ), "AddMany disagrees with reference", result );
+			CHECK( threads % 2 != 0 || batch_calls == 1, "Batch hasher not used", result );
+
+			/* Take out a third, listing some twice and some already gone */
+			batch.clear();
+			for( int ix = 0; ix < n; ix += 3 ) {
+				batch.push_back( &rows[ix] );
+				if( ix % 9 == 0 )
+					batch.push_back( &rows[ix] );
+				in[ix] = false;
+			}
+			Table_Del( tab, &rows[3] );
+			Table_DelMany( tab, batch.data(), batch.size(), threads );
+			CHECK( agrees( tab, rows, in, "abc" ), "DelMany disagrees with reference", result );
+
+			/* Put some back with changed keys, which refiles the ones still there */
+			batch.clear();
+			for( int ix = 0; ix < n; ix += 4 ) {
+				rows[ix].b = (rows[ix].b + 1) % 60;
+				batch.push_back( &rows[ix] );
+				in[ix] = true;
+			}
+			Table_AddMany( tab, batch.data(), batch.size(), threads );
+			CHECK( agrees( tab, rows, in, "abc" ), "Second AddMany disagrees with reference", result );
+
+			Table_AddMany( tab, NULL, 0, threads );
+			Table_DelMany( tab, NULL, 0, threads );
+			CHECK( agrees( tab, rows, in, "abc" ), "Empty batches changed the table", result );
+			Table_Free( &tab );
+		}
+	}
+	return result;
+}
+
+/* Random query expressions, held in pools that do not move */
+struct ExprPool {
+	deque<Table_Expr> expr;
+	deque<Row> probe;
+	deque< vector<Table_Expr *> > operands;
+};
+
+Table_Expr *randexpr( ExprPool &pool, int depth ) {
+	pool.expr.push_back( Table_Expr() );
+	Table_Expr *e = &pool.expr.back();
+	e->op = depth > 2 ? TABLE_EXPR_TERM : (Table_Expr_Op)(rand() % 4);
+	e->count = 0;
+	e->operand = NULL;
+
+	if( e->op == TABLE_EXPR_TERM ) {
+		pool.probe.push_back( { rand() % 5, rand() % 50, rand() % 3 } );
+		const char *names[4] = { "a", "b", "c", "zz" };
+		e->index = names[rand() % 4];
+		e->probe = &pool.probe.back();
+	} else {
+		e->count = e->op == TABLE_EXPR_NOT ? 1 : rand() % 4;
+		pool.operands.push_back( vector<Table_Expr *>() );
+		vector<Table_Expr *> &operands = pool.operands.back();
+		for( int ix = 0; ix < e->count; ix++ )
+			operands.push_back( randexpr( pool, depth + 1 ) );
+		e->operand = operands.data();
+	}
+	return e;
+}
+
+/* Whether a row matches, by brute force; the index "zz" does not exist */
+bool matches( Table_Expr *e, const Row &row ) {
+	Row *probe = (Row *)e->probe;
+
+	switch( e->op ) {
+		case TABLE_EXPR_TERM:
+			return e->index[0] == 'a' ? row.a == probe->a : e->index[0] == 'b' ? row.b == probe->b : e->index[1] == '\0' && row.c == probe->c;
+		case TABLE_EXPR_AND:
+			for( int ix = 0; ix < e->count; ix++ )
+				if( !matches( e->operand[ix], row ) )
+					return false;
+			return true;
+		case TABLE_EXPR_OR:
+			for( int ix = 0; ix < e->count; ix++ )
+				if( matches( e->operand[ix], row ) )
+					return true;
+			return false;
+		default:
+			return !matches( e->operand[0], row );
+	}
+}
+
+// Select test: random boolean expressions against brute force, with ids reused underneath
+bool test_select() {
+	bool result = true;
+	const int n = 20000;
+
+	srand( 45 );
+	for( int backend = HASHTREE_BACKEND_TRIE; backend <= HASHTREE_BACKEND_HASHMAP; backend++ ) {
+		vector<Row> rows( n );
+		vector<bool> in( n, true );
+		vector<void *> batch;
+		Table tab = Table_InitBackend( backend );
+
+		Table_CreateIndex( tab, "a", &hash_a, &hash_clean );
+		Table_CreateIndex( tab, "b", &hash_b, &hash_clean );
+		for( int ix = 0; ix < n; ix++ ) {
+			rows[ix] = { rand() % 5, rand() % 50, rand() % 3 };
+			batch.push_back( &rows[ix] );
+		}
+		Table_AddMany( tab, batch.data(), n, 2 );
+		for( int ix = 0; ix < n; ix += 3 ) {
+			Table_Del( tab, &rows[ix] );
+			in[ix] = false;
+		}
+		for( int ix = 0; ix < n; ix += 6 ) {
+			Table_Add( tab, &rows[ix] );
+			in[ix] = true;
+		}
+		Table_CreateIndex( tab, "c", &hash_c, &hash_clean );
+		for( int ix = 1; ix < n; ix += 11 ) {
+			rows[ix].b = (rows[ix].b + 1) % 50;
+			Table_Update( tab, &rows[ix] );
+		}
+
+		bool same = true;
+		for( int q = 0; q < 300; q++ ) {
+			ExprPool pool;
+			Table_Expr *e = randexpr( pool, 0 );
+			Table_Bucket found = Table_Select( tab, e );
+			size_t want = 0;
+
+			for( int ix = 0; ix < n; ix++ ) {
+				if( in[ix] && matches( e, rows[ix] ) ) {
+					want++;
+					same &= Table_Bucket_Contains( found, &rows[ix] );
+				}
+			}
+			same &= Table_Bucket_Count( found ) == want;
+			same &= drain( Table_Cursor_Init( found ) ).size() == want;
+			Table_Bucket_Free( &found );
+		}
+		CHECK( same, "Select disagrees with brute force", result );
+
+		/* Entries removed after the select are passed over, not taken for the end */
+		Row two = { 2, 0, 0 };
+		Table_Expr term = { TABLE_EXPR_TERM, "a", &two, 0, NULL };
+		Table_Bucket found = Table_Select( tab, &term );
+		vector<void *> before = drain( Table_Cursor_Init( found ) ), kept;
+		for( size_t ix = 0; ix < before.size(); ix++ ) {
+			if( ix % 2 == 0 )
+				Table_Del( tab, before[ix] );
+			else
+				kept.push_back( before[ix] );
+		}
+		vector<void *> each;
+		Table_Bucket_Foreach( found, &gather, &each );
+		CHECK( before.size() > 0 && drain( Table_Cursor_Init( found ) ) == kept && each == kept, "Removed entries not passed over", result );
+		Table_Bucket_Free( &found );
+		Table_Free( &tab );
+	}
+	return result;
+}
+
+// Cursor test: offsets and limits against a full walk
+bool test_cursor() {
+	bool result = true;
+	const int n = 300000;
+	vector<Row> rows( n );
+	vector<void *> batch( n );
+	Table tab = Table_Init();
+
+	for( int ix = 0; ix < n; ix++ ) {
+		rows[ix] = { ix % 10 == 0 ? 1 : ix % 3 == 0 ? 2 : 3 + ix % 1000, 0, 0 };
+		batch[ix] = &rows[ix];
+	}
+	Table_CreateIndex( tab, "a", &hash_a, &hash_clean );
+	Table_AddMany( tab, batch.data(), n, 1 );
+
+	Row probe = { 2, 0, 0 };
+	size_t want = 0;
+	for( int ix = 0; ix < n; ix++ )
+		want += rows[ix].a == 2;
+
+	Table_Cursor cursor = Table_Query( tab, "a", &probe );
+	CHECK( Table_Cursor_Count( &cursor ) == want, "Cursor miscounts", result );
+	vector<void *> all = drain( cursor );
+	CHECK( all.size() == want, "Cursor walk miscounted", result );
+
+	/* Windows across container boundaries, at the ends and past them */
+	const size_t offsets[] = { 0, 1, 7, 4095, 4096, 20000, want - 1, want, want + 5 };
+	bool same = true;
+	for( int io = 0; io < 9; io++ ) {
+		for( size_t limit = 0; limit < 30; limit += 7 ) {
+			Table_Cursor_Limit( &cursor, offsets[io], limit );
+			size_t count = Table_Cursor_Count( &cursor );
+			vector<void *> window = drain( cursor );
+			same &= window.size() == count;
+			for( size_t ix = 0; ix < window.size(); ix++ )
+				same &= window[ix] == all[offsets[io] + ix];
+		}
+	}
+	Table_Cursor_Limit( &cursor, 10, SIZE_MAX );
+	same &= drain( cursor ).size() == want - 10;
+	CHECK( same, "Offset and limit windows disagree with the full walk", result );
+
+	Table_Free( &tab );
+	return result;
+}
+
+extern "C" void tally( void *data, const void *key, size_t key_len, size_t count ) {
+	(*(map<int, size_t> *)data)[*(const int *)key] += count;
+}
+
+// Aggregate test: counts answered from the buckets
+bool test_aggregate() {
+	bool result = true;
+	const int n = 50000;
+	vector<Row> rows( n );
+	map<int, size_t> want, got;
+	Table tab = Table_Init();
+
+	srand( 45 );
+	Table_CreateIndex( tab, "a", &hash_a, &hash_clean );
+	for( int ix = 0; ix < n; ix++ ) {
+		rows[ix] = { rand() % 300, 0, 0 };
+		Table_Add( tab, &rows[ix] );
+	}
+	for( int ix = 0; ix < n; ix += 2 )
+		Table_Del( tab, &rows[ix] );
+	for( int ix = 1; ix < n; ix += 2 )
+		want[rows[ix].a]++;
+
+	CHECK( Table_Count( tab ) == (size_t)n / 2, "Count incorrect", result );
+	CHECK( Table_Distinct( tab, "a" ) == want.size(), "Distinct incorrect", result );
+	CHECK( Table_Distinct( tab, "zz" ) == 0, "Missing index has keys", result );
+
+	bool same = true;
+	for( int v = -1; v <= 300; v++ ) {
+		Row probe = { v, 0, 0 };
+		size_t count = want.count( v ) ? want[v] : 0;
+		same &= Table_Query_Count( tab, "a", &probe ) == count;
+		same &= Table_Exists( tab, "a", &probe ) == (count > 0);
+	}
+	CHECK( same, "Query_Count or Exists disagrees with reference", result );
+
+	Table_GroupCount( tab, "a", &tally, &got );
+	CHECK( got == want, "GroupCount disagrees with reference", result );
+	DISPL( "groups", got.size() );
+
+	Table_Free( &tab );
+	return result;
+}
+
+// Background build test: builds race changes from this thread, on either policy and backend
+bool test_build() {
+	bool result = true;
+	const int n = 100000;
+
+	for( int backend = HASHTREE_BACKEND_TRIE; backend <= HASHTREE_BACKEND_HASHMAP; backend++ ) {
+		for( int policy = TABLE_BUILD_FALLBACK; policy <= TABLE_BUILD_BLOCK; policy++ ) {
+			vector<Row> rows( n * 2 );
+			vector<bool> in( n * 2 );
+			vector<void *> batch;
+			Table tab = Table_InitBackend( backend );
+
+			srand( 45 + policy );
+			for( int ix = 0; ix < n * 2; ix++ )
+				rows[ix] = { rand() % 97, rand() % 97, 0 };
+			for( int ix = 0; ix < n; ix++ ) {
+				batch.push_back( &rows[ix] );
+				in[ix] = true;
+			}
+			Table_AddMany( tab, batch.data(), n, 2 );
+			Table_CreateIndex( tab, "b", &hash_b, &hash_clean );
+			Table_CreateIndex( tab, "a", &hash_a, &hash_clean );
+			Table_SetBatchHasher( tab, "a", &hash_a_many );
+
+			/* Rebuild "a" while the table keeps changing; the same hashers keep the batch form */
+			Row probe = { 3, 3, 0 };
+			batch_calls = 0;
+			Table_Build build = Table_CreateIndexAsync( tab, "a", &hash_a, &hash_clean, 4, (Table_Build_Policy)policy );
+			CHECK( build != NULL, "Build not started", result );
+			if( build == NULL ) {
+				Table_Free( &tab );
+				continue;
+			}
+
+			int ops = 0, overlap = 0;
+			size_t done, total;
+			while( !Table_Build_Done( build ) || ops < 20000 ) {
+				int at = rand() % (n * 2);
+				switch( rand() % 4 ) {
+					case 0:
+						Table_Add( tab, &rows[at] );
+						in[at] = true;
+						break;
+					case 1:
+						Table_Del( tab, &rows[at] );
+						in[at] = false;
+						break;
+					case 2:
+						Table_Update( tab, &rows[at] );
+						break;
+					default: {
+						void *some[8];
+						for( int ix = 0; ix < 8; ix++ ) {
+							int other = rand() % (n * 2);
+							some[ix] = &rows[other];
+							in[other] = false;
+						}
+						Table_DelMany( tab, some, 8, 2 );
+					}
+				}
+				if( ops % 500 == 0 ) {
+					Table_Build_Progress( build, &done, &total );
+					CHECK( done <= total && total == (size_t)n, "Progress out of range", result );
+					(void)Table_Query_Count( tab, "b", &probe );
+				}
+
+				/* Queries on the index being built fall back to the old one, or wait it out */
+				if( ops == 3000 )
+					(void)Table_Query_Count( tab, "a", &probe );
+				ops++;
+				overlap += !Table_Build_Done( build );
+			}
+			DISPL( "changes made during the build", overlap );
+			CHECK( Table_Build_Wait( &build ), "Build not published", result );
+			CHECK( build == NULL, "Build handle not released", result );
+
+			/* The new index caught every change made while it was built */
+			CHECK( agrees( tab, rows, in, "ab" ), "Built index disagrees with reference", result );
+			CHECK( batch_calls > 0, "Batch hasher not carried over to the rebuild", result );
+			Table_Free( &tab );
+		}
+	}
+
+	/* A cursor on the index a build replaces reads on until the table next changes */
+	vector<Row> rows( 5000 );
+	Table tab = Table_Init();
+	for( int ix = 0; ix < 5000; ix++ ) {
+		rows[ix] = { ix % 10, 0, 0 };
+		Table_Add( tab, &rows[ix] );
+	}
+	Table_CreateIndex( tab, "a", &hash_a, &hash_clean );
+	Row probe = { 3, 0, 0 };
+	Table_Cursor cursor = Table_Query( tab, "a", &probe );
+	Table_Build build = Table_CreateIndexAsync( tab, "a", &hash_a, &hash_clean, 2, TABLE_BUILD_FALLBACK );
+	while( build != NULL && !Table_Build_Done( build ) )
+		this_thread::yield();
+	CHECK( drain( cursor ).size() == 500, "Cursor lost its index to the build", result );
+	CHECK( build != NULL && Table_Build_Wait( &build ), "Rebuild not published", result );
+	Table_Del( tab, &rows[3] );
+	CHECK( Table_Query_Count( tab, "a", &probe ) == 499, "Rebuilt index not in use", result );
+	Table_Free( &tab );
+
+	/* A select waiting out a blocking build of one term plans none of the others until it
+	 *   is through, as their buckets may be emptied and let go while it waits */
+	const int m = 200000, k = 64;
+	vector<Row> many( m );
+	vector<void *> all;
+	for( int ix = 0; ix < m; ix++ ) {
+		many[ix] = { ix < k ? 1 : 2 + ix % 50, ix < k ? 1 : 2 + ix % 50, 0 };
+		all.push_back( &many[ix] );
+	}
+	tab = Table_Init();
+	Table_AddMany( tab, all.data(), m, 2 );
+	Table_CreateIndex( tab, "a", &hash_a, &hash_clean );
+	Table_CreateIndex( tab, "b", &hash_b, &hash_clean );
+
+	Row one = { 1, 1, 0 };
+	Table_Expr terms[2] = { { TABLE_EXPR_TERM, "b", &one, 0, NULL }, { TABLE_EXPR_TERM, "a", &one, 0, NULL } };
+	Table_Expr *both[2] = { &terms[0], &terms[1] };
+	Table_Expr conj = { TABLE_EXPR_AND, NULL, NULL, 2, both };
+	atomic<bool> stop( false );
+	int churns = 0;
+	build = Table_CreateIndexAsync( tab, "a", &hash_a, &hash_clean, 1, TABLE_BUILD_BLOCK );
+	thread churn( [&]() {
+		while( !stop ) {
+			for( int ix = 0; ix < k; ix++ )
+				Table_Del( tab, &many[ix] );
+			for( int ix = 0; ix < k; ix++ )
+				Table_Add( tab, &many[ix] );
+			churns++;
+		}
+	} );
+	Table_Bucket found = Table_Select( tab, &conj );
+	stop = true;
+	churn.join();
+	DISPL( "churns of the selected rows", churns );
+	CHECK( build != NULL && Table_Build_Wait( &build ), "Blocking build not published", result );
+
+	/* Only the churned rows ever take the ids they give up, so whatever was selected is one of them */
+	vector<void *> picked = drain( Table_Cursor_Init( found ) );
+	bool within = picked.size() <= (size_t)k;
+	for( void *row : picked )
+		within &= row >= (void *)&many[0] && row < (void *)&many[k];
+	CHECK( within, "Select planned on buckets let go during a build", result );
+	Table_Bucket_Free( &found );
+	CHECK( Table_Query_Count( tab, "a", &one ) == (size_t)k, "Blocking build lost churned rows", result );
+
+	/* A table may be freed with a build under way; the handle outlives it */
+	build = Table_CreateIndexAsync( tab, "a", &hash_a, &hash_clean, 2, TABLE_BUILD_BLOCK );
+	Table_Free( &tab );
+	CHECK( build != NULL && Table_Build_Done( build ), "Free did not wait for the build", result );
+	if( build != NULL )
+		Table_Build_Wait( &build );
+	return result;
+}
+
+// Registry growth test: ids handed out in order stay one run per chunk in the live set,
+//   edited in place, rather than a container rebuilt on every add
+bool test_registry_growth() {
+	bool result = true;
+	const int n = 1000000;
+	vector<Row> rows( n );
+	Table tab = Table_Init();
+
+	/* Each add is a step along the last run: about a second for the lot even unoptimized,
+	 *   where rebuilding the chunk's container every time took ten or more */
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	for( int ix = 0; ix < n; ix++ )
+		Table_Add( tab, &rows[ix] );
+	chrono::duration<double> took = chrono::steady_clock::now() - start;
+	DISPL( "seconds for a million adds", took.count() );
+	CHECK( took.count() < 5.0, "Adds slower than a step along a run", result );
+	BitSparse *live = &tab->rows.live;
+	bool runs = live->containers == (n + 65535) / 65536;
+	for( int ix = 0; ix < live->containers; ix++ )
+		runs &= live->container[ix].kind == BITSPARSE_RUN && live->container[ix].size == 1;
+	CHECK( runs, "Sequential ids not kept as one run per chunk", result );
+	CHECK( Table_Count( tab ) == (size_t)n, "Count incorrect", result );
+
+	/* Taking out a stretch and numbering new rows into it keeps the runs */
+	for( int ix = 70000; ix < 80000; ix++ )
+		Table_Del( tab, &rows[ix] );
+	CHECK( live->container[1].kind == BITSPARSE_RUN && live->container[1].size == 2, "Removed stretch not a gap between runs", result );
+	for( int ix = 70000; ix < 80000; ix++ )
+		Table_Add( tab, &rows[ix] );
+	runs = true;
+	for( int ix = 0; ix < live->containers; ix++ )
+		runs &= live->container[ix].kind == BITSPARSE_RUN && live->container[ix].size == 1;
+	CHECK( runs, "Refilled stretch not merged back into its run", result );
+
+	/* Scattered removals give up the runs where they must, and the registry still agrees */
+	srand( 47 );
+	vector<bool> in( n, true );
+	for( int ix = 0; ix < n / 4; ix++ ) {
+		int at = rand() % n;
+		Table_Del( tab, &rows[at] );
+		in[at] = false;
+	}
+	size_t want = 0;
+	for( int ix = 0; ix < n; ix++ )
+		want += in[ix];
+	CHECK( Table_Count( tab ) == want && BitSparse_Cardinality( live ) == want, "Scattered removals miscounted", result );
+	bool same = true;
+	for( int ix = 0; ix < n; ix += 97 )
+		same &= (Table_Rows_Id( &tab->rows, &rows[ix] ) >= 0) == in[ix];
+	CHECK( same, "Registry disagrees with reference", result );
+
+	Table_Free( &tab );
+	return result;
+}
+
+void setup( vector<aTest> &ourtests ) {
+	ourtests.push_back( { &test_init, "Initialization Test" } );
+	ourtests.push_back( { &test_many, "AddMany & DelMany Test" } );
+	ourtests.push_back( { &test_bucket, "Bucket Test" } );
+	ourtests.push_back( { &test_registry, "Row Registry Test" } );
+	ourtests.push_back( { &test_registry_growth, "Row Registry Growth Test" } );
+	ourtests.push_back( { &test_update, "Update Test" } );
+	ourtests.push_back( { &test_select, "Select Test" } );
+	ourtests.push_back( { &test_cursor, "Cursor Test" } );
+	ourtests.push_back( { &test_aggregate, "Aggregate Test" } );
+	ourtests.push_back( { &test_build, "Background Build Test" } );
+}
+
+#define RUNTEST( treg, tix, failed ) \
+	if( DISPLAY_DEBUG ) { \
+		cout << "  :: " << treg[tix].name << " ::  " << endl; \
+		bool status = treg[tix].test(); \
+		cout << endl << "+---------------------+" << endl; \
+		cout << "| Test Status: "; \
+		if( status ) { \
+			cout << "Passed"; \
+		} else { \
+			cout << "Failed"; \
+			failed.push_back(tix); \
+		} \
+		cout << " |" << endl; \
+		cout << "+---------------------+" << endl << endl << endl; \
+	} else { \
+		if( treg[tix].test() ) { \
+			cout << "."; \
+		} else { \
+			cout << "F"; \
+			failed.push_back(tix); \
+		} \
+	}
+
+int main( int argc, char **argv ) {
+	vector<aTest> registry;
+	vector<int> schedual, failures;
+	setup( registry );
+	argproc( argc, argv, registry, schedual );
+	if( schedual.size() == 0 ) {
+		schedual.push_back( 0 );
+	}
+	
+	// Iterate over the schedual
+	for( int ix = 0; ix < schedual.size(); ix++ ) {
+		if( schedual[ix] == 0 ) {
+			// Run all tests
+			for( int iy = 0; iy < registry.size(); iy++ ) {
+				RUNTEST( registry, iy, failures );
+			}
+		} else {
+			RUNTEST( registry, schedual[ix] - 1, failures );
+		}
+	}
+	
+	if( failures.size() > 0 ) {
+		cout << endl << "Failures: ";
+		for( int ifail = 0; ifail < failures.size(); ifail++ ) {
+			cout << failures[ifail] << " ";
+		}
+		cout << endl;
+	}
+	
+	return EXIT_SUCCESS;
+}
+
+
+#undef RUNTEST